@@ -97,7 +97,8 @@ static ADDRESS *mutt_expand_aliases_r (ADDRESS *a, LIST **expn)
 	  char namebuf[STRING];
 
 	  mutt_gecos_name (namebuf, sizeof (namebuf), pw);
-	  mutt_str_replace (&a->personal, namebuf);
+	  mutt_str_release (&a->personal);
+	  a->personal = safe_strdup (namebuf);
 
 #ifdef EXACT_ADDRESS
 	  FREE (&a->val);
@@ -138,6 +139,7 @@ ADDRESS *mutt_expand_aliases (ADDRESS *a)
 
 void mutt_expand_aliases_env (ENVELOPE *env)
 {
+  mutt_env_load_lazy (env);
   env->from = mutt_expand_aliases (env->from);
   env->to = mutt_expand_aliases (env->to);
   env->cc = mutt_expand_aliases (env->cc);
@@ -185,6 +187,7 @@ ADDRESS *mutt_get_address (ENVELOPE *env, char **pfxp)
   ADDRESS *adr;
   char *pfx = NULL;
 
+  mutt_env_load_lazy (env);
   if (mutt_addr_is_user (env->from))
   {
     if (env->to && !mutt_is_mail_list (env->to))
@@ -330,7 +333,8 @@ retry_name:
     mutt_free_alias (&new);
     goto cleanup;
   }
-  mutt_str_replace (&new->addr->personal, mutt_b2s (buf));
+  mutt_str_release (&new->addr->personal);
+  new->addr->personal = safe_strdup (mutt_b2s (buf));
 #ifdef EXACT_ADDRESS
   FREE (&new->addr->val);
 #endif
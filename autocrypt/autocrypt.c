@@ -394,6 +394,7 @@ int mutt_autocrypt_process_gossip_header (HEADER *hdr, ENVELOPE *prot_headers)
     return 0;
 
   env = hdr->env;
+  mutt_env_load_lazy (env);
 
   if (!env->from)
     return 0;
@@ -143,7 +143,10 @@ void mutt_autocrypt_db_normalize_addrlist (ADDRESS *addrlist)
 
   mutt_addrlist_to_local (addrlist);
   for (addr = addrlist; addr; addr = addr->next)
+  {
+    mutt_str_unshare (&addr->mailbox);
     ascii_strlower (addr->mailbox);
+  }
   mutt_addrlist_to_intl (addrlist, NULL);
 }
 
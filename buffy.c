@@ -48,9 +48,14 @@
 #include <utime.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include <stdio.h>
 
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+
 static time_t BuffyTime = 0;	/* last time we started checking for mail */
 static time_t BuffyStatsTime = 0; /* last time we check performed mail_check_stats */
 time_t BuffyDoneTime = 0;	/* last time we knew for sure how much mail there was. */
@@ -59,6 +64,26 @@ static short BuffyNotify = 0;	/* # of unnotified new boxes */
 
 static BUFFY* buffy_get (const char *path);
 
+/* A local mailbox handed to the poller thread ($mail_check_async), and
+ * what the thread found.  The thread only works on the copy. */
+struct buffy_job
+{
+  BUFFY *buffy;			/* NULL once removed from Incoming */
+  BUFFY copy;			/* with a pathbuf of its own */
+  short magic;			/* when queued */
+  int check_stats;
+  char *mh_unseen;		/* $mh_seq_unseen and $mh_seq_flagged */
+  char *mh_flagged;
+  int stat_rc;
+  struct stat sb;
+  int rc;			/* of buffy_maildir_scan() or mh_buffy_scan() */
+  int counted;			/* by buffy_mbox_count() */
+};
+
+#ifdef USE_PTHREADS
+static void buffy_poller_forget (BUFFY *b);
+#endif
+
 /* Find the last message in the file.
  * upon success return 0. If no message found - return -1 */
 
@@ -350,6 +375,9 @@ static void buffy_remove (BUFFY **pbuffy)
 #ifdef USE_INOTIFY
   if (!(*pbuffy)->nopoll)
     mutt_monitor_remove (*pbuffy);
+#endif
+#ifdef USE_PTHREADS
+  buffy_poller_forget (*pbuffy);
 #endif
   buffy_free (pbuffy);
 
@@ -476,21 +504,18 @@ int mutt_parse_unmailboxes (BUFFER *path, BUFFER *s, union pointer_long_t udata,
 /* Checks the specified maildir subdir (cur or new) for new mail or mail counts.
  * check_new:   if true, check for new mail.
  * check_stats: if true, count total, new, and flagged messages.
+ * path, msgpath: scratch buffers.
  * Returns 1 if the dir has new mail.
  */
 static int buffy_maildir_check_dir (BUFFY* mailbox, const char *dir_name, int check_new,
-                                    int check_stats)
+                                    int check_stats, BUFFER *path, BUFFER *msgpath)
 {
-  BUFFER *path = NULL;
-  BUFFER *msgpath = NULL;
   DIR *dirp;
   struct dirent *de;
   char *p;
   int rc = 0;
   struct stat sb;
 
-  path = mutt_buffer_pool_get ();
-  msgpath = mutt_buffer_pool_get ();
   mutt_buffer_printf (path, "%s/%s", mutt_b2s (mailbox->pathbuf), dir_name);
 
   /* when $mail_check_recent is set, if the new/ directory hasn't been modified since
@@ -498,6 +523,7 @@ static int buffy_maildir_check_dir (BUFFY* mailbox, const char *dir_name, int ch
    */
   if (check_new && option(OPTMAILCHECKRECENT))
   {
+    mailbox->check_ops++;
     if (stat(mutt_b2s (path), &sb) == 0 &&
         mutt_stat_timespec_compare (&sb, MUTT_STAT_MTIME, &mailbox->last_visited) < 0)
     {
@@ -507,17 +533,18 @@ static int buffy_maildir_check_dir (BUFFY* mailbox, const char *dir_name, int ch
   }
 
   if (! (check_new || check_stats))
-    goto cleanup;
+    return rc;
 
+  mailbox->check_ops++;
   if ((dirp = opendir (mutt_b2s (path))) == NULL)
   {
     mailbox->magic = 0;
-    rc = 0;
-    goto cleanup;
+    return 0;
   }
 
   while ((de = readdir (dirp)) != NULL)
   {
+    mailbox->check_ops++;
     if (*de->d_name == '.')
       continue;
 
@@ -540,6 +567,7 @@ static int buffy_maildir_check_dir (BUFFY* mailbox, const char *dir_name, int ch
         if (option(OPTMAILCHECKRECENT))
         {
           mutt_buffer_printf (msgpath, "%s/%s", mutt_b2s (path), de->d_name);
+          mailbox->check_ops++;
           /* ensure this message was received since leaving this mailbox */
           if (stat(mutt_b2s (msgpath), &sb) == 0 &&
               (mutt_stat_timespec_compare (&sb, MUTT_STAT_CTIME, &mailbox->last_visited) <= 0))
@@ -556,18 +584,17 @@ static int buffy_maildir_check_dir (BUFFY* mailbox, const char *dir_name, int ch
 
   closedir (dirp);
 
-cleanup:
-  mutt_buffer_pool_release (&path);
-  mutt_buffer_pool_release (&msgpath);
-
   return rc;
 }
 
-/* Checks new mail for a maildir mailbox.
+/* Checks new mail for a maildir mailbox, using the scratch buffers path
+ * and msgpath.  Touches nothing but mailbox, so it may run in the
+ * poller thread on a copy.
  * check_stats: if true, also count total, new, and flagged messages.
  * Returns 1 if the mailbox has new mail.
  */
-static int buffy_maildir_check (BUFFY* mailbox, int check_stats)
+static int buffy_maildir_scan (BUFFY* mailbox, int check_stats, BUFFER *path,
+                               BUFFER *msgpath)
 {
   int rc, check_new = 1;
 
@@ -578,21 +605,173 @@ static int buffy_maildir_check (BUFFY* mailbox, int check_stats)
     mailbox->msg_flagged = 0;
   }
 
-  rc = buffy_maildir_check_dir (mailbox, "new", check_new, check_stats);
+  rc = buffy_maildir_check_dir (mailbox, "new", check_new, check_stats,
+                                path, msgpath);
 
   check_new = !rc && option (OPTMAILDIRCHECKCUR);
   if (check_new || check_stats)
-    if (buffy_maildir_check_dir (mailbox, "cur", check_new, check_stats))
+    if (buffy_maildir_check_dir (mailbox, "cur", check_new, check_stats,
+                                 path, msgpath))
       rc = 1;
 
   return rc;
 }
 
+/* Checks new mail for a maildir mailbox.
+ * check_stats: if true, also count total, new, and flagged messages.
+ * Returns 1 if the mailbox has new mail.
+ */
+static int buffy_maildir_check (BUFFY* mailbox, int check_stats)
+{
+  BUFFER *path, *msgpath;
+  int rc;
+
+  path = mutt_buffer_pool_get ();
+  msgpath = mutt_buffer_pool_get ();
+  rc = buffy_maildir_scan (mailbox, check_stats, path, msgpath);
+  mutt_buffer_pool_release (&path);
+  mutt_buffer_pool_release (&msgpath);
+
+  return rc;
+}
+
+/* Whether the mbox or MMDF mailbox, whose stat() is sb, was changed
+ * since its messages were last counted. */
+static int buffy_mbox_stats_due (BUFFY *mailbox, struct stat *sb)
+{
+  return mutt_stat_timespec_compare (sb, MUTT_STAT_MTIME,
+                                     &mailbox->stats_last_checked) > 0;
+}
+
+#ifdef USE_PTHREADS
+/* Counts the messages of an mbox or MMDF mailbox, whose stat() is sb,
+ * and the unread and flagged ones.  The messages are found the way
+ * mbox_parse_mailbox() and mmdf_parse_mailbox() find them, but only
+ * their Status, X-Status and Content-Length headers are looked at.  As
+ * when the mailbox is opened with MUTT_PEEK, its access time is put
+ * back afterwards.  Touches nothing but mailbox, so it may run in the
+ * poller thread on a copy.
+ * Returns 0 on success, -1 if the mailbox can't be read.
+ */
+static int buffy_mbox_count (BUFFY *mailbox, struct stat *sb)
+{
+  char buf[HUGE_STRING];
+  struct utimbuf utimebuf;
+  FILE *fp;
+  LOFF_T loc, tmploc, length;
+  int mmdf = mailbox->magic == MUTT_MMDF;
+  int read, old, flagged, deleted, has_new = 0, body;
+
+  mailbox->check_ops++;
+  if ((fp = fopen (mutt_b2s (mailbox->pathbuf), "r")) == NULL)
+    return -1;
+  mailbox->check_bytes += sb->st_size;
+
+  mailbox->msg_count   = 0;
+  mailbox->msg_unread  = 0;
+  mailbox->msg_flagged = 0;
+
+  while (fgets (buf, sizeof (buf), fp) != NULL)
+  {
+    if (mmdf)
+    {
+      if (mutt_strcmp (buf, MMDF_SEP) != 0)
+        continue;
+      /* the From_ line is optional */
+      loc = ftello (fp);
+      if (fgets (buf, sizeof (buf), fp) != NULL &&
+          !is_from (buf, NULL, 0, NULL))
+        fseeko (fp, loc, SEEK_SET);
+    }
+    else if (!is_from (buf, NULL, 0, NULL))
+      continue;
+
+    read = old = flagged = deleted = 0;
+    length = -1;
+    body = 1;
+    while (fgets (buf, sizeof (buf), fp) != NULL)
+    {
+      if (mmdf && !mutt_strcmp (buf, MMDF_SEP))
+      {
+        body = 0;
+        break;
+      }
+      mutt_remove_trailing_ws (buf);
+      if (!*buf)
+        break;
+      if (!ascii_strncasecmp (buf, "status:", 7))
+      {
+        read |= strchr (buf + 7, 'R') != NULL;
+        old |= strchr (buf + 7, 'O') != NULL;
+      }
+      else if (!ascii_strncasecmp (buf, "x-status:", 9))
+      {
+        flagged |= strchr (buf + 9, 'F') != NULL;
+        deleted |= strchr (buf + 9, 'D') != NULL;
+      }
+      else if (!ascii_strncasecmp (buf, "content-length:", 15) &&
+               mutt_atolofft (skip_email_wsp (buf + 15), &length, 0) < 0)
+        length = -1;
+    }
+
+    mailbox->msg_count++;
+    if (!read)
+    {
+      mailbox->msg_unread++;
+      if (!old && !deleted)
+        has_new = 1;
+    }
+    if (flagged)
+      mailbox->msg_flagged++;
+
+    if (mmdf)
+    {
+      /* up to the closing separator */
+      if (body)
+        while (fgets (buf, sizeof (buf), fp) != NULL &&
+               mutt_strcmp (buf, MMDF_SEP) != 0)
+          ;
+    }
+    else if (length > 0)
+    {
+      /* skip a body whose length checks out, as mbox_parse_mailbox() does */
+      loc = ftello (fp);
+      tmploc = length < sb->st_size ? loc + length + 1 : -1;
+      if (0 < tmploc && tmploc < sb->st_size)
+      {
+        if (fseeko (fp, tmploc, SEEK_SET) != 0 ||
+            fgets (buf, sizeof (buf), fp) == NULL ||
+            mutt_strncmp ("From ", buf, 5) != 0)
+          tmploc = loc;
+        fseeko (fp, tmploc, SEEK_SET);
+      }
+      else if (tmploc == sb->st_size)
+        fseeko (fp, tmploc, SEEK_SET);
+    }
+  }
+  safe_fclose (&fp);
+
+  mutt_get_stat_timespec (&mailbox->stats_last_checked, sb, MUTT_STAT_MTIME);
+
+  /* see mbox_reset_atime() */
+  utimebuf.actime = sb->st_atime;
+  utimebuf.modtime = sb->st_mtime;
+  if (!option (OPTMAILCHECKRECENT) && utimebuf.actime >= utimebuf.modtime &&
+      has_new)
+    utimebuf.actime = utimebuf.modtime - 1;
+  utime (mutt_b2s (mailbox->pathbuf), &utimebuf);
+
+  return 0;
+}
+#endif /* USE_PTHREADS */
+
 /* Checks new mail for an mbox mailbox
  * check_stats: if true, also count total, new, and flagged messages.
+ * With job, the messages were counted by the poller thread.
  * Returns 1 if the mailbox has new mail.
  */
-static int buffy_mbox_check (BUFFY* mailbox, struct stat *sb, int check_stats)
+static int buffy_mbox_check (BUFFY* mailbox, struct stat *sb, int check_stats,
+                             struct buffy_job *job)
 {
   int rc = 0;
   int new_or_changed;
@@ -625,9 +804,20 @@ static int buffy_mbox_check (BUFFY* mailbox, struct stat *sb, int check_stats)
       (sb->st_ctime != sb->st_mtime || sb->st_ctime != sb->st_atime))
     mailbox->newly_created = 0;
 
-  if (check_stats &&
-      (mutt_stat_timespec_compare (sb, MUTT_STAT_MTIME, &mailbox->stats_last_checked) > 0))
+  if (job)
+  {
+    if (job->counted)
+    {
+      mailbox->msg_count          = job->copy.msg_count;
+      mailbox->msg_unread         = job->copy.msg_unread;
+      mailbox->msg_flagged        = job->copy.msg_flagged;
+      mailbox->stats_last_checked = job->copy.stats_last_checked;
+    }
+  }
+  else if (check_stats && buffy_mbox_stats_due (mailbox, sb))
   {
+    mailbox->check_ops++;
+    mailbox->check_bytes += sb->st_size;
     if (mx_open_mailbox (mutt_b2s (mailbox->pathbuf),
                          MUTT_READONLY | MUTT_QUIET | MUTT_NOSORT | MUTT_PEEK,
                          &ctx) != NULL)
@@ -643,6 +833,417 @@ static int buffy_mbox_check (BUFFY* mailbox, struct stat *sb, int check_stats)
   return rc;
 }
 
+/* Takes over what the poller thread found in a maildir or MH mailbox. */
+static int buffy_poller_take (BUFFY *mailbox, struct buffy_job *job)
+{
+  mailbox->new = job->copy.new;
+  mailbox->magic = job->copy.magic;
+  if (job->check_stats)
+  {
+    mailbox->msg_count   = job->copy.msg_count;
+    mailbox->msg_unread  = job->copy.msg_unread;
+    mailbox->msg_flagged = job->copy.msg_flagged;
+  }
+  return job->rc;
+}
+
+/* Polls one of Incoming for new mail, and for total/new/flagged messages
+ * if check_stats is set.  The open mailbox, identified by contex_sb, is
+ * left alone.  With job, the stat() and maildir scan done by the poller
+ * thread are used instead of doing them here.
+ * Returns 1 if the mailbox has new mail, -1 if it doesn't exist.
+ */
+static int buffy_poll (BUFFY *tmp, struct stat *contex_sb, int check_stats,
+                       struct buffy_job *job)
+{
+  struct stat sb;
+  int rc = 0;
+
+  sb.st_size=0;
+  if (job)
+    sb = job->sb;
+
+  if (tmp->magic != MUTT_IMAP)
+  {
+    tmp->new = 0;
+#ifdef USE_POP
+    if (mx_is_pop (mutt_b2s (tmp->pathbuf)))
+      tmp->magic = MUTT_POP;
+    else
+#endif
+    {
+      tmp->check_ops++;
+      if ((job ? job->stat_rc : stat (mutt_b2s (tmp->pathbuf), &sb)) != 0 ||
+          (S_ISREG(sb.st_mode) && sb.st_size == 0) ||
+          (!tmp->magic &&
+           (tmp->magic = mx_get_magic (mutt_b2s (tmp->pathbuf))) <= 0))
+      {
+        /* if the mailbox still doesn't exist, set the newly created flag to
+         * be ready for when it does. */
+        tmp->newly_created = 1;
+        tmp->magic = 0;
+        tmp->size = 0;
+        return -1;
+      }
+    }
+  }
+
+  /* check to see if the folder is the currently selected folder
+   * before polling */
+  if (!Context || !Context->path ||
+      (( tmp->magic == MUTT_IMAP || tmp->magic == MUTT_POP )
+          ? mutt_strcmp (mutt_b2s (tmp->pathbuf), Context->path) :
+            (sb.st_dev != contex_sb->st_dev || sb.st_ino != contex_sb->st_ino)))
+  {
+    switch (tmp->magic)
+    {
+      case MUTT_MBOX:
+      case MUTT_MMDF:
+        if (buffy_mbox_check (tmp, &sb, check_stats, job) > 0)
+          rc = 1;
+        break;
+
+      case MUTT_MAILDIR:
+        if ((job ? buffy_poller_take (tmp, job) :
+             buffy_maildir_check (tmp, check_stats)) > 0)
+          rc = 1;
+        break;
+
+      case MUTT_MH:
+        if ((job ? buffy_poller_take (tmp, job) :
+             mh_buffy (tmp, check_stats)) > 0)
+          rc = 1;
+        break;
+    }
+  }
+  else if (option(OPTCHECKMBOXSIZE) && Context && Context->path)
+    tmp->size = (off_t) sb.st_size;	/* update the size of current folder */
+
+  return rc;
+}
+
+/* Decides when to poll tmp again after a poll at time t, which found a
+ * change or not.  See $mail_check_backoff. */
+static void buffy_schedule (BUFFY *tmp, int changed, time_t t)
+{
+  if (changed)
+    tmp->idle = 0;
+  else if (tmp->idle < BuffyBackoff - 1)
+    tmp->idle++;
+
+  tmp->next_check = t + (time_t) BuffyTimeout * (tmp->idle + 1);
+}
+
+/* Identifies the open mailbox for buffy_poll(). */
+static void buffy_context_stat (struct stat *contex_sb)
+{
+  /* check device ID and serial number instead of comparing paths */
+  if (!Context || Context->magic == MUTT_IMAP || Context->magic == MUTT_POP
+      || stat (Context->path, contex_sb) != 0)
+  {
+    contex_sb->st_dev=0;
+    contex_sb->st_ino=0;
+  }
+}
+
+/* Whether the last poll of tmp, started at time t, changed what is shown
+ * of it, given its state before.  Also settles its notification. */
+static int buffy_polled (BUFFY *tmp, BUFFY *orig, int scheduled, time_t t)
+{
+  int changed;
+
+  changed = (orig->new != tmp->new) ||
+    (orig->msg_count != tmp->msg_count) ||
+    (orig->msg_unread != tmp->msg_unread) ||
+    (orig->msg_flagged != tmp->msg_flagged);
+  if (scheduled && tmp->magic != MUTT_IMAP)
+    buffy_schedule (tmp, changed, t);
+#ifdef USE_SIDEBAR
+  if (changed)
+    mutt_set_current_menu_redraw (REDRAW_SIDEBAR);
+#endif
+
+  if (!tmp->new)
+    tmp->notified = 0;
+  else
+  {
+    /* pretend we've already notified for the mailbox */
+    if (tmp->nonotify)
+      tmp->notified = 1;
+    else if (!tmp->notified)
+      BuffyNotify++;
+  }
+
+  return changed;
+}
+
+#ifdef USE_PTHREADS
+/* The poller thread of $mail_check_async.  The jobs belong to the main
+ * thread, except while the state is POLLER_BUSY. */
+#define POLLER_IDLE 0
+#define POLLER_BUSY 1
+#define POLLER_DONE 2
+
+static pthread_mutex_t PollerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PollerCond = PTHREAD_COND_INITIALIZER;
+static int PollerState = POLLER_IDLE;
+static int PollerStarted = 0;
+static int PollerPipe[2] = { -1, -1 };	/* written to when done */
+static struct buffy_job *PollerJobs = NULL;
+static size_t PollerCount = 0;
+static size_t PollerMax = 0;
+static time_t PollerTime = 0;		/* when the jobs were queued */
+
+static int buffy_poller_state (void)
+{
+  int state;
+
+  pthread_mutex_lock (&PollerLock);
+  state = PollerState;
+  pthread_mutex_unlock (&PollerLock);
+
+  return state;
+}
+
+/* Runs outside the main thread: no buffer pool, no dprint of its own,
+ * nothing but the job. */
+static void buffy_poller_run (struct buffy_job *job, BUFFER *path,
+                              BUFFER *msgpath)
+{
+  struct timeval before, after;
+
+  gettimeofday (&before, NULL);
+  job->stat_rc = stat (mutt_b2s (job->copy.pathbuf), &job->sb);
+  if (job->stat_rc == 0)
+    switch (job->magic)
+    {
+      case MUTT_MAILDIR:
+        job->rc = buffy_maildir_scan (&job->copy, job->check_stats, path,
+                                      msgpath);
+        break;
+      case MUTT_MH:
+        job->rc = mh_buffy_scan (&job->copy, job->check_stats, path,
+                                 job->mh_unseen, job->mh_flagged);
+        break;
+      case MUTT_MBOX:
+      case MUTT_MMDF:
+        if (job->check_stats && job->sb.st_size > 0 &&
+            buffy_mbox_stats_due (&job->copy, &job->sb))
+          job->counted = buffy_mbox_count (&job->copy, &job->sb) == 0;
+        break;
+    }
+  gettimeofday (&after, NULL);
+  job->copy.check_usecs = (after.tv_sec - before.tv_sec) * 1000000UL +
+    after.tv_usec - before.tv_usec;
+}
+
+static void *buffy_poller_main (void *arg)
+{
+  BUFFER *path, *msgpath;
+  size_t i, count;
+
+  path = mutt_buffer_new ();
+  msgpath = mutt_buffer_new ();
+
+  pthread_mutex_lock (&PollerLock);
+  FOREVER
+  {
+    while (PollerState != POLLER_BUSY)
+      pthread_cond_wait (&PollerCond, &PollerLock);
+    count = PollerCount;
+    pthread_mutex_unlock (&PollerLock);
+
+    for (i = 0; i < count; i++)
+      buffy_poller_run (&PollerJobs[i], path, msgpath);
+
+    pthread_mutex_lock (&PollerLock);
+    PollerState = POLLER_DONE;
+    if (PollerPipe[1] != -1 && write (PollerPipe[1], "", 1) == -1)
+    {
+      /* the pipe is full, so the main thread will look anyway */
+    }
+  }
+
+  /* not reached */
+  return NULL;
+}
+
+static int buffy_poller_start (void)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  int rc;
+
+  if (PollerStarted)
+    return 0;
+
+  if (pipe (PollerPipe) == 0)
+  {
+    fcntl (PollerPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl (PollerPipe[1], F_SETFL, O_NONBLOCK);
+    fcntl (PollerPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl (PollerPipe[1], F_SETFD, FD_CLOEXEC);
+  }
+  else
+    PollerPipe[0] = PollerPipe[1] = -1;
+
+  pthread_attr_init (&attr);
+  pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create (&thread, &attr, buffy_poller_main, NULL);
+  pthread_attr_destroy (&attr);
+  if (rc != 0)
+  {
+    dprint (1, (debugfile, "buffy_poller_start: pthread_create: %s\n",
+                strerror (rc)));
+    if (PollerPipe[0] != -1)
+    {
+      close (PollerPipe[0]);
+      close (PollerPipe[1]);
+      PollerPipe[0] = PollerPipe[1] = -1;
+    }
+    return -1;
+  }
+
+#ifdef USE_INOTIFY
+  if (PollerPipe[0] != -1)
+    mutt_monitor_add_fd (PollerPipe[0]);
+#endif
+  PollerStarted = 1;
+  return 0;
+}
+
+/* Whether the poller thread can check tmp.  The open mailbox, and
+ * unknown or remote mailboxes are left to buffy_poll(). */
+static int buffy_poller_wants (BUFFY *tmp)
+{
+  if (tmp->magic != MUTT_MBOX && tmp->magic != MUTT_MMDF &&
+      tmp->magic != MUTT_MAILDIR && tmp->magic != MUTT_MH)
+    return 0;
+  if (Context && !mutt_strcmp (tmp->realpath, Context->realpath))
+    return 0;
+  return 1;
+}
+
+static void buffy_poller_add (BUFFY *tmp, int check_stats)
+{
+  struct buffy_job *job;
+
+  if (PollerCount == PollerMax)
+  {
+    PollerMax += 64;
+    safe_realloc (&PollerJobs, PollerMax * sizeof (struct buffy_job));
+  }
+  job = &PollerJobs[PollerCount++];
+  memset (job, 0, sizeof (struct buffy_job));
+  job->buffy = tmp;
+  job->copy = *tmp;
+  job->copy.pathbuf = mutt_buffer_new ();
+  mutt_buffer_strcpy (job->copy.pathbuf, mutt_b2s (tmp->pathbuf));
+  job->copy.new = 0;	/* as buffy_poll() does before a check */
+  job->copy.check_ops = 0;
+  job->copy.check_bytes = 0;
+  job->magic = tmp->magic;
+  job->check_stats = check_stats;
+  if (job->magic == MUTT_MH)
+  {
+    /* the thread mustn't look at options that may change meanwhile */
+    job->mh_unseen = safe_strdup (MhUnseen);
+    job->mh_flagged = safe_strdup (MhFlagged);
+  }
+}
+
+/* Hands the queued jobs to the poller thread, or runs them here if it
+ * can't be started. */
+static void buffy_poller_submit (time_t t)
+{
+  size_t i;
+
+  if (!PollerCount)
+    return;
+
+  PollerTime = t;
+  if (buffy_poller_start () == 0)
+  {
+    pthread_mutex_lock (&PollerLock);
+    PollerState = POLLER_BUSY;
+    pthread_cond_signal (&PollerCond);
+    pthread_mutex_unlock (&PollerLock);
+  }
+  else
+  {
+    BUFFER *path = mutt_buffer_pool_get ();
+    BUFFER *msgpath = mutt_buffer_pool_get ();
+
+    for (i = 0; i < PollerCount; i++)
+      buffy_poller_run (&PollerJobs[i], path, msgpath);
+    PollerState = POLLER_DONE;
+    mutt_buffer_pool_release (&path);
+    mutt_buffer_pool_release (&msgpath);
+  }
+}
+
+/* Applies the results of the poller thread, once it is done, and
+ * counts the mailboxes with new mail again. */
+static void buffy_poller_collect (void)
+{
+  struct buffy_job *job;
+  struct stat contex_sb;
+  BUFFY *tmp, orig;
+  char c;
+  size_t i;
+
+  if (PollerPipe[0] != -1)
+    while (read (PollerPipe[0], &c, 1) > 0)
+      ;
+  if (buffy_poller_state () != POLLER_DONE)
+    return;
+
+  buffy_context_stat (&contex_sb);
+  for (i = 0; i < PollerCount; i++)
+  {
+    job = &PollerJobs[i];
+    tmp = job->buffy;
+    if (tmp && !tmp->nopoll && tmp->magic == job->magic)
+    {
+      orig = *tmp;
+      tmp->check_ops = job->copy.check_ops;
+      tmp->check_bytes = job->copy.check_bytes;
+      if (buffy_poll (tmp, &contex_sb, job->check_stats, job) >= 0)
+        buffy_polled (tmp, &orig, 1, PollerTime);
+      tmp->check_usecs = job->copy.check_usecs;
+      dprint (3, (debugfile, "buffy_poller_collect: %s: %lu usecs, %u calls, %ld bytes\n",
+                  mutt_b2s (tmp->pathbuf), tmp->check_usecs, tmp->check_ops,
+                  (long) tmp->check_bytes));
+    }
+    mutt_buffer_free (&job->copy.pathbuf);
+    FREE (&job->mh_unseen);
+    FREE (&job->mh_flagged);
+  }
+  PollerCount = 0;
+  PollerState = POLLER_IDLE;
+
+  BuffyCount = 0;
+  BuffyNotify = 0;
+  for (tmp = Incoming; tmp; tmp = tmp->next)
+    if (!tmp->nopoll && tmp->new)
+    {
+      BuffyCount++;
+      if (!tmp->notified)
+        BuffyNotify++;
+    }
+}
+
+/* Called when b is removed from Incoming. */
+static void buffy_poller_forget (BUFFY *b)
+{
+  size_t i;
+
+  for (i = 0; i < PollerCount; i++)
+    if (PollerJobs[i].buffy == b)
+      PollerJobs[i].buffy = NULL;
+}
+#endif /* USE_PTHREADS */
+
 /* Check all Incoming for new mail and total/new/flagged messages
  * The force argument may be any combination of the following values:
  *   MUTT_BUFFY_CHECK_FORCE        ignore BuffyTimeout and check for new mail
@@ -650,20 +1251,18 @@ static int buffy_mbox_check (BUFFY* mailbox, struct stat *sb, int check_stats)
  */
 int mutt_buffy_check (int force)
 {
-  BUFFY *tmp;
-  struct stat sb;
+  BUFFY *tmp, orig;
   struct stat contex_sb;
+  struct timeval before, after;
   time_t t;
   int check_stats = 0;
-#ifdef USE_SIDEBAR
-  short orig_new;
-  int orig_count, orig_unread, orig_flagged;
+  int rc, skip;
+  int polled = 0, skipped = 0;
+  unsigned long usecs = 0;
+#ifdef USE_PTHREADS
+  int async, idle;
 #endif
 
-  sb.st_size=0;
-  contex_sb.st_dev=0;
-  contex_sb.st_ino=0;
-
 #ifdef USE_IMAP
   /* update postponed count as well, on force */
   if (force & MUTT_BUFFY_CHECK_FORCE)
@@ -673,6 +1272,14 @@ int mutt_buffy_check (int force)
   /* fastest return if there are no mailboxes */
   if (!Incoming)
     return 0;
+
+#ifdef USE_PTHREADS
+  if (PollerCount)
+    buffy_poller_collect ();
+  async = option (OPTMAILCHECKASYNC);
+  idle = !PollerCount;
+#endif
+
   t = time (NULL);
   if (!force && (t - BuffyTime < BuffyTimeout))
     return BuffyCount;
@@ -693,97 +1300,67 @@ int mutt_buffy_check (int force)
   BuffyCount += imap_buffy_check (force, check_stats);
 #endif
 
-  /* check device ID and serial number instead of comparing paths */
-  if (!Context || Context->magic == MUTT_IMAP || Context->magic == MUTT_POP
-      || stat (Context->path, &contex_sb) != 0)
-  {
-    contex_sb.st_dev=0;
-    contex_sb.st_ino=0;
-  }
+  buffy_context_stat (&contex_sb);
 
   for (tmp = Incoming; tmp; tmp = tmp->next)
   {
     if (tmp->nopoll)
       continue;
 
-#ifdef USE_SIDEBAR
-    orig_new = tmp->new;
-    orig_count = tmp->msg_count;
-    orig_unread = tmp->msg_unread;
-    orig_flagged = tmp->msg_flagged;
-#endif
+    orig = *tmp;
 
-    if (tmp->magic != MUTT_IMAP)
+    skip = !force && BuffyBackoff > 1 && tmp->magic != MUTT_IMAP &&
+      t < tmp->next_check;
+#ifdef USE_PTHREADS
+    /* the poller thread takes the mailboxes it can, unless it is still
+     * busy with the last ones */
+    if (!skip && async && buffy_poller_wants (tmp))
     {
-      tmp->new = 0;
-#ifdef USE_POP
-      if (mx_is_pop (mutt_b2s (tmp->pathbuf)))
-	tmp->magic = MUTT_POP;
-      else
-#endif
-        if (stat (mutt_b2s (tmp->pathbuf), &sb) != 0 ||
-            (S_ISREG(sb.st_mode) && sb.st_size == 0) ||
-            (!tmp->magic &&
-             (tmp->magic = mx_get_magic (mutt_b2s (tmp->pathbuf))) <= 0))
-        {
-          /* if the mailbox still doesn't exist, set the newly created flag to
-           * be ready for when it does. */
-          tmp->newly_created = 1;
-          tmp->magic = 0;
-          tmp->size = 0;
-          continue;
-        }
+      if (idle)
+        buffy_poller_add (tmp, check_stats);
+      skip = idle ? 2 : 1;
     }
-
-    /* check to see if the folder is the currently selected folder
-     * before polling */
-    if (!Context || !Context->path ||
-	(( tmp->magic == MUTT_IMAP || tmp->magic == MUTT_POP )
-            ? mutt_strcmp (mutt_b2s (tmp->pathbuf), Context->path) :
-	      (sb.st_dev != contex_sb.st_dev || sb.st_ino != contex_sb.st_ino)))
+#endif
+    if (skip)
     {
-      switch (tmp->magic)
-      {
-        case MUTT_MBOX:
-        case MUTT_MMDF:
-          if (buffy_mbox_check (tmp, &sb, check_stats) > 0)
-            BuffyCount++;
-          break;
-
-        case MUTT_MAILDIR:
-          if (buffy_maildir_check (tmp, check_stats) > 0)
-            BuffyCount++;
-          break;
-
-        case MUTT_MH:
-          if (mh_buffy (tmp, check_stats) > 0)
-            BuffyCount++;
-          break;
-      }
+      /* keep what the last poll found */
+      if (skip == 1)
+        skipped++;
+      if (tmp->new)
+        BuffyCount++;
     }
-    else if (option(OPTCHECKMBOXSIZE) && Context && Context->path)
-      tmp->size = (off_t) sb.st_size;	/* update the size of current folder */
-
-#ifdef USE_SIDEBAR
-    if ((orig_new != tmp->new) ||
-        (orig_count != tmp->msg_count) ||
-        (orig_unread != tmp->msg_unread) ||
-        (orig_flagged != tmp->msg_flagged))
-      mutt_set_current_menu_redraw (REDRAW_SIDEBAR);
-#endif
-
-    if (!tmp->new)
-      tmp->notified = 0;
     else
     {
-      /* pretend we've already notified for the mailbox */
-      if (tmp->nonotify)
-        tmp->notified = 1;
-      else if (!tmp->notified)
-        BuffyNotify++;
+      tmp->check_ops = 0;
+      tmp->check_bytes = 0;
+      gettimeofday (&before, NULL);
+      rc = buffy_poll (tmp, &contex_sb, check_stats, NULL);
+      gettimeofday (&after, NULL);
+      tmp->check_usecs = (after.tv_sec - before.tv_sec) * 1000000UL +
+        after.tv_usec - before.tv_usec;
+      usecs += tmp->check_usecs;
+      polled++;
+      dprint (3, (debugfile, "mutt_buffy_check: %s: %lu usecs, %u calls, %ld bytes\n",
+                  mutt_b2s (tmp->pathbuf), tmp->check_usecs, tmp->check_ops,
+                  (long) tmp->check_bytes));
+
+      if (rc < 0)
+        continue;
+      if (rc > 0)
+        BuffyCount++;
     }
+
+    buffy_polled (tmp, &orig, !skip, t);
   }
 
+  dprint (2, (debugfile, "mutt_buffy_check: polled %d mailboxes in %lu usecs, skipped %d\n",
+              polled, usecs, skipped));
+
+#ifdef USE_PTHREADS
+  if (idle)
+    buffy_poller_submit (t);
+#endif
+
   BuffyDoneTime = BuffyTime;
   return (BuffyCount);
 }
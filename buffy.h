@@ -42,11 +42,19 @@ typedef struct buffy_t
   short newly_created;		/* mbox or mmdf just popped into existence */
   struct timespec last_visited;		/* time of last exit from this mailbox */
   struct timespec stats_last_checked;	/* mtime of mailbox the last time stats where checked. */
+
+  /* cost of the last check, see $mail_check_backoff */
+  unsigned long check_usecs;	/* wall time */
+  unsigned int check_ops;	/* stat, open and readdir calls */
+  off_t check_bytes;		/* bytes read */
+  short idle;			/* checks in a row that found no change */
+  time_t next_check;		/* not polled again before this */
 }
 BUFFY;
 
 WHERE BUFFY *Incoming;
 WHERE short BuffyTimeout INITVAL (3);
+WHERE short BuffyBackoff INITVAL (1);
 WHERE short BuffyCheckStatsInterval INITVAL (60);
 
 extern time_t BuffyDoneTime;	/* last time we knew for sure how much mail there was */
@@ -72,6 +80,7 @@ void mutt_buffy_cleanup (const char *buf, struct stat *st);
 void mutt_buffy_setnotified (const char *path);
 
 int mh_buffy (BUFFY *, int);
+int mh_buffy_scan (BUFFY *, int, BUFFER *, const char *, const char *);
 
 /* force flags passed to mutt_buffy_check() */
 #define MUTT_BUFFY_CHECK_FORCE       1
@@ -127,6 +127,7 @@ static void process_protected_headers (HEADER *cur)
 
     mutt_str_replace (&cur->env->subject, prot_headers->subject);
     FREE (&cur->env->disp_subj);
+    cur->search_known = 0;
     if (regexec (ReplyRegexp.rx, cur->env->subject, 1, pmatch, 0) == 0)
       cur->env->real_subj = cur->env->subject + pmatch[0].rm_eo;
     else
@@ -284,6 +285,7 @@ int mutt_display_message (HEADER *cur)
     /* update crypto information for this message */
     cur->security &= ~(GOODSIGN|BADSIGN);
     cur->security |= crypt_query (cur->content);
+    cur->search_known = 0;
 
     /* Remove color cache for this message, in case there
        are color patterns for both ~g and ~V */
@@ -1185,6 +1187,10 @@ int mutt_edit_content_type (HEADER *h, BODY *b, FILE *fp)
     h->security |= crypt_query (b);
   }
 
+  /* ~M and the crypto patterns may match differently now */
+  if (h)
+    h->search_known = 0;
+
   return structure_changed;
 }
 
@@ -1202,6 +1208,7 @@ static int _mutt_check_traditional_pgp (HEADER *h, int *redraw)
   if (crypt_pgp_check_traditional (msg->fp, h->content, 0))
   {
     h->security = crypt_query (h->content);
+    h->search_known = 0;
     *redraw |= REDRAW_FULL;
     rv = 1;
   }
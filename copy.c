@@ -401,6 +401,8 @@ mutt_copy_header (FILE *in, HEADER *h, FILE *out, int flags, const char *prefix)
     fputc ('\n', out);
   }
 
+  if (flags & CH_UPDATE_REFS)
+    mutt_env_load_lazy (h->env);
   if ((flags & CH_UPDATE_REFS) && h->env->references)
   {
     fputs ("References:", out);
@@ -1039,7 +1041,10 @@ static int address_header_decode (char **h)
   rfc2047_decode_adrlist (a);
   for (cur = a; cur; cur = cur->next)
     if (cur->personal)
+    {
+      mutt_str_unshare (&cur->personal);
       rfc822_dequote_comment (cur->personal);
+    }
 
   /* angle brackets for return path are mandated by RfC5322,
    * so leave Return-Path as-is */
@@ -5472,6 +5472,7 @@ static int verify_sender (HEADER *h, gpgme_protocol_t protocol)
   ADDRESS *sender = NULL;
   unsigned int ret = 1;
 
+  mutt_env_load_lazy (h->env);
   if (h->env->from)
     {
       h->env->from = mutt_expand_aliases (h->env->from);
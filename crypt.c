@@ -842,6 +842,7 @@ void crypt_extract_keys_from_messages (HEADER * h)
 			       Context->hdrs[Context->v2r[i]], 0, 0);
 	  fflush(fpout);
 
+          mutt_env_load_lazy (Context->hdrs[Context->v2r[i]]->env);
           if (Context->hdrs[Context->v2r[i]]->env->from)
 	    tmp = mutt_expand_aliases (Context->hdrs[Context->v2r[i]]->env->from);
 	  else if (Context->hdrs[Context->v2r[i]]->env->sender)
@@ -884,6 +885,7 @@ void crypt_extract_keys_from_messages (HEADER * h)
 	  mutt_copy_message (fpout, Context, h, 0, 0);
 
 	fflush(fpout);
+	mutt_env_load_lazy (h->env);
 	if (h->env->from) tmp = mutt_expand_aliases (h->env->from);
 	else if (h->env->sender)  tmp = mutt_expand_aliases (h->env->sender);
 	mbox = tmp ? tmp->mailbox : NULL;
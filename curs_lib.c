@@ -1212,6 +1212,27 @@ void mutt_flushinp (void)
   flushinp ();
 }
 
+/* Returns 1 if a keystroke (or queued event) is waiting to be read by
+ * mutt_getch(), without consuming it.  Used by background work that
+ * should give way as soon as the user starts typing.
+ */
+int mutt_input_pending (void)
+{
+  int ch;
+
+  if (UngetCount || MacroBufferCount || SigInt || SigWinch)
+    return 1;
+
+  timeout (0);
+  ch = getch ();
+  timeout (MuttGetchTimeout);
+  if (ch == ERR)
+    return 0;
+
+  ungetch (ch);
+  return 1;
+}
+
 #if (defined(USE_SLANG_CURSES) || defined(HAVE_CURS_SET))
 /* The argument can take 3 values:
  * -1: restore the value of the last call
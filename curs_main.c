@@ -1047,6 +1047,15 @@ int mutt_index_menu (void)
 	}
         break;
 
+      case OP_MAIN_SHOW_SEARCH_CACHE:
+	{
+	  char buf[STRING];
+
+	  mutt_search_cache_stats (buf, sizeof (buf));
+	  mutt_message ("%s", buf);
+	}
+	break;
+
       case OP_MAIN_LIMIT:
 
 	CHECK_IN_MAILBOX;
@@ -1213,6 +1222,27 @@ int mutt_index_menu (void)
 	  menu->redraw |= REDRAW_INDEX | REDRAW_STATUS;
 	break;
 
+#ifdef USE_HCACHE
+      case OP_MAIN_COMPACT_HCACHE:
+	CHECK_IN_MAILBOX;
+	{
+	  int removed = 0;
+	  LOFF_T reclaimed = 0;
+	  char size[SHORT_STRING];
+
+	  mutt_message _("Compacting header cache...");
+	  if (mx_gc_header_cache (Context, 0, &removed, &reclaimed) < 0)
+	  {
+	    mutt_error _("Unable to compact the header cache of this mailbox.");
+	    break;
+	  }
+	  mutt_pretty_size (size, sizeof (size), reclaimed);
+	  mutt_message (_("Removed %d stale header cache entries, reclaimed %s."),
+			removed, size);
+	}
+	break;
+#endif
+
 	/* --------------------------------------------------------------------
 	 * The following operations can be performed inside of the pager.
 	 */
@@ -1547,6 +1577,7 @@ int mutt_index_menu (void)
         CHECK_VISIBLE;
 	CHECK_READONLY;
 
+        mutt_env_load_lazy (CURHDR->env);
         if ((Sort & SORT_MASK) != SORT_THREADS)
 	  mutt_error _("Threading is not enabled.");
 	else if (CURHDR->env->in_reply_to || CURHDR->env->references)
@@ -79,4 +79,13 @@
 # ifndef USE_ZLIB
 #  define USE_ZLIB
 # endif
+# ifndef USE_PTHREADS
+#  define USE_PTHREADS
+# endif
+# ifndef HAVE_MMAP
+#  define HAVE_MMAP
+# endif
+# ifndef HAVE_FMEMOPEN
+#  define HAVE_FMEMOPEN
+# endif
 #endif
@@ -275,6 +275,7 @@ void _mutt_set_flag (CONTEXT *ctx, HEADER *h, int flag, int bf, int upd_flags)
   {
     h->color.pair = 0;
     h->color.attrs = 0;
+    h->search_known = 0;
 #ifdef USE_SIDEBAR
     mutt_set_current_menu_redraw (REDRAW_SIDEBAR);
 #endif
@@ -147,6 +147,9 @@ const struct menu_func_op_t OpMain[] = { /* map: index */
   { "clear-flag",                OP_MAIN_CLEAR_FLAG },
   { "collapse-all",              OP_MAIN_COLLAPSE_ALL },
   { "collapse-thread",           OP_MAIN_COLLAPSE_THREAD },
+#ifdef USE_HCACHE
+  { "compact-header-cache",      OP_MAIN_COMPACT_HCACHE },
+#endif
   { "compose-to-sender",         OP_COMPOSE_TO_SENDER },
   { "copy-message",              OP_COPY_MESSAGE },
   { "create-alias",              OP_CREATE_ALIAS },
@@ -212,6 +215,7 @@ const struct menu_func_op_t OpMain[] = { /* map: index */
   { "save-message",              OP_SAVE },
   { "set-flag",                  OP_MAIN_SET_FLAG },
   { "show-limit",                OP_MAIN_SHOW_LIMIT },
+  { "show-search-cache",         OP_MAIN_SHOW_SEARCH_CACHE },
   { "show-version",              OP_VERSION },
 #ifdef USE_SIDEBAR
   { "sidebar-first",             OP_SIDEBAR_FIRST },
@@ -87,6 +87,15 @@ WHERE char *MessageCachedir;
 #endif
 #if USE_HCACHE
 WHERE char *HeaderCache;
+WHERE short HeaderCacheBatch;
+WHERE short HeaderCacheCompact;
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+WHERE char *HeaderCacheCompressMethod;
+WHERE short HeaderCacheCompressLevel;
+#endif
+#ifdef HAVE_ZSTD
+WHERE char *HeaderCacheCompressDictionary;
+#endif
 #if HAVE_GDBM || HAVE_DB4
 WHERE long  HeaderCachePageSize;
 #endif /* HAVE_GDBM || HAVE_DB4 */
@@ -250,6 +259,12 @@ WHERE short ScoreThresholdDelete;
 WHERE short ScoreThresholdRead;
 WHERE short ScoreThresholdFlag;
 
+#ifdef USE_PTHREADS
+WHERE short MaildirReadThreads;
+WHERE short SearchThreads;
+WHERE short SortWorkers;
+#endif
+
 #ifdef USE_SIDEBAR
 WHERE short SidebarWidth;
 WHERE LIST *SidebarWhitelist;
@@ -257,9 +272,12 @@ WHERE LIST *SidebarWhitelist;
 
 #ifdef USE_IMAP
 WHERE long  ImapFetchChunkSize;
+WHERE short ImapFetchConnections;
 WHERE short ImapKeepalive;
 WHERE short ImapPipelineDepth;
 WHERE short ImapPollTimeout;
+WHERE long  ImapPrefetchChunkSize;
+WHERE short ImapPrefetchDelay;
 #endif
 
 /* flags for received signals */
@@ -963,7 +963,7 @@ static int is_mmnoask (const char *buf)
  *
  * 0    otherwise
  */
-static int mutt_is_autoview (BODY *b)
+int mutt_is_autoview (BODY *b)
 {
   char type[STRING];
   int is_autoview = 0;
@@ -27,18 +27,29 @@
 
 #include "mutt.h"
 
-#define SOMEPRIME 149711
+/* Each time the free elements run out, a block of this many, or of half
+ * the number of slots if that is more, is allocated. */
+#define HASH_BLOCK_MIN 16
 
-static unsigned int gen_string_hash (union hash_key key, unsigned int n)
+struct hash_block
 {
-  unsigned int h = 0;
+  struct hash_block *next;
+  struct hash_elem *elems;
+};
+
+/* FNV-1a */
+static unsigned int gen_string_hash (union hash_key key)
+{
+  unsigned int h = 2166136261U;
   unsigned char *s = (unsigned char *)key.strkey;
 
   while (*s)
-    h += (h << 7) + *s++;
-  h = (h * SOMEPRIME) % n;
+  {
+    h ^= *s++;
+    h *= 16777619U;
+  }
 
-  return h;
+  return h ^ (h >> 15);
 }
 
 static int cmp_string_key (union hash_key a, union hash_key b)
@@ -46,16 +57,18 @@ static int cmp_string_key (union hash_key a, union hash_key b)
   return mutt_strcmp (a.strkey, b.strkey);
 }
 
-static unsigned int gen_case_string_hash (union hash_key key, unsigned int n)
+static unsigned int gen_case_string_hash (union hash_key key)
 {
-  unsigned int h = 0;
+  unsigned int h = 2166136261U;
   unsigned char *s = (unsigned char *)key.strkey;
 
   while (*s)
-    h += (h << 7) + tolower (*s++);
-  h = (h * SOMEPRIME) % n;
+  {
+    h ^= tolower (*s++);
+    h *= 16777619U;
+  }
 
-  return h;
+  return h ^ (h >> 15);
 }
 
 static int cmp_case_string_key (union hash_key a, union hash_key b)
@@ -63,9 +76,12 @@ static int cmp_case_string_key (union hash_key a, union hash_key b)
   return mutt_strcasecmp (a.strkey, b.strkey);
 }
 
-static unsigned int gen_int_hash (union hash_key key, unsigned int n)
+/* UIDs and such are often consecutive, spread them over the slots */
+static unsigned int gen_int_hash (union hash_key key)
 {
-  return key.intkey % n;
+  unsigned int h = key.intkey * 2654435769U;
+
+  return h ^ (h >> 16);
 }
 
 static int cmp_int_key (union hash_key a, union hash_key b)
@@ -80,10 +96,12 @@ static int cmp_int_key (union hash_key a, union hash_key b)
 static HASH *new_hash (int nelem)
 {
   HASH *table = safe_calloc (1, sizeof (HASH));
-  if (nelem == 0)
-    nelem = 2;
-  table->nelem = nelem;
-  table->table = safe_calloc (nelem, sizeof (struct hash_elem *));
+
+  /* nelem is only a hint, the table grows as needed */
+  table->size = 16;
+  while (table->size < (unsigned int) nelem && table->size < (1U << 30))
+    table->size <<= 1;
+  table->slots = safe_calloc (table->size, sizeof (struct hash_slot));
   return table;
 }
 
@@ -117,55 +135,144 @@ HASH *int_hash_create (int nelem, int flags)
   return table;
 }
 
+static struct hash_elem *new_elem (HASH *table)
+{
+  struct hash_block *block;
+  struct hash_elem *elem;
+  unsigned int i, n;
+
+  if (!table->free_elems)
+  {
+    n = MAX (table->size / 2, HASH_BLOCK_MIN);
+    block = safe_malloc (sizeof (struct hash_block));
+    block->elems = safe_malloc (n * sizeof (struct hash_elem));
+    block->next = table->blocks;
+    table->blocks = block;
+    for (i = n; i > 0; i--)
+    {
+      block->elems[i - 1].next = table->free_elems;
+      table->free_elems = &block->elems[i - 1];
+    }
+  }
+
+  elem = table->free_elems;
+  table->free_elems = elem->next;
+  return elem;
+}
+
+static void free_elem (HASH *table, struct hash_elem *elem)
+{
+  if (table->strdup_keys)
+    FREE (&elem->key.strkey);
+  elem->next = table->free_elems;
+  table->free_elems = elem;
+}
+
+/* Returns the slot of key, or the free slot where it would go. */
+static struct hash_slot *find_slot (const HASH *table, union hash_key key,
+                                    unsigned int hash)
+{
+  unsigned int mask = table->size - 1;
+  unsigned int i;
+  struct hash_slot *slot;
+
+  for (i = hash & mask; ; i = (i + 1) & mask)
+  {
+    slot = &table->slots[i];
+    if (!slot->elem ||
+        (slot->hash == hash && table->cmp_key (slot->elem->key, key) == 0))
+      return slot;
+  }
+}
+
+static void grow_hash (HASH *table)
+{
+  struct hash_slot *old = table->slots;
+  unsigned int oldsize = table->size;
+  unsigned int mask, i, j;
+
+  table->size <<= 1;
+  table->slots = safe_calloc (table->size, sizeof (struct hash_slot));
+  mask = table->size - 1;
+  for (i = 0; i < oldsize; i++)
+  {
+    if (!old[i].elem)
+      continue;
+    for (j = old[i].hash & mask; table->slots[j].elem; j = (j + 1) & mask)
+      ;
+    table->slots[j] = old[i];
+  }
+  FREE (&old);
+}
+
+/* Frees slot, moving back the slots after it that would not be found
+ * past the hole. */
+static void remove_slot (HASH *table, struct hash_slot *slot)
+{
+  unsigned int mask = table->size - 1;
+  unsigned int i, j, home;
+
+  i = j = slot - table->slots;
+  FOREVER
+  {
+    j = (j + 1) & mask;
+    if (!table->slots[j].elem)
+      break;
+    home = table->slots[j].hash & mask;
+    /* j can fill the hole at i unless its home lies cyclically in (i, j] */
+    if ((j > i) ? (home <= i || home > j) : (home <= i && home > j))
+    {
+      table->slots[i] = table->slots[j];
+      i = j;
+    }
+  }
+  table->slots[i].elem = NULL;
+  table->used--;
+}
+
 /* table        hash table to update
  * key          key to hash on
  * data         data to associate with `key'
- * allow_dup    if nonzero, duplicate keys are allowed in the table
  */
 static int union_hash_insert (HASH * table, union hash_key key, void *data)
 {
-  struct hash_elem *ptr;
-  unsigned int h;
-
-  ptr = (struct hash_elem *) safe_malloc (sizeof (struct hash_elem));
-  h = table->gen_hash (key, table->nelem);
-  ptr->key = key;
-  ptr->data = data;
+  struct hash_slot *slot;
+  struct hash_elem *elem;
+  unsigned int hash;
 
-  if (table->allow_dups)
+  hash = table->gen_hash (key);
+  slot = find_slot (table, key, hash);
+  if (slot->elem)
   {
-    ptr->next = table->table[h];
-    table->table[h] = ptr;
+    if (!table->allow_dups)
+      return -1;
   }
-  else
+  else if ((table->used + 1) * 4 > table->size * 3)
   {
-    struct hash_elem *tmp, *last;
-    int r;
+    grow_hash (table);
+    slot = find_slot (table, key, hash);
+  }
 
-    for (tmp = table->table[h], last = NULL; tmp; last = tmp, tmp = tmp->next)
-    {
-      r = table->cmp_key (tmp->key, key);
-      if (r == 0)
-      {
-	FREE (&ptr);
-	return (-1);
-      }
-      if (r > 0)
-	break;
-    }
-    if (last)
-      last->next = ptr;
-    else
-      table->table[h] = ptr;
-    ptr->next = tmp;
+  elem = new_elem (table);
+  if (table->strdup_keys)
+    key.strkey = safe_strdup (key.strkey);
+  elem->key = key;
+  elem->data = data;
+  elem->next = slot->elem;
+  if (!slot->elem)
+  {
+    slot->hash = hash;
+    table->used++;
   }
-  return h;
+  slot->elem = elem;
+
+  return 0;
 }
 
 int hash_insert (HASH * table, const char *strkey, void *data)
 {
   union hash_key key;
-  key.strkey = table->strdup_keys ? safe_strdup (strkey) : strkey;
+  key.strkey = strkey;
   return union_hash_insert (table, key, data);
 }
 
@@ -178,20 +285,10 @@ int int_hash_insert (HASH * table, unsigned int intkey, void *data)
 
 static struct hash_elem *union_hash_find_elem (const HASH *table, union hash_key key)
 {
-  int hash;
-  struct hash_elem *ptr;
-
   if (!table)
     return NULL;
 
-  hash = table->gen_hash (key, table->nelem);
-  ptr = table->table[hash];
-  for (; ptr; ptr = ptr->next)
-  {
-    if (table->cmp_key (key, ptr->key) == 0)
-      return (ptr);
-  }
-  return NULL;
+  return find_slot (table, key, table->gen_hash (key))->elem;
 }
 
 static void *union_hash_find (const HASH *table, union hash_key key)
@@ -224,52 +321,44 @@ void *int_hash_find (const HASH *table, unsigned int intkey)
   return union_hash_find (table, key);
 }
 
+/* Returns all the elements with key, linked through ->next, most
+ * recently inserted first. */
 struct hash_elem *hash_find_bucket (const HASH *table, const char *strkey)
 {
   union hash_key key;
-  int hash;
-
-  if (!table)
-    return NULL;
-
   key.strkey = strkey;
-  hash = table->gen_hash (key, table->nelem);
-  return table->table[hash];
+  return union_hash_find_elem (table, key);
 }
 
 static void union_hash_delete (HASH *table, union hash_key key, const void *data,
                                void (*destroy) (void *))
 {
-  int hash;
+  struct hash_slot *slot;
   struct hash_elem *ptr, **last;
 
   if (!table)
     return;
 
-  hash = table->gen_hash (key, table->nelem);
-  ptr = table->table[hash];
-  last = &table->table[hash];
+  slot = find_slot (table, key, table->gen_hash (key));
+  if (!slot->elem)
+    return;
 
-  while (ptr)
+  last = &slot->elem;
+  while ((ptr = *last))
   {
-    if ((data == ptr->data || !data)
-	&& table->cmp_key (ptr->key, key) == 0)
+    if (data == ptr->data || !data)
     {
       *last = ptr->next;
       if (destroy)
 	destroy (ptr->data);
-      if (table->strdup_keys)
-        FREE (&ptr->key.strkey);
-      FREE (&ptr);
-
-      ptr = *last;
+      free_elem (table, ptr);
     }
     else
-    {
       last = &ptr->next;
-      ptr = ptr->next;
-    }
   }
+
+  if (!slot->elem)
+    remove_slot (table, slot);
 }
 
 void hash_delete (HASH *table, const char *strkey, const void *data,
@@ -293,28 +382,35 @@ void int_hash_delete (HASH *table, unsigned int intkey, const void *data,
  */
 void hash_destroy (HASH **ptr, void (*destroy) (void *))
 {
-  int i;
+  unsigned int i;
   HASH *pptr;
-  struct hash_elem *elem, *tmp;
+  struct hash_elem *elem;
+  struct hash_block *block;
 
   if (!ptr || !*ptr)
     return;
 
   pptr = *ptr;
-  for (i = 0 ; i < pptr->nelem; i++)
+  if (destroy || pptr->strdup_keys)
   {
-    for (elem = pptr->table[i]; elem; )
+    for (i = 0 ; i < pptr->size; i++)
     {
-      tmp = elem;
-      elem = elem->next;
-      if (destroy)
-	destroy (tmp->data);
-      if (pptr->strdup_keys)
-        FREE (&tmp->key.strkey);
-      FREE (&tmp);
+      for (elem = pptr->slots[i].elem; elem; elem = elem->next)
+      {
+        if (destroy)
+          destroy (elem->data);
+        if (pptr->strdup_keys)
+          FREE (&elem->key.strkey);
+      }
     }
   }
-  FREE (&pptr->table);
+  while ((block = pptr->blocks))
+  {
+    pptr->blocks = block->next;
+    FREE (&block->elems);
+    FREE (&block);
+  }
+  FREE (&pptr->slots);
   FREE (ptr);		/* __FREE_CHECKED__ */
 }
 
@@ -329,11 +425,11 @@ struct hash_elem *hash_walk(const HASH *table, struct hash_walk_state *state)
   if (state->last)
     state->index++;
 
-  while (state->index < table->nelem)
+  while ((unsigned int) state->index < table->size)
   {
-    if (table->table[state->index])
+    if (table->slots[state->index].elem)
     {
-      state->last = table->table[state->index];
+      state->last = table->slots[state->index].elem;
       return state->last;
     }
     state->index++;
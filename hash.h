@@ -29,16 +29,29 @@ struct hash_elem
 {
   union hash_key key;
   void *data;
-  struct hash_elem *next;
+  struct hash_elem *next;	/* more elements with the same key */
 };
 
+/* The table is open addressed with linear probing: each distinct key
+ * has one slot, holding the elements inserted with that key. */
+struct hash_slot
+{
+  unsigned int hash;
+  struct hash_elem *elem;	/* NULL if the slot is free */
+};
+
+struct hash_block;
+
 typedef struct
 {
-  int nelem;
+  unsigned int size;		/* number of slots, a power of 2 */
+  unsigned int used;		/* number of slots in use */
   unsigned int strdup_keys : 1;      /* if set, the key->strkey is strdup'ed */
   unsigned int allow_dups : 1;       /* if set, duplicate keys are allowed */
-  struct hash_elem **table;
-  unsigned int (*gen_hash)(union hash_key, unsigned int);
+  struct hash_slot *slots;
+  struct hash_block *blocks;	/* the elements are carved out of these */
+  struct hash_elem *free_elems;
+  unsigned int (*gen_hash)(union hash_key);
   int (*cmp_key)(union hash_key, union hash_key);
 }
 HASH;
@@ -0,0 +1,478 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Checks the HASH table: insert, find and delete with string, case
+ * insensitive and integer keys, growing, MUTT_HASH_ALLOW_DUPS, and what
+ * hash_walk() and hash_find_bucket() promise.  Run by "make check".
+ *
+ *   ./hash_test bench [keys]
+ *
+ * instead compares its speed with the chained table it replaced, which
+ * is kept below, on keys like Message-IDs.  The default is 500000 keys.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mutt_test.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+static int Failed = 0;
+static int Checks = 0;
+
+#define check(ok, what) check_ (ok, what, __LINE__)
+
+static void check_ (int ok, const char *what, int line)
+{
+  Checks++;
+  if (!ok)
+  {
+    Failed++;
+    fprintf (stderr, "FAIL: line %d: %s\n", line, what);
+  }
+}
+
+static unsigned int Seed = 88172645U;
+
+/* xorshift32 */
+static unsigned int test_random (void)
+{
+  Seed ^= Seed << 13;
+  Seed ^= Seed >> 17;
+  Seed ^= Seed << 5;
+  return Seed;
+}
+
+static char **make_keys (int n)
+{
+  char **keys = safe_calloc (n, sizeof (char *));
+  char buf[SHORT_STRING];
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    snprintf (buf, sizeof (buf), "<%08x.%d.mutt@host%d.example.com>",
+              test_random (), i, i % 7);
+    keys[i] = safe_strdup (buf);
+  }
+  return keys;
+}
+
+static void free_keys (char ***keys, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    FREE (&(*keys)[i]);
+  FREE (keys);		/* __FREE_CHECKED__ */
+}
+
+/* Every key must be found from its home slot without crossing a free
+ * slot, and the used slots must be counted right. */
+static int table_consistent (const HASH *table)
+{
+  unsigned int mask = table->size - 1;
+  unsigned int i, j, used = 0;
+
+  for (i = 0; i < table->size; i++)
+  {
+    if (!table->slots[i].elem)
+      continue;
+    used++;
+    if (table->slots[i].hash != table->gen_hash (table->slots[i].elem->key))
+      return 0;
+    for (j = table->slots[i].hash & mask; j != i; j = (j + 1) & mask)
+      if (!table->slots[j].elem)
+	return 0;
+  }
+  return used == table->used && table->used * 4 <= table->size * 3;
+}
+
+static void test_strings (void)
+{
+  const int n = 20000;
+  char **keys = make_keys (n);
+  char upper[SHORT_STRING];
+  HASH *table;
+  int i, ok;
+
+  /* from a tiny size hint, so that it grows many times */
+  table = hash_create (2, MUTT_HASH_STRDUP_KEYS);
+  for (i = 0, ok = 1; i < n; i++)
+    ok &= hash_insert (table, keys[i], keys[i]) == 0;
+  check (ok, "insert");
+  check (table->used == (unsigned int) n, "used after insert");
+  check ((table->size & (table->size - 1)) == 0, "size is a power of 2");
+  check (table_consistent (table), "consistent after growing");
+
+  for (i = 0, ok = 1; i < n; i++)
+    ok &= hash_find (table, keys[i]) == keys[i];
+  check (ok, "find");
+  check (!hash_find (table, "<not.there@example.com>"), "find missing key");
+  check (hash_insert (table, keys[0], NULL) == -1, "duplicate rejected");
+  check (hash_find (table, keys[0]) == keys[0], "duplicate left alone");
+
+  /* the keys were copied */
+  strfcpy (upper, keys[1], sizeof (upper));
+  keys[1][1] = '#';
+  check (hash_find (table, upper) == keys[1], "key copied");
+  keys[1][1] = upper[1];
+
+  for (i = 0; i < n; i += 3)
+    hash_delete (table, keys[i], NULL, NULL);
+  for (i = 0, ok = 1; i < n; i++)
+    ok &= hash_find (table, keys[i]) == ((i % 3) ? keys[i] : NULL);
+  check (ok, "find after delete");
+  check (table_consistent (table), "consistent after delete");
+
+  for (i = 0, ok = 1; i < n; i += 3)
+    ok &= hash_insert (table, keys[i], keys[i]) == 0;
+  check (ok, "insert again");
+  for (i = 0, ok = 1; i < n; i++)
+    ok &= hash_find (table, keys[i]) == keys[i];
+  check (ok, "find after inserting again");
+  hash_destroy (&table, NULL);
+  check (!table, "destroyed");
+
+  table = hash_create (16, MUTT_HASH_STRCASECMP);
+  hash_insert (table, "Message-ID", keys[0]);
+  check (hash_find (table, "message-id") == keys[0], "case insensitive find");
+  check (hash_insert (table, "MESSAGE-ID", NULL) == -1,
+         "case insensitive duplicate");
+  hash_delete (table, "MeSsAgE-iD", NULL, NULL);
+  check (!hash_find (table, "Message-ID"), "case insensitive delete");
+  hash_destroy (&table, NULL);
+
+  free_keys (&keys, n);
+}
+
+/* Random inserts and deletes in a small integer table, compared with an
+ * array.  Small keys crowd the table, so backward shifts wrap around. */
+static void test_mixed (void)
+{
+  const unsigned int range = 700;
+  int present[700];
+  HASH *table;
+  unsigned int key;
+  int i, ok = 1, consistent = 1, rc;
+
+  memset (present, 0, sizeof (present));
+  table = int_hash_create (16, 0);
+  for (i = 0; i < 200000; i++)
+  {
+    key = test_random () % range;
+    if (test_random () % 2)
+    {
+      rc = int_hash_insert (table, key, present + key);
+      ok &= rc == (present[key] ? -1 : 0);
+      present[key] = 1;
+    }
+    else
+    {
+      int_hash_delete (table, key, NULL, NULL);
+      present[key] = 0;
+    }
+    ok &= int_hash_find (table, key) == (present[key] ? present + key : NULL);
+    if (i % 1000 == 0)
+      consistent &= table_consistent (table);
+  }
+  for (key = 0; key < range; key++)
+    ok &= int_hash_find (table, key) == (present[key] ? present + key : NULL);
+  check (ok, "random inserts and deletes");
+  check (consistent && table_consistent (table), "consistent throughout");
+  hash_destroy (&table, NULL);
+}
+
+static int Destroyed;
+
+static void count_destroy (void *data)
+{
+  Destroyed++;
+}
+
+static void test_dups (void)
+{
+  static int data[4];
+  HASH *table;
+  struct hash_elem *elem;
+  int i;
+
+  table = hash_create (16, MUTT_HASH_ALLOW_DUPS);
+  for (i = 0; i < 3; i++)
+    check (hash_insert (table, "dup", &data[i]) == 0, "insert duplicate");
+  hash_insert (table, "other", &data[3]);
+
+  /* the bucket holds exactly the elements of the key, newest first */
+  elem = hash_find_bucket (table, "dup");
+  for (i = 2; i >= 0 && elem; i--, elem = elem->next)
+    check (elem->data == &data[i] && !strcmp (elem->key.strkey, "dup"),
+           "bucket order");
+  check (i == -1 && !elem, "bucket length");
+  check (hash_find (table, "dup") == &data[2], "find returns the newest");
+
+  hash_delete (table, "dup", &data[1], NULL);
+  elem = hash_find_bucket (table, "dup");
+  check (elem && elem->data == &data[2] && elem->next &&
+         elem->next->data == &data[0] && !elem->next->next,
+         "delete one duplicate");
+
+  Destroyed = 0;
+  hash_delete (table, "dup", NULL, count_destroy);
+  check (Destroyed == 2, "delete all duplicates");
+  check (!hash_find_bucket (table, "dup"), "duplicates gone");
+  check (hash_find (table, "other") == &data[3], "other key left alone");
+  check (table_consistent (table), "consistent after deleting duplicates");
+
+  hash_insert (table, "dup", &data[0]);
+  hash_insert (table, "dup", &data[1]);
+  Destroyed = 0;
+  hash_destroy (&table, count_destroy);
+  check (Destroyed == 3, "destroy calls destroy() for each element");
+}
+
+static void test_walk (void)
+{
+  const int n = 3000;
+  struct hash_walk_state state;
+  struct hash_elem *elem, *prev;
+  HASH *table;
+  int *seen, i, ok = 1, dups_together = 1, first[2];
+
+  seen = safe_calloc (n, sizeof (int));
+  table = int_hash_create (4, MUTT_HASH_ALLOW_DUPS);
+
+  memset (&state, 0, sizeof (state));
+  check (!hash_walk (table, &state), "walk of an empty table");
+
+  /* key i / 2, twice each */
+  for (i = 0; i < n; i++)
+    int_hash_insert (table, i / 2, seen + i);
+
+  memset (&state, 0, sizeof (state));
+  for (prev = NULL; (elem = hash_walk (table, &state)); prev = elem)
+  {
+    seen[(int *) elem->data - seen]++;
+    /* the second element of a key follows the first, and is older */
+    if (prev && prev->key.intkey == elem->key.intkey)
+      dups_together &= (int *) prev->data > (int *) elem->data;
+    else if ((elem->key.intkey * 2 + 1) < (unsigned int) n)
+      dups_together &= elem->next && elem->next->key.intkey == elem->key.intkey;
+  }
+  for (i = 0; i < n; i++)
+    ok &= seen[i] == 1;
+  check (ok, "walk visits each element once");
+  check (dups_together, "walk visits duplicates together, newest first");
+
+  /* a finished walk starts over */
+  check (state.index == 0 && !state.last, "walk state reset");
+  elem = hash_walk (table, &state);
+  first[0] = elem ? (int *) elem->data - seen : -1;
+  memset (&state, 0, sizeof (state));
+  elem = hash_walk (table, &state);
+  first[1] = elem ? (int *) elem->data - seen : -2;
+  check (first[0] == first[1], "walk starts over from the beginning");
+
+  hash_destroy (&table, NULL);
+  FREE (&seen);
+}
+
+/*
+ * The chained table HASH used to be, for comparison: a fixed number of
+ * buckets, each a sorted list of malloc()ed elements.
+ */
+struct chained_elem
+{
+  const char *key;
+  void *data;
+  struct chained_elem *next;
+};
+
+struct chained
+{
+  int nelem;
+  struct chained_elem **table;
+};
+
+static unsigned int chained_hash (const char *key, unsigned int n)
+{
+  unsigned int h = 0;
+  const unsigned char *s = (const unsigned char *) key;
+
+  while (*s)
+    h += (h << 7) + *s++;
+  return (h * 149711) % n;
+}
+
+static struct chained *chained_create (int nelem)
+{
+  struct chained *table = safe_calloc (1, sizeof (struct chained));
+
+  table->nelem = nelem ? nelem : 2;
+  table->table = safe_calloc (table->nelem, sizeof (struct chained_elem *));
+  return table;
+}
+
+static int chained_insert (struct chained *table, const char *key, void *data)
+{
+  struct chained_elem *ptr, *tmp, *last;
+  unsigned int h = chained_hash (key, table->nelem);
+  int r;
+
+  for (tmp = table->table[h], last = NULL; tmp; last = tmp, tmp = tmp->next)
+  {
+    if ((r = mutt_strcmp (tmp->key, key)) == 0)
+      return -1;
+    if (r > 0)
+      break;
+  }
+  ptr = safe_malloc (sizeof (struct chained_elem));
+  ptr->key = key;
+  ptr->data = data;
+  ptr->next = tmp;
+  if (last)
+    last->next = ptr;
+  else
+    table->table[h] = ptr;
+  return 0;
+}
+
+static void *chained_find (const struct chained *table, const char *key)
+{
+  struct chained_elem *ptr;
+
+  for (ptr = table->table[chained_hash (key, table->nelem)]; ptr; ptr = ptr->next)
+    if (mutt_strcmp (key, ptr->key) == 0)
+      return ptr->data;
+  return NULL;
+}
+
+static void chained_delete (struct chained *table, const char *key)
+{
+  struct chained_elem *ptr, **last;
+
+  last = &table->table[chained_hash (key, table->nelem)];
+  while ((ptr = *last))
+  {
+    if (mutt_strcmp (ptr->key, key) == 0)
+    {
+      *last = ptr->next;
+      FREE (&ptr);
+    }
+    else
+      last = &ptr->next;
+  }
+}
+
+static void chained_destroy (struct chained **table)
+{
+  struct chained_elem *elem, *tmp;
+  int i;
+
+  for (i = 0; i < (*table)->nelem; i++)
+    for (elem = (*table)->table[i]; elem; )
+    {
+      tmp = elem;
+      elem = elem->next;
+      FREE (&tmp);
+    }
+  FREE (&(*table)->table);
+  FREE (table);		/* __FREE_CHECKED__ */
+}
+
+/* nanoseconds per key */
+#define NS(t) ((t) * 1e9 / n)
+
+static void bench (char **keys, int n, int hint)
+{
+  struct chained *chained;
+  HASH *table;
+  double t[6];
+  int i, found = 0;
+
+  t[0] = mutt_test_now ();
+  table = hash_create (hint, 0);
+  for (i = 0; i < n; i++)
+    hash_insert (table, keys[i], keys[i]);
+  t[1] = mutt_test_now ();
+  for (i = 0; i < n; i++)
+    found += hash_find (table, keys[(i * 7919UL) % n]) != NULL;
+  t[2] = mutt_test_now ();
+  for (i = 0; i < n; i++)
+    hash_delete (table, keys[i], NULL, NULL);
+  t[3] = mutt_test_now ();
+  hash_destroy (&table, NULL);
+  printf ("%7d keys, hint %7d:  HASH    insert %7.0f  find %7.0f  delete %7.0f ns\n",
+          n, hint, NS (t[1] - t[0]), NS (t[2] - t[1]), NS (t[3] - t[2]));
+
+  t[0] = mutt_test_now ();
+  chained = chained_create (hint);
+  for (i = 0; i < n; i++)
+    chained_insert (chained, keys[i], keys[i]);
+  t[1] = mutt_test_now ();
+  for (i = 0; i < n; i++)
+    found += chained_find (chained, keys[(i * 7919UL) % n]) != NULL;
+  t[2] = mutt_test_now ();
+  for (i = 0; i < n; i++)
+    chained_delete (chained, keys[i]);
+  t[3] = mutt_test_now ();
+  chained_destroy (&chained);
+  printf ("%7d keys, hint %7d:  chained insert %7.0f  find %7.0f  delete %7.0f ns\n",
+          n, hint, NS (t[1] - t[0]), NS (t[2] - t[1]), NS (t[3] - t[2]));
+
+  if (found != 2 * n)
+    fprintf (stderr, "%d of %d keys found\n", found, 2 * n);
+}
+
+int main (int argc, char **argv)
+{
+  char **keys;
+  int n;
+
+  if (argc > 1 && !strcmp (argv[1], "bench"))
+  {
+    n = argc > 2 ? atoi (argv[2]) : 500000;
+    if (n < 1)
+    {
+      fprintf (stderr, "usage: %s [bench [keys]]\n", argv[0]);
+      return 1;
+    }
+    keys = make_keys (n);
+    /* sized for the keys, as for the Message-IDs of a folder, and far
+     * too small, as for a hash created before the folder is read */
+    bench (keys, n, n);
+    bench (keys, n, 1024);
+    free_keys (&keys, n);
+    return 0;
+  }
+
+  test_strings ();
+  test_mixed ();
+  test_dups ();
+  test_walk ();
+
+  if (Failed)
+    fprintf (stderr, "%d of %d checks failed\n", Failed, Checks);
+  else
+    printf ("%d checks passed\n", Checks);
+  return Failed ? 1 : 0;
+}
@@ -55,14 +55,38 @@
 #include "md5.h"
 #include "rfc822.h"
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
 unsigned int hcachever = 0x0;
 
+/* With $header_cache_shared, all folders keep their records in a single
+ * database, which is opened once and stays open until mutt exits.  The
+ * handles returned by mutt_hcache_open() are copies of Shared.db, with a
+ * folder prefix of their own. */
+static struct
+{
+  char *path;
+  header_cache_t *db;		/* backend fields of the open database */
+  int refs;			/* handles currently open */
+  header_cache_t *txn_owner;	/* handle that has a transaction open */
+} Shared;
+
 #if HAVE_QDBM
 struct header_cache
 {
   VILLA *db;
   char *folder;
   unsigned int crc;
+  int batch;			/* inside mutt_hcache_begin() */
+  int batched;			/* records stored since the last commit */
+  int shared;			/* a handle on the $header_cache_shared database */
+  void *fetched;		/* record from the backend, see mutt_hcache_fetch() */
+  void *unpacked;		/* its decompressed copy, if any */
 };
 #elif HAVE_TC
 struct header_cache
@@ -70,6 +94,11 @@ struct header_cache
   TCBDB *db;
   char *folder;
   unsigned int crc;
+  int batch;			/* inside mutt_hcache_begin() */
+  int batched;			/* records stored since the last commit */
+  int shared;			/* a handle on the $header_cache_shared database */
+  void *fetched;		/* record from the backend, see mutt_hcache_fetch() */
+  void *unpacked;		/* its decompressed copy, if any */
 };
 #elif HAVE_KC
 struct header_cache
@@ -77,6 +106,12 @@ struct header_cache
   KCDB *db;
   char *folder;
   unsigned int crc;
+  int batch;			/* inside mutt_hcache_begin() */
+  int batched;			/* records stored since the last commit */
+  int shared;			/* a handle on the $header_cache_shared database */
+  void *fetched;		/* record from the backend, see mutt_hcache_fetch() */
+  void *unpacked;		/* its decompressed copy, if any */
+  int lockfd;			/* see hcache_lock() */
 };
 #elif HAVE_GDBM
 struct header_cache
@@ -84,6 +119,11 @@ struct header_cache
   GDBM_FILE db;
   char *folder;
   unsigned int crc;
+  int batch;			/* inside mutt_hcache_begin() */
+  int batched;			/* records stored since the last commit */
+  int shared;			/* a handle on the $header_cache_shared database */
+  void *fetched;		/* record from the backend, see mutt_hcache_fetch() */
+  void *unpacked;		/* its decompressed copy, if any */
 };
 #elif HAVE_DB4
 struct header_cache
@@ -92,6 +132,11 @@ struct header_cache
   DB *db;
   char *folder;
   unsigned int crc;
+  int batch;			/* inside mutt_hcache_begin() */
+  int batched;			/* records stored since the last commit */
+  int shared;			/* a handle on the $header_cache_shared database */
+  void *fetched;		/* record from the backend, see mutt_hcache_fetch() */
+  void *unpacked;		/* its decompressed copy, if any */
   int fd;
   BUFFER *lockfile;
 };
@@ -112,6 +157,12 @@ struct header_cache
   MDB_dbi db;
   char *folder;
   unsigned int crc;
+  int batch;			/* inside mutt_hcache_begin() */
+  int batched;			/* records stored since the last commit */
+  int shared;			/* a handle on the $header_cache_shared database */
+  void *fetched;		/* record from the backend, see mutt_hcache_fetch() */
+  void *unpacked;		/* its decompressed copy, if any */
+  int lockfd;			/* see hcache_lock() */
   enum mdb_txn_mode txn_mode;
 };
 
@@ -148,6 +199,7 @@ static int mdb_get_r_txn(header_cache_t *h)
 
 static int mdb_get_w_txn(header_cache_t *h)
 {
+  header_cache_t *owner = Shared.txn_owner;
   int rc;
 
   if (h->txn)
@@ -159,6 +211,18 @@ static int mdb_get_w_txn(header_cache_t *h)
     mdb_txn_abort (h->txn);
   }
 
+  /* Only one write transaction can be open in the environment, so
+   * commit the one of another handle on the shared database. */
+  if (h->shared && owner && owner != h && owner->txn &&
+      owner->txn_mode == txn_write)
+  {
+    if ((rc = mdb_txn_commit (owner->txn)) != MDB_SUCCESS)
+      dprint (2, (debugfile, "mdb_get_w_txn: mdb_txn_commit %s\n",
+                  mdb_strerror (rc)));
+    owner->txn_mode = txn_uninitialized;
+    owner->txn = NULL;
+  }
+
   if ((rc = mdb_txn_begin (h->env, NULL, 0, &h->txn)) != MDB_SUCCESS)
   {
     h->txn = NULL;
@@ -168,6 +232,8 @@ static int mdb_get_w_txn(header_cache_t *h)
   }
 
   h->txn_mode = txn_write;
+  if (h->shared)
+    Shared.txn_owner = h;
   return rc;
 }
 #endif
@@ -227,6 +293,76 @@ static inline int is_ascii (const char *p, size_t len)
   return 1;
 }
 
+/* Strings are stored in UTF-8, so with any other $charset every
+ * non-ASCII string is converted when it is dumped or restored.  Keep
+ * the two conversion descriptors open instead of opening new ones for
+ * every string.
+ */
+static iconv_t
+hcache_iconv (int restore)
+{
+  static iconv_t cd[2] = { (iconv_t) -1, (iconv_t) -1 };
+  static char *charset = NULL;
+  int i;
+
+  if (mutt_strcmp (charset, Charset))
+  {
+    for (i = 0; i < 2; i++)
+    {
+      if (cd[i] != (iconv_t) -1)
+        iconv_close (cd[i]);
+      cd[i] = (iconv_t) -1;
+    }
+    mutt_str_replace (&charset, Charset);
+  }
+
+  if (cd[restore] == (iconv_t) -1)
+    cd[restore] = restore ? mutt_iconv_open (Charset, "utf-8", 0) :
+                            mutt_iconv_open ("utf-8", Charset, 0);
+
+  return cd[restore];
+}
+
+/* Like mutt_convert_string() between $charset and UTF-8, in the
+ * direction given by restore. */
+static int
+hcache_convert (char **ps, int restore)
+{
+  ICONV_CONST char *repls[] = { "\357\277\275", "?", 0 };
+  ICONV_CONST char *ib;
+  char *buf, *ob;
+  size_t ibl, obl;
+  iconv_t cd;
+
+  if (!*ps || !**ps)
+    return 0;
+
+  if ((cd = hcache_iconv (restore)) == (iconv_t) -1)
+    return -1;
+
+  ib = *ps;
+  ibl = strlen (*ps);
+  if (ibl >= SIZE_MAX / MB_LEN_MAX)
+    return -1;
+
+  obl = MB_LEN_MAX * ibl;
+  ob = buf = safe_malloc (obl + 1);
+
+  iconv (cd, 0, 0, 0, 0);
+  if (restore)
+    mutt_iconv (cd, &ib, &ibl, &ob, &obl, repls, NULL);
+  else
+    mutt_iconv (cd, &ib, &ibl, &ob, &obl, NULL, "\357\277\275");
+  iconv (cd, 0, 0, &ob, &obl);
+  *ob = '\0';
+
+  FREE (ps);		/* __FREE_CHECKED__ */
+  *ps = buf;
+  mutt_str_adjust (ps);
+
+  return 0;
+}
+
 static unsigned char *
 dump_char_size(char *c, unsigned char *d, int *off, ssize_t size, int convert)
 {
@@ -242,7 +378,7 @@ dump_char_size(char *c, unsigned char *d, int *off, ssize_t size, int convert)
   if (convert && !is_ascii (c, size))
   {
     p = mutt_substrdup (c, c + size);
-    if (mutt_convert_string (&p, Charset, "utf-8", 0) == 0)
+    if (hcache_convert (&p, 0) == 0)
     {
       c = p;
       size = mutt_strlen (c) + 1;
@@ -280,19 +416,40 @@ restore_char(char **c, const unsigned char *d, int *off, int convert)
 
   *c = safe_malloc(size);
   memcpy(*c, d + *off, size);
+  /* on failure, the UTF-8 string is kept */
   if (convert && !is_ascii (*c, size))
+    hcache_convert (c, 1);
+  *off += size;
+}
+
+/* Like restore_char(), but the string is shared through
+ * mutt_str_intern(). */
+static void
+restore_interned(char **c, const unsigned char *d, int *off, int convert)
+{
+  unsigned int size;
+  const char *s;
+  char *tmp;
+
+  restore_int(&size, d, off);
+  s = (const char *) d + *off;
+  *off += size;
+
+  if (size == 0)
+    *c = NULL;
+  else if (size == 1)
+    *c = safe_calloc (1, 1);
+  else if (convert && !is_ascii (s, size))
   {
-    char *tmp = safe_strdup (*c);
-    if (mutt_convert_string (&tmp, "utf-8", Charset, 0) == 0)
-    {
-      mutt_str_replace (c, tmp);
-    }
-    else
-    {
-      FREE(&tmp);
-    }
+    tmp = safe_malloc (size);
+    memcpy (tmp, s, size);
+    /* on failure, the UTF-8 string is kept */
+    hcache_convert (&tmp, 1);
+    *c = mutt_str_intern (tmp);
+    FREE (&tmp);
   }
-  *off += size;
+  else
+    *c = mutt_str_intern (s);
 }
 
 static unsigned char *
@@ -333,8 +490,8 @@ restore_address(ADDRESS ** a, const unsigned char *d, int *off, int convert)
 #ifdef EXACT_ADDRESS
     restore_char(&(*a)->val, d, off, convert);
 #endif
-    restore_char(&(*a)->personal, d, off, convert);
-    restore_char(&(*a)->mailbox, d, off, 0);
+    restore_interned(&(*a)->personal, d, off, convert);
+    restore_interned(&(*a)->mailbox, d, off, 0);
     restore_int((unsigned int *) &(*a)->group, d, off);
     a = &(*a)->next;
     counter--;
@@ -381,6 +538,50 @@ restore_list(LIST ** l, const unsigned char *d, int *off, int convert)
   *l = NULL;
 }
 
+/* The skip_*() functions step over what dump_*() wrote, for the fields
+ * restore_envelope() leaves to mutt_hcache_restore_lazy(). */
+static void
+skip_char(const unsigned char *d, int *off)
+{
+  unsigned int size;
+
+  restore_int(&size, d, off);
+  *off += size;
+}
+
+static void
+skip_address(const unsigned char *d, int *off)
+{
+  unsigned int counter;
+
+  restore_int(&counter, d, off);
+
+  while (counter)
+  {
+#ifdef EXACT_ADDRESS
+    skip_char(d, off);
+#endif
+    skip_char(d, off);
+    skip_char(d, off);
+    *off += sizeof (int);
+    counter--;
+  }
+}
+
+static void
+skip_list(const unsigned char *d, int *off)
+{
+  unsigned int counter;
+
+  restore_int(&counter, d, off);
+
+  while (counter)
+  {
+    skip_char(d, off);
+    counter--;
+  }
+}
+
 static unsigned char *
 dump_buffer(BUFFER * b, unsigned char *d, int *off, int convert)
 {
@@ -543,19 +744,102 @@ dump_envelope(ENVELOPE * e, unsigned char *d, int *off, int convert)
   return d;
 }
 
+/* The fields that neither the index nor threading look at are stored
+ * in the order of the record, and then
+ *   return_path
+ *   bcc, sender, reply_to, mail_followup_to
+ *   date
+ *   userhdrs
+ * are copied as they are into e->lazy, after a byte with the convert
+ * flag.  Records with none of them store nothing.  References is
+ * restored right away: threading reads it for every message. */
+#define LAZY_RANGES 4
+
+static void
+store_lazy(ENVELOPE * e, const unsigned char *d, int *start, int *end,
+           int convert)
+{
+  size_t len = 0;
+  unsigned char *p;
+  int i, j;
+
+  for (i = 0; i < LAZY_RANGES; i++)
+    len += end[i] - start[i];
+
+  /* each field is a zero count or size when absent */
+  for (i = 0; i < LAZY_RANGES; i++)
+    for (j = start[i]; j < end[i]; j++)
+      if (d[j])
+        goto store;
+  return;
+
+store:
+  p = e->lazy = safe_malloc (len + 1);
+  *p++ = convert;
+  for (i = 0; i < LAZY_RANGES; i++)
+  {
+    memcpy (p, d + start[i], end[i] - start[i]);
+    p += end[i] - start[i];
+  }
+}
+
+/* Restores the fields restore_envelope() kept in e->lazy.  Use
+ * mutt_env_load_lazy() instead of calling this directly. */
+void
+mutt_hcache_restore_lazy(ENVELOPE * e)
+{
+  ENVELOPE *tmp;
+  const unsigned char *d;
+  int off = 0, convert;
+
+  if (!e->lazy)
+    return;
+
+  convert = e->lazy[0];
+  d = e->lazy + 1;
+  tmp = mutt_new_envelope ();
+
+  restore_address(&tmp->return_path, d, &off, convert);
+  restore_address(&tmp->bcc, d, &off, convert);
+  restore_address(&tmp->sender, d, &off, convert);
+  restore_address(&tmp->reply_to, d, &off, convert);
+  restore_address(&tmp->mail_followup_to, d, &off, convert);
+  restore_char(&tmp->date, d, &off, 0);
+  restore_list(&tmp->userhdrs, d, &off, convert);
+
+  FREE (&e->lazy);
+
+#define MOVE_LAZY(f) if (!e->f) { e->f = tmp->f; tmp->f = NULL; }
+  MOVE_LAZY(return_path);
+  MOVE_LAZY(bcc);
+  MOVE_LAZY(sender);
+  MOVE_LAZY(reply_to);
+  MOVE_LAZY(mail_followup_to);
+  MOVE_LAZY(date);
+  MOVE_LAZY(userhdrs);
+#undef MOVE_LAZY
+
+  mutt_free_envelope (&tmp);
+}
+
 static void
 restore_envelope(ENVELOPE * e, const unsigned char *d, int *off, int convert)
 {
   int real_subj_off;
+  int start[LAZY_RANGES], end[LAZY_RANGES];
 
-  restore_address(&e->return_path, d, off, convert);
+  start[0] = *off;
+  skip_address(d, off);		/* return_path */
+  end[0] = *off;
   restore_address(&e->from, d, off, convert);
   restore_address(&e->to, d, off, convert);
   restore_address(&e->cc, d, off, convert);
-  restore_address(&e->bcc, d, off, convert);
-  restore_address(&e->sender, d, off, convert);
-  restore_address(&e->reply_to, d, off, convert);
-  restore_address(&e->mail_followup_to, d, off, convert);
+  start[1] = *off;
+  skip_address(d, off);		/* bcc */
+  skip_address(d, off);		/* sender */
+  skip_address(d, off);		/* reply_to */
+  skip_address(d, off);		/* mail_followup_to */
+  end[1] = *off;
 
   restore_char(&e->list_post, d, off, convert);
 
@@ -572,14 +856,20 @@ restore_envelope(ENVELOPE * e, const unsigned char *d, int *off, int convert)
 
   restore_char(&e->message_id, d, off, 0);
   restore_char(&e->supersedes, d, off, 0);
-  restore_char(&e->date, d, off, 0);
-  restore_char(&e->x_label, d, off, convert);
+  start[2] = *off;
+  skip_char(d, off);		/* date */
+  end[2] = *off;
+  restore_interned(&e->x_label, d, off, convert);
 
   restore_buffer(&e->spam, d, off, convert);
 
   restore_list(&e->references, d, off, 0);
   restore_list(&e->in_reply_to, d, off, 0);
-  restore_list(&e->userhdrs, d, off, convert);
+  start[3] = *off;
+  skip_list(d, off);		/* userhdrs */
+  end[3] = *off;
+
+  store_lazy(e, d, start, end, convert);
 }
 
 static int
@@ -678,6 +968,310 @@ mutt_hcache_per_folder(BUFFER *hcpath, const char *path, const char *folder,
   }
 }
 
+/* Header records can be compressed independently of the backend.  The
+ * dumped record starts with the validate union and the crc, followed by
+ * the codec, the length of the uncompressed payload and the length of
+ * the stored payload.  Only the payload is compressed, so that
+ * crc_matches() works on any record, and records written with another
+ * $header_cache_compress_method remain readable.
+ */
+enum
+{
+  HC_CODEC_NONE = 0,
+  HC_CODEC_ZSTD,
+  HC_CODEC_LZ4
+};
+
+#define HC_PAYLOAD_OFF (sizeof (validate) + 4 * sizeof (unsigned int))
+
+/* bump when the layout of the fields preceding the payload changes */
+#define HC_RECORD_FORMAT "codec1"
+
+#ifdef HAVE_ZSTD
+static struct
+{
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+  ZSTD_CDict *cdict;
+  ZSTD_DDict *ddict;
+  char *dict;			/* $header_cache_compress_dictionary loaded */
+  int level;			/* $header_cache_compress_level of cdict */
+} Zstd;
+
+/* (Re)load $header_cache_compress_dictionary if it has changed. */
+static void
+zstd_load_dictionary (void)
+{
+  FILE *fp = NULL;
+  struct stat sb;
+  void *buf = NULL;
+
+  if (!mutt_strcmp (Zstd.dict, HeaderCacheCompressDictionary) &&
+      (!Zstd.cdict || Zstd.level == HeaderCacheCompressLevel))
+    return;
+
+  if (Zstd.cdict)
+    ZSTD_freeCDict (Zstd.cdict);
+  if (Zstd.ddict)
+    ZSTD_freeDDict (Zstd.ddict);
+  Zstd.cdict = NULL;
+  Zstd.ddict = NULL;
+  mutt_str_replace (&Zstd.dict, HeaderCacheCompressDictionary);
+  Zstd.level = HeaderCacheCompressLevel;
+
+  if (!Zstd.dict || !*Zstd.dict)
+    return;
+
+  if ((fp = fopen (Zstd.dict, "r")) == NULL || fstat (fileno (fp), &sb) != 0 ||
+      sb.st_size <= 0)
+  {
+    dprint (1, (debugfile, "zstd_load_dictionary: can't read %s\n", Zstd.dict));
+    goto out;
+  }
+  buf = safe_malloc (sb.st_size);
+  if (fread (buf, 1, sb.st_size, fp) != (size_t) sb.st_size)
+  {
+    dprint (1, (debugfile, "zstd_load_dictionary: can't read %s\n", Zstd.dict));
+    goto out;
+  }
+
+  Zstd.cdict = ZSTD_createCDict (buf, sb.st_size, Zstd.level);
+  Zstd.ddict = ZSTD_createDDict (buf, sb.st_size);
+  if (!Zstd.cdict || !Zstd.ddict)
+    dprint (1, (debugfile, "zstd_load_dictionary: %s is not a dictionary\n",
+                Zstd.dict));
+
+out:
+  safe_fclose (&fp);
+  FREE (&buf);
+}
+
+static size_t
+zstd_compress (const void *src, size_t len, void *dst, size_t dlen)
+{
+  size_t rc;
+
+  if (!Zstd.cctx && !(Zstd.cctx = ZSTD_createCCtx ()))
+    return 0;
+  zstd_load_dictionary ();
+
+  if (Zstd.cdict)
+    rc = ZSTD_compress_usingCDict (Zstd.cctx, dst, dlen, src, len, Zstd.cdict);
+  else
+    rc = ZSTD_compressCCtx (Zstd.cctx, dst, dlen, src, len,
+                            HeaderCacheCompressLevel);
+
+  return ZSTD_isError (rc) ? 0 : rc;
+}
+
+static size_t
+zstd_decompress (const void *src, size_t len, void *dst, size_t dlen)
+{
+  size_t rc;
+
+  if (!Zstd.dctx && !(Zstd.dctx = ZSTD_createDCtx ()))
+    return 0;
+  zstd_load_dictionary ();
+
+  if (Zstd.ddict)
+    rc = ZSTD_decompress_usingDDict (Zstd.dctx, dst, dlen, src, len, Zstd.ddict);
+  else
+    rc = ZSTD_decompressDCtx (Zstd.dctx, dst, dlen, src, len);
+
+  if (ZSTD_isError (rc))
+  {
+    dprint (1, (debugfile, "zstd_decompress: %s\n", ZSTD_getErrorName (rc)));
+    return 0;
+  }
+  return rc;
+}
+
+/* A record compressed with a dictionary can only be read with the
+ * same dictionary. */
+static int
+zstd_can_decompress (const void *src, size_t len)
+{
+  unsigned int id;
+
+  if ((id = ZSTD_getDictID_fromFrame (src, len)) == 0)
+    return 1;
+  zstd_load_dictionary ();
+  return Zstd.ddict && ZSTD_getDictID_fromDDict (Zstd.ddict) == id;
+}
+#endif /* HAVE_ZSTD */
+
+/* Returns the codec for a $header_cache_compress_method value, or -1 if
+ * it is unknown or not compiled in. */
+int
+mutt_hcache_codec (const char *method)
+{
+  if (!method || !*method || !ascii_strcasecmp (method, "none"))
+    return HC_CODEC_NONE;
+#ifdef HAVE_ZSTD
+  if (!ascii_strcasecmp (method, "zstd"))
+    return HC_CODEC_ZSTD;
+#endif
+#ifdef HAVE_LZ4
+  if (!ascii_strcasecmp (method, "lz4"))
+    return HC_CODEC_LZ4;
+#endif
+  return -1;
+}
+
+static int
+hcache_codec_supported (unsigned int codec, const unsigned char *src,
+                        size_t len)
+{
+  switch (codec)
+  {
+    case HC_CODEC_NONE:
+      return 1;
+#ifdef HAVE_ZSTD
+    case HC_CODEC_ZSTD:
+      return zstd_can_decompress (src, len);
+#endif
+#ifdef HAVE_LZ4
+    case HC_CODEC_LZ4:
+      return 1;
+#endif
+  }
+  return 0;
+}
+
+/* Compress the payload of a freshly dumped record of *off bytes, if a
+ * method is set and it actually saves space. */
+static unsigned char *
+hcache_compress (unsigned char *d, int *off)
+{
+  unsigned int codec = HC_CODEC_NONE;
+  unsigned int len = *off - HC_PAYLOAD_OFF;
+  unsigned char *c = NULL;
+  size_t clen = 0, bound = 0;
+  int method;
+
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+  method = mutt_hcache_codec (HeaderCacheCompressMethod);
+#else
+  method = HC_CODEC_NONE;
+#endif
+#ifdef HAVE_ZSTD
+  if (method == HC_CODEC_ZSTD)
+    bound = ZSTD_compressBound (len);
+#endif
+#ifdef HAVE_LZ4
+  if (method == HC_CODEC_LZ4)
+    bound = LZ4_compressBound (len);
+#endif
+
+  if (bound)
+  {
+    c = safe_malloc (HC_PAYLOAD_OFF + bound);
+#ifdef HAVE_ZSTD
+    if (method == HC_CODEC_ZSTD)
+      clen = zstd_compress (d + HC_PAYLOAD_OFF, len, c + HC_PAYLOAD_OFF, bound);
+#endif
+#ifdef HAVE_LZ4
+    if (method == HC_CODEC_LZ4)
+    {
+      int rc = LZ4_compress_default ((const char *) d + HC_PAYLOAD_OFF,
+                                     (char *) c + HC_PAYLOAD_OFF, len, bound);
+      clen = rc > 0 ? rc : 0;
+    }
+#endif
+  }
+
+  if (clen > 0 && clen < len)
+  {
+    codec = method;
+    memcpy (c, d, HC_PAYLOAD_OFF);
+    FREE (&d);
+    d = c;
+    *off = HC_PAYLOAD_OFF + clen;
+  }
+  else
+  {
+    FREE (&c);
+    clen = len;
+  }
+
+  memcpy (d + sizeof (validate) + sizeof (unsigned int), &codec,
+          sizeof (unsigned int));
+  memcpy (d + sizeof (validate) + 2 * sizeof (unsigned int), &len,
+          sizeof (unsigned int));
+  memcpy (d + sizeof (validate) + 3 * sizeof (unsigned int), &clen,
+          sizeof (unsigned int));
+  return d;
+}
+
+/* Returns the record d with its payload decompressed: d itself if it
+ * wasn't compressed, or a new buffer the caller has to free, in which
+ * case *owned is set.  Returns NULL if the payload can't be decoded,
+ * because this build lacks the codec or the record is damaged. */
+static void *
+hcache_unpack (const unsigned char *d, int *owned)
+{
+  unsigned int codec, len, clen;
+  int off = sizeof (validate) + sizeof (unsigned int);
+  unsigned char *buf;
+  size_t rc = 0;
+
+  *owned = 0;
+  restore_int (&codec, d, &off);
+  restore_int (&len, d, &off);
+  restore_int (&clen, d, &off);
+
+  if (codec == HC_CODEC_NONE)
+    return (void *) d;
+  if (!hcache_codec_supported (codec, d + off, clen))
+    return NULL;
+
+  buf = safe_malloc (HC_PAYLOAD_OFF + len);
+#ifdef HAVE_ZSTD
+  if (codec == HC_CODEC_ZSTD)
+    rc = zstd_decompress (d + off, clen, buf + HC_PAYLOAD_OFF, len);
+#endif
+#ifdef HAVE_LZ4
+  if (codec == HC_CODEC_LZ4)
+  {
+    int r = LZ4_decompress_safe ((const char *) d + off,
+                                 (char *) buf + HC_PAYLOAD_OFF, clen, len);
+    rc = r > 0 ? r : 0;
+  }
+#endif
+
+  if (rc != len)
+  {
+    FREE (&buf);
+    return NULL;
+  }
+
+  memcpy (buf, d, HC_PAYLOAD_OFF);
+  codec = HC_CODEC_NONE;
+  memcpy (buf + sizeof (validate) + sizeof (unsigned int), &codec,
+          sizeof (unsigned int));
+  memcpy (buf + sizeof (validate) + 3 * sizeof (unsigned int), &len,
+          sizeof (unsigned int));
+
+  *owned = 1;
+  return buf;
+}
+
+const char *
+mutt_hcache_compress_methods (void)
+{
+  static char methods[SHORT_STRING];
+
+  methods[0] = '\0';
+#ifdef HAVE_ZSTD
+  snprintf (methods, sizeof (methods), "zstd %u", ZSTD_versionNumber ());
+#endif
+#ifdef HAVE_LZ4
+  snprintf (methods + strlen (methods), sizeof (methods) - strlen (methods),
+            "%slz4 %d", methods[0] ? ", " : "", LZ4_versionNumber ());
+#endif
+  return methods[0] ? methods : "none";
+}
+
 /* This function transforms a header into a char so that it is usable by
  * db_store.
  */
@@ -704,7 +1298,13 @@ mutt_hcache_dump(header_cache_t *h, HEADER * header, int *off,
 
   d = dump_int(h->crc, d, off);
 
+  /* codec and lengths, filled in by hcache_compress() */
+  d = dump_int(0, d, off);
+  d = dump_int(0, d, off);
+  d = dump_int(0, d, off);
+
   lazy_realloc(&d, *off + sizeof (HEADER));
+  mutt_env_load_lazy (header->env);
   memcpy(&nh, header, sizeof (HEADER));
 
   /* some fields are not safe to cache */
@@ -738,7 +1338,7 @@ mutt_hcache_dump(header_cache_t *h, HEADER * header, int *off,
   d = dump_body(nh.content, d, off, convert);
   d = dump_char(nh.maildir_flags, d, off, convert);
 
-  return d;
+  return hcache_compress (d, off);
 }
 
 HEADER *
@@ -748,11 +1348,8 @@ mutt_hcache_restore(const unsigned char *d, HEADER ** oh)
   HEADER *h = mutt_new_header();
   int convert = !Charset_is_utf8;
 
-  /* skip validate */
-  off += sizeof (validate);
-
-  /* skip crc */
-  off += sizeof (unsigned int);
+  /* mutt_hcache_fetch() has decompressed the payload */
+  d += HC_PAYLOAD_OFF;
 
   memcpy(h, d + off, sizeof (HEADER));
   off += sizeof (HEADER);
@@ -776,12 +1373,28 @@ mutt_hcache_restore(const unsigned char *d, HEADER ** oh)
   return h;
 }
 
+/* Frees the record the last mutt_hcache_fetch() on h returned. */
+static void
+hcache_release_record (header_cache_t *h)
+{
+  FREE (&h->unpacked);
+  mutt_hcache_free (&h->fetched);
+}
+
+/* The record returned belongs to h: it stays valid until the next
+ * mutt_hcache_fetch() on h or mutt_hcache_close(), and mustn't be freed
+ * by the caller. */
 void *
 mutt_hcache_fetch(header_cache_t *h, const char *filename,
 		  size_t(*keylen) (const char *fn))
 {
-  void* data;
+  void *data, *unpacked;
+  int owned;
 
+  if (!h)
+    return NULL;
+
+  hcache_release_record (h);
   data = mutt_hcache_fetch_raw (h, filename, keylen);
 
   if (!data || !crc_matches(data, h->crc))
@@ -790,7 +1403,26 @@ mutt_hcache_fetch(header_cache_t *h, const char *filename,
     return NULL;
   }
 
-  return data;
+  if (!(unpacked = hcache_unpack (data, &owned)))
+  {
+    /* Treat it as a miss, and don't let it be found again: the caller
+     * parses the message and stores a fresh record. */
+    dprint (1, (debugfile, "mutt_hcache_fetch: dropping undecodable record for %s\n",
+                filename));
+    mutt_hcache_free (&data);
+    mutt_hcache_delete (h, filename, keylen);
+    return NULL;
+  }
+
+  if (owned)
+  {
+    mutt_hcache_free (&data);
+    h->unpacked = unpacked;
+  }
+  else
+    h->fetched = data;
+
+  return unpacked;
 }
 
 void *
@@ -867,25 +1499,100 @@ mutt_hcache_fetch_raw (header_cache_t *h, const char *filename,
 #endif
 }
 
-/*
- * flags
- *
- * MUTT_GENERATE_UIDVALIDITY
- * ignore uidvalidity param and store gettimeofday() as the value
- */
-int
-mutt_hcache_store(header_cache_t *h, const char *filename, HEADER * header,
-		  unsigned int uidvalidity,
-		  size_t(*keylen) (const char *fn),
-		  mutt_hcache_store_flags_t flags)
+static int
+hcache_txn_begin (header_cache_t *h)
 {
-  char* data;
-  int dlen;
-  int ret;
-
-  if (!h)
-    return -1;
-
+#if HAVE_QDBM || HAVE_TC || HAVE_KC
+  /* the transaction is one of the database, which the handles on the
+   * shared database join if one is open already */
+  if (h->shared)
+  {
+    if (Shared.txn_owner)
+      return 0;
+    Shared.txn_owner = h;
+  }
+#endif
+#if HAVE_QDBM
+  return vltranbegin (h->db) ? 0 : -1;
+#elif HAVE_TC
+  return tcbdbtranbegin (h->db) ? 0 : -1;
+#elif HAVE_KC
+  return kcdbbegintran (h->db, 0) ? 0 : -1;
+#elif HAVE_LMDB
+  return mdb_get_w_txn (h);
+#else
+  /* gdbm and Berkeley DB (without a transactional environment) write
+   * every record on its own anyway */
+  return 0;
+#endif
+}
+
+static int
+hcache_txn_commit (header_cache_t *h)
+{
+#if HAVE_QDBM || HAVE_TC || HAVE_KC
+  if (h->shared)
+  {
+    if (Shared.txn_owner != h)
+      return 0;
+    Shared.txn_owner = NULL;
+  }
+#endif
+#if HAVE_QDBM
+  return vltrancommit (h->db) ? 0 : -1;
+#elif HAVE_TC
+  return tcbdbtrancommit (h->db) ? 0 : -1;
+#elif HAVE_KC
+  return kcdbendtran (h->db, 1) ? 0 : -1;
+#elif HAVE_LMDB
+  int rc = MDB_SUCCESS;
+
+  if (h->txn && h->txn_mode == txn_write)
+  {
+    if ((rc = mdb_txn_commit (h->txn)) != MDB_SUCCESS)
+      dprint (2, (debugfile, "hcache_txn_commit: mdb_txn_commit: %s\n",
+                  mdb_strerror (rc)));
+    h->txn_mode = txn_uninitialized;
+    h->txn = NULL;
+  }
+  return rc;
+#else
+  return 0;
+#endif
+}
+
+/* Commit the current transaction of a batch once it holds
+ * $header_cache_batch records, and start the next one. */
+static void
+hcache_batch_stored (header_cache_t *h)
+{
+  if (HeaderCacheBatch <= 0 || ++h->batched < HeaderCacheBatch)
+    return;
+
+  h->batched = 0;
+  if (hcache_txn_commit (h) != 0 || hcache_txn_begin (h) != 0)
+    h->batch = 0;
+}
+
+/*
+ * flags
+ *
+ * MUTT_GENERATE_UIDVALIDITY
+ * ignore uidvalidity param and store gettimeofday() as the value
+ */
+int
+mutt_hcache_store(header_cache_t *h, const char *filename, HEADER * header,
+		  unsigned int uidvalidity,
+		  size_t(*keylen) (const char *fn),
+		  mutt_hcache_store_flags_t flags)
+{
+  char* data;
+  int dlen;
+  int ret;
+
+  if (!h)
+    return -1;
+
   data = mutt_hcache_dump(h, header, &dlen, uidvalidity, flags);
   ret = mutt_hcache_store_raw (h, filename, data, dlen, keylen);
 
@@ -929,7 +1636,11 @@ mutt_hcache_store_raw (header_cache_t* h, const char* filename, void* data,
   databuf.size = dlen;
   databuf.ulen = dlen;
 
-  return h->db->put(h->db, NULL, &key, &databuf, 0);
+  if (h->db->put(h->db, NULL, &key, &databuf, 0) != 0)
+    return -1;
+  if (h->batch)
+    hcache_batch_stored (h);
+  return 0;
 
 #else
   path = mutt_buffer_pool_get ();
@@ -970,11 +1681,43 @@ mutt_hcache_store_raw (header_cache_t* h, const char* filename, void* data,
   }
 #endif
 
+  if (rv == 0 && h->batch)
+    hcache_batch_stored (h);
+
   mutt_buffer_pool_release (&path);
   return rv;
 #endif
 }
 
+/* Start grouping stores into transactions of $header_cache_batch records
+ * each, until mutt_hcache_commit() or mutt_hcache_close().  This saves a
+ * commit per record for backends that support transactions, and is a
+ * no-op for the others.
+ */
+int
+mutt_hcache_begin (header_cache_t *h)
+{
+  if (!h || h->batch)
+    return -1;
+
+  if (hcache_txn_begin (h) != 0)
+    return -1;
+  h->batch = 1;
+  h->batched = 0;
+
+  return 0;
+}
+
+int
+mutt_hcache_commit (header_cache_t *h)
+{
+  if (!h || !h->batch)
+    return -1;
+
+  h->batch = 0;
+  return hcache_txn_commit (h);
+}
+
 static char* get_foldername (const char *folder)
 {
   char *p = NULL;
@@ -999,6 +1742,92 @@ static char* get_foldername (const char *folder)
   return p;
 }
 
+/* Lets go of a handle on the shared database.  Returns 0 if the handle
+ * has a database of its own instead, which the caller has to close. */
+static int
+hcache_release_shared (header_cache_t *h)
+{
+  if (!h->shared)
+    return 0;
+  if (Shared.txn_owner == h)
+    Shared.txn_owner = NULL;
+  Shared.refs--;
+  return 1;
+}
+
+#if HAVE_KC || HAVE_LMDB
+/* hcache_compact() rebuilds Kyoto Cabinet and LMDB databases into a new
+ * file and renames it over the old one.  Another mutt process with the
+ * old one open would go on using the unlinked file, so every handle
+ * holds a shared lock on a file next to the database, and compaction
+ * only goes ahead when it can make that lock exclusive.  fcntl() locks
+ * belong to the process, so this says nothing about other handles in
+ * this one; those on the shared database are counted in Shared.refs.
+ */
+static int
+hcache_lock_set (int fd, short type, int wait)
+{
+  struct flock lck;
+  int rc;
+
+  memset (&lck, 0, sizeof (lck));
+  lck.l_type = type;
+  lck.l_whence = SEEK_SET;
+  while ((rc = fcntl (fd, wait ? F_SETLKW : F_SETLK, &lck)) == -1 &&
+         errno == EINTR)
+    ;
+  return rc;
+}
+
+/* Takes the shared lock for the database at path, waiting for another
+ * process to finish compacting it.  Without the lock, the handle works
+ * but won't be compacted. */
+static void
+hcache_lock (header_cache_t *h, const char *path)
+{
+  BUFFER *lockfile;
+
+  lockfile = mutt_buffer_pool_get ();
+  mutt_buffer_printf (lockfile, "%s-compact-lock", path);
+  h->lockfd = open (mutt_b2s (lockfile), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (h->lockfd >= 0 && hcache_lock_set (h->lockfd, F_RDLCK, 1) < 0)
+  {
+    close (h->lockfd);
+    h->lockfd = -1;
+  }
+  if (h->lockfd < 0)
+    dprint (1, (debugfile, "hcache_lock: can't lock %s\n", mutt_b2s (lockfile)));
+  mutt_buffer_pool_release (&lockfile);
+}
+
+static void
+hcache_unlock (header_cache_t *h)
+{
+  if (h->lockfd >= 0)
+    close (h->lockfd);
+  h->lockfd = -1;
+}
+
+/* Returns 0 if no other process has the database open.  The lock then
+ * stays exclusive until hcache_compact_unlock(). */
+static int
+hcache_compact_lock (header_cache_t *h)
+{
+  if (h->lockfd < 0 || hcache_lock_set (h->lockfd, F_WRLCK, 0) < 0)
+  {
+    dprint (2, (debugfile, "hcache_compact_lock: database in use elsewhere\n"));
+    return -1;
+  }
+  return 0;
+}
+
+static void
+hcache_compact_unlock (header_cache_t *h)
+{
+  hcache_lock_set (h->lockfd, F_RDLCK, 0);
+}
+#endif /* HAVE_KC || HAVE_LMDB */
+
 #if HAVE_QDBM
 static int
 hcache_open_qdbm (struct header_cache* h, const char* path)
@@ -1021,7 +1850,12 @@ mutt_hcache_close(header_cache_t *h)
   if (!h)
     return;
 
-  vlclose(h->db);
+  hcache_release_record (h);
+
+  if (h->batch)
+    mutt_hcache_commit (h);
+  if (!hcache_release_shared (h))
+    vlclose(h->db);
   FREE(&h->folder);
   FREE(&h);
 }
@@ -1076,14 +1910,21 @@ mutt_hcache_close(header_cache_t *h)
   if (!h)
     return;
 
-  if (!tcbdbclose(h->db))
+  hcache_release_record (h);
+
+  if (h->batch)
+    mutt_hcache_commit (h);
+  if (!hcache_release_shared (h))
   {
+    if (!tcbdbclose(h->db))
+    {
 #ifdef DEBUG
-    int ecode = tcbdbecode (h->db);
-    dprint (2, (debugfile, "tcbdbclose failed for %s: %s (ecode %d)\n", h->folder, tcbdberrmsg (ecode), ecode));
+      int ecode = tcbdbecode (h->db);
+      dprint (2, (debugfile, "tcbdbclose failed for %s: %s (ecode %d)\n", h->folder, tcbdberrmsg (ecode), ecode));
 #endif
+    }
+    tcbdbdel(h->db);
   }
-  tcbdbdel(h->db);
   FREE(&h->folder);
   FREE(&h);
 }
@@ -1153,10 +1994,18 @@ mutt_hcache_close(header_cache_t *h)
   if (!h)
     return;
 
-  if (!kcdbclose(h->db))
-    dprint (2, (debugfile, "kcdbclose failed for %s: %s (ecode %d)\n", h->folder,
-                kcdbemsg (h->db), kcdbecode (h->db)));
-  kcdbdel(h->db);
+  hcache_release_record (h);
+
+  if (h->batch)
+    mutt_hcache_commit (h);
+  if (!hcache_release_shared (h))
+  {
+    if (!kcdbclose(h->db))
+      dprint (2, (debugfile, "kcdbclose failed for %s: %s (ecode %d)\n", h->folder,
+                  kcdbemsg (h->db), kcdbecode (h->db)));
+    kcdbdel(h->db);
+    hcache_unlock (h);
+  }
   FREE(&h->folder);
   FREE(&h);
 }
@@ -1211,7 +2060,10 @@ mutt_hcache_close(header_cache_t *h)
   if (!h)
     return;
 
-  gdbm_close(h->db);
+  hcache_release_record (h);
+
+  if (!hcache_release_shared (h))
+    gdbm_close(h->db);
   FREE(&h->folder);
   FREE(&h);
 }
@@ -1326,6 +2178,8 @@ mutt_hcache_close(header_cache_t *h)
   if (!h)
     return;
 
+  hcache_release_record (h);
+
   h->db->close (h->db, 0);
   h->env->close (h->env, 0);
   mx_unlock_file (mutt_b2s (h->lockfile), h->fd, 0);
@@ -1369,7 +2223,11 @@ hcache_open_lmdb (struct header_cache* h, const char* path)
 
   mdb_env_set_mapsize(h->env, LMDB_DB_SIZE);
 
-  if ((rc = mdb_env_open(h->env, path, MDB_NOSUBDIR, 0644)) != MDB_SUCCESS)
+  /* several handles on the shared database may have read transactions
+   * open in the same thread */
+  if ((rc = mdb_env_open(h->env, path,
+                         MDB_NOSUBDIR | (h->shared ? MDB_NOTLS : 0),
+                         0644)) != MDB_SUCCESS)
   {
     dprint (2, (debugfile, "hcache_open_lmdb: mdb_env_open: %s\n",
                 mdb_strerror(rc)));
@@ -1408,6 +2266,8 @@ mutt_hcache_close(header_cache_t *h)
   if (!h)
     return;
 
+  hcache_release_record (h);
+
   if (h->txn)
   {
     if (h->txn_mode == txn_write)
@@ -1424,7 +2284,11 @@ mutt_hcache_close(header_cache_t *h)
     h->txn = NULL;
   }
 
-  mdb_env_close(h->env);
+  if (!hcache_release_shared (h))
+  {
+    mdb_env_close(h->env);
+    hcache_unlock (h);
+  }
   FREE (&h->folder);
   FREE (&h);
 }
@@ -1469,13 +2333,121 @@ cleanup:
 }
 #endif
 
+/* Opens the database at path, replacing a possibly incompatible one. */
+static int
+hcache_open_path (header_cache_t *h,
+                  int (*hcache_open) (struct header_cache* h, const char* path),
+                  const char *path)
+{
+  struct stat sb;
+
+#if HAVE_KC || HAVE_LMDB
+  hcache_lock (h, path);
+#endif
+  if (hcache_open (h, path))
+  {
+    /* remove a possibly incompatible version */
+    if (stat (path, &sb) ||
+        unlink (path) ||
+        hcache_open (h, path))
+    {
+#if HAVE_KC || HAVE_LMDB
+      hcache_unlock (h);
+#endif
+      return -1;
+    }
+  }
+  return 0;
+}
+
+#if !HAVE_DB4
+static void
+hcache_shared_namer (const char *folder, BUFFER *dest)
+{
+  mutt_buffer_strcpy (dest, "shared.hcache");
+}
+
+/* Makes h a handle on the shared database, opening it if necessary. */
+static int
+hcache_open_shared (header_cache_t *h,
+                    int (*hcache_open) (struct header_cache* h, const char* path),
+                    const char *path)
+{
+  char *folder = h->folder;
+  unsigned int crc = h->crc;
+
+  if (Shared.db && mutt_strcmp (Shared.path, path))
+  {
+    /* $header_cache was changed */
+    if (Shared.refs)
+      return -1;
+    mutt_hcache_shutdown ();
+  }
+
+  if (!Shared.db)
+  {
+    /* Unlike hcache_open_path(), don't take a failure for an
+     * incompatible database: it is more likely to be held open by
+     * another mutt. */
+    h->shared = 1;
+#if HAVE_KC || HAVE_LMDB
+    hcache_lock (h, path);
+#endif
+    if (hcache_open (h, path))
+    {
+      dprint (1, (debugfile, "hcache_open_shared: can't open %s\n", path));
+#if HAVE_KC || HAVE_LMDB
+      hcache_unlock (h);
+#endif
+      return -1;
+    }
+    Shared.db = safe_malloc (sizeof (struct header_cache));
+    memcpy (Shared.db, h, sizeof (struct header_cache));
+    Shared.db->folder = NULL;
+#if HAVE_LMDB
+    /* the transaction of the first handle is its own */
+    Shared.db->txn = NULL;
+    Shared.db->txn_mode = txn_uninitialized;
+#endif
+    Shared.path = safe_strdup (path);
+  }
+  else
+  {
+    memcpy (h, Shared.db, sizeof (struct header_cache));
+    h->folder = folder;
+    h->crc = crc;
+  }
+
+  Shared.refs++;
+  return 0;
+}
+#endif /* !HAVE_DB4 */
+
+/* Closes the shared database, once all handles on it have been closed. */
+void
+mutt_hcache_shutdown (void)
+{
+  if (!Shared.db)
+    return;
+
+  if (Shared.refs)
+    dprint (1, (debugfile, "mutt_hcache_shutdown: %d handles still open\n",
+                Shared.refs));
+  Shared.db->shared = 0;
+  mutt_hcache_close (Shared.db);
+  Shared.db = NULL;
+  Shared.refs = 0;
+  Shared.txn_owner = NULL;
+  FREE (&Shared.path);
+}
+
 header_cache_t *
 mutt_hcache_open(const char *path, const char *folder, hcache_namer_t namer)
 {
   struct header_cache *h = safe_calloc(1, sizeof (struct header_cache));
   int (*hcache_open) (struct header_cache* h, const char* path);
-  struct stat sb;
   BUFFER *hcpath = NULL;
+  int rc;
 
 #if HAVE_QDBM
   hcache_open = hcache_open_qdbm;
@@ -1509,6 +2481,9 @@ mutt_hcache_open(const char *path, const char *folder, hcache_namer_t namer)
     /* Seed with the compiled-in header structure hash */
     md5_process_bytes(&hcachever, sizeof(hcachever), &ctx);
 
+    /* Mix in the record layout */
+    md5_process_bytes(HC_RECORD_FORMAT, sizeof (HC_RECORD_FORMAT), &ctx);
+
     /* Mix in user's spam list */
     for (spam = SpamList; spam; spam = spam->next)
     {
@@ -1543,24 +2518,453 @@ mutt_hcache_open(const char *path, const char *folder, hcache_namer_t namer)
   }
 
   hcpath = mutt_buffer_pool_get ();
-  mutt_hcache_per_folder(hcpath, path, h->folder, namer);
 
-  if (hcache_open (h, mutt_b2s (hcpath)))
+#if !HAVE_DB4
+  /* Berkeley DB keeps each folder in a database of its own anyway */
+  if (option (OPTHCACHESHARED))
   {
-    /* remove a possibly incompatible version */
-    if (stat (mutt_b2s (hcpath), &sb) ||
-        unlink (mutt_b2s (hcpath)) ||
-        hcache_open (h, mutt_b2s (hcpath)))
-    {
-      FREE(&h->folder);
-      FREE(&h);
-    }
+    unsigned char md5sum[16];
+    int i;
+
+    /* Prefix the keys with a digest of the folder name, so that the
+     * prefix of one folder is never the start of another folder's. */
+    md5_buffer (h->folder, strlen (h->folder), &md5sum);
+    mutt_buffer_clear (hcpath);
+    for (i = 0; i < 16; i++)
+      mutt_buffer_add_printf (hcpath, "%02x", md5sum[i]);
+    mutt_buffer_addch (hcpath, ':');
+    mutt_str_replace (&h->folder, mutt_b2s (hcpath));
+
+    mutt_hcache_per_folder (hcpath, path, h->folder, hcache_shared_namer);
+    rc = hcache_open_shared (h, hcache_open, mutt_b2s (hcpath));
+  }
+  else
+#endif
+  {
+    mutt_hcache_per_folder(hcpath, path, h->folder, namer);
+    rc = hcache_open_path (h, hcache_open, mutt_b2s (hcpath));
+  }
+
+  if (rc)
+  {
+    FREE(&h->folder);
+    FREE(&h);
   }
 
   mutt_buffer_pool_release (&hcpath);
   return h;
 }
 
+/* Header cache garbage collection.
+ *
+ * Records of messages that have left a mailbox are only removed when
+ * mutt_hcache_delete() happens to be called for them, so the cache of a
+ * long lived mailbox keeps growing.  mutt_hcache_gc() walks the records
+ * of a folder, asks the mailbox driver whether each key is still in use
+ * and drops the others.  The walk can be done in slices of a bounded
+ * number of records: the key to continue at is kept in the database
+ * itself, under HC_GC_KEY.  Once a pass is complete, the database is
+ * compacted.
+ */
+#define HC_GC_KEY "/GCRESUME"
+
+struct hcache_walk
+{
+  const char *prefix;		/* keys of other folders are skipped */
+  int sorted;			/* keys of a folder are adjacent */
+  int max;			/* keys to look at, 0 for all of them */
+  int seen;
+  char **keys;			/* keys of the folder collected */
+  int nkeys;
+  char *next;			/* key to continue at */
+};
+
+/* Records a key of the walk.  Returns 0 once the walk should stop. */
+static int
+hcache_walk_key (struct hcache_walk *w, const char *kbuf, size_t ksiz)
+{
+  size_t plen = strlen (w->prefix);
+
+  /* the walk of a sorted database starts at the folder's first key */
+  if (w->sorted && (ksiz < plen || strncmp (kbuf, w->prefix, plen)))
+    return 0;
+
+  if (w->max && w->seen == w->max)
+  {
+    w->next = mutt_substrdup (kbuf, kbuf + ksiz);
+    return 0;
+  }
+  w->seen++;
+
+  if (ksiz >= plen && !strncmp (kbuf, w->prefix, plen))
+  {
+    if (w->nkeys % 256 == 0)
+      safe_realloc (&w->keys, (w->nkeys + 256) * sizeof (char *));
+    w->keys[w->nkeys++] = mutt_substrdup (kbuf, kbuf + ksiz);
+  }
+  return 1;
+}
+
+/* Walks the keys of the database starting at from, or at the first one
+ * if from is NULL or, for gdbm, does not exist. */
+static int
+hcache_walk (header_cache_t *h, const char *from, struct hcache_walk *w)
+{
+#if HAVE_QDBM
+  char *kbuf;
+  int ksiz, more = 1;
+
+  w->sorted = 1;
+  if (from ? vlcurjump (h->db, from, strlen (from), VL_JFORWARD) :
+      vlcurfirst (h->db))
+  {
+    do
+    {
+      if (!(kbuf = vlcurkey (h->db, &ksiz)))
+        break;
+      more = hcache_walk_key (w, kbuf, ksiz);
+      free (kbuf);
+    }
+    while (more && vlcurnext (h->db));
+  }
+  return 0;
+#elif HAVE_TC
+  BDBCUR *cur;
+  char *kbuf;
+  int ksiz, more = 1;
+
+  w->sorted = 1;
+  if (!(cur = tcbdbcurnew (h->db)))
+    return -1;
+  if (from ? tcbdbcurjump (cur, from, strlen (from)) : tcbdbcurfirst (cur))
+  {
+    do
+    {
+      if (!(kbuf = tcbdbcurkey (cur, &ksiz)))
+        break;
+      more = hcache_walk_key (w, kbuf, ksiz);
+      tcfree (kbuf);
+    }
+    while (more && tcbdbcurnext (cur));
+  }
+  tcbdbcurdel (cur);
+  return 0;
+#elif HAVE_KC
+  KCCUR *cur;
+  char *kbuf;
+  size_t ksiz;
+  int more = 1;
+
+  w->sorted = 1;
+  if (!(cur = kcdbcursor (h->db)))
+    return -1;
+  if (from ? kccurjumpkey (cur, from, strlen (from)) : kccurjump (cur))
+  {
+    while (more && (kbuf = kccurgetkey (cur, &ksiz, 1)))
+    {
+      more = hcache_walk_key (w, kbuf, ksiz);
+      kcfree (kbuf);
+    }
+  }
+  kccurdel (cur);
+  return 0;
+#elif HAVE_GDBM
+  datum key, next;
+  int own = 0, more = 1;
+
+  key.dptr = (char *) from;
+  key.dsize = mutt_strlen (from);
+  if (!from || !gdbm_exists (h->db, key))
+  {
+    key = gdbm_firstkey (h->db);
+    own = 1;
+  }
+
+  while (key.dptr)
+  {
+    next.dptr = NULL;
+    if ((more = hcache_walk_key (w, key.dptr, key.dsize)))
+      next = gdbm_nextkey (h->db, key);
+    if (own)
+      free (key.dptr);
+    key = next;
+    own = 1;
+  }
+  return 0;
+#elif HAVE_DB4
+  DBC *cur;
+  DBT key, data;
+  int rc;
+
+  w->sorted = 1;
+  if (h->db->cursor (h->db, NULL, &cur, 0))
+    return -1;
+
+  mutt_hcache_dbt_empty_init (&key);
+  key.flags = DB_DBT_REALLOC;
+  if (from)
+  {
+    key.data = safe_strdup (from);
+    key.size = strlen (from);
+  }
+  mutt_hcache_dbt_empty_init (&data);
+  data.flags = DB_DBT_PARTIAL;
+
+  rc = cur->c_get (cur, &key, &data, from ? DB_SET_RANGE : DB_FIRST);
+  while (!rc && hcache_walk_key (w, key.data, key.size))
+    rc = cur->c_get (cur, &key, &data, DB_NEXT);
+
+  FREE (&key.data);
+  cur->c_close (cur);
+  return 0;
+#elif HAVE_LMDB
+  MDB_cursor *cur;
+  MDB_val key, data;
+  int rc;
+
+  w->sorted = 1;
+  if (mdb_get_r_txn (h) != MDB_SUCCESS ||
+      mdb_cursor_open (h->txn, h->db, &cur) != MDB_SUCCESS)
+    return -1;
+
+  key.mv_data = (void *) from;
+  key.mv_size = mutt_strlen (from);
+  rc = mdb_cursor_get (cur, &key, &data, from ? MDB_SET_RANGE : MDB_FIRST);
+  while (rc == MDB_SUCCESS && hcache_walk_key (w, key.mv_data, key.mv_size))
+    rc = mdb_cursor_get (cur, &key, &data, MDB_NEXT);
+
+  mdb_cursor_close (cur);
+  return 0;
+#endif
+}
+
+static LOFF_T
+hcache_size (header_cache_t *h)
+{
+#if HAVE_QDBM
+  return vlfsiz (h->db);
+#elif HAVE_TC
+  return tcbdbfsiz (h->db);
+#elif HAVE_KC
+  return kcdbsize (h->db);
+#else
+  struct stat sb;
+  int fd;
+
+#if HAVE_GDBM
+  fd = gdbm_fdesc (h->db);
+#elif HAVE_DB4
+  if (h->db->fd (h->db, &fd))
+    return -1;
+#elif HAVE_LMDB
+  if (mdb_env_get_fd (h->env, &fd) != MDB_SUCCESS)
+    return -1;
+#endif
+  if (fstat (fd, &sb) < 0)
+    return -1;
+  return sb.st_size;
+#endif
+}
+
+/* Rewrites the database without the space left by removed records. */
+static int
+hcache_compact (header_cache_t *h)
+{
+#if HAVE_QDBM
+  return vloptimize (h->db) ? 0 : -1;
+#elif HAVE_TC
+  return tcbdboptimize (h->db, 0, 0, 0, -1, -1, UINT8_MAX) ? 0 : -1;
+#elif HAVE_KC
+  /* there is no defragmentation call in the C API: copy the records
+   * into a new database and replace the old one with it */
+  KCDB *db;
+  BUFFER *tmp;
+  char *path;
+  int rc = -1;
+
+  /* other handles on the database would keep the old one */
+  if ((h->shared && Shared.refs > 1) || hcache_compact_lock (h))
+    return -1;
+  if (!(path = kcdbpath (h->db)))
+  {
+    hcache_compact_unlock (h);
+    return -1;
+  }
+  tmp = mutt_buffer_pool_get ();
+  mutt_buffer_printf (tmp, "%s.compact#type=kct%s", path,
+                      option(OPTHCACHECOMPRESS) ? "#opts=c" : "");
+
+  if ((db = kcdbnew ()) == NULL)
+    goto out;
+  if (!kcdbopen (db, mutt_b2s (tmp), KCOWRITER | KCOCREATE | KCOTRUNCATE))
+  {
+    kcdbdel (db);
+    goto out;
+  }
+  rc = kcdbmerge (db, &h->db, 1, KCMSET) ? 0 : -1;
+  if (!kcdbclose (db))
+    rc = -1;
+  kcdbdel (db);
+
+  mutt_buffer_printf (tmp, "%s.compact", path);
+  if (rc == 0)
+  {
+    kcdbclose (h->db);
+    kcdbdel (h->db);
+    rc = rename (mutt_b2s (tmp), path);
+    if (hcache_open_kc (h, path))
+    {
+      h->db = NULL;
+      rc = -1;
+    }
+    if (h->shared)
+      Shared.db->db = h->db;
+  }
+  if (rc)
+    unlink (mutt_b2s (tmp));
+
+out:
+  hcache_compact_unlock (h);
+  mutt_buffer_pool_release (&tmp);
+  kcfree (path);
+  return rc;
+#elif HAVE_GDBM
+  return gdbm_reorganize (h->db);
+#elif HAVE_DB4
+  return h->db->compact (h->db, NULL, NULL, NULL, NULL, DB_FREE_SPACE, NULL);
+#elif HAVE_LMDB
+  /* a compacting copy drops the free pages */
+  const char *p;
+  char *path = NULL;
+  BUFFER *tmp;
+  int rc = -1;
+
+  /* other handles on the database would keep the old one */
+  if ((h->shared && Shared.refs > 1) || hcache_compact_lock (h))
+    return -1;
+
+  if (h->txn)
+  {
+    if (h->txn_mode == txn_write)
+      mdb_txn_commit (h->txn);
+    else
+      mdb_txn_abort (h->txn);
+    h->txn_mode = txn_uninitialized;
+    h->txn = NULL;
+  }
+
+  if (mdb_env_get_path (h->env, &p) != MDB_SUCCESS)
+  {
+    hcache_compact_unlock (h);
+    return -1;
+  }
+  path = safe_strdup (p);
+  tmp = mutt_buffer_pool_get ();
+  mutt_buffer_printf (tmp, "%s.compact", path);
+  unlink (mutt_b2s (tmp));
+
+  if ((rc = mdb_env_copy2 (h->env, mutt_b2s (tmp), MDB_CP_COMPACT)) != MDB_SUCCESS)
+  {
+    dprint (2, (debugfile, "hcache_compact: mdb_env_copy2: %s\n",
+                mdb_strerror (rc)));
+    unlink (mutt_b2s (tmp));
+    rc = -1;
+    goto out;
+  }
+
+  mdb_env_close (h->env);
+  if ((rc = rename (mutt_b2s (tmp), path)) != 0)
+    unlink (mutt_b2s (tmp));
+  if (hcache_open_lmdb (h, path))
+  {
+    h->env = NULL;
+    rc = -1;
+  }
+  if (h->shared)
+  {
+    Shared.db->env = h->env;
+    Shared.db->db = h->db;
+  }
+
+out:
+  hcache_compact_unlock (h);
+  mutt_buffer_pool_release (&tmp);
+  FREE (&path);
+  return rc;
+#endif
+}
+
+/* Removes the records of this folder for which live() returns 0.  It is
+ * passed each key without the leading '/', if any.  At most budget keys
+ * are looked at, or all of them if budget is 0.  The number of records
+ * removed is added to *removed, and once the pass is complete, the space
+ * given back by compacting the database to *reclaimed.
+ *
+ * Returns 1 if the pass is not complete yet, 0 if it is, -1 on error.
+ */
+int
+mutt_hcache_gc (header_cache_t *h, hcache_live_t live, void *data,
+                int budget, int *removed, LOFF_T *reclaimed)
+{
+  struct hcache_walk w;
+  char *from = NULL;
+  void *resume;
+  const char *key;
+  LOFF_T size, after;
+  int i, rc = -1;
+
+  if (!h || h->batch)
+    return -1;
+
+  memset (&w, 0, sizeof (w));
+  w.max = budget;
+#if HAVE_DB4
+  w.prefix = "";
+#else
+  w.prefix = h->folder;
+#endif
+
+  if ((resume = mutt_hcache_fetch_raw (h, HC_GC_KEY, strlen)))
+  {
+    from = safe_strdup (resume);
+    mutt_hcache_free (&resume);
+  }
+
+  if (hcache_walk (h, from ? from : (*w.prefix ? w.prefix : NULL), &w) < 0)
+    goto out;
+
+  for (i = 0; i < w.nkeys; i++)
+  {
+    key = w.keys[i] + strlen (w.prefix);
+    if (!mutt_strcmp (key + (*key == '/'), HC_GC_KEY + 1) ||
+        live (key + (*key == '/'), data))
+      continue;
+    mutt_hcache_delete (h, key, strlen);
+    (*removed)++;
+  }
+
+  if (w.next)
+  {
+    mutt_hcache_store_raw (h, HC_GC_KEY, w.next, strlen (w.next) + 1, strlen);
+    rc = 1;
+    goto out;
+  }
+
+  mutt_hcache_delete (h, HC_GC_KEY, strlen);
+  size = hcache_size (h);
+  if (hcache_compact (h) == 0 && (after = hcache_size (h)) >= 0 && size > after)
+    *reclaimed += size - after;
+  rc = 0;
+
+out:
+  for (i = 0; i < w.nkeys; i++)
+    FREE (&w.keys[i]);
+  FREE (&w.keys);
+  FREE (&w.next);
+  FREE (&from);
+  return rc;
+}
+
 void mutt_hcache_free (void **data)
 {
   if (!data || !*data)
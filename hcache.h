@@ -46,6 +46,19 @@ int mutt_hcache_store_raw (header_cache_t *h, const char* filename, void* data,
                            size_t dlen, size_t(*keylen) (const char* fn));
 int mutt_hcache_delete(header_cache_t *h, const char *filename, size_t (*keylen)(const char *fn));
 
+/* group the stores in between into $header_cache_batch sized transactions */
+int mutt_hcache_begin (header_cache_t *h);
+int mutt_hcache_commit (header_cache_t *h);
+
+void mutt_hcache_shutdown (void);
+
+/* drop the records of messages no longer in the folder */
+typedef int (*hcache_live_t)(const char *key, void *data);
+int mutt_hcache_gc (header_cache_t *h, hcache_live_t live, void *data,
+                    int budget, int *removed, LOFF_T *reclaimed);
+
 const char *mutt_hcache_backend (void);
+const char *mutt_hcache_compress_methods (void);
+int mutt_hcache_codec (const char *method);
 
 #endif /* _HCACHE_H_ */
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Measures how fast headers are stored in the header cache, one store
+ * at a time and batched with mutt_hcache_begin(), then reads them back
+ * to check them.  "make check" builds it but doesn't run it:
+ *
+ *   ./hcache_bench [messages [command ...]]
+ *
+ * The default is 100000 messages, each stored in a new cache.  The
+ * commands are run as with -e, eg to set $header_cache_compress_method.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mime.h"
+#include "mutt_test.h"
+
+#ifdef USE_HCACHE
+#include "hcache.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef USE_HCACHE
+/* a header like those of a typical mailing list message */
+static HEADER *bench_header (int i)
+{
+  HEADER *h;
+  char buf[STRING];
+
+  h = mutt_new_header ();
+  h->env = mutt_new_envelope ();
+  h->content = mutt_new_body ();
+
+  snprintf (buf, sizeof (buf), "Sender %d <sender%d@example.com>", i % 97, i % 97);
+  h->env->from = rfc822_parse_adrlist (NULL, buf);
+  h->env->to = rfc822_parse_adrlist (NULL, "list@lists.example.org");
+  h->env->cc = rfc822_parse_adrlist (NULL, "Someone Else <else@example.net>");
+  snprintf (buf, sizeof (buf), "Re: [list] discussion number %d", i / 10);
+  h->env->subject = safe_strdup (buf);
+  h->env->real_subj = h->env->subject + 4;
+  snprintf (buf, sizeof (buf), "<%d.bench@example.com>", i);
+  h->env->message_id = safe_strdup (buf);
+  if (i % 10)
+  {
+    snprintf (buf, sizeof (buf), "<%d.bench@example.com>", i - 1);
+    h->env->in_reply_to = mutt_add_list (NULL, buf);
+    h->env->references = mutt_add_list (NULL, buf);
+  }
+  h->env->list_post = safe_strdup ("mailto:list@lists.example.org");
+
+  h->content->type = TYPETEXT;
+  h->content->subtype = safe_strdup ("plain");
+  mutt_set_parameter ("charset", "us-ascii", &h->content->parameter);
+  h->content->encoding = ENC7BIT;
+  h->content->offset = 1200;
+  h->content->length = 1000 + i % 4000;
+
+  h->date_sent = 1767225600 + i * 60;
+  h->received = h->date_sent + 5;
+  h->lines = 20 + i % 80;
+  h->read = i % 3 != 0;
+  h->index = i;
+
+  return h;
+}
+
+/* stores n headers in a new cache in dir, returns the time taken */
+static double bench_store (const char *dir, const char *folder, HEADER **hdrs,
+                           int n, int batch)
+{
+  header_cache_t *hc;
+  char key[SHORT_STRING];
+  double start;
+  int i;
+
+  start = mutt_test_now ();
+  if (!(hc = mutt_hcache_open (dir, folder, NULL)))
+    return -1;
+  if (batch)
+    mutt_hcache_begin (hc);
+  for (i = 0; i < n; i++)
+  {
+    snprintf (key, sizeof (key), "/%d", i);
+    mutt_hcache_store (hc, key, hdrs[i], 0, strlen, 0);
+  }
+  if (batch)
+    mutt_hcache_commit (hc);
+  mutt_hcache_close (hc);
+  return mutt_test_now () - start;
+}
+
+/* reads the headers back, returns the number that don't match */
+static int bench_check (const char *dir, const char *folder, HEADER **hdrs,
+                        int n, double *elapsed)
+{
+  header_cache_t *hc;
+  HEADER *h;
+  void *data;
+  char key[SHORT_STRING];
+  double start;
+  int i, bad = 0;
+
+  *elapsed = 0;
+  start = mutt_test_now ();
+  if (!(hc = mutt_hcache_open (dir, folder, NULL)))
+    return n;
+  for (i = 0; i < n; i++)
+  {
+    snprintf (key, sizeof (key), "/%d", i);
+    if (!(data = mutt_hcache_fetch (hc, key, strlen)))
+    {
+      bad++;
+      continue;
+    }
+    h = mutt_hcache_restore ((unsigned char *) data, NULL);
+    if (mutt_strcmp (h->env->message_id, hdrs[i]->env->message_id) ||
+        mutt_strcmp (h->env->subject, hdrs[i]->env->subject) ||
+        h->content->length != hdrs[i]->content->length ||
+        h->read != hdrs[i]->read)
+      bad++;
+    mutt_free_header (&h);
+  }
+  mutt_hcache_close (hc);
+  *elapsed = mutt_test_now () - start;
+  return bad;
+}
+#endif /* USE_HCACHE */
+
+int main (int argc, char **argv)
+{
+#ifdef USE_HCACHE
+  BUFFER *dir;
+  LIST *commands = NULL;
+  HEADER **hdrs;
+  double plain, batched, fetched;
+  int i, n, bad;
+
+  n = argc > 1 ? atoi (argv[1]) : 100000;
+  if (n < 1)
+  {
+    fprintf (stderr, "usage: %s [messages [command ...]]\n", argv[0]);
+    return 1;
+  }
+
+  for (i = 2; i < argc; i++)
+    commands = mutt_add_list (commands, argv[i]);
+  mutt_test_init (commands);
+  mutt_free_list (&commands);
+
+  dir = mutt_buffer_new ();
+  mutt_buffer_printf (dir, "%s/mutt-hcache-bench-XXXXXX", NONULL (Tempdir));
+  if (!mkdtemp (dir->data))
+  {
+    mutt_perror (mutt_b2s (dir));
+    return 1;
+  }
+  mutt_buffer_addch (dir, '/');
+
+  hdrs = safe_calloc (n, sizeof (HEADER *));
+  for (i = 0; i < n; i++)
+    hdrs[i] = bench_header (i);
+
+  printf ("backend %s, %d messages, $header_cache_batch %d\n",
+          mutt_hcache_backend (), n, HeaderCacheBatch);
+  plain = bench_store (mutt_b2s (dir), "/bench/plain", hdrs, n, 0);
+  batched = bench_store (mutt_b2s (dir), "/bench/batched", hdrs, n, 1);
+  bad = bench_check (mutt_b2s (dir), "/bench/batched", hdrs, n, &fetched);
+
+  if (plain > 0)
+    printf ("store:          %10.0f headers/s\n", n / plain);
+  if (batched > 0)
+    printf ("store, batched: %10.0f headers/s\n", n / batched);
+  if (fetched > 0)
+    printf ("fetch:          %10.0f headers/s\n", n / fetched);
+  if (bad)
+    fprintf (stderr, "%d of %d headers didn't read back\n", bad, n);
+
+  for (i = 0; i < n; i++)
+    mutt_free_header (&hdrs[i]);
+  FREE (&hdrs);
+  mutt_rmtree (mutt_b2s (dir));
+  mutt_buffer_free (&dir);
+
+  return (plain < 0 || batched < 0 || bad) ? 1 : 0;
+#else
+  printf ("%s: the header cache isn't compiled in\n", argv[0]);
+  return MUTT_TEST_SKIP;
+#endif
+}
@@ -117,6 +117,9 @@ static void make_from (ENVELOPE *hdr, char *buf, size_t len, int do_lists)
       return;
   }
 
+  if (me && !hdr->to && !hdr->cc)
+    mutt_env_load_lazy (hdr);
+
   if (me && hdr->to)
     snprintf (buf, len, "To %s", mutt_get_name (hdr->to));
   else if (me && hdr->cc)
@@ -280,6 +283,7 @@ hdr_format_str (char *dest,
   switch (op)
   {
     case 'A':
+      mutt_env_load_lazy (hdr->env);
       if (hdr->env->reply_to && hdr->env->reply_to->mailbox)
       {
 	mutt_format_s (dest, destlen, prefix, mutt_addr_for_display (hdr->env->reply_to));
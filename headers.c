@@ -297,12 +297,14 @@ static int label_message(CONTEXT *ctx, HEADER *hdr, char *new)
 
   if (hdr->env->x_label != NULL)
     label_ref_dec(ctx, hdr->env->x_label);
-  mutt_str_replace (&hdr->env->x_label, new);
+  mutt_str_release (&hdr->env->x_label);
+  hdr->env->x_label = mutt_str_intern (new);
   if (hdr->env->x_label != NULL)
     label_ref_inc(ctx, hdr->env->x_label);
 
   hdr->changed = 1;
   hdr->env->changed |= MUTT_ENV_CHANGED_XLABEL;
+  hdr->search_known = 0;
   return 1;
 }
 
@@ -581,8 +581,10 @@ void mutt_default_save (char *path, size_t pathlen, HEADER *hdr)
     BUFFER *tmp = NULL;
     ADDRESS *adr;
     ENVELOPE *env = hdr->env;
-    int fromMe = mutt_addr_is_user (env->from);
+    int fromMe;
 
+    mutt_env_load_lazy (env);
+    fromMe = mutt_addr_is_user (env->from);
     if (!fromMe && env->reply_to && env->reply_to->mailbox)
       adr = env->reply_to;
     else if (!fromMe && env->from && env->from->mailbox)
@@ -34,12 +34,15 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #define IMAP_CMD_BUFSIZE 512
 
 /* forward declarations */
 static int cmd_start (IMAP_DATA* idata, const char* cmdstr, int flags);
+static unsigned long long cmd_usecs (void);
 static int cmd_queue_full (IMAP_DATA* idata);
+static void cmd_adapt_window (IMAP_DATA* idata, unsigned long long usecs);
 static int cmd_queue (IMAP_DATA* idata, const char* cmdstr, int flags);
 static IMAP_COMMAND* cmd_new (IMAP_DATA* idata);
 static int cmd_status (const char *s);
@@ -183,6 +186,9 @@ int imap_cmd_step (IMAP_DATA* idata)
 	/* bogus - we don't know which command result to return here. Caller
 	 * should provide a tag. */
 	rc = cmd->state;
+	idata->pipeline_batch++;
+	if (rc != IMAP_CMD_OK)
+	  idata->pipeline_failed++;
       }
       else
 	stillrunning++;
@@ -197,6 +203,11 @@ int imap_cmd_step (IMAP_DATA* idata)
   else
   {
     dprint (3, (debugfile, "IMAP queue drained\n"));
+    if (idata->pipeline_start)
+    {
+      cmd_adapt_window (idata, cmd_usecs () - idata->pipeline_start);
+      idata->pipeline_start = 0;
+    }
     imap_cmd_finish (idata);
   }
 
@@ -308,7 +319,9 @@ void imap_cmd_finish (IMAP_DATA* idata)
     return;
   }
 
-  if (!(idata->state >= IMAP_SELECTED) || idata->ctx->closing)
+  /* the extra connections of a parallel header download are selected
+   * without a context of their own */
+  if (!(idata->state >= IMAP_SELECTED) || !idata->ctx || idata->ctx->closing)
     return;
 
   if (idata->reopen & IMAP_REOPEN_ALLOW)
@@ -361,6 +374,8 @@ int imap_cmd_idle (IMAP_DATA* idata)
   {
     /* successfully entered IDLE state */
     idata->state = IMAP_IDLE;
+    /* IDLE stays in the queue until the next command: don't time it */
+    idata->pipeline_start = 0;
     /* queue automatic exit when next command is issued */
     mutt_buffer_addstr (idata->cmdbuf, "DONE\r\n");
     rc = IMAP_CMD_OK;
@@ -374,14 +389,84 @@ int imap_cmd_idle (IMAP_DATA* idata)
   return 0;
 }
 
+static unsigned long long cmd_usecs (void)
+{
+  struct timeval tv;
+
+  if (gettimeofday (&tv, NULL) < 0)
+    return 0;
+  return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
 static int cmd_queue_full (IMAP_DATA* idata)
 {
+  int queued;
+
   if ((idata->nextcmd + 1) % idata->cmdslots == idata->lastcmd)
     return 1;
 
+  /* the adaptive window is usually smaller than the command ring */
+  queued = (idata->nextcmd - idata->lastcmd + idata->cmdslots) % idata->cmdslots;
+  if (queued > idata->pipeline_window)
+    return 1;
+
+  if (mutt_buffer_len (idata->cmdbuf) >= IMAP_PIPELINE_BYTES)
+    return 1;
+
   return 0;
 }
 
+/* imap_cmd_queue_full: returns 1 if queueing another command would first
+ * flush the pipeline and wait for its responses.  Callers that parse the
+ * responses to their queued commands themselves must stop queueing then. */
+int imap_cmd_queue_full (IMAP_DATA* idata)
+{
+  return cmd_queue_full (idata);
+}
+
+/* cmd_adapt_window: resize the pipeline after a batch of commands was
+ * sent and fully answered in usecs microseconds.
+ *
+ * Only batches that used the whole window say anything about it.  While
+ * doubling the window keeps lowering the time per command, the
+ * connection is bound by latency rather than by the server, so the
+ * window keeps growing.  Once that stops paying off it is held.  A batch
+ * that got much slower per command, or that had failed commands, shrinks
+ * it again. */
+static void cmd_adapt_window (IMAP_DATA* idata, unsigned long long usecs)
+{
+  int n = idata->pipeline_batch;
+  int max = idata->cmdslots - 2;
+  int window = idata->pipeline_window;
+  unsigned long cost;
+
+  if (ImapPipelineDepth <= 0 || n < 1)
+    return;
+
+  if (idata->pipeline_failed)
+  {
+    window = MAX (window / 2, 1);
+    idata->pipeline_cost = 0;
+  }
+  else if (n >= window)
+  {
+    cost = usecs / n;
+    if (!idata->pipeline_cost || cost * 10 < idata->pipeline_cost * 9)
+      window = MIN (window * 2, max);
+    else if (cost > idata->pipeline_cost * 2)
+      window = MAX (window * 3 / 4, 1);
+    idata->pipeline_cost = cost;
+  }
+
+  if (window != idata->pipeline_window)
+  {
+    dprint (3, (debugfile, "cmd_adapt_window: %d commands in %llu usecs, "
+                "pipeline window %d -> %d\n", n, usecs,
+                idata->pipeline_window, window));
+    idata->pipeline_window = window;
+  }
+}
+
 /* sets up a new command control block and adds it to the queue.
  * Returns NULL if the pipeline is full. */
 static IMAP_COMMAND* cmd_new (IMAP_DATA* idata)
@@ -450,6 +535,13 @@ static int cmd_start (IMAP_DATA* idata, const char* cmdstr, int flags)
   if (mutt_buffer_len (idata->cmdbuf) == 0)
     return IMAP_CMD_BAD;
 
+  /* time the batch from the first write until the queue drains */
+  if (!idata->pipeline_start)
+  {
+    idata->pipeline_start = cmd_usecs ();
+    idata->pipeline_batch = idata->pipeline_failed = 0;
+  }
+
   rc = mutt_socket_write_d (idata->conn, idata->cmdbuf->data, -1,
                             flags & IMAP_CMD_PASS ? IMAP_LOG_PASS : IMAP_LOG_CMD);
   mutt_buffer_clear (idata->cmdbuf);
@@ -574,6 +574,8 @@ void imap_close_connection(IMAP_DATA* idata)
   }
   idata->seqno = idata->nextcmd = idata->lastcmd = idata->status = 0;
   memset (idata->cmds, 0, sizeof (IMAP_COMMAND) * idata->cmdslots);
+  idata->pipeline_batch = idata->pipeline_failed = 0;
+  idata->pipeline_start = 0;
 }
 
 /* Try to reconnect and merge current state back in.
@@ -632,6 +634,8 @@ int imap_reconnect (IMAP_DATA **p_idata)
          * parts of the code but I don't know why yet. */
         if (old_hdr->env && old_hdr->env->changed)
         {
+          mutt_env_load_lazy (old_hdr->env);
+          mutt_env_load_lazy (new_hdr->env);
           new_hdr->env->changed = old_hdr->env->changed;
           new_hdr->changed = 1;
           new_ctx.changed = 1;
@@ -650,7 +654,7 @@ int imap_reconnect (IMAP_DATA **p_idata)
           }
           if (old_hdr->env->changed & MUTT_ENV_CHANGED_XLABEL)
           {
-            FREE (&new_hdr->env->x_label);
+            mutt_str_release (&new_hdr->env->x_label);
             new_hdr->env->x_label = old_hdr->env->x_label;
             old_hdr->env->x_label = NULL;
           }
@@ -770,7 +774,11 @@ static char* imap_get_flags (LIST** hflags, char* s)
   return s;
 }
 
-static int imap_open_mailbox (CONTEXT* ctx)
+/* imap_select_mailbox: SELECT (or EXAMINE) ctx->path and read its headers.
+ * prefetch is set when called from imap_prefetch(), which only wants the
+ * header cache filled: the download then gives way to keystrokes and
+ * failures are not reported to the user. */
+static int imap_select_mailbox (CONTEXT* ctx, int prefetch)
 {
   IMAP_DATA *idata;
   IMAP_STATUS* status;
@@ -793,6 +801,7 @@ static int imap_open_mailbox (CONTEXT* ctx)
 
   /* once again the context is new */
   ctx->data = idata;
+  idata->prefetch = prefetch;
 
   /* Clean up path and replace the one in the ctx */
   imap_fix_path (idata, mx.mbox, buf, sizeof (buf));
@@ -946,8 +955,14 @@ static int imap_open_mailbox (CONTEXT* ctx)
     char *s;
     s = imap_next_word (idata->buf); /* skip seq */
     s = imap_next_word (s); /* Skip response */
-    mutt_error ("%s", s);
-    mutt_sleep (2);
+    if (prefetch)
+      dprint (1, (debugfile, "imap_select_mailbox: prefetch of %s refused: %s\n",
+                  idata->mailbox, s));
+    else
+    {
+      mutt_error ("%s", s);
+      mutt_sleep (2);
+    }
     goto fail;
   }
 
@@ -998,8 +1013,11 @@ static int imap_open_mailbox (CONTEXT* ctx)
 
   if (count && (imap_read_headers (idata, 1, count, 1) < 0))
   {
-    mutt_error _("Error opening mailbox");
-    mutt_sleep (1);
+    if (!prefetch)
+    {
+      mutt_error _("Error opening mailbox");
+      mutt_sleep (1);
+    }
     goto fail;
   }
 
@@ -1011,12 +1029,22 @@ static int imap_open_mailbox (CONTEXT* ctx)
 
 fail:
   if (idata->state == IMAP_SELECTED)
+  {
+    /* don't leave an abandoned prefetch selected on the server */
+    if (prefetch && idata->status != IMAP_FATAL)
+      imap_exec (idata, "CLOSE", IMAP_CMD_FAIL_OK);
     idata->state = IMAP_AUTHENTICATED;
+  }
 fail_noidata:
   FREE (&mx.mbox);
   return -1;
 }
 
+static int imap_open_mailbox (CONTEXT* ctx)
+{
+  return imap_select_mailbox (ctx, 0);
+}
+
 static int imap_open_mailbox_append (CONTEXT *ctx, int flags)
 {
   IMAP_DATA *idata;
@@ -1735,6 +1763,7 @@ int imap_close_mailbox (CONTEXT* ctx)
 
     idata->check_status = 0;
     idata->reopen = 0;
+    idata->prefetch = 0;
     FREE (&(idata->mailbox));
     mutt_free_list (&idata->flags);
     idata->ctx = NULL;
@@ -1876,6 +1905,44 @@ static int imap_save_to_header_cache (CONTEXT *ctx, HEADER *h)
   return rc;
 }
 
+#ifdef USE_HCACHE
+/* Only message records are dropped, not the mailbox state. */
+static int imap_hcache_live (const char *key, void *data)
+{
+  IMAP_DATA *idata = (IMAP_DATA *) data;
+  unsigned int uid;
+  int n = 0;
+
+  if (!isdigit ((unsigned char) *key) ||
+      sscanf (key, "%u%n", &uid, &n) != 1 || key[n])
+    return 1;
+  return int_hash_find (idata->uid_hash, uid) != NULL;
+}
+#endif
+
+/* Drops header cache records of messages expunged from the mailbox. */
+static int imap_gc_header_cache (CONTEXT *ctx, int budget, int *removed,
+                                 LOFF_T *reclaimed)
+{
+  int rc = -1;
+#ifdef USE_HCACHE
+  int close_hc = 1;
+  IMAP_DATA* idata;
+
+  idata = (IMAP_DATA *)ctx->data;
+  if (idata->hcache)
+    close_hc = 0;
+  else
+    idata->hcache = imap_hcache_open (idata, NULL);
+  if (idata->hcache)
+    rc = mutt_hcache_gc (idata->hcache, imap_hcache_live, idata, budget,
+                         removed, reclaimed);
+  if (close_hc)
+    imap_hcache_close (idata);
+#endif
+  return rc;
+}
+
 /* split path into (idata,mailbox name) */
 static int imap_get_mailbox (const char* path, IMAP_DATA** hidata, char* buf, size_t blen)
 {
@@ -1995,6 +2062,133 @@ int imap_buffy_check (int force, int check_stats)
   return buffies;
 }
 
+#if USE_HCACHE
+/* Mailboxes imap_prefetch() has completed this session, and those it
+ * failed to open and won't try again. */
+static LIST *PrefetchDone = NULL;
+static LIST *PrefetchFailed = NULL;
+
+/* Returns 1 if the header cache of mailbox name is behind the server.
+ * The last STATUS response from the buffy check is compared with the
+ * UIDVALIDITY and UIDNEXT stored in the cache.  Without one, each
+ * mailbox is prefetched once per session. */
+static int imap_prefetch_stale (IMAP_DATA* idata, const char* name,
+                                const char* path)
+{
+  header_cache_t *hc;
+  IMAP_STATUS *status;
+  void *data;
+  unsigned int uidvalidity = 0, uidnext = 0;
+
+  if (!(hc = imap_hcache_open (idata, name)))
+    return 0;
+  if ((data = mutt_hcache_fetch_raw (hc, "/UIDVALIDITY", imap_hcache_keylen)))
+  {
+    memcpy (&uidvalidity, data, sizeof (unsigned int));
+    mutt_hcache_free (&data);
+  }
+  if ((data = mutt_hcache_fetch_raw (hc, "/UIDNEXT", imap_hcache_keylen)))
+  {
+    memcpy (&uidnext, data, sizeof (unsigned int));
+    mutt_hcache_free (&data);
+  }
+  mutt_hcache_close (hc);
+
+  if (!uidnext)
+    return mutt_find_list (PrefetchDone, path) == NULL;
+
+  status = imap_mboxcache_get (idata, name, 0);
+  if (status && status->uidvalidity && status->uidnext)
+    return status->uidvalidity != uidvalidity || status->uidnext > uidnext;
+
+  return mutt_find_list (PrefetchDone, path) == NULL;
+}
+#endif /* USE_HCACHE */
+
+/* imap_prefetch: fill the header cache of the next IMAP mailbox in the
+ * $mailboxes list whose cache is out of date, while the user is idle.
+ * The mailbox is EXAMINEd over a connection other than the one holding
+ * the current mailbox, and closed again before returning.  The download
+ * stops early if a key is pressed.
+ *
+ * Returns 1 if a mailbox was (at least partly) prefetched, 0 if there
+ * is nothing left to do. */
+int imap_prefetch (void)
+{
+#if USE_HCACHE
+  BUFFY *b;
+  IMAP_MBOX mx;
+  IMAP_DATA *idata, *cidata = NULL;
+  CONTEXT *ctx;
+  char name[LONG_STRING];
+  const char *path;
+
+  if (!option (OPTIMAPPREFETCH) || !HeaderCache)
+    return 0;
+
+  if (Context && Context->magic == MUTT_IMAP)
+    cidata = (IMAP_DATA*) Context->data;
+
+  for (b = Incoming; b; b = b->next)
+  {
+    path = mutt_b2s (b->pathbuf);
+    if (!b->magic && mx_is_imap (path))
+      b->magic = MUTT_IMAP;
+    if (b->magic != MUTT_IMAP || b->nopoll)
+      continue;
+
+    if (mutt_find_list (PrefetchFailed, path) ||
+        imap_parse_path (path, &mx))
+      continue;
+
+    /* only use accounts we are already logged in to: no password prompts
+     * while the user is away */
+    if (!(idata = imap_conn_find (&mx.account, MUTT_IMAP_CONN_NONEW)))
+    {
+      FREE (&mx.mbox);
+      continue;
+    }
+    imap_fix_path (idata, mx.mbox, name, sizeof (name));
+    if (!*name)
+      strfcpy (name, "INBOX", sizeof (name));
+    FREE (&mx.mbox);
+
+    if (cidata && cidata->mailbox &&
+        imap_account_match (&cidata->conn->account, &idata->conn->account) &&
+        !imap_mxcmp (name, cidata->mailbox))
+      continue;
+
+    if (!imap_prefetch_stale (idata, name, path))
+      continue;
+
+    dprint (2, (debugfile, "imap_prefetch: fetching headers of %s\n", path));
+
+    ctx = safe_calloc (1, sizeof (CONTEXT));
+    ctx->path = safe_strdup (path);
+    ctx->magic = MUTT_IMAP;
+    ctx->mx_ops = &mx_imap_ops;
+    ctx->msgnotreadyet = -1;
+    ctx->quiet = 1;
+    ctx->readonly = 1;
+    ctx->peekonly = 1;
+
+    if (imap_select_mailbox (ctx, 1) == 0)
+      PrefetchDone = mutt_add_list (PrefetchDone, path);
+    else if (!mutt_input_pending ())
+    {
+      dprint (1, (debugfile, "imap_prefetch: giving up on %s\n", path));
+      PrefetchFailed = mutt_add_list (PrefetchFailed, path);
+    }
+
+    mx_fastclose_mailbox (ctx);
+    FREE (&ctx);
+    return 1;
+  }
+#endif /* USE_HCACHE */
+
+  return 0;
+}
+
 /* imap_status: returns count of messages in mailbox, or -1 on error.
  * if queue != 0, queue the command and expect it to have been run
  * on the next call (for pipelining the postponed count) */
@@ -2133,125 +2327,143 @@ void imap_mboxcache_free (IMAP_DATA* idata)
   mutt_free_list (&idata->mboxcache);
 }
 
-/* returns number of patterns in the search that should be done server-side
- * (eg are full-text) */
-static int do_search (const pattern_t* search, int allpats)
+/* How the server can answer for a pattern, see imap_search_class() */
+#define IMAP_SEARCH_EXACT	1	/* its answer is the result */
+#define IMAP_SEARCH_FILTER	2	/* it can only rule messages out */
+
+/* whether the regexp source rx is plain ASCII text matching only itself */
+static int imap_search_literal (const char *rx)
 {
-  int rc = 0;
-  const pattern_t* pat;
+  for (; *rx; rx++)
+    if ((unsigned char) *rx >= 0x80 || strchr ("\\^$.[]|()*+?{}", *rx))
+      return 0;
+  return 1;
+}
 
-  for (pat = search; pat; pat = pat->next)
+/* returns how the server can search for pat, or 0.  Full-text string
+ * searches are left to the server entirely.  With $imap_search_filter, a
+ * body regexp which is plain text can at least be looked up as a
+ * substring, which the server matches ignoring case, to skip downloading
+ * the messages without it.  That is off by default: servers search the
+ * decoded text and some only match whole words, so a message mutt would
+ * match can be missed.  Everything else mutt already has what it needs for, and does a better
+ * job of (eg server doesn't support regexps, and its sizes, dates and
+ * flags don't mean quite the same as mutt's). */
+static int imap_search_class (const pattern_t* pat)
+{
+  switch (pat->op)
   {
-    switch (pat->op)
-    {
-      case MUTT_BODY:
-      case MUTT_HEADER:
-      case MUTT_WHOLE_MSG:
-        if (pat->stringmatch)
-          rc++;
-        break;
-      default:
-        if (pat->child && do_search (pat->child, 1))
-          rc++;
-    }
-
-    if (!allpats)
-      break;
+    case MUTT_BODY:
+    case MUTT_HEADER:
+    case MUTT_WHOLE_MSG:
+      if (pat->stringmatch)
+        return IMAP_SEARCH_EXACT;
+      if (option (OPTIMAPSEARCHFILTER) && pat->op != MUTT_HEADER &&
+          pat->expr && imap_search_literal (pat->expr))
+        return IMAP_SEARCH_FILTER;
   }
 
-  return rc;
+  return 0;
 }
 
-/* convert mutt pattern_t to IMAP SEARCH command containing only elements
- * that require full-text search (mutt already has what it needs for most
- * match types, and does a better job (eg server doesn't support regexps). */
+/* convert a full-text mutt pattern_t, ignoring its negation, to an IMAP
+ * SEARCH key */
 static int imap_compile_search (const pattern_t* pat, BUFFER* buf)
 {
-  if (! do_search (pat, 0))
-    return 0;
-
-  if (pat->not)
-    mutt_buffer_addstr (buf, "NOT ");
+  char term[STRING];
+  char *delim;
+  const char *str = pat->stringmatch ? pat->p.str : pat->expr;
 
-  if (pat->child)
+  switch (pat->op)
   {
-    int clauses;
-
-    if ((clauses = do_search (pat->child, 1)) > 0)
-    {
-      const pattern_t* clause = pat->child;
+    case MUTT_HEADER:
+      mutt_buffer_addstr (buf, "HEADER ");
 
-      mutt_buffer_addch (buf, '(');
-
-      while (clauses)
+      /* extract header name */
+      if (! (delim = strchr (pat->p.str, ':')))
       {
-        if (do_search (clause, 0))
-        {
-          if (pat->op == MUTT_OR && clauses > 1)
-            mutt_buffer_addstr (buf, "OR ");
-          clauses--;
-
-          if (imap_compile_search (clause, buf) < 0)
-            return -1;
+        mutt_error (_("Header search without header name: %s"), pat->p.str);
+        return -1;
+      }
+      *delim = '\0';
+      imap_quote_string (term, sizeof (term), pat->p.str);
+      mutt_buffer_addstr (buf, term);
+      mutt_buffer_addch (buf, ' ');
+
+      /* and field */
+      *delim = ':';
+      delim++;
+      SKIPWS(delim);
+      imap_quote_string (term, sizeof (term), delim);
+      mutt_buffer_addstr (buf, term);
+      break;
+    case MUTT_BODY:
+      mutt_buffer_addstr (buf, "BODY ");
+      imap_quote_string (term, sizeof (term), str);
+      mutt_buffer_addstr (buf, term);
+      break;
+    case MUTT_WHOLE_MSG:
+      mutt_buffer_addstr (buf, "TEXT ");
+      imap_quote_string (term, sizeof (term), str);
+      mutt_buffer_addstr (buf, term);
+      break;
+  }
 
-          if (clauses)
-            mutt_buffer_addch (buf, ' ');
+  return 0;
+}
 
-        }
-        clause = clause->next;
-      }
+/* Searches the server for each full-text pattern in the tree pat it can
+ * answer for, and leaves the results in pat->found for mutt_pattern_exec(),
+ * which evaluates the rest of the tree locally.  Each one is searched on
+ * its own, so that whatever it is combined with -- a regexp, a flag, a
+ * negation -- its result stays exact. */
+static int imap_search_patterns (CONTEXT* ctx, pattern_t* pat)
+{
+  BUFFER buf;
+  IMAP_DATA* idata = (IMAP_DATA*)ctx->data;
+  int class, i;
 
-      mutt_buffer_addch (buf, ')');
-    }
-  }
-  else
+  for (; pat; pat = pat->next)
   {
-    char term[STRING];
-    char *delim;
+    if (pat->child)
+    {
+      if (imap_search_patterns (ctx, pat->child) < 0)
+        return -1;
+      continue;
+    }
+    if (!(class = imap_search_class (pat)))
+      continue;
 
-    switch (pat->op)
+    for (i = 0; i < ctx->msgcount; i++)
+      ctx->hdrs[i]->matched = 0;
+
+    mutt_buffer_init (&buf);
+    mutt_buffer_addstr (&buf, "UID SEARCH ");
+    if (imap_compile_search (pat, &buf) < 0 ||
+        imap_exec (idata, buf.data, 0) < 0)
     {
-      case MUTT_HEADER:
-        mutt_buffer_addstr (buf, "HEADER ");
+      FREE (&buf.data);
+      return -1;
+    }
+    FREE (&buf.data);
 
-        /* extract header name */
-        if (! (delim = strchr (pat->p.str, ':')))
-        {
-          mutt_error (_("Header search without header name: %s"), pat->p.str);
-          return -1;
-        }
-        *delim = '\0';
-        imap_quote_string (term, sizeof (term), pat->p.str);
-        mutt_buffer_addstr (buf, term);
-        mutt_buffer_addch (buf, ' ');
-
-        /* and field */
-        *delim = ':';
-        delim++;
-        SKIPWS(delim);
-        imap_quote_string (term, sizeof (term), delim);
-        mutt_buffer_addstr (buf, term);
-        break;
-      case MUTT_BODY:
-        mutt_buffer_addstr (buf, "BODY ");
-        imap_quote_string (term, sizeof (term), pat->p.str);
-        mutt_buffer_addstr (buf, term);
-        break;
-      case MUTT_WHOLE_MSG:
-        mutt_buffer_addstr (buf, "TEXT ");
-        imap_quote_string (term, sizeof (term), pat->p.str);
-        mutt_buffer_addstr (buf, term);
-        break;
+    /* messages the server matched for a filter are searched locally */
+    FREE (&pat->found);
+    pat->found = safe_calloc (MAX (ctx->msgcount, 1), sizeof (unsigned char));
+    for (i = 0; i < ctx->msgcount; i++)
+    {
+      if (!ctx->hdrs[i]->matched)
+        pat->found[i] = BODY_NOT_FOUND;
+      else if (class == IMAP_SEARCH_EXACT)
+        pat->found[i] = BODY_FOUND;
     }
   }
 
   return 0;
 }
 
-int imap_search (CONTEXT* ctx, const pattern_t* pat)
+int imap_search (CONTEXT* ctx, pattern_t* pat)
 {
-  BUFFER buf;
-  IMAP_DATA* idata = (IMAP_DATA*)ctx->data;
   int i;
 
   for (i = 0; i < ctx->msgcount; i++)
@@ -2263,24 +2475,7 @@ int imap_search (CONTEXT* ctx, const pattern_t* pat)
    */
   set_option (OPTSEARCHINVALID);
 
-  if (!do_search (pat, 1))
-    return 0;
-
-  mutt_buffer_init (&buf);
-  mutt_buffer_addstr (&buf, "UID SEARCH ");
-  if (imap_compile_search (pat, &buf) < 0)
-  {
-    FREE (&buf.data);
-    return -1;
-  }
-  if (imap_exec (idata, buf.data, 0) < 0)
-  {
-    FREE (&buf.data);
-    return -1;
-  }
-
-  FREE (&buf.data);
-  return 0;
+  return imap_search_patterns (ctx, pat);
 }
 
 int imap_subscribe (char *path, int subscribe)
@@ -2638,4 +2833,5 @@ struct mx_ops mx_imap_ops = {
   .check = imap_check_mailbox_reopen,
   .sync = NULL,      /* imap syncing is handled by imap_sync_mailbox */
   .save_to_header_cache = imap_save_to_header_cache,
+  .gc_header_cache = imap_gc_header_cache,
 };
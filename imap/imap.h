@@ -39,10 +39,11 @@ int imap_sync_mailbox (CONTEXT *ctx, int expunge, int *index_hint);
 int imap_close_mailbox (CONTEXT *ctx);
 int imap_buffy_check (int force, int check_stats);
 int imap_status (const char *path, int queue);
-int imap_search (CONTEXT* ctx, const pattern_t* pat);
+int imap_search (CONTEXT* ctx, pattern_t* pat);
 int imap_subscribe (char *path, int subscribe);
 int imap_complete (char* dest, size_t dlen, const char* path);
 int imap_fast_trash (CONTEXT* ctx, char* dest);
+int imap_prefetch (void);
 
 void imap_allow_reopen (CONTEXT *ctx);
 void imap_disallow_reopen (CONTEXT *ctx);
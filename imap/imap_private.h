@@ -56,6 +56,18 @@
 #define IMAP_CACHE_LEN 10
 
 #define SEQLEN 5
+
+/* The command pipeline starts out $imap_pipeline_depth commands deep and
+ * adapts from there (see cmd_adapt_window()), up to this many commands,
+ * or $imap_pipeline_depth if that is larger. */
+#define IMAP_PIPELINE_MAX 256
+/* Queued commands are also sent once this many bytes are waiting, so a
+ * large pipeline can't fill both directions of the socket. */
+#define IMAP_PIPELINE_BYTES (64 * 1024)
+/* $imap_fetch_connections opens at most this many extra connections, and
+ * only when at least IMAP_FETCH_PARALLEL_MIN headers are to be fetched. */
+#define IMAP_FETCH_CONN_MAX 16
+#define IMAP_FETCH_PARALLEL_MIN 1000
 /* maximum length of command lines before they must be split (for
  * lazy servers) */
 #define IMAP_MAX_CMDLEN 1024
@@ -210,6 +222,14 @@ typedef struct
   int lastcmd;
   BUFFER* cmdbuf;
 
+  /* adaptive pipelining: the number of commands sent per round trip, and
+   * the batch of commands currently being timed */
+  int pipeline_window;
+  int pipeline_batch;          /* completed commands in this batch */
+  int pipeline_failed;         /* ... of which did not return OK */
+  unsigned long long pipeline_start; /* usecs, 0 if not timing */
+  unsigned long pipeline_cost; /* usecs per command in the last full batch */
+
   /* cache IMAP_STATUS of visited mailboxes */
   LIST* mboxcache;
 
@@ -219,6 +239,7 @@ typedef struct
   char *mailbox;
   unsigned short check_status;
   unsigned char reopen;
+  unsigned char prefetch;      /* selected by imap_prefetch() in the background */
   unsigned int newMailCount;   /* Set when EXISTS notifies of new mail */
   IMAP_CACHE cache[IMAP_CACHE_LEN];
   HASH *uid_hash;
@@ -282,6 +303,7 @@ int imap_code (const char* s);
 const char* imap_cmd_trailer (IMAP_DATA* idata);
 int imap_exec (IMAP_DATA* idata, const char* cmd, int flags);
 int imap_cmd_idle (IMAP_DATA* idata);
+int imap_cmd_queue_full (IMAP_DATA* idata);
 
 /* message.c */
 void imap_add_keywords (char* s, HEADER* keywords, LIST* mailbox_flags, size_t slen);
@@ -71,7 +71,7 @@ static FILE* msg_cache_put (IMAP_DATA* idata, HEADER* h);
 static int msg_cache_commit (IMAP_DATA* idata, HEADER* h);
 
 static int flush_buffer (char* buf, size_t* len, CONNECTION* conn);
-static int msg_fetch_header (CONTEXT* ctx, IMAP_HEADER* h, char* buf,
+static int msg_fetch_header (IMAP_DATA* idata, IMAP_HEADER* h, char* buf,
                              FILE* fp);
 static int msg_parse_fetch (IMAP_HEADER* h, char* s);
 static char* msg_parse_flags (IMAP_HEADER* h, char* s);
@@ -79,11 +79,19 @@ static char* msg_parse_flags (IMAP_HEADER* h, char* s);
 
 /* If the user hits ctrl-c during an initial header download for a mailbox,
  * prompt whether to completely abort the download and close the mailbox.
+ * A background prefetch is abandoned without asking.
  */
 static int query_abort_header_download (IMAP_DATA *idata)
 {
   int abort = 0;
 
+  if (idata->prefetch)
+  {
+    imap_close_connection (idata);
+    SigInt = 0;
+    return 1;
+  }
+
   mutt_flushinp ();
   /* L10N: This prompt is made if the user hits Ctrl-C when opening
    * an IMAP mailbox */
@@ -145,9 +153,12 @@ static void imap_alloc_uid_hash (IMAP_DATA *idata, unsigned int msn_count)
  * This can happen if during a sync/close, messages are deleted from
  * the cache, but the server doesn't get the updates (via a dropped
  * network connection, or just plain refusing the updates).
+ *
+ * A non-zero chunk_size overrides $imap_fetch_chunk_size.
  */
 static unsigned int imap_fetch_msn_seqset (BUFFER *b, IMAP_DATA *idata, int evalhc,
                                            unsigned int msn_begin, unsigned int msn_end,
+                                           unsigned int chunk_size,
                                            unsigned int *fetch_msn_end)
 {
   unsigned int max_headers_per_fetch = UINT_MAX;
@@ -161,6 +172,11 @@ static unsigned int imap_fetch_msn_seqset (BUFFER *b, IMAP_DATA *idata, int eval
 
   if (ImapFetchChunkSize > 0)
     max_headers_per_fetch = ImapFetchChunkSize;
+  if (idata->prefetch && ImapPrefetchChunkSize > 0 &&
+      ImapPrefetchChunkSize < max_headers_per_fetch)
+    max_headers_per_fetch = ImapPrefetchChunkSize;
+  if (chunk_size)
+    max_headers_per_fetch = chunk_size;
 
   if (!evalhc)
   {
@@ -267,6 +283,7 @@ retry:
 
 #if USE_HCACHE
   idata->hcache = imap_hcache_open (idata, NULL);
+  mutt_hcache_begin (idata->hcache);
 
   if (idata->hcache && initial_download)
   {
@@ -422,6 +439,21 @@ retry:
 
 bail:
 #if USE_HCACHE
+  /* Record how far an interrupted prefetch got, so the next open (or
+   * prefetch) evaluates those headers from the cache and only fetches the
+   * rest.  The CONDSTORE/QRESYNC state no longer describes the cache. */
+  if (retval < 0 && idata->prefetch && maxuid &&
+      (uid_validity != idata->uid_validity || maxuid >= uidnext))
+  {
+    mutt_hcache_store_raw (idata->hcache, "/UIDVALIDITY", &idata->uid_validity,
+                           sizeof (idata->uid_validity), imap_hcache_keylen);
+    maxuid++;
+    mutt_hcache_store_raw (idata->hcache, "/UIDNEXT", &maxuid,
+                           sizeof (maxuid), imap_hcache_keylen);
+    mutt_hcache_delete (idata->hcache, "/MODSEQ", imap_hcache_keylen);
+    imap_hcache_clear_uid_seqset (idata);
+  }
+  mutt_hcache_commit (idata->hcache);
   imap_hcache_close (idata);
   FREE (&uid_seqset);
 #endif /* USE_HCACHE */
@@ -486,7 +518,7 @@ static int read_headers_normal_eval_cache (IMAP_DATA *idata,
       if (rc != IMAP_CMD_CONTINUE)
         break;
 
-      if ((mfhrc = msg_fetch_header (ctx, &h, idata->buf, NULL)) < 0)
+      if ((mfhrc = msg_fetch_header (idata, &h, idata->buf, NULL)) < 0)
         continue;
 
       if (!h.data->uid)
@@ -737,6 +769,7 @@ static int read_headers_condstore_qresync_updates (IMAP_DATA *idata,
     Sort = old_sort;
 
     idata->hcache = imap_hcache_open (idata, NULL);
+    mutt_hcache_begin (idata->hcache);
     idata->reopen &= ~IMAP_EXPUNGE_PENDING;
   }
 
@@ -826,6 +859,346 @@ fail:
 }
 #endif  /* USE_HCACHE */
 
+/* Builds a new HEADER from the FETCH response parsed into h and fp, and
+ * enters it into the msn_index, uid_hash and header cache.  The header
+ * takes over h->data; the caller places it in ctx->hdrs.
+ */
+static HEADER *read_headers_new_header (IMAP_DATA *idata, IMAP_HEADER *h,
+                                        FILE *fp, unsigned int *maxuid)
+{
+  HEADER *hdr;
+
+  hdr = mutt_new_header ();
+
+  idata->max_msn = MAX (idata->max_msn, h->data->msn);
+  idata->msn_index[h->data->msn - 1] = hdr;
+  int_hash_insert (idata->uid_hash, h->data->uid, hdr);
+
+  /* messages which have not been expunged are ACTIVE (borrowed from mh
+   * folders) */
+  hdr->active = 1;
+  hdr->changed = 0;
+  hdr->read = h->data->read;
+  hdr->old = h->data->old;
+  hdr->deleted = h->data->deleted;
+  hdr->flagged = h->data->flagged;
+  hdr->replied = h->data->replied;
+  hdr->received = h->received;
+  hdr->data = (void *) (h->data);
+
+  if (*maxuid < h->data->uid)
+    *maxuid = h->data->uid;
+
+  rewind (fp);
+  /* NOTE: if Date: header is missing, mutt_read_rfc822_header depends
+   *   on h->received being set */
+  hdr->env = mutt_read_rfc822_header (fp, hdr, 0, 0);
+  /* content built as a side-effect of mutt_read_rfc822_header */
+  hdr->content->length = h->content_length;
+
+#if USE_HCACHE
+  imap_hcache_put (idata, hdr);
+#endif /* USE_HCACHE */
+
+  h->data = NULL;
+
+  return hdr;
+}
+
+/* Logs out of an extra connection opened by read_headers_fetch_parallel().
+ * One which is still in the middle of a command is just dropped.
+ */
+static void read_headers_helper_close (IMAP_DATA *hidata, int busy)
+{
+  CONNECTION *conn = hidata->conn;
+
+  FREE (&hidata->mailbox);
+  if (busy)
+    hidata->status = IMAP_FATAL;
+  imap_logout ((IMAP_DATA**) (void*) &conn->data);
+  mutt_socket_free (conn);
+}
+
+/* The message numbers seen by an extra connection only match ours until
+ * the server reports an expunge on it.
+ */
+static int read_headers_helper_expunged (char *buf)
+{
+  char *s;
+
+  if (buf[0] != '*')
+    return 0;
+
+  s = imap_next_word (buf);
+  if (ascii_strncasecmp ("VANISHED", s, 8) == 0)
+    return 1;
+  if (!isdigit ((unsigned char) *s))
+    return 0;
+
+  s = imap_next_word (s);
+  return ascii_strncasecmp ("EXPUNGE", s, 7) == 0;
+}
+
+/* Downloads the new headers in msn_begin..msn_end over the mailbox's own
+ * connection and up to $imap_fetch_connections extra ones at once.  Each
+ * connection fetches the next free chunk as soon as it is done with the
+ * previous one.  The extra connections EXAMINE the mailbox and are logged
+ * out again afterwards.  Anything they fail to deliver is left for the
+ * caller to fetch the usual way.  The new headers are appended to
+ * ctx->hdrs in message number order.
+ */
+static int read_headers_fetch_parallel (IMAP_DATA *idata, unsigned int msn_begin,
+                                        unsigned int msn_end, int evalhc,
+                                        unsigned int *maxuid, int initial_download,
+                                        const char *hdrreq, FILE *fp,
+                                        progress_t *progress)
+{
+  CONTEXT *ctx;
+  IMAP_DATA *conns[IMAP_FETCH_CONN_MAX + 1];
+  CONNECTION *socks[IMAP_FETCH_CONN_MAX + 1];
+  int which[IMAP_FETCH_CONN_MAX + 1];
+  int busy[IMAP_FETCH_CONN_MAX + 1];
+  IMAP_DATA *cidata;
+  HEADER **fetched = NULL;
+  HEADER *hdr;
+  IMAP_HEADER h;
+  BUFFER *b = NULL;
+  char buf[LONG_STRING];
+  char *cmd, *pc;
+  unsigned int msn, next, fetch_msn_end, chunk_size, todo = 0, count = 0;
+  int nconns = 1, running = 0, i, n, rc, mfhrc, retval = -1;
+
+  ctx = idata->ctx;
+
+  if (evalhc)
+  {
+    for (msn = msn_begin; msn <= msn_end; msn++)
+      if (!idata->msn_index[msn - 1])
+        todo++;
+  }
+  else if (msn_end >= msn_begin)
+    todo = msn_end - msn_begin + 1;
+  if (todo < IMAP_FETCH_PARALLEL_MIN)
+    return 0;
+
+  memset (&h, 0, sizeof (h));
+  memset (busy, 0, sizeof (busy));
+  conns[0] = idata;
+
+  imap_munge_mbox_name (idata, buf, sizeof (buf), idata->mailbox);
+  safe_asprintf (&cmd, "EXAMINE %s", buf);
+  for (i = 0; i < MIN (ImapFetchConnections, IMAP_FETCH_CONN_MAX); i++)
+  {
+    /* the connections handed out so far are all selected, so this opens
+     * a new one */
+    if (!(cidata = imap_conn_find (&idata->conn->account,
+                                   MUTT_IMAP_CONN_NOSELECT)))
+      break;
+
+    FREE (&cidata->mailbox);
+    cidata->mailbox = safe_strdup (idata->mailbox);
+    cidata->ctx = NULL;
+    cidata->newMailCount = 0;
+    cidata->max_msn = 0;
+    cidata->uid_validity = 0;
+    cidata->state = IMAP_SELECTED;
+
+    if (imap_cmd_start (cidata, cmd) < 0)
+    {
+      read_headers_helper_close (cidata, 1);
+      break;
+    }
+    conns[nconns++] = cidata;
+  }
+  FREE (&cmd);
+
+  /* Only use the connections which see the same mailbox.  The EXISTS
+   * count ends up in newMailCount, as max_msn is 0. */
+  for (i = n = 1; i < nconns; i++)
+  {
+    cidata = conns[i];
+    while ((rc = imap_cmd_step (cidata)) == IMAP_CMD_CONTINUE)
+    {
+      pc = imap_next_word (cidata->buf);
+      if (ascii_strncasecmp ("OK [UIDVALIDITY", pc, 14) == 0)
+      {
+        pc += 3;
+        pc = imap_next_word (pc);
+        mutt_atoui (pc, &cidata->uid_validity, MUTT_ATOI_ALLOW_TRAILING);
+      }
+    }
+
+    if (rc != IMAP_CMD_OK ||
+        cidata->uid_validity != idata->uid_validity ||
+        cidata->newMailCount < msn_end)
+    {
+      dprint (2, (debugfile, "read_headers_fetch_parallel: not using extra connection %d\n", i));
+      read_headers_helper_close (cidata, 0);
+      continue;
+    }
+    cidata->reopen &= ~IMAP_NEWMAIL_PENDING;
+    conns[n++] = cidata;
+  }
+  nconns = n;
+
+  if (nconns == 1)
+    return 0;
+
+  dprint (2, (debugfile, "read_headers_fetch_parallel: fetching %u headers over %d connections\n",
+              todo, nconns));
+
+  if (ImapFetchChunkSize > 0)
+    chunk_size = ImapFetchChunkSize;
+  else
+    chunk_size = todo / (4 * nconns) + 1;
+
+  fetched = safe_calloc (msn_end - msn_begin + 1, sizeof (HEADER *));
+  b = mutt_buffer_pool_get ();
+  next = msn_begin;
+
+  FOREVER
+  {
+    /* hand the next chunk to each idle connection */
+    for (i = 0; i < nconns && next <= msn_end; i++)
+    {
+      if (!conns[i] || busy[i])
+        continue;
+
+      if (!imap_fetch_msn_seqset (b, idata, evalhc, next, msn_end, chunk_size,
+                                  &fetch_msn_end))
+      {
+        next = msn_end + 1;
+        break;
+      }
+      next = fetch_msn_end + 1;
+
+      safe_asprintf (&cmd, "FETCH %s (UID FLAGS INTERNALDATE RFC822.SIZE %s)",
+                     mutt_b2s (b), hdrreq);
+      rc = imap_cmd_start (conns[i], cmd);
+      FREE (&cmd);
+      if (rc < 0)
+      {
+        if (!i)
+          goto bail;
+        read_headers_helper_close (conns[i], 1);
+        conns[i] = NULL;
+        continue;
+      }
+      busy[i] = 1;
+      running++;
+    }
+
+    if (!running)
+      break;
+
+    if (initial_download && SigInt &&
+        query_abort_header_download (idata))
+      goto bail;
+
+    for (i = n = 0; i < nconns; i++)
+      if (busy[i])
+      {
+        socks[n] = conns[i]->conn;
+        which[n++] = i;
+      }
+    if ((n = mutt_socket_poll_many (socks, n, 1)) == -2)
+      goto bail;
+    if (n < 0)
+      continue;
+
+    i = which[n];
+    cidata = conns[i];
+
+    /* read what this connection has for us so far */
+    do
+    {
+      if (!h.data)
+      {
+        memset (&h, 0, sizeof (h));
+        h.data = safe_calloc (1, sizeof (IMAP_HEADER_DATA));
+      }
+      rewind (fp);
+
+      if ((rc = imap_cmd_step (cidata)) != IMAP_CMD_CONTINUE)
+        break;
+
+      if (i && read_headers_helper_expunged (cidata->buf))
+      {
+        dprint (1, (debugfile, "read_headers_fetch_parallel: expunge on extra connection %d\n", i));
+        rc = IMAP_CMD_BAD;
+        break;
+      }
+
+      if ((mfhrc = msg_fetch_header (cidata, &h, cidata->buf, fp)) < -1)
+      {
+        rc = IMAP_CMD_BAD;
+        break;
+      }
+      if (mfhrc < 0)
+        continue;
+
+      msn = h.data->msn;
+      if (ftello (fp) && msn >= msn_begin && msn <= msn_end &&
+          !idata->msn_index[msn - 1])
+      {
+        /* make sure we don't get remnants from older larger message headers */
+        fputs ("\n\n", fp);
+
+        fetched[msn - msn_begin] = read_headers_new_header (idata, &h, fp,
+                                                            maxuid);
+        count++;
+        if (!ctx->quiet)
+          mutt_progress_update (progress, msn_begin - 1 + count, -1);
+      }
+      else
+        dprint (2, (debugfile, "read_headers_fetch_parallel: skipping FETCH response for "
+                    "message %u\n", msn));
+
+      imap_free_header_data (&h.data);
+    }
+    while (mutt_socket_poll (cidata->conn, 0) > 0);
+
+    if (rc == IMAP_CMD_CONTINUE)
+      continue;
+
+    busy[i] = 0;
+    running--;
+
+    if (rc == IMAP_CMD_OK)
+      continue;
+    if (!i)
+      goto bail;
+
+    /* the rest of its chunk is picked up afterwards */
+    dprint (1, (debugfile, "read_headers_fetch_parallel: dropping extra connection %d\n", i));
+    read_headers_helper_close (cidata, rc != IMAP_CMD_NO);
+    conns[i] = NULL;
+  }
+
+  retval = 0;
+
+bail:
+  imap_free_header_data (&h.data);
+
+  for (i = 1; i < nconns; i++)
+    if (conns[i])
+      read_headers_helper_close (conns[i], busy[i]);
+
+  for (msn = msn_begin; msn <= msn_end; msn++)
+  {
+    if (!(hdr = fetched[msn - msn_begin]))
+      continue;
+    hdr->index = ctx->msgcount;
+    ctx->hdrs[ctx->msgcount++] = hdr;
+    ctx->size += hdr->content->length;
+  }
+
+  FREE (&fetched);
+  mutt_buffer_pool_release (&b);
+
+  return retval;
+}
+
 /* Retrieve new messages from the server
  */
 static int read_headers_fetch_new (IMAP_DATA *idata, unsigned int msn_begin,
@@ -899,6 +1272,16 @@ static int read_headers_fetch_new (IMAP_DATA *idata, unsigned int msn_begin,
 
   b = mutt_buffer_pool_get ();
 
+  if (ImapFetchConnections > 0 && !idata->prefetch)
+  {
+    if (read_headers_fetch_parallel (idata, msn_begin, msn_end, evalhc, maxuid,
+                                     initial_download, hdrreq, fp, &progress) < 0)
+      goto bail;
+    /* fill in whatever the extra connections did not deliver */
+    idx = ctx->msgcount;
+    evalhc = 1;
+  }
+
   /* NOTE:
    *   The (fetch_msn_end < msn_end) used to be important to prevent
    *   an infinite loop, in the event the server did not return all
@@ -910,13 +1293,26 @@ static int read_headers_fetch_new (IMAP_DATA *idata, unsigned int msn_begin,
    *   cautious I'm keeping it.
    */
   while ((fetch_msn_end < msn_end) &&
-         imap_fetch_msn_seqset (b, idata, evalhc, msn_begin, msn_end,
+         imap_fetch_msn_seqset (b, idata, evalhc, msn_begin, msn_end, 0,
                                 &fetch_msn_end))
   {
-    safe_asprintf (&cmd, "FETCH %s (UID FLAGS INTERNALDATE RFC822.SIZE %s)",
-                   mutt_b2s (b), hdrreq);
-    imap_cmd_start (idata, cmd);
-    FREE (&cmd);
+    /* With $imap_fetch_chunk_size, send as many chunks per round trip as
+     * the command pipeline allows; their responses are read as one.  A
+     * background prefetch sticks to one chunk at a time. */
+    do
+    {
+      safe_asprintf (&cmd, "FETCH %s (UID FLAGS INTERNALDATE RFC822.SIZE %s)",
+                     mutt_b2s (b), hdrreq);
+      rc = imap_exec (idata, cmd, IMAP_CMD_QUEUE);
+      FREE (&cmd);
+      if (rc < 0)
+        goto bail;
+    }
+    while (!idata->prefetch && (fetch_msn_end < msn_end) &&
+           !imap_cmd_queue_full (idata) &&
+           imap_fetch_msn_seqset (b, idata, evalhc, fetch_msn_end + 1, msn_end,
+                                  0, &fetch_msn_end));
+    imap_cmd_start (idata, NULL);
 
     rc = IMAP_CMD_CONTINUE;
     for (msgno = msn_begin; rc == IMAP_CMD_CONTINUE; msgno++)
@@ -942,7 +1338,7 @@ static int read_headers_fetch_new (IMAP_DATA *idata, unsigned int msn_begin,
         if (rc != IMAP_CMD_CONTINUE)
           break;
 
-        if ((mfhrc = msg_fetch_header (ctx, &h, idata->buf, fp)) < 0)
+        if ((mfhrc = msg_fetch_header (idata, &h, idata->buf, fp)) < 0)
           continue;
 
         if (!ftello (fp))
@@ -969,44 +1365,10 @@ static int read_headers_fetch_new (IMAP_DATA *idata, unsigned int msn_begin,
           continue;
         }
 
-        ctx->hdrs[idx] = mutt_new_header ();
-
-        idata->max_msn = MAX (idata->max_msn, h.data->msn);
-        idata->msn_index[h.data->msn - 1] = ctx->hdrs[idx];
-        int_hash_insert (idata->uid_hash, h.data->uid, ctx->hdrs[idx]);
-
+        ctx->hdrs[idx] = read_headers_new_header (idata, &h, fp, maxuid);
         ctx->hdrs[idx]->index = idx;
-        /* messages which have not been expunged are ACTIVE (borrowed from mh
-         * folders) */
-        ctx->hdrs[idx]->active = 1;
-        ctx->hdrs[idx]->changed = 0;
-        ctx->hdrs[idx]->read = h.data->read;
-        ctx->hdrs[idx]->old = h.data->old;
-        ctx->hdrs[idx]->deleted = h.data->deleted;
-        ctx->hdrs[idx]->flagged = h.data->flagged;
-        ctx->hdrs[idx]->replied = h.data->replied;
-        ctx->hdrs[idx]->received = h.received;
-        ctx->hdrs[idx]->data = (void *) (h.data);
-
-        if (*maxuid < h.data->uid)
-          *maxuid = h.data->uid;
-
-        rewind (fp);
-        /* NOTE: if Date: header is missing, mutt_read_rfc822_header depends
-         *   on h.received being set */
-        ctx->hdrs[idx]->env = mutt_read_rfc822_header (fp, ctx->hdrs[idx],
-                                                       0, 0);
-        /* content built as a side-effect of mutt_read_rfc822_header */
-        ctx->hdrs[idx]->content->length = h.content_length;
-        ctx->size += h.content_length;
-
-#if USE_HCACHE
-        imap_hcache_put (idata, ctx->hdrs[idx]);
-#endif /* USE_HCACHE */
-
+        ctx->size += ctx->hdrs[idx]->content->length;
         ctx->msgcount++;
-
-        h.data = NULL;
         idx++;
       }
       while (mfhrc == -1);
@@ -1017,6 +1379,10 @@ static int read_headers_fetch_new (IMAP_DATA *idata, unsigned int msn_begin,
         goto bail;
     }
 
+    /* only the last chunk's result was returned above */
+    if (idata->pipeline_failed)
+      goto bail;
+
     /* In case we get new mail while fetching the headers. */
     if (idata->reopen & IMAP_NEWMAIL_PENDING)
     {
@@ -1039,6 +1405,16 @@ static int read_headers_fetch_new (IMAP_DATA *idata, unsigned int msn_begin,
      * not been altered during or after the fetch.
      */
     msn_begin = fetch_msn_end + 1;
+
+    /* A background prefetch stops between chunks as soon as the user
+     * presses a key.  The headers fetched so far are already in the
+     * header cache. */
+    if (idata->prefetch && (fetch_msn_end < msn_end) && mutt_input_pending ())
+    {
+      dprint (2, (debugfile, "read_headers_fetch_new: prefetch of %s interrupted at msn %u\n",
+                  idata->mailbox, fetch_msn_end));
+      goto bail;
+    }
   }
 
   retval = 0;
@@ -1274,6 +1650,7 @@ parsemsg:
 #if defined(HAVE_PGP) || defined(HAVE_SMIME)
   h->security = crypt_query (h->content);
 #endif
+  h->search_known = 0;
 
   mutt_clear_error();
   rewind (msg->fp);
@@ -1847,15 +2224,12 @@ char* imap_set_flags (IMAP_DATA* idata, HEADER* h, char* s, int *server_changes)
  *      0 on success
  *     -1 if the string is not a fetch response
  *     -2 if the string is a corrupt fetch response */
-static int msg_fetch_header (CONTEXT* ctx, IMAP_HEADER* h, char* buf, FILE* fp)
+static int msg_fetch_header (IMAP_DATA* idata, IMAP_HEADER* h, char* buf, FILE* fp)
 {
-  IMAP_DATA* idata;
   unsigned int bytes;
   int rc = -1; /* default now is that string isn't FETCH response*/
   int parse_rc;
 
-  idata = (IMAP_DATA*) ctx->data;
-
   if (buf[0] != '*')
     return rc;
 
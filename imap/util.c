@@ -229,7 +229,6 @@ HEADER* imap_hcache_get (IMAP_DATA* idata, unsigned int uid)
       h = mutt_hcache_restore ((unsigned char *)data, NULL);
     else
       dprint (3, (debugfile, "hcache uidvalidity mismatch: %u", uv));
-    mutt_hcache_free ((void **)&data);
   }
 
   return h;
@@ -514,7 +513,11 @@ IMAP_DATA* imap_new_idata (void)
   IMAP_DATA* idata = safe_calloc (1, sizeof (IMAP_DATA));
 
   idata->cmdbuf = mutt_buffer_new ();
-  idata->cmdslots = ImapPipelineDepth + 2;
+  idata->pipeline_window = ImapPipelineDepth;
+  if (ImapPipelineDepth > 0)
+    idata->cmdslots = MAX (ImapPipelineDepth, IMAP_PIPELINE_MAX) + 2;
+  else
+    idata->cmdslots = 2;
   idata->cmds = safe_calloc (idata->cmdslots, sizeof(*idata->cmds));
 
   return idata;
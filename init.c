@@ -39,6 +39,10 @@
 #include "mutt_ssl.h"
 #endif
 
+#if USE_HCACHE
+#include "hcache.h"
+#endif
+
 #include "mx.h"
 #include "init.h"
 #include "mailbox.h"
@@ -2497,6 +2501,15 @@ static int parse_set (BUFFER *tmp, BUFFER *s, union pointer_long_t udata, BUFFER
 		      MuttVars[idx].option, tmp->data);
 	    return (-1);
 	  }
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+	  if (MuttVars[idx].data.p == &HeaderCacheCompressMethod &&
+              mutt_hcache_codec (tmp->data) < 0)
+	  {
+	    snprintf (err->data, err->dsize, _("Invalid value for option %s: \"%s\""),
+		      MuttVars[idx].option, tmp->data);
+	    return (-1);
+	  }
+#endif
 
 	  FREE (MuttVars[idx].data.p);		/* __FREE_CHECKED__ */
 	  *((char **) MuttVars[idx].data.p) = safe_strdup (tmp->data);
@@ -2671,6 +2684,24 @@ static int parse_set (BUFFER *tmp, BUFFER *s, union pointer_long_t udata, BUFFER
 	r = -1;
 	break;
       }
+      else if (val < 0 &&
+               mutt_strcmp (MuttVars[idx].option, "maildir_read_threads") == 0)
+      {
+	snprintf (err->data, err->dsize, _("%s: invalid value (%s)"), tmp->data,
+		  _("must not be negative"));
+	r = -1;
+	break;
+      }
+#ifdef USE_IMAP
+      else if (val < 1 &&
+               mutt_strcmp (MuttVars[idx].option, "imap_prefetch_delay") == 0)
+      {
+	snprintf (err->data, err->dsize, _("%s: invalid value (%s)"), tmp->data,
+		  _("must be at least 1"));
+	r = -1;
+	break;
+      }
+#endif
       else
 	*ptr = val;
 
@@ -1452,6 +1452,31 @@ struct option_t MuttVars[] = {
   ** Header caching can greatly improve speed when opening POP, IMAP
   ** MH or Maildir folders, see ``$caching'' for details.
   */
+  { "header_cache_batch", DT_NUM, R_NONE, {.p=&HeaderCacheBatch}, {.l=1000} },
+  /*
+  ** .pp
+  ** When many headers are written to the header cache at once, such as
+  ** when a large folder is opened for the first time, mutt groups them
+  ** into transactions of this many records each, instead of committing
+  ** every record on its own.  A value of 0 puts all of them into a single
+  ** transaction.  This only has an effect with the kyotocabinet, lmdb,
+  ** qdbm and tokyocabinet backends.
+  */
+  { "header_cache_compact", DT_NUM, R_NONE, {.p=&HeaderCacheCompact}, {.l=0} },
+  /*
+  ** .pp
+  ** When greater than 0, each time a mailbox is closed, mutt checks this
+  ** many records of its header cache and removes those of messages that
+  ** are no longer in the mailbox.  The next time the mailbox is closed,
+  ** mutt continues where it left off.  After all records have been
+  ** checked, the database is compacted.  The \fC<compact-header-cache>\fP
+  ** function does the same for all records at once.
+  ** .pp
+  ** This only works if $$header_cache points to a directory, so that each
+  ** mailbox has a database of its own, or if $$header_cache_shared is set.
+  ** With the kyotocabinet and lmdb backends, the database is not
+  ** compacted while another mutt process has it open.
+  */
 # if defined(HAVE_QDBM) || defined(HAVE_TC) || defined(HAVE_KC)
   { "header_cache_compress", DT_BOOL, R_NONE, {.l=OPTHCACHECOMPRESS}, {.l=1} },
   /*
@@ -1464,6 +1489,41 @@ struct option_t MuttVars[] = {
   ** much faster than opening non header cached folders.
   */
 # endif /* HAVE_QDBM */
+# ifdef HAVE_ZSTD
+  { "header_cache_compress_dictionary", DT_PATH, R_NONE, {.p=&HeaderCacheCompressDictionary}, {.p=0} },
+  /*
+  ** .pp
+  ** A zstd dictionary, as created by ``zstd --train'', used when
+  ** compressing header cache records with $$header_cache_compress_method
+  ** set to ``zstd''.  Since headers are compressed one at a time, a
+  ** dictionary trained on your own mail makes them a lot smaller.
+  ** Records written with a dictionary can only be read back with the same
+  ** dictionary; any other header is simply fetched from the folder again.
+  */
+# endif /* HAVE_ZSTD */
+# if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+  { "header_cache_compress_level", DT_NUM, R_NONE, {.p=&HeaderCacheCompressLevel}, {.l=1} },
+  /*
+  ** .pp
+  ** The compression level used when $$header_cache_compress_method is
+  ** ``zstd''.  Higher levels make the header cache smaller, but slow down
+  ** writing it; reading is about as fast at any level.  The lz4 method
+  ** ignores this option.
+  */
+  { "header_cache_compress_method", DT_STR, R_NONE, {.p=&HeaderCacheCompressMethod}, {.p=0} },
+  /*
+  ** .pp
+  ** When set to ``zstd'' or ``lz4'', mutt compresses each record it
+  ** writes to the header cache with that method, whatever the backend.
+  ** ``mutt -v'' lists the methods compiled in.  Records are tagged with
+  ** the method used, so existing caches stay readable when this option
+  ** is changed.  A record that can't be decompressed, for instance one
+  ** written by a mutt built with another method, is removed from the
+  ** cache and the header is read from the folder again.  With the qdbm,
+  ** tokyocabinet and kyotocabinet backends, you will want to unset
+  ** $$header_cache_compress when using this.
+  */
+# endif /* HAVE_ZSTD || HAVE_LZ4 */
 # if defined(HAVE_GDBM) || defined(HAVE_DB4)
   { "header_cache_pagesize", DT_LNUM, R_NONE, {.p=&HeaderCachePageSize}, {.l=16384} },
   /*
@@ -1474,6 +1534,23 @@ struct option_t MuttVars[] = {
   ** or less optimal for most use cases.
   */
 # endif /* HAVE_GDBM || HAVE_DB4 */
+# ifndef HAVE_DB4
+  { "header_cache_shared", DT_BOOL, R_NONE, {.l=OPTHCACHESHARED}, {.l=0} },
+  /*
+  ** .pp
+  ** When \fIset\fP, all folders keep their headers in a single database,
+  ** which is opened the first time it is needed and stays open until mutt
+  ** exits, instead of being opened and closed each time a folder is
+  ** read.  If $$header_cache points to a directory, the database is the
+  ** file ``shared.hcache'' in it.  This saves a lot of work with many
+  ** IMAP folders, for instance when the sidebar is visible.
+  ** .pp
+  ** The database is locked while open with the gdbm, qdbm, tokyocabinet
+  ** and kyotocabinet backends, so only one mutt at a time can use it;
+  ** lmdb doesn't have this restriction.  Changing this option only
+  ** affects folders opened afterwards.
+  */
+# endif /* !HAVE_DB4 */
 #endif /* USE_HCACHE */
   { "header_color_partial", DT_BOOL, R_PAGER_FLOW, {.l=OPTHEADERCOLORPARTIAL}, {.l=0} },
   /*
@@ -1706,6 +1783,19 @@ struct option_t MuttVars[] = {
   ** of this many headers, instead of a single FETCH for all new
   ** headers.
   */
+  { "imap_fetch_connections",	DT_NUM, R_NONE, {.p=&ImapFetchConnections}, {.l=0} },
+  /*
+  ** .pp
+  ** When set to a value greater than 0, mutt opens up to this many
+  ** additional read-only connections to download the headers of a
+  ** large mailbox (at least 1000 new messages), fetching disjoint
+  ** ranges of messages over all connections at once.  This helps with
+  ** servers which throttle each connection.  The ranges are
+  ** $$imap_fetch_chunk_size messages each, or a quarter of an even
+  ** split when that is 0.  The extra connections are logged out once
+  ** the download is done.  At most 16 are used; keep this below the
+  ** number of connections your server allows per user.
+  */
   { "imap_headers",	DT_STR, R_INDEX, {.p=&ImapHeaders}, {.p=0} },
   /*
   ** .pp
@@ -1799,6 +1889,14 @@ struct option_t MuttVars[] = {
   ** more responsive. But not all servers correctly handle pipelined commands,
   ** so if you have problems you might want to try setting this variable to 0.
   ** .pp
+  ** This is only the starting depth.  Mutt times each batch of commands,
+  ** such as the flag updates sent when a mailbox is synced, or the
+  ** requests made for $$imap_fetch_chunk_size, and deepens the pipeline
+  ** (up to 256 commands) while that keeps saving round trips, which
+  ** helps most on high latency links.  It becomes shallower again if the
+  ** server slows down or rejects commands.  Setting this variable to 0
+  ** turns pipelining off entirely.
+  ** .pp
   ** \fBNote:\fP Changes to this variable have no effect on open connections.
   */
   { "imap_poll_timeout", DT_NUM,  R_NONE, {.p=&ImapPollTimeout}, {.l=15} },
@@ -1809,6 +1907,40 @@ struct option_t MuttVars[] = {
   ** for new mail, before timing out and closing the connection.  Set
   ** to 0 to disable timing out.
   */
+  { "imap_prefetch",	DT_BOOL, R_NONE, {.l=OPTIMAPPREFETCH}, {.l=0} },
+  /*
+  ** .pp
+  ** When \fIset\fP, and the $$header_cache is enabled, Mutt uses idle
+  ** time in the index to download the headers of the IMAP mailboxes
+  ** listed with the ``$mailboxes'' command into the header cache, so
+  ** that changing to them later only needs to evaluate the cache.
+  ** Mailboxes are fetched one at a time, over a separate connection,
+  ** once the keyboard has been idle for $$imap_prefetch_delay seconds.
+  ** A mailbox is only fetched again after its \fCSTATUS\fP shows new
+  ** messages.
+  ** .pp
+  ** Only accounts Mutt is already logged in to are prefetched.  A
+  ** keystroke stops the prefetch after the current group of
+  ** $$imap_prefetch_chunk_size headers; it is resumed from where it
+  ** left off the next time the index is idle.
+  */
+  { "imap_prefetch_chunk_size",	DT_LNUM, R_NONE, {.p=&ImapPrefetchChunkSize}, {.l=100} },
+  /*
+  ** .pp
+  ** The number of headers requested per \fCFETCH\fP command by the
+  ** background prefetch (see $$imap_prefetch).  Smaller values limit the
+  ** load placed on the server and make the prefetch stop sooner when a
+  ** key is pressed.  If $$imap_fetch_chunk_size is smaller, it is used
+  ** instead.
+  */
+  { "imap_prefetch_delay",	DT_NUM, R_NONE, {.p=&ImapPrefetchDelay}, {.l=10} },
+  /*
+  ** .pp
+  ** The number of seconds the keyboard must be idle in the index before
+  ** the background prefetch (see $$imap_prefetch) fetches the next
+  ** mailbox.  The same pause is kept between mailboxes.  It must be at
+  ** least 1.
+  */
   { "imap_qresync",  DT_BOOL, R_NONE, {.l=OPTIMAPQRESYNC}, {.l=0} },
   /*
   ** .pp
@@ -1820,6 +1952,19 @@ struct option_t MuttVars[] = {
   ** strange behavior, such as duplicate or missing messages please
   ** file a bug report to let us know.
   */
+  { "imap_search_filter",	DT_BOOL, R_NONE, {.l=OPTIMAPSEARCHFILTER}, {.l=0} },
+  /*
+  ** .pp
+  ** When \fIset\fP, a \fC~b\fP or \fC~B\fP pattern whose regular
+  ** expression is plain ASCII text is first looked up with the server's
+  ** SEARCH command, and messages the server doesn't match are taken not
+  ** to match without being downloaded.  This saves a lot of traffic on
+  ** large mailboxes, but servers don't search the raw text the way mutt
+  ** does: many match decoded text only, and some (such as Gmail and
+  ** Exchange) match whole words only, so messages may be missed.  When
+  ** \fIunset\fP, every message is downloaded and searched by mutt.
+  ** \fC=b\fP, \fC=B\fP and \fC=h\fP are always searched by the server.
+  */
   { "imap_servernoise",		DT_BOOL, R_NONE, {.l=OPTIMAPSERVERNOISE}, {.l=1} },
   /*
   ** .pp
@@ -2011,6 +2156,37 @@ struct option_t MuttVars[] = {
   ** This variable configures how often (in seconds) mutt should look for
   ** new mail. Also see the $$timeout variable.
   */
+#ifdef USE_PTHREADS
+  { "mail_check_async", DT_BOOL, R_NONE, {.l=OPTMAILCHECKASYNC}, {.l=0} },
+  /*
+  ** .pp
+  ** When \fIset\fP, local mailboxes (mbox, MMDF, MH and Maildir) are
+  ** polled for new mail by a background thread, so that a slow file
+  ** system doesn't hold up the user interface.  The results show up in
+  ** the sidebar and the status line once the thread is done; until then
+  ** the previous ones are kept.  The thread also reads the
+  ** ``.mh_sequences'' of MH folders, and counts the messages of mbox and
+  ** MMDF folders for $$mail_check_stats.
+  ** .pp
+  ** IMAP mailboxes are not handled by the thread.  Their STATUS commands
+  ** are still sent from the foreground, on the connections mutt already
+  ** has open, and a server that doesn't answer within
+  ** $$imap_poll_timeout seconds is disconnected.
+  */
+#endif
+  { "mail_check_backoff", DT_NUM, R_NONE, {.p=&BuffyBackoff}, {.l=1} },
+  /*
+  ** .pp
+  ** When greater than 1, mailboxes that keep showing no change are
+  ** polled less often: every check that finds nothing new adds
+  ** $$mail_check seconds to the wait before the next one, up to this
+  ** many times $$mail_check.  A change brings the mailbox back to every
+  ** $$mail_check seconds, and \fC<check-stats>\fP still polls all of
+  ** them.  This keeps a long list of ``$mailboxes'', most of which are
+  ** quiet, from making mutt sluggish.  The cost of each check is
+  ** written to the debug log at level 3.  IMAP mailboxes are not
+  ** affected.
+  */
   { "mail_check_recent",DT_BOOL, R_NONE, {.l=OPTMAILCHECKRECENT}, {.l=1} },
   /*
   ** .pp
@@ -2068,6 +2244,20 @@ struct option_t MuttVars[] = {
   ** message every time the folder is opened (which can be very slow for NFS
   ** folders).
   */
+#endif
+#ifdef USE_PTHREADS
+  { "maildir_read_threads", DT_NUM, R_NONE, {.p=&MaildirReadThreads}, {.l=0} },
+  /*
+  ** .pp
+  ** When set to a value greater than 1, mutt uses this many worker threads
+  ** to open maildir and MH messages and read in their header blocks ahead of
+  ** the parser while a folder is being read.  This mostly helps folders on
+  ** network file systems, where opening each file costs a round trip.
+  ** Messages found in the header cache are never opened.  When set to 0
+  ** or 1, messages are read one at a time.  At most 64 threads are
+  ** started, and fewer files are opened ahead when the limit on open
+  ** files is low.
+  */
 #endif
   { "maildir_trash", DT_BOOL, R_BOTH, {.l=OPTMAILDIRTRASH}, {.l=0} },
   /*
@@ -2126,6 +2316,37 @@ struct option_t MuttVars[] = {
   ** .pp
   ** Also see the $$move variable.
   */
+#ifdef USE_HCACHE
+  { "mbox_header_cache", DT_BOOL, R_NONE, {.l=OPTMBOXHCACHE}, {.l=0} },
+  /*
+  ** .pp
+  ** When \fIset\fP and $$header_cache is in use, mutt keeps an index of
+  ** mbox and MMDF folders in the header cache: the parsed headers together
+  ** with the offset of each message.  When such a folder is opened again
+  ** and has not changed, or mail has only been appended to it, the headers
+  ** are read from the cache and only the new part of the folder is scanned.
+  ** .pp
+  ** A folder is considered unchanged if its size, modification time and
+  ** the contents of its first and last few kilobytes are the same.  Do not
+  ** set this if other programs rewrite your folders while keeping all of
+  ** these intact.
+  */
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_FMEMOPEN)
+  { "mbox_mmap",	DT_BOOL, R_NONE, {.l=OPTMBOXMMAP}, {.l=0} },
+  /*
+  ** .pp
+  ** When \fIset\fP, mbox and MMDF folders are read by mapping the file into
+  ** memory with \fCmmap(2)\fP and searching it for message separators,
+  ** instead of reading it line by line.  This is considerably faster for
+  ** large folders.  Folders that cannot be mapped, such as pipes, and
+  ** compressed folders are always read the traditional way.
+  ** .pp
+  ** \fBNote:\fP if another program truncates the folder while it is being
+  ** read, mutt may be killed by a \fCSIGBUS\fP signal.  Only set this
+  ** if all programs writing to your folders honor the mailbox locks.
+  */
+#endif
   { "mbox_type",	DT_MAGIC,R_NONE, {.p=&DefaultMagic}, {.l=MUTT_MBOX} },
   /*
   ** .pp
@@ -3515,6 +3736,20 @@ struct option_t MuttVars[] = {
   ** For the pager, this variable specifies the number of lines shown
   ** before search results. By default, search results will be top-aligned.
   */
+#ifdef USE_PTHREADS
+  { "search_threads",	DT_NUM,  R_NONE, {.p=&SearchThreads}, {.l=0} },
+  /*
+  ** .pp
+  ** When set to a value greater than 1, \fC<limit>\fP and the
+  ** \fC<tag-pattern>\fP family of functions search the bodies and headers
+  ** of messages in mbox, MMDF, MH and Maildir folders for \fC~b\fP,
+  ** \fC~h\fP and \fC~B\fP with this many worker threads, each reading
+  ** the folder through its own file handle.  With $$thorough_search set,
+  ** only \fC~b\fP on plain text messages needing no decoding is searched
+  ** this way; everything else is still searched one message at a time.
+  ** When set to 0 or 1, all messages are searched one at a time.
+  */
+#endif
   { "send_charset",	DT_STR,  R_NONE, {.p=&SendCharset}, {.p="us-ascii:iso-8859-1:utf-8"} },
   /*
   ** .pp
@@ -4296,6 +4531,17 @@ struct option_t MuttVars[] = {
   ** reversed again (which is not the right thing to do, but kept to
   ** not break any existing configuration setting).
   */
+#ifdef USE_PTHREADS
+  { "sort_workers",	DT_NUM,  R_NONE, {.p=&SortWorkers}, {.l=0} },
+  /*
+  ** .pp
+  ** When set to a value greater than 1, mutt sorts the messages of large
+  ** folders, and the threads of large folders sorted by ``threads'', with
+  ** this many worker threads.  The resulting order is the same.  Threads
+  ** sorted by ``from'' or ``to'' are still sorted one at a time.  When
+  ** set to 0 or 1, everything is sorted by a single thread.
+  */
+#endif
   { "spam_separator",   DT_STR, R_NONE, {.p=&SpamSep}, {.p=","} },
   /*
   ** .pp
@@ -4604,6 +4850,22 @@ struct option_t MuttVars[] = {
   ** .pp
   ** Note that $$indent_string is ignored when this option is \fIset\fP.
   */
+#ifdef USE_HCACHE
+  { "text_index",	DT_BOOL, R_NONE, {.l=OPTTEXTINDEX}, {.l=0} },
+  /*
+  ** .pp
+  ** When \fIset\fP, the words of the message bodies decoded by the
+  ** \fC~w\fP search, and by \fC~b\fP and \fC~B\fP with $$thorough_search,
+  ** are recorded in an index kept in $$header_cache, next to the header
+  ** cache of the mailbox.  \fC<limit>\fP and the \fC<tag-pattern>\fP
+  ** family of functions then skip the messages the index shows lack one
+  ** of the words given to \fC~w\fP, and only decode the rest.  Only
+  ** local mbox, MMDF, MH and Maildir folders are indexed.  Encrypted
+  ** messages, and messages with an encrypted part, are never indexed, so
+  ** that their decrypted text isn't written to disk; they are always
+  ** decoded and searched.
+  */
+#endif
   { "thorough_search",	DT_BOOL, R_NONE, {.l=OPTTHOROUGHSRC}, {.l=1} },
   /*
   ** .pp
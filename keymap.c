@@ -443,6 +443,27 @@ int km_dokey (int menu)
   {
     i = Timeout > 0 ? Timeout : 60;
 #ifdef USE_IMAP
+    /* use idle time in the index to fill the header cache of the other
+     * IMAP mailboxes, one mailbox per $imap_prefetch_delay seconds */
+    if (menu == MENU_MAIN && option (OPTIMAPPREFETCH))
+    {
+      while (ImapPrefetchDelay < i)
+      {
+	mutt_getch_timeout (ImapPrefetchDelay * 1000);
+	tmp = mutt_getch ();
+	mutt_getch_timeout (-1);
+#ifdef USE_INOTIFY
+	if (tmp.ch != -2 || SigWinch || MonitorFilesChanged)
+#else
+	if (tmp.ch != -2 || SigWinch)
+#endif
+	  goto gotkey;
+	i -= ImapPrefetchDelay;
+	if (!imap_prefetch ())
+	  break;
+      }
+    }
+
     /* keepalive may need to run more frequently than Timeout allows */
     if (ImapKeepalive)
     {
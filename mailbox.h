@@ -84,6 +84,7 @@ int mx_access (const char*, int);
 int mx_check_empty (const char *);
 int mx_msg_padding_size (CONTEXT *);
 int mx_save_to_header_cache (CONTEXT *, HEADER *);
+int mx_gc_header_cache (CONTEXT *, int, int *, LOFF_T *);
 
 int mx_is_maildir (const char *);
 int mx_is_mh (const char *);
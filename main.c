@@ -245,6 +245,7 @@ static void show_version (void)
 
 #ifdef USE_HCACHE
   printf ("\nhcache backend: %s", mutt_hcache_backend ());
+  printf ("\nhcache compression: %s", mutt_hcache_compress_methods ());
 #endif
 
   puts ("\n\nCompiler:");
@@ -554,6 +555,12 @@ static void show_version (void)
     "-USE_INOTIFY  "
 #endif
 
+#ifdef USE_PTHREADS
+    "+USE_PTHREADS  "
+#else
+    "-USE_PTHREADS  "
+#endif
+
     );
 
 #ifdef ISPELL
@@ -1414,6 +1421,9 @@ cleanup_and_exit:
 #ifdef USE_IMAP
   imap_logout_all ();
 #endif
+#ifdef USE_HCACHE
+  mutt_hcache_shutdown ();
+#endif
 #ifdef USE_SASL_CYRUS
   mutt_sasl_done ();
 #endif
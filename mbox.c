@@ -28,8 +28,13 @@
 #include "sort.h"
 #include "copy.h"
 #include "mutt_curses.h"
+#if USE_HCACHE
+#include "hcache.h"
+#include "md5.h"
+#endif
 
 #include <sys/stat.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <string.h>
 #include <utime.h>
@@ -37,6 +42,14 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_FMEMOPEN)
+#define MBOX_MMAP 1
+#endif
 
 /* struct used by mutt_sync_mailbox() to store new offsets */
 struct m_update_t
@@ -48,6 +61,364 @@ struct m_update_t
   LOFF_T length;
 };
 
+#ifdef MBOX_MMAP
+/* A folder mapped into memory by mbox_map_open().  The header parser
+ * still wants a stream, so fp is a fmemopen() stream over the same
+ * memory: offsets in it are offsets in the folder.
+ */
+struct mbox_map
+{
+  const char *data;
+  LOFF_T len;
+  FILE *fp;
+};
+
+static int mbox_map_open (CONTEXT *ctx, struct mbox_map *map)
+{
+  struct stat st;
+  void *data;
+
+  memset (map, 0, sizeof (struct mbox_map));
+
+  if (!option (OPTMBOXMMAP))
+    return -1;
+#ifdef USE_COMPRESSED
+  if (ctx->compress_info)
+    return -1;
+#endif
+  if (fstat (fileno (ctx->fp), &st) == -1 || !S_ISREG (st.st_mode) ||
+      st.st_size <= 0 || (unsigned long long) st.st_size > SIZE_MAX)
+    return -1;
+
+  data = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED,
+               fileno (ctx->fp), 0);
+  if (data == MAP_FAILED)
+  {
+    dprint (1, (debugfile, "mbox_map_open: mmap failed: %s\n", strerror (errno)));
+    return -1;
+  }
+
+  if ((map->fp = fmemopen (data, (size_t) st.st_size, "r")) == NULL)
+  {
+    dprint (1, (debugfile, "mbox_map_open: fmemopen failed: %s\n", strerror (errno)));
+    munmap (data, (size_t) st.st_size);
+    return -1;
+  }
+
+#ifdef MADV_SEQUENTIAL
+  madvise (data, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  map->data = (const char *) data;
+  map->len = st.st_size;
+  return 0;
+}
+
+static void mbox_map_close (struct mbox_map *map)
+{
+  safe_fclose (&map->fp);
+  if (map->data)
+    munmap ((void *) map->data, (size_t) map->len);
+  map->data = NULL;
+}
+
+/* Returns the offset of the first line at or after pos that starts
+ * with prefix, or the length of the map if there is none.  Adds the
+ * number of lines skipped to *lines, counting them the way a loop
+ * calling fgets() with a buffer of chunk + 1 bytes would.
+ */
+static LOFF_T mbox_map_find (struct mbox_map *map, LOFF_T pos,
+                             const char *prefix, size_t plen, size_t chunk,
+                             int *lines)
+{
+  const char *p = map->data + pos;
+  const char *end = map->data + map->len;
+  const char *next;
+
+  while (p < end)
+  {
+    if ((size_t) (end - p) >= plen && memcmp (p, prefix, plen) == 0)
+      return p - map->data;
+    if ((next = memchr (p, '\n', end - p)) != NULL)
+      next++;
+    else
+      next = end;
+    *lines += (next - p + chunk - 1) / chunk;
+    p = next;
+  }
+
+  return map->len;
+}
+
+/* Copies the line at pos into buf the way fgets() would, and returns
+ * the offset following what was copied.
+ */
+static LOFF_T mbox_map_gets (struct mbox_map *map, LOFF_T pos,
+                             char *buf, size_t buflen)
+{
+  const char *p = map->data + pos;
+  const char *nl;
+  size_t n;
+
+  n = MIN ((size_t) (map->len - pos), buflen - 1);
+  if ((nl = memchr (p, '\n', n)) != NULL)
+    n = nl - p + 1;
+  memcpy (buf, p, n);
+  buf[n] = 0;
+
+  return pos + n;
+}
+
+static int mbox_map_count_lines (struct mbox_map *map, LOFF_T pos, LOFF_T len)
+{
+  const char *p = map->data + pos;
+  const char *end;
+  int lines = 0;
+
+  end = map->data + MIN (pos + len, map->len);
+  while (p < end && (p = memchr (p, '\n', end - p)) != NULL)
+  {
+    lines++;
+    p++;
+  }
+
+  return lines;
+}
+#endif /* MBOX_MMAP */
+
+#if USE_HCACHE
+/* The mbox index keeps the parsed headers of an mbox or MMDF folder in
+ * the header cache, under their position in the folder ("/0", "/1", ...).
+ * The MBOX_INDEX_KEY record describes the part of the folder they cover,
+ * so that a folder which is unchanged, or has only had mail appended to
+ * it, need not be read again up to that point.
+ */
+#define MBOX_INDEX_KEY "/MBOXINDEX"
+#define MBOX_INDEX_BLOCK 4096
+
+struct mbox_index
+{
+  int magic;
+  int count;			/* number of messages covered */
+  LOFF_T size;			/* covered part of the folder */
+  struct timespec mtime;
+  unsigned char head[16];	/* md5 of the first block */
+  unsigned char tail[16];	/* md5 of the block ending at size */
+};
+
+static header_cache_t *mbox_index_open (CONTEXT *ctx)
+{
+  if (!option (OPTMBOXHCACHE))
+    return NULL;
+#ifdef USE_COMPRESSED
+  /* compressed folders are read from a new temporary file every time */
+  if (ctx->compress_info)
+    return NULL;
+#endif
+  return mutt_hcache_open (HeaderCache, ctx->path, NULL);
+}
+
+/* Checksum the first and the last MBOX_INDEX_BLOCK bytes of the first
+ * size bytes of the folder.  The file position is preserved.
+ */
+static int mbox_index_digest (FILE *fp, LOFF_T size, unsigned char *head,
+                              unsigned char *tail)
+{
+  char buf[MBOX_INDEX_BLOCK];
+  LOFF_T pos;
+  size_t len;
+  int rc = -1;
+
+  if ((pos = ftello (fp)) < 0)
+    return -1;
+
+  len = MIN (size, sizeof (buf));
+  if (fseeko (fp, 0, SEEK_SET) != 0 || fread (buf, 1, len, fp) != len)
+    goto out;
+  md5_buffer (buf, len, head);
+
+  if (fseeko (fp, size - len, SEEK_SET) != 0 || fread (buf, 1, len, fp) != len)
+    goto out;
+  md5_buffer (buf, len, tail);
+  rc = 0;
+
+out:
+  if (fseeko (fp, pos, SEEK_SET) != 0)
+    rc = -1;
+  return rc;
+}
+
+static int mbox_index_fetch (header_cache_t *hc, struct mbox_index *idx)
+{
+  void *data;
+
+  if (!(data = mutt_hcache_fetch_raw (hc, MBOX_INDEX_KEY, strlen)))
+    return -1;
+  memcpy (idx, data, sizeof (struct mbox_index));
+  mutt_hcache_free (&data);
+  return 0;
+}
+
+/* Is the index up to date with what is currently in the context? */
+static int mbox_index_current (CONTEXT *ctx)
+{
+  header_cache_t *hc;
+  struct mbox_index idx;
+  int rc = 0;
+
+  if (!(hc = mbox_index_open (ctx)))
+    return 0;
+  if (mbox_index_fetch (hc, &idx) == 0)
+    rc = (idx.magic == ctx->magic && idx.count == ctx->msgcount &&
+          idx.size == ctx->size);
+  mutt_hcache_close (hc);
+
+  return rc;
+}
+
+/* Read the headers of the part of the folder covered by the index, and
+ * position ctx->fp after it.  Must be called with an empty context,
+ * after ctx->size and ctx->mtime are set.  Returns the number of headers
+ * read; 0 means the folder has to be read from the beginning.
+ */
+static int mbox_index_restore (CONTEXT *ctx, progress_t *progress)
+{
+  header_cache_t *hc;
+  struct mbox_index idx;
+  unsigned char head[16], tail[16];
+  char key[SHORT_STRING], buf[sizeof (MMDF_SEP)];
+  const char *sep;
+  void *data;
+  HEADER *h;
+  int i;
+
+  if (ctx->msgcount || ftello (ctx->fp) != 0)
+    return 0;
+  if (!(hc = mbox_index_open (ctx)))
+    return 0;
+
+  if (mbox_index_fetch (hc, &idx) != 0 ||
+      idx.magic != ctx->magic || idx.count <= 0 ||
+      idx.size <= 0 || idx.size > ctx->size)
+    goto bail;
+
+  if (idx.size == ctx->size &&
+      mutt_timespec_compare (&idx.mtime, &ctx->mtime) != 0)
+    goto bail;
+
+  if (mbox_index_digest (ctx->fp, idx.size, head, tail) != 0 ||
+      memcmp (head, idx.head, sizeof (head)) ||
+      memcmp (tail, idx.tail, sizeof (tail)))
+    goto bail;
+
+  /* anything after the covered part must be new messages */
+  if (idx.size < ctx->size)
+  {
+    sep = ctx->magic == MUTT_MBOX ? "From " : MMDF_SEP;
+    if (fseeko (ctx->fp, idx.size, SEEK_SET) != 0 ||
+        fread (buf, 1, strlen (sep), ctx->fp) != strlen (sep) ||
+        mutt_strncmp (buf, sep, strlen (sep)))
+    {
+      dprint (1, (debugfile, "mbox_index_restore: %s was modified\n",
+                  ctx->path));
+      goto bail;
+    }
+  }
+
+  for (i = 0; i < idx.count; i++)
+  {
+    if (progress)
+      mutt_progress_update (progress, i, -1);
+
+    snprintf (key, sizeof (key), "/%d", i);
+    if (!(data = mutt_hcache_fetch (hc, key, strlen)))
+      break;
+    h = mutt_hcache_restore ((unsigned char *) data, NULL);
+
+    if (h->index != i || h->offset >= idx.size)
+    {
+      mutt_free_header (&h);
+      break;
+    }
+
+    if (ctx->msgcount == ctx->hdrmax)
+      mx_alloc_memory (ctx);
+    ctx->hdrs[ctx->msgcount++] = h;
+  }
+
+  if (i < idx.count)
+  {
+    dprint (1, (debugfile, "mbox_index_restore: incomplete index for %s\n",
+                ctx->path));
+    while (ctx->msgcount > 0)
+      mutt_free_header (&ctx->hdrs[--ctx->msgcount]);
+    goto bail;
+  }
+
+  mutt_hcache_close (hc);
+
+  if (fseeko (ctx->fp, idx.size, SEEK_SET) != 0)
+  {
+    while (ctx->msgcount > 0)
+      mutt_free_header (&ctx->hdrs[--ctx->msgcount]);
+    rewind (ctx->fp);
+    return 0;
+  }
+
+  mx_update_context (ctx, ctx->msgcount);
+  return ctx->msgcount;
+
+bail:
+  mutt_hcache_close (hc);
+  rewind (ctx->fp);
+  return 0;
+}
+
+/* Store the headers from first on, and record that the index covers
+ * count messages and the first size bytes of the folder.  Deleted
+ * headers are skipped: they are only still in the context after a sync.
+ */
+static void mbox_index_save (CONTEXT *ctx, int first, int count, LOFF_T size)
+{
+  header_cache_t *hc;
+  struct mbox_index idx;
+  struct stat sb;
+  char key[SHORT_STRING];
+  int i;
+
+  if (count <= 0 || size <= 0)
+    return;
+  if (!(hc = mbox_index_open (ctx)))
+    return;
+
+  memset (&idx, 0, sizeof (idx));
+  idx.magic = ctx->magic;
+  idx.count = count;
+  idx.size = size;
+  if (fstat (fileno (ctx->fp), &sb) != 0 ||
+      mbox_index_digest (ctx->fp, size, idx.head, idx.tail) != 0)
+    goto out;
+  mutt_get_stat_timespec (&idx.mtime, &sb, MUTT_STAT_MTIME);
+
+  /* invalidate the index while it is being updated */
+  mutt_hcache_delete (hc, MBOX_INDEX_KEY, strlen);
+
+  for (i = first; i < ctx->msgcount; i++)
+  {
+    if (ctx->hdrs[i]->deleted)
+      continue;
+    snprintf (key, sizeof (key), "/%d", ctx->hdrs[i]->index);
+    if (mutt_hcache_store (hc, key, ctx->hdrs[i], 0, strlen, 0) != 0)
+      goto out;
+  }
+
+  mutt_hcache_store_raw (hc, MBOX_INDEX_KEY, &idx, sizeof (idx), strlen);
+
+out:
+  mutt_hcache_close (hc);
+}
+#endif /* USE_HCACHE */
+
 /* parameters:
  * ctx - context to lock
  * excl - exclusive lock?
@@ -79,6 +450,127 @@ void mbox_unlock_mailbox (CONTEXT *ctx)
   }
 }
 
+#ifdef MBOX_MMAP
+/* mmdf_parse_mailbox() for a mapped folder: must produce exactly the
+ * same headers as the stdio loop below.
+ */
+static int mmdf_parse_map (CONTEXT *ctx, struct mbox_map *map,
+                           progress_t *progress)
+{
+  char buf[HUGE_STRING];
+  char return_path[LONG_STRING];
+  int count = 0, oldmsgcount = ctx->msgcount;
+  int lines;
+  time_t t;
+  LOFF_T pos, loc, tmploc;
+  HEADER *hdr;
+  size_t seplen = sizeof (MMDF_SEP) - 1;
+
+  pos = ftello (ctx->fp);
+  while (pos < map->len)
+  {
+    pos = mbox_map_gets (map, pos, buf, sizeof (buf) - 1);
+    if (mutt_strcmp (buf, MMDF_SEP) != 0)
+    {
+      dprint (1, (debugfile, "mmdf_parse_map: corrupt mailbox!\n"));
+      mutt_error _("Mailbox is corrupt!");
+      return (-1);
+    }
+
+    loc = pos;
+
+    count++;
+    if (progress)
+      mutt_progress_update (progress, count,
+                            (int) (loc / (ctx->size / 100 + 1)));
+
+    if (ctx->msgcount == ctx->hdrmax)
+      mx_alloc_memory (ctx);
+    ctx->hdrs[ctx->msgcount] = hdr = mutt_new_header ();
+    hdr->offset = loc;
+    hdr->index = ctx->msgcount;
+
+    if (pos >= map->len)
+    {
+      dprint (1, (debugfile, "mmdf_parse_map: unexpected EOF\n"));
+      break;
+    }
+    pos = mbox_map_gets (map, pos, buf, sizeof (buf) - 1);
+
+    return_path[0] = 0;
+
+    if (!is_from (buf, return_path, sizeof (return_path), &t))
+      pos = loc;
+    else
+      hdr->received = t - mutt_local_tz (t);
+
+    if (fseeko (map->fp, pos, SEEK_SET) != 0)
+    {
+      dprint (1, (debugfile, "mmdf_parse_map: fseek() failed\n"));
+      mutt_error _("Mailbox is corrupt!");
+      return (-1);
+    }
+    hdr->env = mutt_read_rfc822_header (map->fp, hdr, 0, 0);
+
+    pos = loc = ftello (map->fp);
+
+    if (hdr->content->length > 0 && hdr->lines > 0)
+    {
+      tmploc = loc + hdr->content->length;
+
+      if (0 < tmploc && tmploc < ctx->size)
+      {
+        if (tmploc < map->len)
+          pos = mbox_map_gets (map, tmploc, buf, sizeof (buf) - 1);
+        if (tmploc >= map->len || mutt_strcmp (MMDF_SEP, buf) != 0)
+        {
+          pos = loc;
+          hdr->content->length = -1;
+        }
+      }
+      else
+        hdr->content->length = -1;
+    }
+    else
+      hdr->content->length = -1;
+
+    if (hdr->content->length < 0)
+    {
+      lines = 0;
+      loc = mbox_map_find (map, pos, MMDF_SEP, seplen, sizeof (buf) - 2,
+                           &lines);
+      if (loc < map->len)
+        pos = loc + seplen;
+      else
+      {
+        lines--;
+        pos = loc;
+      }
+
+      hdr->lines = lines;
+      hdr->content->length = loc - hdr->content->offset;
+    }
+
+    if (!hdr->env->return_path && return_path[0])
+      hdr->env->return_path = rfc822_parse_adrlist (hdr->env->return_path, return_path);
+
+    if (!hdr->env->from)
+      hdr->env->from = rfc822_cpy_adr (hdr->env->return_path, 0);
+
+    ctx->msgcount++;
+  }
+
+  /* leave ctx->fp where the stdio loop would have */
+  if (fseeko (ctx->fp, pos, SEEK_SET) != 0)
+    dprint (1, (debugfile, "mmdf_parse_map: fseek() failed\n"));
+
+  if (ctx->msgcount > oldmsgcount)
+    mx_update_context (ctx, ctx->msgcount - oldmsgcount);
+
+  return (0);
+}
+#endif /* MBOX_MMAP */
+
 int mmdf_parse_mailbox (CONTEXT *ctx)
 {
   char buf[HUGE_STRING];
@@ -97,6 +589,19 @@ int mmdf_parse_mailbox (CONTEXT *ctx)
 #endif
   progress_t progress;
   char msgbuf[STRING];
+#ifdef MBOX_MMAP
+  struct mbox_map map;
+  int rc;
+#endif
+#if USE_HCACHE
+  int first;
+#endif
+
+#if USE_HCACHE
+  /* headers already in the context need not be stored again, unless the
+   * index was not up to date with them */
+  first = mbox_index_current (ctx) ? ctx->msgcount : 0;
+#endif
 
   if (stat (ctx->path, &sb) == -1)
   {
@@ -132,6 +637,25 @@ int mmdf_parse_mailbox (CONTEXT *ctx)
     mutt_progress_init (&progress, msgbuf, MUTT_PROGRESS_MSG, ReadInc, 0);
   }
 
+#if USE_HCACHE
+  if (!first)
+    first = mbox_index_restore (ctx, ctx->quiet ? NULL : &progress);
+  oldmsgcount = ctx->msgcount;
+#endif
+
+#ifdef MBOX_MMAP
+  if (mbox_map_open (ctx, &map) == 0)
+  {
+    rc = mmdf_parse_map (ctx, &map, ctx->quiet ? NULL : &progress);
+    mbox_map_close (&map);
+#if USE_HCACHE
+    if (rc == 0)
+      mbox_index_save (ctx, first, ctx->msgcount, ftello (ctx->fp));
+#endif
+    return rc;
+  }
+#endif
+
   FOREVER
   {
     if (fgets (buf, sizeof (buf) - 1, ctx->fp) == NULL)
@@ -232,9 +756,143 @@ int mmdf_parse_mailbox (CONTEXT *ctx)
   if (ctx->msgcount > oldmsgcount)
     mx_update_context (ctx, ctx->msgcount - oldmsgcount);
 
+#if USE_HCACHE
+  mbox_index_save (ctx, first, ctx->msgcount, ftello (ctx->fp));
+#endif
+
   return (0);
 }
 
+#ifdef MBOX_MMAP
+/* mbox_parse_mailbox() for a mapped folder.  Instead of reading every
+ * line, skip straight to the next line starting with "From ", counting
+ * the lines in between.  The offsets, lengths and line counts must be
+ * exactly those the stdio loop below would produce.
+ */
+static int mbox_parse_map (CONTEXT *ctx, struct mbox_map *map,
+                           progress_t *progress)
+{
+  char buf[HUGE_STRING], return_path[STRING];
+  HEADER *curhdr;
+  time_t t;
+  int count = 0, lines = 0;
+  LOFF_T loc, next;
+
+  loc = ftello (ctx->fp);
+  while (loc < map->len)
+  {
+    if ((loc = mbox_map_find (map, loc, "From ", 5, sizeof (buf) - 1,
+                              &lines)) >= map->len)
+      break;
+
+    next = mbox_map_gets (map, loc, buf, sizeof (buf));
+    if (!is_from (buf, return_path, sizeof (return_path), &t))
+    {
+      lines++;
+      loc = next;
+      continue;
+    }
+
+#define PREV ctx->hdrs[ctx->msgcount-1]
+
+    /* Save the Content-Length of the previous message */
+    if (count > 0)
+    {
+      if (PREV->content->length < 0)
+      {
+        PREV->content->length = loc - PREV->content->offset - 1;
+        if (PREV->content->length < 0)
+          PREV->content->length = 0;
+      }
+      if (!PREV->lines)
+        PREV->lines = lines ? lines - 1 : 0;
+    }
+
+    count++;
+
+    if (progress)
+      mutt_progress_update (progress, count,
+                            (int)(next / (ctx->size / 100 + 1)));
+
+    if (ctx->msgcount == ctx->hdrmax)
+      mx_alloc_memory (ctx);
+
+    curhdr = ctx->hdrs[ctx->msgcount] = mutt_new_header ();
+    curhdr->received = t - mutt_local_tz (t);
+    curhdr->offset = loc;
+    curhdr->index = ctx->msgcount;
+
+    if (fseeko (map->fp, next, SEEK_SET) != 0)
+      dprint (1, (debugfile, "mbox_parse_map: fseek() failed\n"));
+    curhdr->env = mutt_read_rfc822_header (map->fp, curhdr, 0, 0);
+
+    loc = next = ftello (map->fp);
+
+    /* See mbox_parse_mailbox() for the content-length checks. */
+    if (curhdr->content->length > 0)
+    {
+      LOFF_T tmploc;
+
+      tmploc = curhdr->content->length < ctx->size ? loc + curhdr->content->length + 1 : -1;
+
+      if (0 < tmploc && tmploc < ctx->size)
+      {
+        if (tmploc >= map->len || map->len - tmploc < 5 ||
+            strncmp ("From ", map->data + tmploc, 5) != 0)
+        {
+          dprint (1, (debugfile, "mbox_parse_map: bad content-length in message %d (cl=" OFF_T_FMT ")\n", curhdr->index, curhdr->content->length));
+          curhdr->content->length = -1;
+        }
+      }
+      else if (tmploc != ctx->size)
+        curhdr->content->length = -1;
+
+      if (curhdr->content->length != -1)
+      {
+        if (curhdr->lines == 0)
+          curhdr->lines = mbox_map_count_lines (map, loc,
+                                                curhdr->content->length);
+        next = tmploc;
+      }
+    }
+
+    ctx->msgcount++;
+
+    if (!curhdr->env->return_path && return_path[0])
+      curhdr->env->return_path = rfc822_parse_adrlist (curhdr->env->return_path, return_path);
+
+    if (!curhdr->env->from)
+      curhdr->env->from = rfc822_cpy_adr (curhdr->env->return_path, 0);
+
+    lines = 0;
+    loc = next;
+  }
+
+  if (count > 0)
+  {
+    if (PREV->content->length < 0)
+    {
+      PREV->content->length = map->len - PREV->content->offset - 1;
+      if (PREV->content->length < 0)
+	PREV->content->length = 0;
+    }
+
+    if (!PREV->lines)
+      PREV->lines = lines ? lines - 1 : 0;
+
+    mx_update_context (ctx, count);
+  }
+
+#undef PREV
+
+  /* leave ctx->fp where the stdio loop would have */
+  if (fseeko (ctx->fp, map->len, SEEK_SET) != 0)
+    dprint (1, (debugfile, "mbox_parse_map: fseek() failed\n"));
+
+  return (0);
+}
+#endif /* MBOX_MMAP */
+
 /* Note that this function is also called when new mail is appended to the
  * currently open folder, and NOT just when the mailbox is initially read.
  *
@@ -257,6 +915,19 @@ int mbox_parse_mailbox (CONTEXT *ctx)
 #endif
   progress_t progress;
   char msgbuf[STRING];
+#ifdef MBOX_MMAP
+  struct mbox_map map;
+  int rc;
+#endif
+#if USE_HCACHE
+  int first;
+#endif
+
+#if USE_HCACHE
+  /* headers already in the context need not be stored again, unless the
+   * index was not up to date with them */
+  first = mbox_index_current (ctx) ? ctx->msgcount : 0;
+#endif
 
   /* Save information about the folder at the time we opened it. */
   if (stat (ctx->path, &sb) == -1)
@@ -295,6 +966,24 @@ int mbox_parse_mailbox (CONTEXT *ctx)
     mutt_progress_init (&progress, msgbuf, MUTT_PROGRESS_MSG, ReadInc, 0);
   }
 
+#if USE_HCACHE
+  if (!first)
+    first = mbox_index_restore (ctx, ctx->quiet ? NULL : &progress);
+#endif
+
+#ifdef MBOX_MMAP
+  if (mbox_map_open (ctx, &map) == 0)
+  {
+    rc = mbox_parse_map (ctx, &map, ctx->quiet ? NULL : &progress);
+    mbox_map_close (&map);
+#if USE_HCACHE
+    if (rc == 0)
+      mbox_index_save (ctx, first, ctx->msgcount, ftello (ctx->fp));
+#endif
+    return rc;
+  }
+#endif
+
   loc = ftello (ctx->fp);
   while (fgets (buf, sizeof (buf), ctx->fp) != NULL)
   {
@@ -435,6 +1124,10 @@ int mbox_parse_mailbox (CONTEXT *ctx)
     mx_update_context (ctx, count);
   }
 
+#if USE_HCACHE
+  mbox_index_save (ctx, first, ctx->msgcount, ftello (ctx->fp));
+#endif
+
   return (0);
 }
 
@@ -590,10 +1283,12 @@ static int strict_cmp_lists (const LIST *a, const LIST *b)
   return (1);
 }
 
-static int strict_cmp_envelopes (const ENVELOPE *e1, const ENVELOPE *e2)
+static int strict_cmp_envelopes (ENVELOPE *e1, ENVELOPE *e2)
 {
   if (e1 && e2)
   {
+    mutt_env_load_lazy (e1);
+    mutt_env_load_lazy (e2);
     if (mutt_strcmp (e1->message_id, e2->message_id) ||
 	mutt_strcmp (e1->subject, e2->subject) ||
 	!strict_cmp_lists (e1->references, e2->references) ||
@@ -842,6 +1537,9 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
   int rc = -1;
   int need_sort = 0; /* flag to resort mailbox if new mail arrives */
   int first = -1;	/* first message to be written */
+#if USE_HCACHE
+  int indexed = 0;	/* mbox index was up to date before the sync */
+#endif
   LOFF_T offset;	/* location in mailbox to write changed messages */
   struct stat statbuf;
   struct m_update_t *newOffset = NULL;
@@ -927,6 +1625,9 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
 
   /* save the index of the first changed/deleted message */
   first = i;
+#if USE_HCACHE
+  indexed = mbox_index_current (ctx);
+#endif
   /* where to start overwriting */
   offset = ctx->hdrs[i]->offset;
 
@@ -1138,6 +1839,9 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
       ctx->hdrs[i]->index = j++;
     }
   }
+#if USE_HCACHE
+  mbox_index_save (ctx, indexed ? first : 0, j, ctx->size);
+#endif
   FREE (&newOffset);
   FREE (&oldOffset);
   unlink (mutt_b2s (tempfile)); /* remove partial copy of the mailbox */
@@ -1392,6 +2096,35 @@ int mbox_check_empty (const char *path)
   return ((st.st_size == 0));
 }
 
+#if USE_HCACHE
+/* Records past the end of the folder are left from before it shrank. */
+static int mbox_hcache_live (const char *key, void *data)
+{
+  int n = 0, i;
+
+  if (!isdigit ((unsigned char) *key) ||
+      sscanf (key, "%d%n", &i, &n) != 1 || key[n])
+    return 1;
+  return i < ((CONTEXT *) data)->msgcount;
+}
+#endif
+
+/* Drops offset index records of messages no longer in the folder. */
+static int mbox_gc_header_cache (CONTEXT *ctx, int budget, int *removed,
+                                 LOFF_T *reclaimed)
+{
+  int rc = -1;
+#if USE_HCACHE
+  header_cache_t *hc;
+
+  if (!(hc = mbox_index_open (ctx)))
+    return -1;
+  rc = mutt_hcache_gc (hc, mbox_hcache_live, ctx, budget, removed, reclaimed);
+  mutt_hcache_close (hc);
+#endif
+  return rc;
+}
+
 static int mbox_msg_padding_size (CONTEXT *ctx)
 {
   return 1;
@@ -1414,6 +2147,7 @@ struct mx_ops mx_mbox_ops = {
   .sync = mbox_sync_mailbox,
   .msg_padding_size = mbox_msg_padding_size,
   .save_to_header_cache = NULL,
+  .gc_header_cache = mbox_gc_header_cache,
 };
 
 struct mx_ops mx_mmdf_ops = {
@@ -1428,4 +2162,5 @@ struct mx_ops mx_mmdf_ops = {
   .sync = mbox_sync_mailbox,
   .msg_padding_size = mmdf_msg_padding_size,
   .save_to_header_cache = NULL,
+  .gc_header_cache = mbox_gc_header_cache,
 };
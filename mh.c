@@ -40,6 +40,9 @@
 #ifdef USE_INOTIFY
 #include "monitor.h"
 #endif
+#ifdef USE_PTHREADS
+#include "mutt_workers.h"
+#endif
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -59,8 +62,17 @@
 #include <sys/time.h>
 #endif
 
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
 #define		INS_SORT_THRESHOLD		6
 
+/* files each maildir reader thread may have open ahead of the parser */
+#define		PREFETCH_PER_THREAD		16
+/* descriptors left to the rest of mutt when sizing the prefetch window */
+#define		PREFETCH_FD_RESERVE		64
+
 static int maildir_check_mailbox (CONTEXT * ctx, int *index_hint);
 static int mh_check_mailbox (CONTEXT * ctx, int *index_hint);
 
@@ -85,6 +97,10 @@ struct mh_data
 {
   struct timespec mtime_cur;
   mode_t mh_umask;
+#ifdef USE_INOTIFY
+  MONITOR_MAILDIR *monitor;	/* per-file events of a maildir */
+  HASH *canon_hash;		/* canonical filename -> HEADER */
+#endif
 };
 
 /* mh_sequences support */
@@ -98,6 +114,15 @@ static inline struct mh_data *mh_data (CONTEXT *ctx)
   return (struct mh_data*)ctx->data;
 }
 
+/* Called when headers are freed or their canonical filename changes. */
+static inline void maildir_forget_canon (CONTEXT *ctx)
+{
+#ifdef USE_INOTIFY
+  if (ctx->data)
+    hash_destroy (&mh_data (ctx)->canon_hash, NULL);
+#endif
+}
+
 static void mhs_alloc (struct mh_sequences *mhs, int i)
 {
   int j;
@@ -166,38 +191,41 @@ static int mh_read_token (char *t, int *first, int *last)
   return 0;
 }
 
-static int mh_read_sequences (struct mh_sequences *mhs, const char *path)
+/* Reads the sequences named unseen, flagged and replied (any of which
+ * may be NULL) from the .mh_sequences file pathname.  Uses no buffer
+ * pool and no globals, so that the poller thread of $mail_check_async
+ * can call it. */
+static int mh_read_sequences_file (struct mh_sequences *mhs,
+                                   const char *pathname, const char *unseen,
+                                   const char *flagged, const char *replied)
 {
   FILE *fp = NULL;
   int line = 1;
   char *buff = NULL;
-  char *t;
+  char *t, *q;
   size_t sz = 0;
 
   short f;
   int first, last, rc = 0;
 
-  BUFFER *pathname = mutt_buffer_pool_get ();
-  mutt_buffer_printf (pathname, "%s/.mh_sequences", path);
-
-  if (!(fp = fopen (mutt_b2s (pathname), "r")))
+  if (!(fp = fopen (pathname, "r")))
     goto out; /* yes, ask callers to silently ignore the error */
 
   while ((buff = mutt_read_line (buff, &sz, fp, &line, 0)))
   {
-    if (!(t = strtok (buff, " \t:")))
+    if (!(t = strtok_r (buff, " \t:", &q)))
       continue;
 
-    if (!mutt_strcmp (t, MhUnseen))
+    if (unseen && !mutt_strcmp (t, unseen))
       f = MH_SEQ_UNSEEN;
-    else if (!mutt_strcmp (t, MhFlagged))
+    else if (flagged && !mutt_strcmp (t, flagged))
       f = MH_SEQ_FLAGGED;
-    else if (!mutt_strcmp (t, MhReplied))
+    else if (replied && !mutt_strcmp (t, replied))
       f = MH_SEQ_REPLIED;
     else			/* unknown sequence */
       continue;
 
-    while ((t = strtok (NULL, " \t:")))
+    while ((t = strtok_r (NULL, " \t:", &q)))
     {
       if (mh_read_token (t, &first, &last) < 0)
       {
@@ -213,12 +241,24 @@ static int mh_read_sequences (struct mh_sequences *mhs, const char *path)
   rc = 0;
 
 out:
-  mutt_buffer_pool_release (&pathname);
   FREE (&buff);
   safe_fclose (&fp);
   return rc;
 }
 
+static int mh_read_sequences (struct mh_sequences *mhs, const char *path)
+{
+  BUFFER *pathname;
+  int rc;
+
+  pathname = mutt_buffer_pool_get ();
+  mutt_buffer_printf (pathname, "%s/.mh_sequences", path);
+  rc = mh_read_sequences_file (mhs, mutt_b2s (pathname), MhUnseen, MhFlagged,
+                               MhReplied);
+  mutt_buffer_pool_release (&pathname);
+  return rc;
+}
+
 static inline mode_t mh_umask (CONTEXT* ctx)
 {
   struct stat st;
@@ -241,17 +281,14 @@ static inline mode_t mh_umask (CONTEXT* ctx)
  * Returns 0 if the modifcation time is older
  * Returns -1 on error
  */
-static int mh_sequences_changed(BUFFY *b)
+static int mh_sequences_changed(BUFFY *b, BUFFER *path)
 {
-  BUFFER *path = NULL;
   struct stat sb;
   int rc = -1;
 
-  path = mutt_buffer_pool_get ();
   mutt_buffer_printf (path, "%s/.mh_sequences", mutt_b2s (b->pathbuf));
   if (stat (mutt_b2s (path), &sb) == 0)
     rc = (mutt_stat_timespec_compare (&sb, MUTT_STAT_MTIME, &b->last_visited) > 0);
-  mutt_buffer_pool_release (&path);
   return rc;
 }
 
@@ -260,25 +297,25 @@ static int mh_sequences_changed(BUFFY *b)
  * Returns 0 if the modtime is newer
  * Returns -1 on error
  */
-static int mh_already_notified(BUFFY *b, int msgno)
+static int mh_already_notified(BUFFY *b, int msgno, BUFFER *path)
 {
-  BUFFER *path = NULL;
   struct stat sb;
   int rc = -1;
 
-  path = mutt_buffer_pool_get ();
   mutt_buffer_printf (path, "%s/%d", mutt_b2s (b->pathbuf), msgno);
   if (stat (mutt_b2s (path), &sb) == 0)
     rc = (mutt_stat_timespec_compare (&sb, MUTT_STAT_MTIME, &b->last_visited) <= 0);
-  mutt_buffer_pool_release (&path);
   return rc;
 }
 
-/* Checks new mail for a mh mailbox.
+/* Checks new mail for a mh mailbox, using the scratch buffer path and
+ * the sequence names unseen and flagged.  Touches nothing but mailbox,
+ * so it may run in the poller thread of $mail_check_async on a copy.
  * check_stats: if true, also count total, new, and flagged messages.
  * Returns 1 if the mailbox has new mail.
  */
-int mh_buffy (BUFFY *mailbox, int check_stats)
+int mh_buffy_scan (BUFFY *mailbox, int check_stats, BUFFER *path,
+                   const char *unseen, const char *flagged)
 {
   int i;
   struct mh_sequences mhs;
@@ -289,7 +326,7 @@ int mh_buffy (BUFFY *mailbox, int check_stats)
 
   /* when $mail_check_recent is set and the .mh_sequences file hasn't changed
    * since the last mailbox visit, there is no "new mail" */
-  if (option(OPTMAILCHECKRECENT) && mh_sequences_changed(mailbox) <= 0)
+  if (option(OPTMAILCHECKRECENT) && mh_sequences_changed(mailbox, path) <= 0)
   {
     rc = 0;
     check_new = 0;
@@ -299,7 +336,10 @@ int mh_buffy (BUFFY *mailbox, int check_stats)
     return rc;
 
   memset (&mhs, 0, sizeof (mhs));
-  if (mh_read_sequences (&mhs, mutt_b2s (mailbox->pathbuf)) < 0)
+  mailbox->check_ops++;
+  mutt_buffer_printf (path, "%s/.mh_sequences", mutt_b2s (mailbox->pathbuf));
+  if (mh_read_sequences_file (&mhs, mutt_b2s (path), unseen, flagged,
+                              NULL) < 0)
     return 0;
 
   if (check_stats)
@@ -322,7 +362,8 @@ int mh_buffy (BUFFY *mailbox, int check_stats)
       {
         /* if the first unseen message we encounter was in the mailbox during the
            last visit, don't notify about it */
-        if (!option(OPTMAILCHECKRECENT) || mh_already_notified(mailbox, i) == 0)
+        if (!option(OPTMAILCHECKRECENT) ||
+            mh_already_notified(mailbox, i, path) == 0)
         {
           mailbox->new = 1;
           rc = 1;
@@ -340,10 +381,12 @@ int mh_buffy (BUFFY *mailbox, int check_stats)
 
   if (check_stats)
   {
+    mailbox->check_ops++;
     if ((dirp = opendir (mutt_b2s (mailbox->pathbuf))) != NULL)
     {
       while ((de = readdir (dirp)) != NULL)
       {
+        mailbox->check_ops++;
         if (*de->d_name == '.')
           continue;
         if (mh_valid_message (de->d_name))
@@ -356,6 +399,22 @@ int mh_buffy (BUFFY *mailbox, int check_stats)
   return rc;
 }
 
+/* Checks new mail for a mh mailbox.
+ * check_stats: if true, also count total, new, and flagged messages.
+ * Returns 1 if the mailbox has new mail.
+ */
+int mh_buffy (BUFFY *mailbox, int check_stats)
+{
+  BUFFER *path;
+  int rc;
+
+  path = mutt_buffer_pool_get ();
+  rc = mh_buffy_scan (mailbox, check_stats, path, MhUnseen, MhFlagged);
+  mutt_buffer_pool_release (&path);
+
+  return rc;
+}
+
 static int mh_mkstemp (CONTEXT * dest, FILE ** fp, char **tgt)
 {
   int fd;
@@ -772,40 +831,49 @@ static void maildir_update_mtime (CONTEXT * ctx)
  * Actually parse a maildir message.  This may also be used to fill
  * out a fake header structure generated by lazy maildir parsing.
  */
-static HEADER *maildir_parse_message (int magic, const char *fname,
-				      int is_old, HEADER * _h)
+static HEADER *maildir_parse_stream (int magic, FILE *f, const char *fname,
+				     int is_old, HEADER * _h)
 {
-  FILE *f;
   HEADER *h = _h;
   struct stat st;
 
-  if ((f = fopen (fname, "r")) != NULL)
-  {
-    if (!h)
-      h = mutt_new_header ();
-    h->env = mutt_read_rfc822_header (f, h, 0, 0);
+  if (!h)
+    h = mutt_new_header ();
+  h->env = mutt_read_rfc822_header (f, h, 0, 0);
 
-    fstat (fileno (f), &st);
-    safe_fclose (&f);
+  fstat (fileno (f), &st);
 
-    if (!h->received)
-      h->received = h->date_sent;
+  if (!h->received)
+    h->received = h->date_sent;
 
-    /* always update the length since we have fresh information available. */
-    h->content->length = st.st_size - h->content->offset;
+  /* always update the length since we have fresh information available. */
+  h->content->length = st.st_size - h->content->offset;
 
-    h->index = -1;
+  h->index = -1;
 
-    if (magic == MUTT_MAILDIR)
-    {
-      /*
-       * maildir stores its flags in the filename, so ignore the
-       * flags in the header of the message
-       */
+  if (magic == MUTT_MAILDIR)
+  {
+    /*
+     * maildir stores its flags in the filename, so ignore the
+     * flags in the header of the message
+     */
 
-      h->old = is_old;
-      maildir_parse_flags (h, fname);
-    }
+    h->old = is_old;
+    maildir_parse_flags (h, fname);
+  }
+  return h;
+}
+
+static HEADER *maildir_parse_message (int magic, const char *fname,
+				      int is_old, HEADER * _h)
+{
+  FILE *f;
+  HEADER *h;
+
+  if ((f = fopen (fname, "r")) != NULL)
+  {
+    h = maildir_parse_stream (magic, f, fname, is_old, _h);
+    safe_fclose (&f);
     return h;
   }
   return NULL;
@@ -1108,6 +1176,170 @@ static void mh_sort_natural (CONTEXT *ctx, struct maildir **md)
   *md = maildir_sort (*md, (size_t) -1, md_cmp_path);
 }
 
+#if USE_HCACHE
+static void maildir_hcache_store_entry (header_cache_t *hc, int magic,
+                                        HEADER *h)
+{
+  if (magic == MUTT_MH)
+    mutt_hcache_store (hc, h->path, h, 0, strlen, MUTT_GENERATE_UIDVALIDITY);
+  else
+    mutt_hcache_store (hc, h->path + 3, h, 0, &maildir_hcache_keylen,
+                       MUTT_GENERATE_UIDVALIDITY);
+}
+#endif
+
+#ifdef USE_PTHREADS
+/*
+ * Messages that missed the header cache, queued during the first pass
+ * of maildir_delayed_parsing() in mailbox order.
+ */
+struct maildir_queue
+{
+  struct maildir **entries;
+  char **paths;
+  FILE **fps;
+  size_t count;
+  size_t max;
+};
+
+static void maildir_queue_add (struct maildir_queue *q, struct maildir *p,
+                               const char *path)
+{
+  if (q->count == q->max)
+  {
+    q->max += 256;
+    safe_realloc (&q->entries, q->max * sizeof (struct maildir *));
+    safe_realloc (&q->paths, q->max * sizeof (char *));
+  }
+  q->entries[q->count] = p;
+  q->paths[q->count] = safe_strdup (path);
+  q->count++;
+}
+
+/*
+ * Runs in a worker thread: open the message and pull its first block
+ * into the stdio buffer.  On network file systems the open and first
+ * read are the expensive part.  Parsing is left to the main thread,
+ * because mutt_read_rfc822_header() uses the buffer pool, the charset
+ * code and (with autocrypt) the database, none of which is thread safe.
+ */
+static void maildir_prefetch_message (void *data, size_t i)
+{
+  struct maildir_queue *q = (struct maildir_queue *) data;
+  FILE *fp;
+  int c;
+
+  if ((fp = fopen (q->paths[i], "r")) == NULL)
+    return;
+  if ((c = getc (fp)) != EOF)
+    ungetc (c, fp);
+  q->fps[i] = fp;
+}
+
+/*
+ * How many messages the workers may open ahead of the parser: a few per
+ * thread, but never so many that the prefetched files could use up the
+ * descriptors mutt needs for everything else.
+ */
+static size_t maildir_prefetch_window (void)
+{
+  size_t window;
+#ifdef HAVE_SYS_RESOURCE_H
+  struct rlimit rl;
+#endif
+
+  window = MIN (MaildirReadThreads, MUTT_WORKERS_MAX) * PREFETCH_PER_THREAD;
+#ifdef HAVE_SYS_RESOURCE_H
+  if (getrlimit (RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+  {
+    if (rl.rlim_cur <= 2 * PREFETCH_FD_RESERVE)
+      window = 1;
+    else
+      window = MIN (window, (size_t) (rl.rlim_cur - PREFETCH_FD_RESERVE) / 2);
+  }
+#endif
+  return window;
+}
+
+/*
+ * Parses the queued messages in order, while up to MaildirReadThreads
+ * workers open the following ones.
+ */
+static void maildir_parse_queue (CONTEXT *ctx, struct maildir_queue *q,
+#if USE_HCACHE
+                                 header_cache_t *hc,
+#endif
+                                 progress_t *progress, int count)
+{
+  WORKERS *workers;
+  struct maildir *p;
+  size_t i, j;
+  HEADER *h;
+
+  if (!q->count)
+    return;
+
+  q->fps = safe_calloc (q->count, sizeof (FILE *));
+  workers = mutt_workers_start (MaildirReadThreads, q->count,
+                                maildir_prefetch_window (),
+                                maildir_prefetch_message, q);
+
+  for (i = 0; i < q->count; i++)
+  {
+    if (!ctx->quiet && progress)
+      mutt_progress_update (progress, count - q->count + i, -1);
+
+    mutt_workers_wait (workers, i);
+
+    p = q->entries[i];
+    if (q->fps[i])
+    {
+      h = maildir_parse_stream (ctx->magic, q->fps[i], q->paths[i],
+                                p->h->old, p->h);
+      safe_fclose (&q->fps[i]);
+    }
+    else
+    {
+      h = maildir_parse_message (ctx->magic, q->paths[i], p->h->old, p->h);
+      if (!h && workers && (errno == EMFILE || errno == ENFILE))
+      {
+        /* The files opened ahead hold the descriptors we need.  Stop
+         * the workers, let go of what they opened and read the rest of
+         * the queue one message at a time. */
+        dprint (1, (debugfile, "maildir_parse_queue: out of descriptors, "
+                    "prefetch stopped at %zu of %zu\n", i, q->count));
+        mutt_workers_finish (&workers);
+        for (j = i + 1; j < q->count; j++)
+          safe_fclose (&q->fps[j]);
+        h = maildir_parse_message (ctx->magic, q->paths[i], p->h->old, p->h);
+      }
+    }
+
+    if (h)
+    {
+      p->header_parsed = 1;
+#if USE_HCACHE
+      maildir_hcache_store_entry (hc, ctx->magic, p->h);
+#endif
+    }
+    else
+      mutt_free_header (&p->h);
+  }
+
+  mutt_workers_finish (&workers);
+
+  for (i = 0; i < q->count; i++)
+  {
+    safe_fclose (&q->fps[i]);
+    FREE (&q->paths[i]);
+  }
+  FREE (&q->fps);
+  FREE (&q->paths);
+  FREE (&q->entries);
+  q->count = q->max = 0;
+}
+#endif /* USE_PTHREADS */
+
 #if HAVE_DIRENT_D_INO
 static struct maildir *skip_duplicates (struct maildir *p, struct maildir **last)
 {
@@ -1149,6 +1381,12 @@ static void maildir_delayed_parsing (CONTEXT * ctx, struct maildir **md,
   struct stat lastchanged;
   int ret;
 #endif
+#ifdef USE_PTHREADS
+  struct maildir_queue queue;
+  int threaded = MaildirReadThreads > 1;
+
+  memset (&queue, 0, sizeof (queue));
+#endif
 
 #if HAVE_DIRENT_D_INO
 #define DO_SORT()                                                       \
@@ -1173,6 +1411,7 @@ static void maildir_delayed_parsing (CONTEXT * ctx, struct maildir **md,
 
 #if USE_HCACHE
   hc = mutt_hcache_open (HeaderCache, ctx->path, NULL);
+  mutt_hcache_begin (hc);
 #endif
 
   fn = mutt_buffer_pool_get ();
@@ -1186,7 +1425,11 @@ static void maildir_delayed_parsing (CONTEXT * ctx, struct maildir **md,
     }
 
     if (!ctx->quiet && progress)
+#ifdef USE_PTHREADS
+      mutt_progress_update (progress, count - queue.count, -1);
+#else
       mutt_progress_update (progress, count, -1);
+#endif
 
     DO_SORT();
 
@@ -1220,25 +1463,36 @@ static void maildir_delayed_parsing (CONTEXT * ctx, struct maildir **md,
     {
 #endif /* USE_HCACHE */
 
+#ifdef USE_PTHREADS
+      if (threaded)
+        maildir_queue_add (&queue, p, mutt_b2s (fn));
+      else
+#endif
       if (maildir_parse_message (ctx->magic, mutt_b2s (fn), p->h->old, p->h))
       {
         p->header_parsed = 1;
 #if USE_HCACHE
-        if (ctx->magic == MUTT_MH)
-          mutt_hcache_store (hc, p->h->path, p->h, 0, strlen, MUTT_GENERATE_UIDVALIDITY);
-        else
-          mutt_hcache_store (hc, p->h->path + 3, p->h, 0, &maildir_hcache_keylen, MUTT_GENERATE_UIDVALIDITY);
+        maildir_hcache_store_entry (hc, ctx->magic, p->h);
 #endif
       }
       else
         mutt_free_header (&p->h);
 #if USE_HCACHE
     }
-    mutt_hcache_free (&data);
 #endif
     last = p;
   }
+
+#ifdef USE_PTHREADS
+  maildir_parse_queue (ctx, &queue,
 #if USE_HCACHE
+                       hc,
+#endif
+                       progress, count);
+#endif
+
+#if USE_HCACHE
+  mutt_hcache_commit (hc);
   mutt_hcache_close (hc);
 #endif
 
@@ -1251,6 +1505,15 @@ static void maildir_delayed_parsing (CONTEXT * ctx, struct maildir **md,
 
 static int mh_close_mailbox (CONTEXT *ctx)
 {
+#ifdef USE_INOTIFY
+  struct mh_data *data = mh_data (ctx);
+
+  if (data)
+  {
+    mutt_monitor_maildir_remove (&data->monitor);
+    hash_destroy (&data->canon_hash, NULL);
+  }
+#endif
   FREE (&ctx->data);
 
   return 0;
@@ -1332,6 +1595,14 @@ static int maildir_read_dir (CONTEXT * ctx)
   /* maildir looks sort of like MH, except that there are two subdirectories
    * of the main folder path from which to read messages
    */
+#ifdef USE_INOTIFY
+  /* watch before scanning, so nothing arriving meanwhile is missed */
+  if (!ctx->data)
+    ctx->data = safe_calloc (sizeof (struct mh_data), 1);
+  if (!mh_data (ctx)->monitor)
+    mh_data (ctx)->monitor = mutt_monitor_maildir_add (ctx->path);
+#endif
+
   if (mh_read_dir (ctx, "new") == -1 || mh_read_dir (ctx, "cur") == -1)
     return (-1);
 
@@ -1657,7 +1928,10 @@ static int _maildir_commit_message (CONTEXT * ctx, MESSAGE * msg, HEADER * hdr)
     if (safe_rename (msg->path, mutt_b2s (full)) == 0)
     {
       if (hdr)
+      {
 	mutt_str_replace (&hdr->path, mutt_b2s (path));
+	maildir_forget_canon (ctx);
+      }
       FREE (&msg->path);
 
       /*
@@ -2008,6 +2282,9 @@ int mh_sync_mailbox (CONTEXT * ctx, int *index_hint)
   if (i != 0)
     return i;
 
+  /* the deleted messages are freed after this */
+  maildir_forget_canon (ctx);
+
 #if USE_HCACHE
   if (ctx->magic == MUTT_MAILDIR || ctx->magic == MUTT_MH)
     hc = mutt_hcache_open(HeaderCache, ctx->path, NULL);
@@ -2153,6 +2430,8 @@ static void maildir_update_tables (CONTEXT *ctx, int *index_hint)
     Sort = old_sort;
   }
 
+  maildir_forget_canon (ctx);
+
   old_count = ctx->msgcount;
   for (i = 0, j = 0; i < old_count; i++)
   {
@@ -2208,6 +2487,183 @@ static int maildir_update_flags (CONTEXT *ctx, HEADER *o, HEADER *n)
 }
 
 
+/* Updates o, a message of ctx, from n, the same message as just found in
+ * the folder.  Returns 1 if the flags of o changed. */
+static int maildir_merge_header (CONTEXT *ctx, HEADER *o, HEADER *n)
+{
+  int flags_changed = 0;
+
+  /* check to see if the message has moved to a different
+   * subdirectory.  If so, update the associated filename.
+   */
+  if (mutt_strcmp (o->path, n->path))
+    mutt_str_replace (&o->path, n->path);
+
+  /* if the user hasn't modified the flags on this message, update
+   * the flags we just detected.
+   */
+  if (!o->changed)
+    if (maildir_update_flags (ctx, o, n))
+      flags_changed = 1;
+
+  if (o->deleted == o->trash)
+    if (o->deleted != n->deleted)
+    {
+      o->deleted = n->deleted;
+      if (o->deleted)
+        ctx->deleted++;
+      else
+        ctx->deleted--;
+      flags_changed = 1;
+    }
+  if (o->trash != n->trash)
+  {
+    o->trash = n->trash;
+    if (o->trash)
+      ctx->trashed++;
+    else
+      ctx->trashed--;
+  }
+
+  return flags_changed;
+}
+
+#ifdef USE_INOTIFY
+/* Applies the files created, renamed or deleted in the maildir since
+ * the last check, as reported by the monitor, instead of rescanning the
+ * subdirectories.
+ *
+ * returns -1 if changes may have been missed, otherwise like
+ * maildir_check_mailbox().
+ */
+static int maildir_check_events (CONTEXT *ctx, int *index_hint)
+{
+  struct mh_data *data = mh_data (ctx);
+  MONITOR_FILE *files = NULL;
+  size_t count = 0, n;
+  HEADER **gone = NULL;
+  size_t gonecount = 0, gonemax = 0;
+  struct maildir *md = NULL, **last = &md, *p;
+  HASH *seen;
+  HEADER *h, *tmp;
+  BUFFER *buf, *canon;
+  struct stat st;
+  int occult = 0, have_new = 0, flags_changed = 0;
+  int i, oldcount;
+
+  if (mutt_monitor_maildir_take (data->monitor, &files, &count) == -1)
+    return -1;
+  if (!count)
+    return 0;
+
+  buf = mutt_buffer_pool_get ();
+  canon = mutt_buffer_pool_get ();
+
+  if (!data->canon_hash)
+  {
+    data->canon_hash = hash_create (MAX (ctx->msgcount, 16), MUTT_HASH_STRDUP_KEYS);
+    for (i = 0; i < ctx->msgcount; i++)
+    {
+      maildir_canon_filename (canon, ctx->hdrs[i]->path);
+      if (!hash_find (data->canon_hash, mutt_b2s (canon)))
+        hash_insert (data->canon_hash, mutt_b2s (canon), ctx->hdrs[i]);
+    }
+  }
+
+  /* only the latest event of each message counts */
+  seen = hash_create (count, MUTT_HASH_STRDUP_KEYS);
+  for (n = count; n-- > 0; )
+  {
+    maildir_canon_filename (canon, files[n].path);
+    if (hash_find (seen, mutt_b2s (canon)))
+      continue;
+    hash_insert (seen, mutt_b2s (canon), &files[n]);
+
+    h = hash_find (data->canon_hash, mutt_b2s (canon));
+    if (files[n].added)
+    {
+      /* if it has moved on already, that is still to be read */
+      mutt_buffer_printf (buf, "%s/%s", ctx->path, files[n].path);
+      if (stat (mutt_b2s (buf), &st) == -1)
+        continue;
+
+      tmp = mutt_new_header ();
+      tmp->old = !mutt_strncmp (files[n].path, "cur/", 4);
+      maildir_parse_flags (tmp, files[n].path);
+      tmp->path = safe_strdup (files[n].path);
+
+      if (h)
+      {
+        if (maildir_merge_header (ctx, h, tmp))
+          flags_changed = 1;
+        mutt_free_header (&tmp);
+      }
+      else
+      {
+        p = safe_calloc (sizeof (struct maildir), 1);
+        p->h = tmp;
+        p->canon_fname = safe_strdup (mutt_b2s (canon));
+#ifdef HAVE_DIRENT_D_INO
+        p->inode = st.st_ino;
+#endif /* HAVE_DIRENT_D_INO */
+        *last = p;
+        last = &p->next;
+      }
+    }
+    else if (h)
+    {
+      mutt_buffer_printf (buf, "%s/%s", ctx->path, h->path);
+      if (stat (mutt_b2s (buf), &st) == -1 && errno == ENOENT)
+      {
+        if (gonecount == gonemax)
+        {
+          gonemax += 16;
+          safe_realloc (&gone, gonemax * sizeof (HEADER *));
+        }
+        gone[gonecount++] = h;
+      }
+    }
+  }
+  hash_destroy (&seen, NULL);
+  mutt_monitor_maildir_free_files (&files, count);
+
+  /* simulate a "reopen" event, as in maildir_check_mailbox() */
+  if (gonecount)
+  {
+    for (i = 0; i < ctx->msgcount; i++)
+      ctx->hdrs[i]->active = 1;
+    for (n = 0; n < gonecount; n++)
+      gone[n]->active = 0;
+    FREE (&gone);
+    occult = 1;
+    maildir_update_tables (ctx, index_hint);
+  }
+
+  maildir_delayed_parsing (ctx, &md, NULL);
+
+  oldcount = ctx->msgcount;
+  have_new = maildir_move_to_context (ctx, &md);
+  if (data->canon_hash)
+    for (i = oldcount; i < ctx->msgcount; i++)
+    {
+      maildir_canon_filename (canon, ctx->hdrs[i]->path);
+      if (!hash_find (data->canon_hash, mutt_b2s (canon)))
+        hash_insert (data->canon_hash, mutt_b2s (canon), ctx->hdrs[i]);
+    }
+
+  mutt_buffer_pool_release (&buf);
+  mutt_buffer_pool_release (&canon);
+
+  if (occult)
+    return MUTT_REOPENED;
+  if (have_new)
+    return MUTT_NEW_MAIL;
+  if (flags_changed)
+    return MUTT_FLAGS;
+  return 0;
+}
+#endif /* USE_INOTIFY */
+
 /* This function handles arrival of new mail and reopening of
  * maildir folders.  The basic idea here is we check to see if either
  * the new or cur subdirectories have changed, and if so, we scan them
@@ -2226,6 +2682,7 @@ static int maildir_check_mailbox (CONTEXT * ctx, int *index_hint)
   int occult = 0;		/* messages were removed from the mailbox */
   int have_new = 0;		/* messages were added to the mailbox */
   int flags_changed = 0;        /* message flags were changed in the mailbox */
+  int rescan = 0;		/* changes may have been missed */
   struct maildir *md;		/* list of messages in the mailbox */
   struct maildir **last, *p;
   int i;
@@ -2240,6 +2697,19 @@ static int maildir_check_mailbox (CONTEXT * ctx, int *index_hint)
   if (!option (OPTCHECKNEW))
     return 0;
 
+#ifdef USE_INOTIFY
+  /* Unless events were lost, the monitor already knows which files
+   * changed.  Otherwise watch anew, and rescan both subdirectories. */
+  if (data->monitor)
+  {
+    if ((i = maildir_check_events (ctx, index_hint)) != -1)
+      return i;
+    mutt_monitor_maildir_remove (&data->monitor);
+    data->monitor = mutt_monitor_maildir_add (ctx->path);
+    rescan = 1;
+  }
+#endif
+
   buf = mutt_buffer_pool_get ();
   mutt_buffer_printf (buf, "%s/new", ctx->path);
   if (stat (mutt_b2s (buf), &st_new) == -1)
@@ -2260,6 +2730,8 @@ static int maildir_check_mailbox (CONTEXT * ctx, int *index_hint)
     changed = 1;
   if (mutt_stat_timespec_compare (&st_cur, MUTT_STAT_MTIME, &data->mtime_cur) > 0)
     changed |= 2;
+  if (rescan)
+    changed = 3;
 
   if (!changed)
   {
@@ -2316,38 +2788,8 @@ static int maildir_check_mailbox (CONTEXT * ctx, int *index_hint)
     {
       /* message already exists, merge flags */
       ctx->hdrs[i]->active = 1;
-
-      /* check to see if the message has moved to a different
-       * subdirectory.  If so, update the associated filename.
-       */
-      if (mutt_strcmp (ctx->hdrs[i]->path, p->h->path))
-	mutt_str_replace (&ctx->hdrs[i]->path, p->h->path);
-
-      /* if the user hasn't modified the flags on this message, update
-       * the flags we just detected.
-       */
-      if (!ctx->hdrs[i]->changed)
-	if (maildir_update_flags (ctx, ctx->hdrs[i], p->h))
-          flags_changed = 1;
-
-      if (ctx->hdrs[i]->deleted == ctx->hdrs[i]->trash)
-        if (ctx->hdrs[i]->deleted != p->h->deleted)
-        {
-          ctx->hdrs[i]->deleted = p->h->deleted;
-          if (ctx->hdrs[i]->deleted)
-            ctx->deleted++;
-          else
-            ctx->deleted--;
-          flags_changed = 1;
-        }
-      if (ctx->hdrs[i]->trash != p->h->trash)
-      {
-        ctx->hdrs[i]->trash = p->h->trash;
-        if (ctx->hdrs[i]->trash)
-          ctx->trashed++;
-        else
-          ctx->trashed--;
-      }
+      if (maildir_merge_header (ctx, ctx->hdrs[i], p->h))
+        flags_changed = 1;
 
       /* this is a duplicate of an existing header, so remove it */
       mutt_free_header (&p->h);
@@ -2570,6 +3012,54 @@ static int mh_save_to_header_cache (CONTEXT *ctx, HEADER *h)
 }
 
 
+#if USE_HCACHE
+static int mh_hcache_live (const char *key, void *data)
+{
+  return hash_find ((HASH *) data, key) != NULL;
+}
+#endif
+
+/* Drops header cache records of messages no longer in the folder. */
+static int mh_gc_header_cache (CONTEXT *ctx, int budget, int *removed,
+                               LOFF_T *reclaimed)
+{
+  int rc = -1;
+#if USE_HCACHE
+  header_cache_t *hc;
+  HASH *live;
+  BUFFER *key;
+  const char *p;
+  int i;
+
+  if (!(hc = mutt_hcache_open (HeaderCache, ctx->path, NULL)))
+    return -1;
+
+  /* the keys as stored by maildir_hcache_store_entry() */
+  live = hash_create (ctx->msgcount, MUTT_HASH_STRDUP_KEYS);
+  key = mutt_buffer_pool_get ();
+  for (i = 0; i < ctx->msgcount; i++)
+  {
+    p = ctx->hdrs[i]->path;
+    if (ctx->magic == MUTT_MAILDIR)
+    {
+      p += 4;
+      mutt_buffer_substrcpy (key, p, p + maildir_hcache_keylen (p));
+    }
+    else
+      mutt_buffer_strcpy (key, p);
+    hash_insert (live, mutt_b2s (key), ctx->hdrs[i]);
+  }
+  mutt_buffer_pool_release (&key);
+
+  rc = mutt_hcache_gc (hc, mh_hcache_live, live, budget, removed, reclaimed);
+
+  hash_destroy (&live, NULL);
+  mutt_hcache_close (hc);
+#endif
+  return rc;
+}
+
+
 /*
  * These functions try to find a message in a maildir folder when it
  * has moved under our feet.  Note that this code is rather expensive, but
@@ -2812,6 +3302,7 @@ struct mx_ops mx_maildir_ops = {
   .check = maildir_check_mailbox,
   .sync = mh_sync_mailbox,
   .save_to_header_cache = maildir_save_to_header_cache,
+  .gc_header_cache = mh_gc_header_cache,
 };
 
 struct mx_ops mx_mh_ops = {
@@ -2825,4 +3316,5 @@ struct mx_ops mx_mh_ops = {
   .check = mh_check_mailbox,
   .sync = mh_sync_mailbox,
   .save_to_header_cache = mh_save_to_header_cache,
+  .gc_header_cache = mh_gc_header_cache,
 };
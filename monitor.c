@@ -243,8 +243,9 @@ static int monitor_handle_ignore (int descr)
  *       0   (1) input ready from STDIN, or (2) monitoring inactive -> no poll()
  * MonitorFilesChanged also reflects changes to monitored files.
  *
- * Only STDIN and INotify file handles currently expected/supported.
- * More would ask for common infrastructur (sockets?).
+ * Only STDIN, INotify and the file handles of mutt_monitor_add_fd() are
+ * currently expected/supported.  More would ask for common infrastructur
+ * (sockets?).
  */
 int mutt_monitor_poll (void)
 {
@@ -254,7 +255,7 @@ int mutt_monitor_poll (void)
 
   MonitorFilesChanged = 0;
 
-  if (INotifyFd != -1)
+  if (PollFdsCount)
   {
     fds = poll (PollFds, PollFdsCount, MuttGetchTimeout);
 
@@ -310,6 +311,13 @@ int mutt_monitor_poll (void)
               }
             }
           }
+          else
+          {
+            /* see mutt_monitor_add_fd() */
+            MonitorFilesChanged = 1;
+            while (read (PollFds[i].fd, buf, sizeof(buf)) > 0)
+              ;
+          }
         }
       }
       if (!inputReady)
@@ -320,6 +328,17 @@ int mutt_monitor_poll (void)
   return rc;
 }
 
+/* mutt_monitor_add_fd: have mutt_monitor_poll() also wait for fd, a
+ * non-blocking descriptor other threads write to when they have news.
+ * Whatever is written is discarded, and reported as a change to the
+ * monitored files, so the index checks for new mail.
+ */
+void mutt_monitor_add_fd (int fd)
+{
+  mutt_poll_fd_add (0, POLLIN);
+  mutt_poll_fd_add (fd, POLLIN);
+}
+
 #define RESOLVERES_OK_NOTEXISTING  0
 #define RESOLVERES_OK_EXISTING     1
 #define RESOLVERES_FAIL_NOMAILBOX -3
@@ -495,3 +514,175 @@ cleanup:
   monitor_info_free (&info2);
   return rc;
 }
+
+/* Watches of the new and cur subdirectories of an open Maildir, one
+ * inotify instance each, so that several can be open at once.  The
+ * events are read when mh.c asks for them. */
+#define INOTIFY_MASK_MAILDIR (IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | \
+                              IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* beyond this many, rescanning the Maildir is cheaper */
+#define MAILDIR_EVENTS_MAX 10000
+
+struct monitor_maildir_t
+{
+  int fd;
+  int descr[2];			/* of new and cur */
+  MONITOR_FILE *files;
+  size_t count;
+  size_t max;
+  unsigned int lost : 1;	/* events were dropped */
+  unsigned int broken : 1;	/* a watch went away */
+};
+
+static const char *MaildirSubdirs[] = { "new", "cur" };
+
+/* mutt_monitor_maildir_add: watch the files of the Maildir at path.
+ *
+ * returns NULL if inotify can't, in which case the Maildir has to be
+ * rescanned to notice changes.
+ */
+MONITOR_MAILDIR *mutt_monitor_maildir_add (const char *path)
+{
+  MONITOR_MAILDIR *mm;
+  BUFFER *buf;
+  int i;
+
+  mm = safe_calloc (1, sizeof (MONITOR_MAILDIR));
+#if HAVE_INOTIFY_INIT1
+  mm->fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+#else
+  if ((mm->fd = inotify_init ()) != -1)
+  {
+    fcntl (mm->fd, F_SETFL, O_NONBLOCK);
+    fcntl (mm->fd, F_SETFD, FD_CLOEXEC);
+  }
+#endif
+  if (mm->fd == -1)
+  {
+    dprint (2, (debugfile, "monitor: inotify_init failed, errno=%d %s\n", errno, strerror(errno)));
+    FREE (&mm);
+    return NULL;
+  }
+
+  buf = mutt_buffer_pool_get ();
+  for (i = 0; i < 2; i++)
+  {
+    mutt_buffer_printf (buf, "%s/%s", path, MaildirSubdirs[i]);
+    if ((mm->descr[i] = inotify_add_watch (mm->fd, mutt_b2s (buf), INOTIFY_MASK_MAILDIR)) == -1)
+    {
+      dprint (2, (debugfile, "monitor: inotify_add_watch failed for '%s', errno=%d %s\n", mutt_b2s (buf), errno, strerror(errno)));
+      mutt_buffer_pool_release (&buf);
+      close (mm->fd);
+      FREE (&mm);
+      return NULL;
+    }
+    dprint (3, (debugfile, "monitor: inotify_add_watch descriptor=%d for '%s'\n", mm->descr[i], mutt_b2s (buf)));
+  }
+  mutt_buffer_pool_release (&buf);
+
+  return mm;
+}
+
+void mutt_monitor_maildir_remove (MONITOR_MAILDIR **mm)
+{
+  if (!mm || !*mm)
+    return;
+
+  close ((*mm)->fd);
+  mutt_monitor_maildir_free_files (&(*mm)->files, (*mm)->count);
+  FREE (mm);		/* __FREE_CHECKED__ */
+}
+
+void mutt_monitor_maildir_free_files (MONITOR_FILE **files, size_t count)
+{
+  size_t i;
+
+  if (!files || !*files)
+    return;
+
+  for (i = 0; i < count; i++)
+    FREE (&(*files)[i].path);
+  FREE (files);		/* __FREE_CHECKED__ */
+}
+
+static void monitor_maildir_read (MONITOR_MAILDIR *mm)
+{
+  char buf[EVENT_BUFLEN]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *event;
+  BUFFER *path;
+  char *ptr;
+  int len, i;
+
+  path = mutt_buffer_pool_get ();
+  while ((len = read (mm->fd, buf, sizeof(buf))) > 0)
+  {
+    for (ptr = buf; ptr < buf + len;
+         ptr += sizeof(struct inotify_event) + event->len)
+    {
+      event = (const struct inotify_event *) ptr;
+      dprint (5, (debugfile, "monitor:  + maildir: descriptor=%d mask=0x%x\n",
+                  event->wd, event->mask));
+
+      if (event->mask & IN_Q_OVERFLOW)
+        mm->lost = 1;
+      if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+        mm->broken = 1;
+      if (mm->lost || mm->broken || (event->mask & IN_ISDIR) ||
+          !event->len || *event->name == '.')
+        continue;
+
+      for (i = 0; i < 2 && mm->descr[i] != event->wd; i++)
+        ;
+      if (i == 2)
+        continue;
+
+      if (mm->count == MAILDIR_EVENTS_MAX)
+      {
+        mm->lost = 1;
+        continue;
+      }
+      if (mm->count == mm->max)
+      {
+        mm->max = mm->max ? mm->max * 2 : 16;
+        safe_realloc (&mm->files, mm->max * sizeof (MONITOR_FILE));
+      }
+      mutt_buffer_printf (path, "%s/%s", MaildirSubdirs[i], event->name);
+      mm->files[mm->count].path = safe_strdup (mutt_b2s (path));
+      mm->files[mm->count].added = (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0;
+      mm->count++;
+    }
+  }
+  if (len == -1 && errno != EAGAIN)
+  {
+    dprint (2, (debugfile, "monitor: read inotify events failed, errno=%d %s\n",
+                errno, strerror(errno)));
+    mm->lost = 1;
+  }
+  mutt_buffer_pool_release (&path);
+}
+
+/* mutt_monitor_maildir_take: hand over the files changed since the last
+ * call, oldest first.
+ *
+ * return values:
+ *       0   success, the caller frees files with mutt_monitor_maildir_free_files()
+ *      -1   changes may have been missed: rescan, watching anew
+ */
+int mutt_monitor_maildir_take (MONITOR_MAILDIR *mm, MONITOR_FILE **files,
+                               size_t *count)
+{
+  if (!mm)
+    return -1;
+
+  monitor_maildir_read (mm);
+  if (mm->lost || mm->broken)
+    return -1;
+
+  *files = mm->files;
+  *count = mm->count;
+  mm->files = NULL;
+  mm->count = mm->max = 0;
+  return 0;
+}
@@ -27,5 +27,22 @@ int mutt_monitor_add (BUFFY *b);
 int mutt_monitor_remove (BUFFY *b);
 #endif
 int mutt_monitor_poll (void);
+void mutt_monitor_add_fd (int fd);
+
+/* A file created, renamed or deleted in an open Maildir */
+typedef struct monitor_file_t
+{
+  char *path;		/* "new/..." or "cur/..." */
+  short added;		/* created or renamed to path, else gone */
+}
+MONITOR_FILE;
+
+typedef struct monitor_maildir_t MONITOR_MAILDIR;
+
+MONITOR_MAILDIR *mutt_monitor_maildir_add (const char *path);
+void mutt_monitor_maildir_remove (MONITOR_MAILDIR **mm);
+int mutt_monitor_maildir_take (MONITOR_MAILDIR *mm, MONITOR_FILE **files,
+                               size_t *count);
+void mutt_monitor_maildir_free_files (MONITOR_FILE **files, size_t count);
 
 #endif /* MONITOR_H */
@@ -257,6 +257,7 @@ enum
   MUTT_HEADER,
   MUTT_HORMEL,
   MUTT_WHOLE_MSG,
+  MUTT_WORDS,
   MUTT_SENDER,
   MUTT_MESSAGE,
   MUTT_SCORE,
@@ -443,6 +444,9 @@ enum
 #if defined(HAVE_QDBM) || defined(HAVE_TC) || defined(HAVE_KC)
   OPTHCACHECOMPRESS,
 #endif /* HAVE_QDBM */
+#ifndef HAVE_DB4
+  OPTHCACHESHARED,
+#endif
 #endif
   OPTHDRS,
   OPTHEADER,
@@ -465,7 +469,9 @@ enum
   OPTIMAPLSUB,
   OPTIMAPPASSIVE,
   OPTIMAPPEEK,
+  OPTIMAPPREFETCH,
   OPTIMAPQRESYNC,
+  OPTIMAPSEARCHFILTER,
   OPTIMAPSERVERNOISE,
 #ifdef USE_ZLIB
   OPTIMAPDEFLATE,
@@ -495,12 +501,21 @@ enum
   OPTLOCALDATEHEADER,
   OPTMUTTLISPINLINEEVAL,
   OPTMAILCAPSANITIZE,
+#ifdef USE_PTHREADS
+  OPTMAILCHECKASYNC,
+#endif
   OPTMAILCHECKRECENT,
   OPTMAILCHECKSTATS,
   OPTMAILDIRTRASH,
   OPTMAILDIRCHECKCUR,
   OPTMARKERS,
   OPTMARKOLD,
+#ifdef USE_HCACHE
+  OPTMBOXHCACHE,
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_FMEMOPEN)
+  OPTMBOXMMAP,
+#endif
   OPTMENUSCROLL,	/* scroll menu instead of implicit next-page */
   OPTMENUMOVEOFF,	/* allow menu to scroll past last entry */
 #if defined(USE_IMAP) || defined(USE_POP)
@@ -561,6 +576,9 @@ enum
   OPTSTRICTTHREADS,
   OPTSUSPEND,
   OPTTEXTFLOWED,
+#ifdef USE_HCACHE
+  OPTTEXTINDEX,
+#endif
   OPTTHOROUGHSRC,
   OPTTHREADRECEIVED,
   OPTTILDE,
@@ -760,6 +778,10 @@ typedef struct envelope
 #ifdef USE_AUTOCRYPT
   AUTOCRYPTHDR *autocrypt;
   AUTOCRYPTHDR *autocrypt_gossip;
+#endif
+#ifdef USE_HCACHE
+  unsigned char *lazy;		/* fields not yet restored from the header cache,
+				 * see mutt_env_load_lazy() */
 #endif
   unsigned char changed;       /* The MUTT_ENV_CHANGED_* flags specify which
                                 * fields are modified */
@@ -924,6 +946,10 @@ typedef struct header
 
   short recipient;		/* user_is_recipient()'s return value, cached */
 
+  /* one bit per slot of ctx->search_cache */
+  unsigned char search_known;	/* the slot's pattern was evaluated */
+  unsigned char search_matched;	/* ...and matched this message */
+
   COLOR_ATTR color; 		/* color-pair to use when displaying in the index */
 
   time_t date_sent;     	/* time when the message was sent (UTC) */
@@ -971,6 +997,7 @@ struct mutt_thread
   unsigned int deep : 1;
   unsigned int subtree_visible : 2;
   unsigned int next_subtree_visible : 1;
+  unsigned int dirty : 1;	/* used when threading new messages */
   THREAD *parent;
   THREAD *child;
   THREAD *next;
@@ -985,6 +1012,7 @@ struct mutt_thread
 #define MUTT_FULL_MSG           (1<<0)  /* enable body and header matching */
 #define MUTT_PATTERN_DYNAMIC    (1<<1)  /* enable runtime date range evaluation */
 #define MUTT_SEND_MODE_SEARCH   (1<<2)  /* allow send-mode body searching */
+#define MUTT_PATTERN_UNPLANNED  (1<<3)  /* keep operands in written order */
 
 typedef enum {
   MUTT_MATCH_FULL_ADDRESS = 1
@@ -1003,9 +1031,15 @@ typedef struct group_context_t
   struct group_context_t *next;
 } group_context_t;
 
+/* Values of pattern_t.found */
+#define BODY_UNKNOWN	0	/* left to msg_search() */
+#define BODY_NOT_FOUND	1
+#define BODY_FOUND	2
+
 typedef struct pattern_t
 {
   short op;
+  short cost;				/* estimated cost of evaluating it */
   unsigned int not : 1;
   unsigned int alladdr : 1;
   unsigned int stringmatch : 1;
@@ -1014,6 +1048,7 @@ typedef struct pattern_t
   unsigned int isalias : 1;
   unsigned int dynamic : 1;  /* evaluate date ranges at run time */
   unsigned int sendmode : 1; /* evaluate searches in send-mode */
+  unsigned int interactive : 1;	/* may prompt, see plan_pattern() */
   int min;
   int max;
   struct pattern_t *next;
@@ -1024,6 +1059,8 @@ typedef struct pattern_t
     group_t *g;
     char *str;
   } p;
+  char *expr;				/* source of p.rx for ~b, ~h and ~B */
+  unsigned char *found;			/* body search results known ahead, by msgno */
 } pattern_t;
 
 /* This is used when a message is repeatedly pattern matched against.
@@ -1073,6 +1110,8 @@ struct _message;
  *
  * Optional operations
  *  - open_new_msg
+ *  - save_to_header_cache
+ *  - gc_header_cache
  */
 struct mx_ops
 {
@@ -1087,6 +1126,8 @@ struct mx_ops
   int (*open_new_msg) (struct _message *, struct _context *, HEADER *);
   int (*msg_padding_size) (struct _context *);
   int (*save_to_header_cache) (struct _context *, struct header *);
+  int (*gc_header_cache) (struct _context *, int budget, int *removed,
+                          LOFF_T *reclaimed);
 };
 
 typedef struct _context
@@ -1100,6 +1141,10 @@ typedef struct _context
   off_t vsize;
   char *pattern;                /* limit pattern string */
   pattern_t *limit_pattern;     /* compiled limit pattern */
+  struct search_cache *search_cache; /* recently used patterns and results */
+#ifdef USE_HCACHE
+  struct text_index *text_index; /* words waiting to be indexed */
+#endif
   HEADER **hdrs;
   HEADER *last_tag;		/* last tagged msg. used to link threads */
   THREAD *tree;			/* top of thread tree */
@@ -71,7 +71,7 @@ static int addr_is_intl (ADDRESS *a)
 
 static void set_local_mailbox (ADDRESS *a, char *local_mailbox)
 {
-  FREE (&a->mailbox);
+  mutt_str_release (&a->mailbox);
   a->mailbox = local_mailbox;
   a->intl_checked = 1;
   a->is_intl = 0;
@@ -79,7 +79,7 @@ static void set_local_mailbox (ADDRESS *a, char *local_mailbox)
 
 static void set_intl_mailbox (ADDRESS *a, char *intl_mailbox)
 {
-  FREE (&a->mailbox);
+  mutt_str_release (&a->mailbox);
   a->mailbox = intl_mailbox;
   a->intl_checked = 1;
   a->is_intl = 1;
@@ -307,6 +307,7 @@ const char *mutt_addr_for_display (ADDRESS *a)
 
 void mutt_env_to_local (ENVELOPE *e)
 {
+  mutt_env_load_lazy (e);
   mutt_addrlist_to_local (e->return_path);
   mutt_addrlist_to_local (e->from);
   mutt_addrlist_to_local (e->to);
@@ -333,6 +334,8 @@ void mutt_env_to_local (ENVELOPE *e)
 int mutt_env_to_intl (ENVELOPE *env, char **tag, char **err)
 {
   int e = 0;
+
+  mutt_env_load_lazy (env);
   H_TO_INTL(return_path);
   H_TO_INTL(from);
   H_TO_INTL(to);
@@ -174,6 +174,45 @@ int mutt_socket_poll (CONNECTION* conn, time_t wait_secs)
   return -1;
 }
 
+/* mutt_socket_poll_many: wait up to wait_secs for any of the connections
+ *   to become readable.
+ *   Returns: the index of a connection with data to read,
+ *            -1 on timeout or interruption,
+ *            -2 on error */
+int mutt_socket_poll_many (CONNECTION **conns, int nconns, time_t wait_secs)
+{
+  fd_set rfds;
+  struct timeval tv;
+  int i, maxfd = -1, rv;
+
+  /* data may already be buffered here or in the ssl/compression layer */
+  for (i = 0; i < nconns; i++)
+    if (mutt_socket_poll (conns[i], 0) != 0)
+      return i;
+
+  FD_ZERO (&rfds);
+  for (i = 0; i < nconns; i++)
+  {
+    /* let the caller's read notice the closed connection */
+    if (conns[i]->fd < 0)
+      return i;
+    FD_SET (conns[i]->fd, &rfds);
+    maxfd = MAX (maxfd, conns[i]->fd);
+  }
+
+  tv.tv_sec = wait_secs;
+  tv.tv_usec = 0;
+  rv = select (maxfd + 1, &rfds, NULL, NULL, &tv);
+  if (rv < 0)
+    return errno == EINTR ? -1 : -2;
+
+  for (i = 0; rv > 0 && i < nconns; i++)
+    if (FD_ISSET (conns[i]->fd, &rfds))
+      return i;
+
+  return -1;
+}
+
 /* simple read buffering to speed things up. */
 int mutt_socket_readchar (CONNECTION *conn, char *c)
 {
@@ -66,6 +66,7 @@ int mutt_socket_close (CONNECTION* conn);
 int mutt_socket_has_buffered_input (CONNECTION *conn);
 void mutt_socket_clear_buffered_input (CONNECTION *conn);
 int mutt_socket_poll (CONNECTION* conn, time_t wait_secs);
+int mutt_socket_poll_many (CONNECTION **conns, int nconns, time_t wait_secs);
 int mutt_socket_readchar (CONNECTION *conn, char *c);
 #define mutt_socket_buffer_readln(A,B) mutt_socket_buffer_readln_d(A,B,MUTT_SOCK_LOG_CMD)
 int mutt_socket_buffer_readln_d (BUFFER *buf, CONNECTION *conn, int dbg);
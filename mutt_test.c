@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Stands in for main.c in the test and benchmark programs: it defines
+ * the globals, and sets mutt up to run without curses or a muttrc.
+ */
+
+#define MAIN_C 1
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mutt_curses.h"
+#include "keymap.h"
+#include "mailbox.h"
+#include "url.h"
+#include "mutt_crypt.h"
+#include "mutt_idna.h"
+#include "send.h"
+#include "background.h"
+#include "mutt_test.h"
+
+#ifdef USE_SIDEBAR
+#include "sidebar.h"
+#endif
+
+#ifdef USE_SASL_CYRUS
+#include "mutt_sasl.h"
+#endif
+
+#ifdef USE_SASL_GNU
+#include "mutt_sasl_gnu.h"
+#endif
+
+#ifdef USE_IMAP
+#include "imap/imap.h"
+#endif
+
+#ifdef USE_HCACHE
+#include "hcache.h"
+#endif
+
+#ifdef USE_INOTIFY
+#include "monitor.h"
+#endif
+
+#ifdef USE_AUTOCRYPT
+#include "autocrypt/autocrypt.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* defined in main.c */
+char **envlist;
+
+void mutt_exit (int code)
+{
+  exit (code);
+}
+
+/* Initializes mutt with its defaults, then runs commands, as -e does.
+ * mutt_dotlock may not have been built, so none is used. */
+void mutt_test_init (LIST *commands)
+{
+  LIST *dotlock;
+
+  mutt_error = mutt_nocurses_error;
+  mutt_message = mutt_nocurses_error;
+  memset (Options, 0, sizeof (Options));
+  memset (QuadOptions, 0, sizeof (QuadOptions));
+  envlist = safe_calloc (1, sizeof (char *));
+
+  set_option (OPTNOCURSES);
+  mutt_init_windows ();
+  Muttrc = safe_strdup ("/dev/null");
+
+  dotlock = mutt_add_list (NULL, "set dotlock_program=true");
+  dotlock->next = commands;
+  mutt_init (1, dotlock);
+  dotlock->next = NULL;
+  mutt_free_list (&dotlock);
+}
+
+/* seconds since some fixed point, for timing */
+double mutt_test_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
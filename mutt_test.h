@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* What the test and benchmark programs built by "make check" share.
+ * They are linked with everything but main.c. */
+
+#ifndef _MUTT_TEST_H
+#define _MUTT_TEST_H 1
+
+/* exit status telling the test driver a test was skipped */
+#define MUTT_TEST_SKIP 77
+
+void mutt_test_init (LIST *commands);
+double mutt_test_now (void);
+
+#endif /* _MUTT_TEST_H */
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mutt_workers.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+struct mutt_workers
+{
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;   /* signalled when the window slides */
+  pthread_cond_t done_cond;   /* signalled when an item completes */
+  workers_fn_t fn;
+  void *data;
+  size_t count;
+  size_t window;
+  size_t next;                /* next item to hand out */
+  size_t horizon;             /* items below this may be handed out */
+  unsigned char *done;
+  int cancel;
+  int nthreads;
+  pthread_t *threads;
+};
+
+static void *workers_main (void *arg)
+{
+  WORKERS *w = (WORKERS *) arg;
+  size_t item;
+
+  pthread_mutex_lock (&w->lock);
+  for (;;)
+  {
+    while (!w->cancel && w->next < w->count && w->next >= w->horizon)
+      pthread_cond_wait (&w->work_cond, &w->lock);
+    if (w->cancel || w->next >= w->count)
+      break;
+    item = w->next++;
+    pthread_mutex_unlock (&w->lock);
+
+    w->fn (w->data, item);
+
+    pthread_mutex_lock (&w->lock);
+    w->done[item] = 1;
+    pthread_cond_broadcast (&w->done_cond);
+  }
+  pthread_mutex_unlock (&w->lock);
+
+  return NULL;
+}
+
+/* Starts up to nthreads workers calling fn(data, i) for each i below
+ * count.  Returns NULL if no thread could be started, in which case
+ * the caller should do the work itself.
+ */
+WORKERS *mutt_workers_start (int nthreads, size_t count, size_t window,
+                             workers_fn_t fn, void *data)
+{
+  WORKERS *w;
+  sigset_t all, old;
+  int i;
+
+  if (nthreads < 1 || !count)
+    return NULL;
+  if (nthreads > MUTT_WORKERS_MAX)
+    nthreads = MUTT_WORKERS_MAX;
+  if ((size_t) nthreads > count)
+    nthreads = (int) count;
+  if (!window)
+    window = 1;
+
+  w = safe_calloc (1, sizeof (WORKERS));
+  pthread_mutex_init (&w->lock, NULL);
+  pthread_cond_init (&w->work_cond, NULL);
+  pthread_cond_init (&w->done_cond, NULL);
+  w->fn = fn;
+  w->data = data;
+  w->count = count;
+  w->window = window;
+  w->horizon = MIN (window, count);
+  w->done = safe_calloc (count, sizeof (unsigned char));
+  w->threads = safe_calloc (nthreads, sizeof (pthread_t));
+
+  /* Signals (SIGWINCH, SIGINT, SIGCHLD...) are handled by the main
+   * thread only; the workers inherit a fully blocked mask. */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  for (i = 0; i < nthreads; i++)
+  {
+    if (pthread_create (&w->threads[w->nthreads], NULL, workers_main, w) == 0)
+      w->nthreads++;
+  }
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+  dprint (2, (debugfile, "mutt_workers_start: %d of %d threads for %zu items\n",
+              w->nthreads, nthreads, count));
+
+  if (!w->nthreads)
+    mutt_workers_finish (&w);
+
+  return w;
+}
+
+/* Blocks until item has been processed, and lets the workers move
+ * window items beyond it.
+ */
+void mutt_workers_wait (WORKERS *w, size_t item)
+{
+  if (!w || item >= w->count)
+    return;
+
+  pthread_mutex_lock (&w->lock);
+  if (item + w->window > w->horizon)
+  {
+    w->horizon = MIN (item + w->window, w->count);
+    pthread_cond_broadcast (&w->work_cond);
+  }
+  while (!w->done[item] && !w->cancel)
+    pthread_cond_wait (&w->done_cond, &w->lock);
+  pthread_mutex_unlock (&w->lock);
+}
+
+/* Stops handing out new items, waits for the ones in progress and
+ * frees the pool.  Items that were never handed out are left for the
+ * caller to clean up.
+ */
+void mutt_workers_finish (WORKERS **pw)
+{
+  WORKERS *w;
+  int i;
+
+  if (!pw || !*pw)
+    return;
+  w = *pw;
+
+  pthread_mutex_lock (&w->lock);
+  w->cancel = 1;
+  pthread_cond_broadcast (&w->work_cond);
+  pthread_mutex_unlock (&w->lock);
+
+  for (i = 0; i < w->nthreads; i++)
+    pthread_join (w->threads[i], NULL);
+
+  pthread_cond_destroy (&w->done_cond);
+  pthread_cond_destroy (&w->work_cond);
+  pthread_mutex_destroy (&w->lock);
+  FREE (&w->threads);
+  FREE (&w->done);
+  FREE (pw);		/* __FREE_CHECKED__ */
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _MUTT_WORKERS_H
+#define _MUTT_WORKERS_H 1
+
+/* Upper bound on the number of threads a single pool will start,
+ * regardless of what the user configured. */
+#define MUTT_WORKERS_MAX 64
+
+/* A pool of worker threads processing the items 0 .. count-1 of a
+ * caller-owned array.  Items are handed out in increasing order, at
+ * most `window' items ahead of the last item the caller waited for,
+ * so the caller can consume the results in order while the workers
+ * run ahead.
+ *
+ * The work function runs outside the main thread.  It must only
+ * touch the item it was given: no curses, no buffer pool, no dprint,
+ * no mutt_error(), and no other global state that is not read-only.
+ */
+typedef struct mutt_workers WORKERS;
+typedef void (*workers_fn_t) (void *data, size_t item);
+
+WORKERS *mutt_workers_start (int nthreads, size_t count, size_t window,
+                             workers_fn_t fn, void *data);
+void mutt_workers_wait (WORKERS *w, size_t item);
+void mutt_workers_finish (WORKERS **pw);
+
+#endif /* _MUTT_WORKERS_H */
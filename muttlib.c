@@ -35,6 +35,7 @@
 
 #include "mutt_crypt.h"
 #include "mutt_random.h"
+#include "slab.h"
 
 #include <string.h>
 #include <ctype.h>
@@ -48,16 +49,104 @@
 #include <sys/types.h>
 #include <utime.h>
 #include <dirent.h>
+#include <stdint.h>
+
+/* The objects every message is built from.  See slab.h. */
+static SLAB_POOL HeaderSlabs = SLAB_POOL_INITIALIZER (HEADER);
+static SLAB_POOL EnvelopeSlabs = SLAB_POOL_INITIALIZER (ENVELOPE);
+static SLAB_POOL BodySlabs = SLAB_POOL_INITIALIZER (BODY);
+
+HEADER *mutt_new_header (void)
+{
+  return (HEADER *) mutt_slab_alloc (&HeaderSlabs);
+}
+
+ENVELOPE *mutt_new_envelope (void)
+{
+  return (ENVELOPE *) mutt_slab_alloc (&EnvelopeSlabs);
+}
 
 BODY *mutt_new_body (void)
 {
-  BODY *p = (BODY *) safe_calloc (1, sizeof (BODY));
+  BODY *p = (BODY *) mutt_slab_alloc (&BodySlabs);
 
   p->disposition = DISPATTACH;
   p->use_disp = 1;
   return (p);
 }
 
+/* Addresses, names and labels recur across a mailbox, so the parser
+ * and the header cache share one reference counted copy of each.  The
+ * keys are the shared copies, the data their reference counts.
+ *
+ * A shared string must not be modified, and must be given back with
+ * mutt_str_release() instead of FREE().  mutt_str_release() also frees
+ * strings that aren't shared, so both kinds can be mixed in the same
+ * field.  Only the main thread may use these.
+ */
+static HASH *StringPool = NULL;
+
+/* Returns a shared copy of s.  Like safe_strdup(), NULL is returned for
+ * an empty string. */
+char *mutt_str_intern (const char *s)
+{
+  struct hash_elem *elem;
+  uintptr_t count;
+
+  if (!s || !*s)
+    return NULL;
+
+  if (!StringPool)
+    StringPool = hash_create (1024, MUTT_HASH_STRDUP_KEYS);
+
+  if ((elem = hash_find_elem (StringPool, s)))
+  {
+    count = (uintptr_t) elem->data;
+    elem->data = (void *) (count + 1);
+  }
+  else
+  {
+    hash_insert (StringPool, s, (void *) 1);
+    elem = hash_find_elem (StringPool, s);
+  }
+
+  return (char *) elem->key.strkey;
+}
+
+void mutt_str_release (char **p)
+{
+  struct hash_elem *elem;
+  uintptr_t count;
+
+  if (!*p)
+    return;
+
+  if (!StringPool || !(elem = hash_find_elem (StringPool, *p)) ||
+      elem->key.strkey != *p)
+  {
+    FREE (p);		/* __FREE_CHECKED__ */
+    return;
+  }
+
+  count = (uintptr_t) elem->data;
+  if (count <= 1)
+    hash_delete (StringPool, *p, NULL, NULL);
+  else
+    elem->data = (void *) (count - 1);
+  *p = NULL;
+}
+
+/* Replaces a shared *p by a copy of its own, which may be modified. */
+void mutt_str_unshare (char **p)
+{
+  char *s = *p;
+
+  if (!s)
+    return;
+  *p = safe_strdup (s);
+  mutt_str_release (&s);
+}
+
 /* Modified by blong to accept a "suggestion" for file name.  If
  * that file exists, then construct one with unique name but
  * keep any extension.  This might fail, I guess.
@@ -210,7 +299,7 @@ void mutt_free_body (BODY **p)
     if (b->parts)
       mutt_free_body (&b->parts);
 
-    FREE (&b);
+    mutt_slab_free (&b);
   }
 
   *p = 0;
@@ -389,7 +478,7 @@ void mutt_free_header (HEADER **h)
 #if defined USE_POP || defined USE_IMAP
   FREE (&(*h)->data);
 #endif
-  FREE (h);		/* __FREE_CHECKED__ */
+  mutt_slab_free (h);
 }
 
 /* returns true if the header contained in "s" is in list "t" */
@@ -889,7 +978,7 @@ void mutt_free_envelope (ENVELOPE **p)
   FREE (&(*p)->message_id);
   FREE (&(*p)->supersedes);
   FREE (&(*p)->date);
-  FREE (&(*p)->x_label);
+  mutt_str_release (&(*p)->x_label);
 
   mutt_buffer_free (&(*p)->spam);
 
@@ -901,8 +990,11 @@ void mutt_free_envelope (ENVELOPE **p)
   mutt_free_autocrypthdr (&(*p)->autocrypt);
   mutt_free_autocrypthdr (&(*p)->autocrypt_gossip);
 #endif
+#ifdef USE_HCACHE
+  FREE (&(*p)->lazy);
+#endif
 
-  FREE (p);		/* __FREE_CHECKED__ */
+  mutt_slab_free (p);
 }
 
 /* move all the headers from extra not present in base into base */
@@ -911,6 +1003,8 @@ void mutt_merge_envelopes(ENVELOPE* base, ENVELOPE** extra)
   /* copies each existing element if necessary, and sets the element
    * to NULL in the source so that mutt_free_envelope doesn't leave us
    * with dangling pointers. */
+  mutt_env_load_lazy (base);
+  mutt_env_load_lazy (*extra);
 #define MOVE_ELEM(h) if (!base->h) { base->h = (*extra)->h; (*extra)->h = NULL; }
   MOVE_ELEM(return_path);
   MOVE_ELEM(from);
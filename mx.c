@@ -46,6 +46,7 @@
 #endif
 
 #include "buffy.h"
+#include "textindex.h"
 
 #ifdef USE_DOTLOCK
 #include "dotlock.h"
@@ -732,6 +733,10 @@ void mx_fastclose_mailbox (CONTEXT *ctx)
     hash_destroy (&ctx->id_hash, NULL);
   hash_destroy (&ctx->label_hash, NULL);
   mutt_clear_threads (ctx);
+  mutt_search_cache_free (ctx);
+#ifdef USE_HCACHE
+  mutt_text_index_free (ctx);
+#endif
   for (i = 0; i < ctx->msgcount; i++)
     mutt_free_header (&ctx->hdrs[i]);
   FREE (&ctx->hdrs);
@@ -847,6 +852,21 @@ static int trash_append (CONTEXT *ctx)
   return 0;
 }
 
+/* Spends $header_cache_compact records of garbage collection on the
+ * header cache of a mailbox being closed. */
+static void mx_close_gc_header_cache (CONTEXT *ctx)
+{
+#ifdef USE_HCACHE
+  int removed = 0;
+  LOFF_T reclaimed = 0;
+
+  if (HeaderCacheCompact > 0 &&
+      mx_gc_header_cache (ctx, HeaderCacheCompact, &removed, &reclaimed) >= 0)
+    dprint (2, (debugfile, "mx_close_gc_header_cache: dropped %d records, "
+                "reclaimed %ld bytes\n", removed, (long) reclaimed));
+#endif
+}
+
 /* save changes and close mailbox.
  *
  * returns 0 on success.
@@ -1011,6 +1031,7 @@ int mx_close_mailbox (CONTEXT *ctx, int *index_hint)
       mutt_message _("Mailbox is unchanged.");
     if (ctx->magic == MUTT_MBOX || ctx->magic == MUTT_MMDF)
       mbox_reset_atime (ctx, NULL);
+    mx_close_gc_header_cache (ctx);
     mx_fastclose_mailbox (ctx);
     rc = 0;
     goto cleanup;
@@ -1095,6 +1116,7 @@ int mx_close_mailbox (CONTEXT *ctx, int *index_hint)
   }
 #endif
 
+  mx_close_gc_header_cache (ctx);
   mx_fastclose_mailbox (ctx);
 
   rc = 0;
@@ -1371,6 +1393,7 @@ MESSAGE *mx_open_new_message (CONTEXT *dest, HEADER *hdr, int flags)
     {
       if (hdr)
       {
+	mutt_env_load_lazy (hdr->env);
 	if (hdr->env->return_path)
 	  p = hdr->env->return_path;
 	else if (hdr->env->sender)
@@ -1622,4 +1645,32 @@ int mx_save_to_header_cache (CONTEXT *ctx, HEADER *h)
   return ctx->mx_ops->save_to_header_cache (ctx, h);
 }
 
+/* Drops the header cache records of messages no longer in the mailbox,
+ * looking at no more than budget records (all of them if 0).  Returns
+ * 1 if there are records left to look at next time, 0 once the header
+ * cache has been compacted, -1 on error. */
+int mx_gc_header_cache (CONTEXT *ctx, int budget, int *removed,
+                        LOFF_T *reclaimed)
+{
+#ifdef USE_HCACHE
+  struct stat sb;
+
+  if (!ctx->mx_ops || !ctx->mx_ops->gc_header_cache || !HeaderCache)
+    return -1;
+
+  /* in a database file shared by all folders, the keys of one folder
+   * can't always be told apart from those of another, unless they are
+   * prefixed as with $header_cache_shared */
+#ifndef HAVE_DB4
+  if (!option (OPTHCACHESHARED))
+#endif
+    if (stat (HeaderCache, &sb) || !S_ISDIR (sb.st_mode))
+      return -1;
+
+  return ctx->mx_ops->gc_header_cache (ctx, budget, removed, reclaimed);
+#else
+  return -1;
+#endif
+}
+
 /* vim: set sw=2: */
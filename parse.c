@@ -1503,8 +1503,8 @@ int mutt_parse_rfc822_line (ENVELOPE *e, HEADER *hdr, char *line, char *p, short
       }
       else if (ascii_strcasecmp (line+1, "-label") == 0)
       {
-        FREE(&e->x_label);
-        e->x_label = safe_strdup(p);
+        mutt_str_release (&e->x_label);
+        e->x_label = mutt_str_intern (p);
         matched = 1;
       }
 
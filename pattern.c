@@ -38,21 +38,30 @@
 #include "mutt_crypt.h"
 #include "mutt_curses.h"
 #include "group.h"
+#include "textindex.h"
 
 #ifdef USE_IMAP
 #include "mx.h"
 #include "imap/imap.h"
 #endif
 
+#ifdef USE_PTHREADS
+#include "mutt_workers.h"
+#include <pthread.h>
+#endif
+
 static int eat_regexp (pattern_t *pat, int, BUFFER *, BUFFER *);
 static int eat_date (pattern_t *pat, int, BUFFER *, BUFFER *);
 static int eat_range (pattern_t *pat, int, BUFFER *, BUFFER *);
+static int eat_words (pattern_t *pat, int, BUFFER *, BUFFER *);
 static int patmatch (const pattern_t *pat, const char *buf);
+static void plan_pattern (pattern_t *pat);
 
 /* Values for pattern_flags.eat_arg */
 #define EAT_REGEXP	1
 #define EAT_DATE	2
 #define EAT_RANGE	3
+#define EAT_WORDS	4
 
 static const struct pattern_flags
 {
@@ -257,6 +266,11 @@ Flags[] =
        Pattern Completion Menu description for ~V
     */
     N_("cryptographically verified messages") },
+  { 'w', MUTT_WORDS, MUTT_FULL_MSG, EAT_WORDS,
+    /* L10N:
+       Pattern Completion Menu description for ~w
+    */
+    N_("messages whose body contains the words WORDS") },
   { 'x', MUTT_REFERENCE, 0, EAT_REGEXP,
     /* L10N:
        Pattern Completion Menu description for ~x
@@ -338,10 +352,15 @@ msg_search (CONTEXT *ctx, pattern_t* pat, int msgno)
   struct stat st;
   FILE *fp = NULL;
   LOFF_T lng = 0;
+#ifdef USE_HCACHE
+  LOFF_T body = 0;
+#endif
   int match = 0;
   HEADER *h = ctx->hdrs[msgno];
   char *buf;
   size_t blen;
+  /* words are only ever looked for in the decoded text */
+  int thorough = option (OPTTHOROUGHSRC) || pat->op == MUTT_WORDS;
 
   /* The third parameter is whether to download only headers.
    * When the user has $message_cachedir set, they likely expect to
@@ -355,7 +374,7 @@ msg_search (CONTEXT *ctx, pattern_t* pat, int msgno)
 #endif
                                 ))) != NULL)
   {
-    if (option (OPTTHOROUGHSRC))
+    if (thorough)
     {
       /* decode the header / body */
       memset (&s, 0, sizeof (s));
@@ -370,7 +389,7 @@ msg_search (CONTEXT *ctx, pattern_t* pat, int msgno)
 	goto cleanup;
       }
 
-      if (pat->op != MUTT_BODY)
+      if (pat->op != MUTT_BODY && pat->op != MUTT_WORDS)
 	mutt_copy_header (msg->fp, h, s.fpout, CH_FROM | CH_DECODE, NULL);
 
       if (pat->op != MUTT_HEADER)
@@ -389,12 +408,22 @@ msg_search (CONTEXT *ctx, pattern_t* pat, int msgno)
 	  goto cleanup;
 	}
 
+#ifdef USE_HCACHE
+	body = ftello (s.fpout);
+#endif
 	fseeko (msg->fp, h->offset, SEEK_SET);
 	mutt_body_handler (h->content, &s);
       }
 
       fp = s.fpout;
       fflush (fp);
+#ifdef USE_HCACHE
+      /* the decoded text of encrypted mail mustn't end up on disk */
+      if (pat->op != MUTT_HEADER &&
+          !(WithCrypto && ((h->security & ENCRYPT) ||
+                           (crypt_query (h->content) & ENCRYPT))))
+	mutt_text_index_add (ctx, h, fp, body);
+#endif
       fseek (fp, 0, SEEK_SET);
       fstat (fileno (fp), &st);
       lng = (LOFF_T) st.st_size;
@@ -416,32 +445,37 @@ msg_search (CONTEXT *ctx, pattern_t* pat, int msgno)
       }
     }
 
-    blen = STRING;
-    buf = safe_malloc (blen);
-
-    /* search the file "fp" */
-    while (lng > 0)
+    if (pat->op == MUTT_WORDS)
+      match = mutt_text_words_match (pat->p.str, fp);
+    else
     {
-      if (pat->op == MUTT_HEADER)
+      blen = STRING;
+      buf = safe_malloc (blen);
+
+      /* search the file "fp" */
+      while (lng > 0)
       {
-	if (*(buf = mutt_read_rfc822_line (fp, buf, &blen)) == '\0')
+	if (pat->op == MUTT_HEADER)
+	{
+	  if (*(buf = mutt_read_rfc822_line (fp, buf, &blen)) == '\0')
+	    break;
+	}
+	else if (fgets (buf, blen - 1, fp) == NULL)
+	  break; /* don't loop forever */
+	if (patmatch (pat, buf) == 0)
+	{
+	  match = 1;
 	  break;
+	}
+	lng -= mutt_strlen (buf);
       }
-      else if (fgets (buf, blen - 1, fp) == NULL)
-	break; /* don't loop forever */
-      if (patmatch (pat, buf) == 0)
-      {
-	match = 1;
-	break;
-      }
-      lng -= mutt_strlen (buf);
-    }
 
-    FREE (&buf);
+      FREE (&buf);
+    }
 
     mx_close_message (ctx, &msg);
 
-    if (option (OPTTHOROUGHSRC))
+    if (thorough)
     {
       safe_fclose (&fp);
       unlink (mutt_b2s (tempfile));
@@ -567,12 +601,52 @@ static int eat_regexp (pattern_t *pat, int flags, BUFFER *s, BUFFER *err)
       FREE (&pat->p.rx);
       return (-1);
     }
+    /* regexec() serializes on the compiled expression, so the body
+     * search workers each compile their own copy, and an IMAP server
+     * may be able to look up plain text for us. */
+    if (pat->op == MUTT_BODY || pat->op == MUTT_HEADER ||
+        pat->op == MUTT_WHOLE_MSG)
+    {
+      pat->expr = buf.data;
+      buf.data = NULL;
+    }
     FREE (&buf.data);
   }
 
   return 0;
 }
 
+static int eat_words (pattern_t *pat, int flags, BUFFER *s, BUFFER *err)
+{
+  BUFFER buf;
+  BUFFER *words;
+  char *pexpr;
+
+  mutt_buffer_init (&buf);
+  pexpr = s->dptr;
+  if (mutt_extract_token (&buf, s, MUTT_TOKEN_PATTERN | MUTT_TOKEN_COMMENT) != 0 ||
+      !buf.data)
+  {
+    snprintf (err->data, err->dsize, _("Error in expression: %s"), pexpr);
+    FREE (&buf.data);
+    return (-1);
+  }
+
+  words = mutt_buffer_pool_get ();
+  if (!mutt_text_words_parse (words, buf.data))
+  {
+    snprintf (err->data, err->dsize, _("No words to search for: %s"), buf.data);
+    mutt_buffer_pool_release (&words);
+    FREE (&buf.data);
+    return (-1);
+  }
+  pat->p.str = safe_strdup (mutt_b2s (words));
+  mutt_buffer_pool_release (&words);
+  FREE (&buf.data);
+
+  return 0;
+}
+
 static int eat_range (pattern_t *pat, int flags, BUFFER *s, BUFFER *err)
 {
   char *tmp;
@@ -1130,7 +1204,7 @@ void mutt_pattern_free (pattern_t **pat)
     tmp = *pat;
     *pat = (*pat)->next;
 
-    if (tmp->stringmatch || tmp->dynamic)
+    if (tmp->stringmatch || tmp->dynamic || tmp->op == MUTT_WORDS)
       FREE (&tmp->p.str);
     else if (tmp->groupmatch)
       tmp->p.g = NULL;
@@ -1140,6 +1214,9 @@ void mutt_pattern_free (pattern_t **pat)
       FREE (&tmp->p.rx);
     }
 
+    FREE (&tmp->expr);
+    FREE (&tmp->found);
+
     if (tmp->child)
       mutt_pattern_free (&tmp->child);
     FREE (&tmp);
@@ -1338,6 +1415,9 @@ pattern_t *mutt_pattern_comp (/* const */ char *s, int flags, BUFFER *err)
 	    case EAT_RANGE:
               eatrv = eat_range (tmp, flags, &ps, err);
               break;
+	    case EAT_WORDS:
+              eatrv = eat_words (tmp, flags, &ps, err);
+              break;
 	  }
 	  if (eatrv == -1)
 	  {
@@ -1396,9 +1476,131 @@ pattern_t *mutt_pattern_comp (/* const */ char *s, int flags, BUFFER *err)
     tmp->child = curlist;
     curlist = tmp;
   }
+  if (!(flags & MUTT_PATTERN_UNPLANNED))
+    plan_pattern (curlist);
   return (curlist);
 }
 
+/* rough cost of evaluating a pattern for one message, used to order
+ * the operands of ~A ~B and ~A | ~B so that the cheap ones can decide
+ * the result before the expensive ones have to be looked at. */
+#define PAT_COST_FLAG		1	/* in the HEADER */
+#define PAT_COST_ENVELOPE	2	/* in the ENVELOPE, may need a regexp */
+#define PAT_COST_HEADER		3	/* reads the header from the mailbox */
+#define PAT_COST_BODY		4	/* reads and decodes the message */
+#define PAT_COST_THREAD		5	/* evaluates its operand for other messages */
+
+static int pattern_op_cost (pattern_t *pat)
+{
+  switch (pat->op)
+  {
+    case MUTT_SENDER:
+    case MUTT_FROM:
+    case MUTT_TO:
+    case MUTT_CC:
+    case MUTT_SUBJECT:
+    case MUTT_ID:
+    case MUTT_REFERENCE:
+    case MUTT_ADDRESS:
+    case MUTT_RECIPIENT:
+    case MUTT_LIST:
+    case MUTT_SUBSCRIBED_LIST:
+    case MUTT_PERSONAL_RECIP:
+    case MUTT_PERSONAL_FROM:
+    case MUTT_XLABEL:
+    case MUTT_HORMEL:
+      return PAT_COST_ENVELOPE;
+    case MUTT_HEADER:
+      return PAT_COST_HEADER;
+    case MUTT_BODY:
+    case MUTT_WHOLE_MSG:
+    case MUTT_WORDS:
+    case MUTT_MIMEATTACH:
+    case MUTT_MIMETYPE:
+      return PAT_COST_BODY;
+    case MUTT_THREAD:
+    case MUTT_PARENT:
+    case MUTT_CHILDREN:
+      return PAT_COST_THREAD;
+    default:
+      return PAT_COST_FLAG;
+  }
+}
+
+/* whether evaluating the pattern may have effects the user sees: with
+ * $thorough_search, ~b and ~B decode the message, which may ask for a
+ * passphrase or run the crypto backend on encrypted mail, and ~w falls
+ * back to the same search.  ~X and ~M parse the attachments. */
+static int pattern_op_interactive (pattern_t *pat)
+{
+  switch (pat->op)
+  {
+    case MUTT_BODY:
+    case MUTT_WHOLE_MSG:
+    case MUTT_WORDS:
+    case MUTT_MIMEATTACH:
+    case MUTT_MIMETYPE:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* computes the cost of each node of the list pat and sorts the operands
+ * of every AND and OR by it.  both are commutative, so this doesn't
+ * change the result, but evaluating a pattern is not free of side
+ * effects (see pattern_op_interactive()), and the order decides which
+ * of them happen.  running a cheaper operand first can only spare the
+ * user a prompt, so an operand that may prompt is never moved ahead of
+ * one written before it, while cheaper ones written after it still are.
+ * otherwise the sort is stable, so operands of the same cost keep the
+ * order they were written in. */
+static void plan_pattern (pattern_t *pat)
+{
+  pattern_t *child, *next, **p;
+
+  for (; pat; pat = pat->next)
+  {
+    if (pat->child)
+      plan_pattern (pat->child);
+
+    if (pat->op == MUTT_AND || pat->op == MUTT_OR)
+    {
+      pat->cost = 0;
+      pat->interactive = 0;
+      for (child = pat->child, pat->child = NULL; child; child = next)
+      {
+	next = child->next;
+	for (p = &pat->child;
+	     *p && (child->interactive || (*p)->cost <= child->cost);
+	     p = &(*p)->next)
+	  ;
+	child->next = *p;
+	*p = child;
+	if (child->cost > pat->cost)
+	  pat->cost = child->cost;
+	pat->interactive |= child->interactive;
+      }
+    }
+    else
+    {
+      pat->cost = pattern_op_cost (pat);
+      pat->interactive = pattern_op_interactive (pat);
+      if (pat->child)
+      {
+	/* the operand of a thread pattern is evaluated for every
+	 * message in the thread */
+	for (child = pat->child; child; child = child->next)
+	{
+	  if (pat->cost < PAT_COST_THREAD + child->cost)
+	    pat->cost = PAT_COST_THREAD + child->cost;
+	  pat->interactive |= child->interactive;
+	}
+      }
+    }
+  }
+}
+
 static int
 perform_and (pattern_t *pat, pattern_exec_flag flags, CONTEXT *ctx, HEADER *hdr, pattern_cache_t *cache)
 {
@@ -1660,13 +1862,24 @@ mutt_pattern_exec (struct pattern_t *pat, pattern_exec_flag flags, CONTEXT *ctx,
        */
       if (!ctx)
         return 0;
+      /* answered ahead of time by search_bodies() or imap_search() */
+      if (pat->found && pat->found[h->msgno])
+        return (pat->not ^ (pat->found[h->msgno] == BODY_FOUND));
 #ifdef USE_IMAP
       /* IMAP search sets h->matched at search compile time */
       if (ctx->magic == MUTT_IMAP && pat->stringmatch)
 	return (h->matched);
 #endif
       return (pat->not ^ msg_search (ctx, pat, h->msgno));
+    case MUTT_WORDS:
+      if (!ctx)
+        return 0;
+      /* ruled out ahead of time by search_words() */
+      if (pat->found && pat->found[h->msgno])
+        return (pat->not ^ (pat->found[h->msgno] == BODY_FOUND));
+      return (pat->not ^ msg_search (ctx, pat, h->msgno));
     case MUTT_SENDER:
+      mutt_env_load_lazy (h->env);
       return (pat->not ^ match_adrlist (pat, flags & MUTT_MATCH_FULL_ADDRESS, 1,
                                         h->env->sender));
     case MUTT_FROM:
@@ -1691,6 +1904,7 @@ mutt_pattern_exec (struct pattern_t *pat, pattern_exec_flag flags, CONTEXT *ctx,
       return (pat->not ^ (match_reference (pat, h->env->references) ||
 			  match_reference (pat, h->env->in_reply_to)));
     case MUTT_ADDRESS:
+      mutt_env_load_lazy (h->env);
       return (pat->not ^ match_adrlist (pat, flags & MUTT_MATCH_FULL_ADDRESS, 4,
                                         h->env->from, h->env->sender,
                                         h->env->to, h->env->cc));
@@ -1868,13 +2082,616 @@ void mutt_check_simple (BUFFER *s, const char *simple)
   }
 }
 
+/* The search cache keeps the last few patterns used for limiting,
+ * tagging and searching compiled, along with the result of each one for
+ * every message.  A result is stored as a bit in HEADER->search_known and
+ * HEADER->search_matched, so it goes away along with the message, and a
+ * message whose flags change only has to clear its own bits.
+ */
+#define SEARCH_CACHE_SLOTS 8	/* bits in HEADER->search_known */
+
+struct search_cache
+{
+  struct
+  {
+    char *expn;		/* expanded pattern string */
+    pattern_t *pat;
+    int thorough;	/* $thorough_search when it was compiled */
+    unsigned long used;
+  } slot[SEARCH_CACHE_SLOTS];
+  unsigned long clock;
+};
+
+static struct
+{
+  unsigned long lookups;	/* patterns looked up */
+  unsigned long reused;		/* ...which were already compiled */
+  unsigned long hits;		/* results taken from the cache */
+  unsigned long misses;		/* results that had to be evaluated */
+} SearchCacheStats;
+
+/* whether the result of pat for a message only depends on that message,
+ * so that it can be cached until the message itself changes. */
+static int search_cacheable (pattern_t *pat)
+{
+  for (; pat; pat = pat->next)
+  {
+    switch (pat->op)
+    {
+      /* these depend on the thread tree or the current view */
+      case MUTT_THREAD:
+      case MUTT_PARENT:
+      case MUTT_CHILDREN:
+      case MUTT_MESSAGE:
+      case MUTT_COLLAPSED:
+      case MUTT_DUPLICATED:
+      case MUTT_UNREFERENCED:
+      /* these are relative to the current time */
+      case MUTT_DATE:
+      case MUTT_DATE_RECEIVED:
+      /* these depend on configuration which may change at any time */
+      case MUTT_LIST:
+      case MUTT_SUBSCRIBED_LIST:
+      case MUTT_PERSONAL_RECIP:
+      case MUTT_PERSONAL_FROM:
+      case MUTT_MIMEATTACH:
+      /* verifying a signature sets this without _mutt_set_flag() */
+      case MUTT_CRYPT_VERIFIED:
+	return 0;
+    }
+    if (pat->isalias || pat->groupmatch || pat->dynamic)
+      return 0;
+    if (pat->child && !search_cacheable (pat->child))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* returns the slot holding the compiled version of expn, or -1 */
+static int search_cache_lookup (CONTEXT *ctx, const char *expn)
+{
+  struct search_cache *cache = ctx->search_cache;
+  int i;
+
+  SearchCacheStats.lookups++;
+  if (!cache)
+    return -1;
+
+  for (i = 0; i < SEARCH_CACHE_SLOTS; i++)
+  {
+    if (cache->slot[i].expn && !mutt_strcmp (cache->slot[i].expn, expn) &&
+	cache->slot[i].thorough == option (OPTTHOROUGHSRC))
+    {
+      cache->slot[i].used = ++cache->clock;
+      SearchCacheStats.reused++;
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/* hands pat over to the cache, replacing the least recently used slot.
+ * returns the slot, or -1 if pat's results can't be cached, in which
+ * case the caller keeps ownership of pat. */
+static int search_cache_store (CONTEXT *ctx, const char *expn, pattern_t *pat)
+{
+  struct search_cache *cache;
+  unsigned char mask;
+  int i, slot = 0;
+
+  if (!search_cacheable (pat))
+    return -1;
+
+  if (!ctx->search_cache)
+    ctx->search_cache = safe_calloc (1, sizeof (struct search_cache));
+  cache = ctx->search_cache;
+
+  for (i = 1; i < SEARCH_CACHE_SLOTS && cache->slot[slot].expn; i++)
+    if (!cache->slot[i].expn || cache->slot[i].used < cache->slot[slot].used)
+      slot = i;
+
+  if (cache->slot[slot].expn)
+  {
+    mask = ~(1 << slot);
+    for (i = 0; i < ctx->msgcount; i++)
+      ctx->hdrs[i]->search_known &= mask;
+    FREE (&cache->slot[slot].expn);
+    mutt_pattern_free (&cache->slot[slot].pat);
+  }
+
+  cache->slot[slot].expn = safe_strdup (expn);
+  cache->slot[slot].pat = pat;
+  cache->slot[slot].thorough = option (OPTTHOROUGHSRC);
+  cache->slot[slot].used = ++cache->clock;
+
+  return slot;
+}
+
+/* evaluates pat, which is cached in slot unless that is -1, for h */
+static int search_cache_exec (CONTEXT *ctx, int slot, pattern_t *pat, HEADER *h)
+{
+  unsigned char bit;
+
+  if (slot < 0)
+    return mutt_pattern_exec (pat, MUTT_MATCH_FULL_ADDRESS, ctx, h, NULL);
+
+  bit = 1 << slot;
+  if (h->search_known & bit)
+  {
+    SearchCacheStats.hits++;
+    return (h->search_matched & bit) ? 1 : 0;
+  }
+
+  SearchCacheStats.misses++;
+  h->search_known |= bit;
+  if (mutt_pattern_exec (pat, MUTT_MATCH_FULL_ADDRESS, ctx, h, NULL) > 0)
+  {
+    h->search_matched |= bit;
+    return 1;
+  }
+  h->search_matched &= ~bit;
+  return 0;
+}
+
+void mutt_search_cache_free (CONTEXT *ctx)
+{
+  int i;
+
+  if (!ctx->search_cache)
+    return;
+
+  for (i = 0; i < SEARCH_CACHE_SLOTS; i++)
+  {
+    FREE (&ctx->search_cache->slot[i].expn);
+    mutt_pattern_free (&ctx->search_cache->slot[i].pat);
+  }
+  FREE (&ctx->search_cache);
+
+  for (i = 0; i < ctx->msgcount; i++)
+    if (ctx->hdrs[i])
+      ctx->hdrs[i]->search_known = 0;
+}
+
+void mutt_search_cache_stats (char *buf, size_t buflen)
+{
+  snprintf (buf, buflen,
+	    _("Search cache: %lu of %lu patterns reused, %lu of %lu results cached"),
+	    SearchCacheStats.reused, SearchCacheStats.lookups,
+	    SearchCacheStats.hits,
+	    SearchCacheStats.hits + SearchCacheStats.misses);
+}
+
+#ifdef USE_PTHREADS
+/* Messages the body search workers may run ahead, per thread */
+#define BODY_SEARCH_PER_THREAD	16
+
+struct body_search_item
+{
+  char *path;			/* message file, NULL for the folder itself */
+  LOFF_T offset;		/* h->offset */
+  LOFF_T body;			/* h->content->offset */
+  LOFF_T length;		/* h->content->length */
+  int msgno;
+  unsigned char found;		/* BODY_* */
+};
+
+/*
+ * One ~b, ~h or ~B being searched by the workers.  Each worker reads
+ * the message through a FILE of its own, so ctx->fp is left alone,
+ * and borrows one of the private copies of the regexp.
+ */
+struct body_search
+{
+  pattern_t *pat;
+  const char *folder;
+  int thorough;			/* $thorough_search */
+  int flowed;			/* $text_flowed */
+  regex_t *rx;
+  pthread_mutex_t *rxlock;
+  int nrx;
+  struct body_search_item *items;
+  size_t count;
+};
+
+static int uses_body_search (pattern_t *pat)
+{
+  pattern_t *child;
+
+  if (pat->op == MUTT_BODY || pat->op == MUTT_HEADER ||
+      pat->op == MUTT_WHOLE_MSG)
+    return 1;
+  for (child = pat->child; child; child = child->next)
+    if (uses_body_search (child))
+      return 1;
+  return 0;
+}
+
+/* charsets whose decoding leaves plain ASCII text alone */
+static int body_search_ascii (const char *charset)
+{
+  return mutt_is_us_ascii (charset) || mutt_is_utf8 (charset) ||
+    !ascii_strncasecmp (NONULL (charset), "iso-8859-", 9);
+}
+
+/*
+ * Whether msg_search() with $thorough_search runs h's body through
+ * nothing but text_plain_handler(), so that body_search_decoded()
+ * can stand in for it.
+ */
+static int body_search_decodable (HEADER *h)
+{
+  BODY *b = h->content;
+  char charset[STRING];
+
+  if (!b || b->parts || b->type != TYPETEXT ||
+      ascii_strcasecmp ("plain", b->subtype))
+    return 0;
+  if (b->encoding != ENC7BIT && b->encoding != ENC8BIT &&
+      b->encoding != ENCBINARY)
+    return 0;
+  if (WithCrypto && ((h->security & ENCRYPT) ||
+                     ((WithCrypto & APPLICATION_PGP) &&
+                      mutt_is_application_pgp (b))))
+    return 0;
+  if (option (OPTREFLOWTEXT) &&
+      !ascii_strcasecmp ("flowed", mutt_get_parameter ("format", b->parameter)))
+    return 0;
+  if (option (OPTHONORDISP) && b->disposition == DISPATTACH)
+    return 0;
+  if (mutt_is_autoview (b))
+    return 0;
+
+  mutt_get_body_charset (charset, sizeof (charset), b);
+  return body_search_ascii (charset);
+}
+
+static int body_search_match (struct body_search *bs, regex_t *rx,
+                              const char *buf)
+{
+  if (rx)
+    return regexec (rx, buf, 0, NULL, 0) == 0;
+  return patmatch (bs->pat, buf) == 0;
+}
+
+/* Runs in a worker thread: the raw search of msg_search(). */
+static int body_search_raw (struct body_search *bs, regex_t *rx, FILE *fp,
+                            struct body_search_item *item)
+{
+  int op = bs->pat->op;
+  int match = 0;
+  LOFF_T lng = 0;
+  size_t blen = STRING;
+  char *buf;
+
+  if (op != MUTT_BODY)
+  {
+    fseeko (fp, item->offset, SEEK_SET);
+    lng = item->body - item->offset;
+  }
+  if (op != MUTT_HEADER)
+  {
+    if (op == MUTT_BODY)
+      fseeko (fp, item->body, SEEK_SET);
+    lng += item->length;
+  }
+
+  buf = safe_malloc (blen);
+  while (lng > 0)
+  {
+    if (op == MUTT_HEADER)
+    {
+      if (*(buf = mutt_read_rfc822_line (fp, buf, &blen)) == '\0')
+	break;
+    }
+    else if (fgets (buf, blen - 1, fp) == NULL)
+      break;
+    if (body_search_match (bs, rx, buf))
+    {
+      match = 1;
+      break;
+    }
+    lng -= mutt_strlen (buf);
+  }
+  FREE (&buf);
+
+  return match;
+}
+
+/*
+ * Runs in a worker thread: the $thorough_search of msg_search() for a
+ * body accepted by body_search_decodable().  text_plain_handler()
+ * writes each line followed by a newline, without trailing spaces with
+ * $text_flowed, and msg_search() reads that back in pieces of at most
+ * STRING - 2 bytes.  Returns -1 if the body isn't plain ASCII, as then
+ * the result depends on the charset conversion.
+ */
+static int body_search_decoded (struct body_search *bs, regex_t *rx, FILE *fp,
+                                struct body_search_item *item)
+{
+  char chunk[STRING];
+  char *text, *line, *eol, *end, *p;
+  size_t len, off, n;
+  int match = 0;
+
+  text = safe_malloc (item->length + 1);
+  fseeko (fp, item->body, SEEK_SET);
+  end = text + fread (text, 1, item->length, fp);
+
+  for (line = text; line < end && !match; line = eol + 1)
+  {
+    if ((eol = memchr (line, '\n', end - line)) == NULL)
+      eol = end;
+    for (p = line; p < eol; p++)
+      if (!*p || *p == '\r' || (unsigned char) *p >= 0x80)
+      {
+	match = -1;
+	break;
+      }
+    if (match)
+      break;
+
+    len = eol - line;
+    if (bs->flowed && !(len == 3 && !strncmp (line, "-- ", 3)))
+      while (len > 0 && line[len - 1] == ' ')
+	len--;
+    line[len++] = '\n';
+
+    for (off = 0; off < len && !match; off += n)
+    {
+      n = MIN (len - off, sizeof (chunk) - 2);
+      memcpy (chunk, line + off, n);
+      chunk[n] = '\0';
+      match = body_search_match (bs, rx, chunk);
+    }
+  }
+  FREE (&text);
+
+  return match;
+}
+
+/* Runs in a worker thread: search message i of bs. */
+static void body_search_message (void *data, size_t i)
+{
+  struct body_search *bs = (struct body_search *) data;
+  struct body_search_item *item = &bs->items[i];
+  regex_t *rx = NULL;
+  FILE *fp;
+  int k = 0, match;
+
+  if ((fp = fopen (item->path ? item->path : bs->folder, "r")) == NULL)
+    return;
+
+  if (bs->nrx)
+  {
+    /* there is a copy for every thread, so one of them is free */
+    for (k = i % bs->nrx; pthread_mutex_trylock (&bs->rxlock[k]) != 0;
+         k = (k + 1) % bs->nrx)
+      ;
+    rx = &bs->rx[k];
+  }
+
+  if (bs->thorough)
+    match = body_search_decoded (bs, rx, fp, item);
+  else
+    match = body_search_raw (bs, rx, fp, item);
+
+  if (rx)
+    pthread_mutex_unlock (&bs->rxlock[k]);
+  safe_fclose (&fp);
+
+  if (match >= 0)
+    item->found = match ? BODY_FOUND : BODY_NOT_FOUND;
+}
+
+/*
+ * Searches hdrs[0 .. n-1] for the ~b, ~h or ~B pat with $search_threads
+ * workers and leaves the results in pat->found for mutt_pattern_exec().
+ * Messages the workers can't answer for are left to msg_search().  The
+ * main thread collects the results in order, keeping the progress bar
+ * moving, and stops at SigInt, which it leaves set for the caller.
+ */
+static void search_body_pattern (CONTEXT *ctx, pattern_t *pat,
+                                 HEADER **hdrs, int n)
+{
+  struct body_search bs;
+  struct body_search_item *item;
+  WORKERS *workers = NULL;
+  progress_t progress;
+  BUFFER *path;
+  HEADER *h;
+  size_t i;
+  int k;
+
+  memset (&bs, 0, sizeof (bs));
+  bs.pat = pat;
+  bs.folder = ctx->path;
+  bs.thorough = option (OPTTHOROUGHSRC);
+  bs.flowed = option (OPTTEXTFLOWED);
+
+  /* decoding headers involves RFC 2047 and charsets */
+  if (bs.thorough && (pat->op != MUTT_BODY || !body_search_ascii (Charset)))
+    return;
+
+  if (!pat->stringmatch)
+  {
+    if (!pat->expr)
+      return;
+    bs.rx = safe_calloc (MIN (SearchThreads, MUTT_WORKERS_MAX), sizeof (regex_t));
+    bs.rxlock = safe_calloc (MIN (SearchThreads, MUTT_WORKERS_MAX),
+                             sizeof (pthread_mutex_t));
+    for (k = 0; k < MIN (SearchThreads, MUTT_WORKERS_MAX); k++)
+    {
+      if (REGCOMP (&bs.rx[k], pat->expr,
+                   REG_NEWLINE | REG_NOSUB | mutt_which_case (pat->expr)) != 0)
+	goto cleanup;
+      pthread_mutex_init (&bs.rxlock[k], NULL);
+      bs.nrx++;
+    }
+  }
+
+  bs.items = safe_calloc (n, sizeof (struct body_search_item));
+  path = mutt_buffer_pool_get ();
+  for (k = 0; k < n; k++)
+  {
+    h = hdrs[k];
+    if (bs.thorough && !body_search_decodable (h))
+      continue;
+
+    item = &bs.items[bs.count++];
+    item->msgno = h->msgno;
+    item->offset = h->offset;
+    item->body = h->content->offset;
+    item->length = h->content->length;
+    if (ctx->magic == MUTT_MH || ctx->magic == MUTT_MAILDIR)
+    {
+      mutt_buffer_printf (path, "%s/%s", ctx->path, h->path);
+      item->path = safe_strdup (mutt_b2s (path));
+    }
+  }
+  mutt_buffer_pool_release (&path);
+
+  if (bs.count > 1)
+    workers = mutt_workers_start (SearchThreads, bs.count,
+                                  SearchThreads * BODY_SEARCH_PER_THREAD,
+                                  body_search_message, &bs);
+  if (workers)
+  {
+    pat->found = safe_calloc (ctx->msgcount, sizeof (unsigned char));
+    mutt_progress_init (&progress, _("Searching message bodies..."),
+                        MUTT_PROGRESS_MSG, ReadInc, bs.count);
+    for (i = 0; i < bs.count && !SigInt; i++)
+    {
+      mutt_progress_update (&progress, i, -1);
+      mutt_workers_wait (workers, i);
+      pat->found[bs.items[i].msgno] = bs.items[i].found;
+    }
+    mutt_workers_finish (&workers);
+  }
+
+cleanup:
+  for (i = 0; i < bs.count; i++)
+    FREE (&bs.items[i].path);
+  FREE (&bs.items);
+  for (k = 0; k < bs.nrx; k++)
+  {
+    regfree (&bs.rx[k]);
+    pthread_mutex_destroy (&bs.rxlock[k]);
+  }
+  FREE (&bs.rx);
+  FREE (&bs.rxlock);
+}
+
+static void search_body_patterns (CONTEXT *ctx, pattern_t *pat,
+                                  HEADER **hdrs, int n)
+{
+  for (; pat && !SigInt; pat = pat->next)
+  {
+    if (pat->op == MUTT_BODY || pat->op == MUTT_HEADER ||
+        pat->op == MUTT_WHOLE_MSG)
+      search_body_pattern (ctx, pat, hdrs, n);
+    else
+      search_body_patterns (ctx, pat->child, hdrs, n);
+  }
+}
+
+/*
+ * Whether pat may need the body of h searched: the cheaper operands of
+ * a top level AND can already rule the message out.
+ */
+static int body_search_needed (CONTEXT *ctx, pattern_t *pat, HEADER *h)
+{
+  if (pat->op != MUTT_AND)
+    return 1;
+  for (pat = pat->child; pat; pat = pat->next)
+    if (!uses_body_search (pat) &&
+        mutt_pattern_exec (pat, MUTT_MATCH_FULL_ADDRESS, ctx, h, NULL) <= 0)
+      return 0;
+  return 1;
+}
+
+/*
+ * With $search_threads, searches the local messages pat is about to be
+ * evaluated on -- every message for a limit, the visible ones otherwise
+ * -- for its ~b, ~h and ~B in parallel, ahead of mutt_pattern_func()'s
+ * loop.  Messages with a result in search cache slot, or ruled out
+ * without their body, are skipped.
+ */
+static void search_bodies (CONTEXT *ctx, int slot, pattern_t *pat, int all)
+{
+  HEADER **hdrs, *h;
+  int i, n = 0, count;
+
+  if (SearchThreads < 2 || !uses_body_search (pat))
+    return;
+  if (ctx->magic != MUTT_MBOX && ctx->magic != MUTT_MMDF &&
+      ctx->magic != MUTT_MH && ctx->magic != MUTT_MAILDIR)
+    return;
+  if ((count = all ? ctx->msgcount : ctx->vcount) < 2)
+    return;
+
+  hdrs = safe_calloc (count, sizeof (HEADER *));
+  for (i = 0; i < count; i++)
+  {
+    h = ctx->hdrs[all ? i : ctx->v2r[i]];
+    if (slot >= 0 && (h->search_known & (1 << slot)))
+      continue;
+    if (body_search_needed (ctx, pat, h))
+      hdrs[n++] = h;
+  }
+  search_body_patterns (ctx, pat, hdrs, n);
+  FREE (&hdrs);
+}
+#endif /* USE_PTHREADS */
+
+#ifdef USE_HCACHE
+/*
+ * With $text_index, rules out the messages the index of ctx shows lack
+ * a word of each ~w in pat, ahead of mutt_pattern_func()'s loop.
+ */
+static void search_words (CONTEXT *ctx, pattern_t *pat)
+{
+  unsigned char *excluded;
+  int i;
+
+  if (!option (OPTTEXTINDEX))
+    return;
+
+  for (; pat && !SigInt; pat = pat->next)
+  {
+    if (pat->op != MUTT_WORDS)
+    {
+      search_words (ctx, pat->child);
+      continue;
+    }
+
+    if (!(excluded = mutt_text_index_query (ctx, pat->p.str)))
+      continue;
+    for (i = 0; i < ctx->msgcount; i++)
+      excluded[i] = excluded[i] ? BODY_NOT_FOUND : BODY_UNKNOWN;
+    FREE (&pat->found);
+    pat->found = excluded;
+  }
+}
+#endif
+
+static void search_bodies_done (pattern_t *pat)
+{
+  for (; pat; pat = pat->next)
+  {
+    FREE (&pat->found);
+    search_bodies_done (pat->child);
+  }
+}
+
 int mutt_pattern_func (int op, char *prompt)
 {
   pattern_t *pat = NULL;
   BUFFER *buf = NULL;
   char *simple = NULL;
   BUFFER err;
-  int i, rv = -1, padding, interrupted = 0;
+  int i, rv = -1, padding, interrupted = 0, slot = -1;
   progress_t progress;
 
   buf = mutt_buffer_pool_get ();
@@ -1895,10 +2712,16 @@ int mutt_pattern_func (int op, char *prompt)
   mutt_buffer_init (&err);
   err.dsize = STRING;
   err.data = safe_malloc(err.dsize);
-  if ((pat = mutt_pattern_comp (buf->data, MUTT_FULL_MSG, &err)) == NULL)
+  if ((slot = search_cache_lookup (Context, mutt_b2s (buf))) >= 0)
+    pat = Context->search_cache->slot[slot].pat;
+  else
   {
-    mutt_error ("%s", err.data);
-    goto bail;
+    if ((pat = mutt_pattern_comp (buf->data, MUTT_FULL_MSG, &err)) == NULL)
+    {
+      mutt_error ("%s", err.data);
+      goto bail;
+    }
+    slot = search_cache_store (Context, mutt_b2s (buf), pat);
   }
 
 #ifdef USE_IMAP
@@ -1906,6 +2729,13 @@ int mutt_pattern_func (int op, char *prompt)
     goto bail;
 #endif
 
+#ifdef USE_HCACHE
+  search_words (Context, pat);
+#endif
+#ifdef USE_PTHREADS
+  search_bodies (Context, slot, pat, op == MUTT_LIMIT);
+#endif
+
   mutt_progress_init (&progress, _("Executing command on matching messages..."),
 		      MUTT_PROGRESS_MSG, ReadInc,
 		      (op == MUTT_LIMIT) ? Context->msgcount : Context->vcount);
@@ -1931,7 +2761,7 @@ int mutt_pattern_func (int op, char *prompt)
       Context->hdrs[i]->limited = 0;
       Context->hdrs[i]->collapsed = 0;
       Context->hdrs[i]->num_hidden = 0;
-      if (mutt_pattern_exec (pat, MUTT_MATCH_FULL_ADDRESS, Context, Context->hdrs[i], NULL))
+      if (search_cache_exec (Context, slot, pat, Context->hdrs[i]))
       {
 	BODY *this_body = Context->hdrs[i]->content;
 
@@ -1955,7 +2785,7 @@ int mutt_pattern_func (int op, char *prompt)
         break;
       }
       mutt_progress_update (&progress, i, -1);
-      if (mutt_pattern_exec (pat, MUTT_MATCH_FULL_ADDRESS, Context, Context->hdrs[Context->v2r[i]], NULL))
+      if (search_cache_exec (Context, slot, pat, Context->hdrs[Context->v2r[i]]))
       {
 	switch (op)
 	{
@@ -2009,9 +2839,14 @@ int mutt_pattern_func (int op, char *prompt)
   rv = 0;
 
 bail:
+  search_bodies_done (pat);
+#ifdef USE_HCACHE
+  mutt_text_index_flush (Context);
+#endif
   mutt_buffer_pool_release (&buf);
   FREE (&simple);
-  mutt_pattern_free (&pat);
+  if (slot < 0)
+    mutt_pattern_free (&pat);
   FREE (&err.data);
 
   return rv;
@@ -2019,10 +2854,11 @@ bail:
 
 int mutt_search_command (int cur, int op)
 {
-  int i, j;
+  int i, j, slot;
   char buf[STRING];
   int incr;
   HEADER *h;
+  pattern_t *pat;
   progress_t progress;
   const char* msg = NULL;
 
@@ -2075,12 +2911,34 @@ int mutt_search_command (int cur, int op)
     mutt_buffer_pool_release (&temp);
   }
 
+  /* evaluate through the search cache, so that results from limiting or
+   * tagging with the same pattern can be reused */
+  pat = SearchPattern;
+  if ((slot = search_cache_lookup (Context, LastSearchExpn)) >= 0)
+    pat = Context->search_cache->slot[slot].pat;
+  else if (search_cacheable (SearchPattern))
+  {
+    BUFFER err;
+    mutt_buffer_init (&err);
+    err.dsize = STRING;
+    err.data = safe_malloc (err.dsize);
+    if ((pat = mutt_pattern_comp (LastSearchExpn, MUTT_FULL_MSG, &err)) != NULL)
+    {
+      slot = search_cache_store (Context, LastSearchExpn, pat);
+      /* the server hasn't searched for this copy yet */
+      set_option (OPTSEARCHINVALID);
+    }
+    else
+      pat = SearchPattern;
+    FREE (&err.data);
+  }
+
   if (option (OPTSEARCHINVALID))
   {
     for (i = 0; i < Context->msgcount; i++)
       Context->hdrs[i]->searched = 0;
 #ifdef USE_IMAP
-    if (Context->magic == MUTT_IMAP && imap_search (Context, SearchPattern) < 0)
+    if (Context->magic == MUTT_IMAP && imap_search (Context, pat) < 0)
       return -1;
 #endif
     unset_option (OPTSEARCHINVALID);
@@ -2135,7 +2993,7 @@ int mutt_search_command (int cur, int op)
     {
       /* remember that we've already searched this message */
       h->searched = 1;
-      if ((h->matched = (mutt_pattern_exec (SearchPattern, MUTT_MATCH_FULL_ADDRESS, Context, h, NULL) > 0)))
+      if ((h->matched = search_cache_exec (Context, slot, pat, h)))
       {
 	mutt_clear_error();
 	if (msg && *msg)
@@ -2270,6 +3128,13 @@ static MUTTMENU *create_pattern_menu (void)
         */
         mutt_buffer_add_printf (entrybuf, " %s", _("DATERANGE"));
         break;
+      case EAT_WORDS:
+        /* L10N:
+           Pattern Completion Menu argument type: words to look for.
+           Used by ~w.
+        */
+        mutt_buffer_add_printf (entrybuf, " %s", _("WORDS"));
+        break;
     }
     entries[i].expr = safe_strdup (mutt_b2s (entrybuf));
     entries[i].descr = safe_strdup (_(Flags[i].desc));
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Checks that plan_pattern() doesn't change what a pattern matches.
+ * A small threaded mbox is written and opened, and each pattern below
+ * is compiled twice, with and without MUTT_PATTERN_UNPLANNED.  Both
+ * versions must match the same messages.  This is built and run by
+ * "make check".
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mailbox.h"
+#include "mutt_test.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/* Two threads, a reply to a reply, and a few messages on their own,
+ * with a mix of flags, subjects and bodies. */
+static const char *Mailbox =
+  "From a@example.com Mon Jan  5 10:00:00 2026\n"
+  "From: Ann <a@example.com>\n"
+  "To: b@example.com\n"
+  "Subject: lunch plans\n"
+  "Message-ID: <1@example.com>\n"
+  "Date: Mon, 5 Jan 2026 10:00:00 +0000\n"
+  "Status: RO\n"
+  "X-Status: F\n"
+  "\n"
+  "apple pie\n"
+  "\n"
+  "From b@example.com Mon Jan  5 11:00:00 2026\n"
+  "From: Bob <b@example.com>\n"
+  "To: a@example.com\n"
+  "Subject: Re: lunch plans\n"
+  "Message-ID: <2@example.com>\n"
+  "In-Reply-To: <1@example.com>\n"
+  "References: <1@example.com>\n"
+  "Date: Mon, 5 Jan 2026 11:00:00 +0000\n"
+  "Status: O\n"
+  "\n"
+  "a pear would do\n"
+  "\n"
+  "From c@example.com Mon Jan  5 12:00:00 2026\n"
+  "From: Cat <c@example.com>\n"
+  "To: a@example.com\n"
+  "Cc: b@example.com\n"
+  "Subject: meeting\n"
+  "Message-ID: <3@example.com>\n"
+  "Date: Mon, 5 Jan 2026 12:00:00 +0000\n"
+  "\n"
+  "apple and pear\n"
+  "\n"
+  "From a@example.com Mon Jan  5 13:00:00 2026\n"
+  "From: Ann <a@example.com>\n"
+  "To: c@example.com\n"
+  "Subject: Re: meeting\n"
+  "Message-ID: <4@example.com>\n"
+  "In-Reply-To: <3@example.com>\n"
+  "References: <3@example.com>\n"
+  "Date: Mon, 5 Jan 2026 13:00:00 +0000\n"
+  "Status: RO\n"
+  "X-Status: F\n"
+  "\n"
+  "nothing to add\n"
+  "\n"
+  "From c@example.com Mon Jan  5 14:00:00 2026\n"
+  "From: Cat <c@example.com>\n"
+  "To: a@example.com\n"
+  "Subject: Re: meeting\n"
+  "Message-ID: <5@example.com>\n"
+  "In-Reply-To: <4@example.com>\n"
+  "References: <3@example.com> <4@example.com>\n"
+  "Date: Mon, 5 Jan 2026 14:00:00 +0000\n"
+  "X-Status: F\n"
+  "\n"
+  "one more apple\n"
+  "\n"
+  "From d@example.com Mon Jan  5 15:00:00 2026\n"
+  "From: Dan <d@example.com>\n"
+  "To: a@example.com\n"
+  "Subject: report\n"
+  "Message-ID: <6@example.com>\n"
+  "Date: Mon, 5 Jan 2026 15:00:00 +0000\n"
+  "Status: RO\n"
+  "\n"
+  "banana\n"
+  "\n"
+  "From d@example.com Mon Jan  5 16:00:00 2026\n"
+  "From: Dan <d@example.com>\n"
+  "To: b@example.com\n"
+  "Subject: lunch\n"
+  "Message-ID: <7@example.com>\n"
+  "Date: Mon, 5 Jan 2026 16:00:00 +0000\n"
+  "\n"
+  "Pear, Apple\n";
+
+static const char *Patterns[] =
+{
+  /* and */
+  "~b apple ~F",
+  "~F ~b apple",
+  "~b apple ~s lunch ~N",
+  "~h Cc: ~b pear ~O",
+  "~B Ann ~f c@ ~U",
+  /* or */
+  "~b apple | ~F",
+  "~b banana | ~s meeting | ~N",
+  "~s lunch ~b pear | ~F ~b apple",
+  /* negation */
+  "!~b apple ~F",
+  "!(~b apple | ~s lunch) !~F",
+  "!~b pear | !~N",
+  "~b apple !(~F | ~N)",
+  /* thread operators */
+  "~(~b pear) ~F",
+  "~(~F) ~b apple",
+  "~<(~F) ~b pear",
+  "~>(~s meeting | ~b banana) !~F",
+  "~b apple ~(~N) ~O",
+  "~(~b apple ~F) | ~s report",
+  /* nested */
+  "(~s lunch | ~b banana) (~F | ~b pear)",
+  "~b apple (~F | ~U) | ~N ~b pear",
+  "!(~b pear ~(~F)) ~R",
+  NULL
+};
+
+static int Failed = 0;
+static int Checks = 0;
+
+static void check (int ok, const char *what, const char *expr)
+{
+  Checks++;
+  if (!ok)
+  {
+    Failed++;
+    fprintf (stderr, "FAIL: %s: %s\n", expr, what);
+  }
+}
+
+static pattern_t *compile (const char *expr, int flags)
+{
+  BUFFER err;
+  char *s;
+  pattern_t *pat;
+
+  mutt_buffer_init (&err);
+  mutt_buffer_increase_size (&err, STRING);
+  s = safe_strdup (expr);
+  pat = mutt_pattern_comp (s, MUTT_FULL_MSG | flags, &err);
+  if (!pat)
+    fprintf (stderr, "%s: %s\n", expr, err.data);
+  FREE (&s);
+  FREE (&err.data);
+  return pat;
+}
+
+/* planned and unplanned must agree on every message */
+static void check_results (CONTEXT *ctx, const char *expr)
+{
+  pattern_t *planned, *unplanned;
+  char what[STRING];
+  int i, a, b;
+
+  planned = compile (expr, 0);
+  unplanned = compile (expr, MUTT_PATTERN_UNPLANNED);
+  check (planned && unplanned, "doesn't compile", expr);
+  if (!planned || !unplanned)
+    goto out;
+
+  for (i = 0; i < ctx->msgcount; i++)
+  {
+    a = mutt_pattern_exec (planned, MUTT_MATCH_FULL_ADDRESS, ctx,
+                           ctx->hdrs[i], NULL);
+    b = mutt_pattern_exec (unplanned, MUTT_MATCH_FULL_ADDRESS, ctx,
+                           ctx->hdrs[i], NULL);
+    snprintf (what, sizeof (what), "message %d: planned %d, unplanned %d",
+              i + 1, a, b);
+    check (a == b, what, expr);
+  }
+
+out:
+  mutt_pattern_free (&planned);
+  mutt_pattern_free (&unplanned);
+}
+
+/* the operands of the top level AND or OR end up in the order of ops */
+static void check_order (const char *expr, const int *ops, int nops)
+{
+  pattern_t *pat, *child;
+  int i;
+
+  if (!(pat = compile (expr, 0)))
+  {
+    check (0, "doesn't compile", expr);
+    return;
+  }
+
+  for (i = 0, child = pat->child; child && i < nops; child = child->next, i++)
+    if (child->op != ops[i])
+      break;
+  check (i == nops && !child, "operands out of order", expr);
+
+  mutt_pattern_free (&pat);
+}
+
+int main (void)
+{
+  static const int flag_first[] = { MUTT_FLAG, MUTT_BODY };
+  static const int thread_then_body[] = { MUTT_THREAD, MUTT_BODY };
+  static const int flag_body_thread[] = { MUTT_FLAG, MUTT_BODY, MUTT_THREAD };
+  static const int subject_body_body[] = { MUTT_SUBJECT, MUTT_BODY, MUTT_WHOLE_MSG };
+  LIST *commands;
+  BUFFER *path;
+  FILE *fp;
+  CONTEXT *ctx;
+  int i;
+
+  commands = mutt_add_list (NULL, "set sort=threads");
+  mutt_test_init (commands);
+  mutt_free_list (&commands);
+
+  path = mutt_buffer_new ();
+  mutt_buffer_mktemp (path);
+  if ((fp = safe_fopen (mutt_b2s (path), "w")) == NULL)
+  {
+    perror (mutt_b2s (path));
+    return 1;
+  }
+  fputs (Mailbox, fp);
+  safe_fclose (&fp);
+
+  ctx = mx_open_mailbox (mutt_b2s (path), MUTT_READONLY | MUTT_QUIET, NULL);
+  if (!ctx || ctx->msgcount != 7)
+  {
+    fprintf (stderr, "can't read %s\n", mutt_b2s (path));
+    unlink (mutt_b2s (path));
+    return 1;
+  }
+
+  for (i = 0; Patterns[i]; i++)
+    check_results (ctx, Patterns[i]);
+
+  /* cheap operands go first ... */
+  check_order ("~b apple ~F", flag_first, 2);
+  check_order ("~b apple | ~F", flag_first, 2);
+  /* ... but nothing that may prompt moves ahead of what precedes it */
+  check_order ("~(~F) ~b apple", thread_then_body, 2);
+  check_order ("~b apple ~(~F) ~F", flag_body_thread, 3);
+  check_order ("~b apple ~B pear ~s lunch", subject_body_body, 3);
+
+  mx_fastclose_mailbox (ctx);
+  FREE (&ctx);
+  unlink (mutt_b2s (path));
+  mutt_buffer_free (&path);
+
+  if (Failed)
+    fprintf (stderr, "%d of %d checks failed\n", Failed, Checks);
+  else
+    printf ("%d checks passed\n", Checks);
+  return Failed ? 1 : 0;
+}
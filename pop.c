@@ -274,6 +274,7 @@ static int pop_fetch_headers (CONTEXT *ctx)
   void *data;
 
   hc = pop_hcache_open (pop_data, ctx->path);
+  mutt_hcache_begin (hc);
 #endif
 
   time (&pop_data->check_time);
@@ -364,8 +365,6 @@ static int pop_fetch_headers (CONTEXT *ctx)
         {
           mutt_hcache_store (hc, ctx->hdrs[i]->data, ctx->hdrs[i], 0, strlen, MUTT_GENERATE_UIDVALIDITY);
         }
-
-      mutt_hcache_free (&data);
 #endif
 
       /*
@@ -404,6 +403,7 @@ static int pop_fetch_headers (CONTEXT *ctx)
   }
 
 #if USE_HCACHE
+  mutt_hcache_commit (hc);
   mutt_hcache_close (hc);
 #endif
 
@@ -726,6 +726,7 @@ static int pop_fetch_message (CONTEXT* ctx, MESSAGE* msg, int msgno, int headers
   /* This needs to be done in case this is a multipart message */
   if (!WithCrypto)
     h->security = crypt_query (h->content);
+  h->search_known = 0;
 
   mutt_clear_error();
   rewind (msg->fp);
@@ -868,6 +869,42 @@ static int pop_save_to_header_cache (CONTEXT *ctx, HEADER *h)
   return rc;
 }
 
+#ifdef USE_HCACHE
+static int pop_hcache_live (const char *key, void *data)
+{
+  return hash_find ((HASH *) data, key) != NULL;
+}
+#endif
+
+/* Drops header cache records of messages no longer on the server. */
+static int pop_gc_header_cache (CONTEXT *ctx, int budget, int *removed,
+                                LOFF_T *reclaimed)
+{
+  int rc = -1;
+#ifdef USE_HCACHE
+  header_cache_t *hc;
+  HASH *live;
+  const char *uid;
+  int i;
+
+  if (!(hc = pop_hcache_open ((POP_DATA *) ctx->data, ctx->path)))
+    return -1;
+
+  live = hash_create (ctx->msgcount, 0);
+  for (i = 0; i < ctx->msgcount; i++)
+  {
+    uid = ctx->hdrs[i]->data;
+    hash_insert (live, uid + (*uid == '/'), ctx->hdrs[i]);
+  }
+
+  rc = mutt_hcache_gc (hc, pop_hcache_live, live, budget, removed, reclaimed);
+
+  hash_destroy (&live, NULL);
+  mutt_hcache_close (hc);
+#endif
+  return rc;
+}
+
 /* Fetch messages and save them in $spoolfile */
 void pop_fetch_mail (void)
 {
@@ -1043,4 +1080,5 @@ struct mx_ops mx_pop_ops = {
   .open_new_msg = NULL,
   .sync = pop_sync_mailbox,
   .save_to_header_cache = pop_save_to_header_cache,
+  .gc_header_cache = pop_gc_header_cache,
 };
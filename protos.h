@@ -58,8 +58,6 @@ int _mutt_traverse_thread (CONTEXT *ctx, HEADER *hdr, int flag);
 
 
 #define mutt_new_parameter() safe_calloc (1, sizeof (PARAMETER))
-#define mutt_new_header() safe_calloc (1, sizeof (HEADER))
-#define mutt_new_envelope() safe_calloc (1, sizeof (ENVELOPE))
 #ifdef USE_AUTOCRYPT
 #define mutt_new_autocrypthdr() safe_calloc (1, sizeof (AUTOCRYPTHDR))
 #endif
@@ -99,6 +97,11 @@ BODY *mutt_make_multipart_mixed (BODY *);
 BODY *mutt_make_multipart_alternative (BODY *b, BODY *alternative);
 BODY *mutt_remove_multipart_alternative (BODY *b);
 BODY *mutt_new_body (void);
+ENVELOPE *mutt_new_envelope (void);
+HEADER *mutt_new_header (void);
+char *mutt_str_intern (const char *);
+void mutt_str_release (char **);
+void mutt_str_unshare (char **);
 BODY *mutt_parse_multipart (FILE *, const char *, LOFF_T, int);
 BODY *mutt_parse_messageRFC822 (FILE *, BODY *);
 BODY *mutt_read_mime_header (FILE *, int);
@@ -227,6 +230,16 @@ void mutt_free_autocrypthdr (AUTOCRYPTHDR **p);
 void mutt_free_body (BODY **);
 void mutt_free_enter_state (ENTER_STATE **);
 void mutt_free_envelope (ENVELOPE **);
+#ifdef USE_HCACHE
+void mutt_hcache_restore_lazy (ENVELOPE *);
+/* Must be called before the return_path, bcc, sender, reply_to,
+ * mail_followup_to, date or userhdrs of an envelope that may come from
+ * the header cache are read or changed. */
+#define mutt_env_load_lazy(e) \
+  do { if ((e) && (e)->lazy) mutt_hcache_restore_lazy (e); } while (0)
+#else
+#define mutt_env_load_lazy(e) do { } while (0)
+#endif
 void mutt_free_header (HEADER **);
 void mutt_free_parameter (PARAMETER **);
 void mutt_free_regexp (REGEXP **);
@@ -343,6 +356,7 @@ void mutt_filter_commandline_header_tag (char *);
 void mutt_filter_commandline_header_value (char *);
 int mutt_index_menu (void);
 int mutt_invoke_sendmail (ADDRESS *, ADDRESS *, ADDRESS *, ADDRESS *, const char *, int);
+int mutt_is_autoview (BODY *);
 int mutt_is_mail_list (ADDRESS *);
 int mutt_is_message_type(int, const char *);
 int mutt_is_list_cc (int, ADDRESS *, ADDRESS *);
@@ -458,6 +472,8 @@ int mutt_pattern_exec (struct pattern_t *pat, pattern_exec_flag flags, CONTEXT *
 pattern_t *mutt_pattern_comp (/* const */ char *s, int flags, BUFFER *err);
 void mutt_check_simple (BUFFER *s, const char *simple);
 void mutt_pattern_free (pattern_t **pat);
+void mutt_search_cache_free (CONTEXT *ctx);
+void mutt_search_cache_stats (char *buf, size_t buflen);
 
 /* ----------------------------------------------------------------------------
  * Prototypes for broken systems
@@ -641,9 +641,15 @@ void rfc2047_encode_adrlist (ADDRESS *addr, const char *tag)
   while (ptr)
   {
     if (ptr->personal)
+    {
+      mutt_str_unshare (&ptr->personal);
       _rfc2047_encode_string (&ptr->personal, 1, col);
+    }
     else if (ptr->group && ptr->mailbox)
+    {
+      mutt_str_unshare (&ptr->mailbox);
       _rfc2047_encode_string (&ptr->mailbox, 1, col);
+    }
 #ifdef EXACT_ADDRESS
     /* If any kind of encoding is needed for the exact-address value,
      * abort using it.  We can't properly encode it (nor apply IDNA) without
@@ -661,6 +667,7 @@ void rfc2047_encode_adrlist (ADDRESS *addr, const char *tag)
 
 void rfc2047_encode_envelope (ENVELOPE *e)
 {
+  mutt_env_load_lazy (e);
   rfc2047_encode_adrlist (e->from, "From");
   rfc2047_encode_adrlist (e->to, "To");
   rfc2047_encode_adrlist (e->cc, "Cc");
@@ -668,6 +675,7 @@ void rfc2047_encode_envelope (ENVELOPE *e)
   rfc2047_encode_adrlist (e->reply_to, "Reply-To");
   rfc2047_encode_adrlist (e->mail_followup_to, "Mail-Followup-To");
   rfc2047_encode_adrlist (e->sender, "Sender");
+  mutt_str_unshare (&e->x_label);
   rfc2047_encode_string (&e->x_label);
   rfc2047_encode_string (&e->subject);
 }
@@ -981,15 +989,27 @@ void rfc2047_decode (char **pd)
   mutt_buffer_pool_release (&accumulated_word);
 }
 
+/* Like rfc2047_decode(), for a string shared through mutt_str_intern().
+ * The decoded string is shared as well. */
+static void rfc2047_decode_shared (char **pd)
+{
+  char *s = safe_strdup (*pd);
+
+  rfc2047_decode (&s);
+  mutt_str_release (pd);
+  *pd = mutt_str_intern (s);
+  FREE (&s);
+}
+
 void rfc2047_decode_adrlist (ADDRESS *a)
 {
   while (a)
   {
     if (a->personal && ((strstr (a->personal, "=?") != NULL) ||
 			AssumedCharset))
-      rfc2047_decode (&a->personal);
+      rfc2047_decode_shared (&a->personal);
     else if (a->group && a->mailbox && (strstr (a->mailbox, "=?") != NULL))
-      rfc2047_decode (&a->mailbox);
+      rfc2047_decode_shared (&a->mailbox);
 #ifdef EXACT_ADDRESS
     if (a->val && strstr (a->val, "=?") != NULL)
       rfc2047_decode (&a->val);
@@ -1000,6 +1020,7 @@ void rfc2047_decode_adrlist (ADDRESS *a)
 
 void rfc2047_decode_envelope (ENVELOPE *e)
 {
+  mutt_env_load_lazy (e);
   rfc2047_decode_adrlist (e->from);
   rfc2047_decode_adrlist (e->to);
   rfc2047_decode_adrlist (e->cc);
@@ -1008,6 +1029,6 @@ void rfc2047_decode_envelope (ENVELOPE *e)
   rfc2047_decode_adrlist (e->mail_followup_to);
   rfc2047_decode_adrlist (e->return_path);
   rfc2047_decode_adrlist (e->sender);
-  rfc2047_decode (&e->x_label);
+  rfc2047_decode_shared (&e->x_label);
   rfc2047_decode (&e->subject);
 }
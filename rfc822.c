@@ -26,6 +26,7 @@
 
 #ifndef TESTING
 #include "mutt.h"
+#include "slab.h"
 #else
 #define safe_strdup strdup
 #define safe_malloc malloc
@@ -64,6 +65,14 @@ const char * const RFC822Errors[] = {
   "bad address literal"
 };
 
+/* Addresses are allocated in bulk, like the rest of a message. */
+static SLAB_POOL AddressSlabs = SLAB_POOL_INITIALIZER (ADDRESS);
+
+ADDRESS *rfc822_new_address (void)
+{
+  return (ADDRESS *) mutt_slab_alloc (&AddressSlabs);
+}
+
 void rfc822_dequote_comment (char *s)
 {
   char *w = s;
@@ -88,12 +97,12 @@ void rfc822_dequote_comment (char *s)
 
 static void free_address (ADDRESS *a)
 {
-  FREE(&a->personal);
-  FREE(&a->mailbox);
+  mutt_str_release (&a->personal);
+  mutt_str_release (&a->mailbox);
 #ifdef EXACT_ADDRESS
   FREE(&a->val);
 #endif
-  FREE(&a);
+  mutt_slab_free (&a);
 }
 
 int rfc822_remove_from_adrlist (ADDRESS **a, const char *mailbox)
@@ -137,9 +146,9 @@ void rfc822_free_address (ADDRESS **p)
 #ifdef EXACT_ADDRESS
     FREE (&t->val);
 #endif
-    FREE (&t->personal);
-    FREE (&t->mailbox);
-    FREE (&t);
+    mutt_str_release (&t->personal);
+    mutt_str_release (&t->mailbox);
+    mutt_slab_free (&t);
   }
 }
 
@@ -364,12 +373,12 @@ parse_address (const char *s,
   }
 
   terminate_string (token, *tokenlen, tokenmax);
-  addr->mailbox = safe_strdup (token);
+  addr->mailbox = mutt_str_intern (token);
 
   if (*commentlen && !addr->personal)
   {
     terminate_string (comment, *commentlen, commentmax);
-    addr->personal = safe_strdup (comment);
+    addr->personal = mutt_str_intern (comment);
   }
 
   return s;
@@ -417,7 +426,7 @@ parse_route_addr (const char *s,
   }
 
   if (!addr->mailbox)
-    addr->mailbox = safe_strdup ("@");
+    addr->mailbox = mutt_str_intern ("@");
 
   s++;
   return s;
@@ -496,7 +505,7 @@ ADDRESS *rfc822_parse_adrlist (ADDRESS *top, const char *s)
       else if (commentlen && last && !last->personal)
       {
 	terminate_buffer (comment, commentlen);
-	last->personal = safe_strdup (comment);
+	last->personal = mutt_str_intern (comment);
       }
 
 #ifdef EXACT_ADDRESS
@@ -558,7 +567,7 @@ ADDRESS *rfc822_parse_adrlist (ADDRESS *top, const char *s)
 
         cur = rfc822_new_address ();
         terminate_buffer (phrase, phraselen);
-        cur->mailbox = safe_strdup (phrase);
+        cur->mailbox = mutt_str_intern (phrase);
         cur->group = 1;
         in_group = 1;
 
@@ -590,7 +599,7 @@ ADDRESS *rfc822_parse_adrlist (ADDRESS *top, const char *s)
       else if (commentlen && last && !last->personal)
       {
 	terminate_buffer (comment, commentlen);
-	last->personal = safe_strdup (comment);
+	last->personal = mutt_str_intern (comment);
       }
 #ifdef EXACT_ADDRESS
       if (last && !last->val)
@@ -617,7 +626,7 @@ ADDRESS *rfc822_parse_adrlist (ADDRESS *top, const char *s)
       terminate_buffer (phrase, phraselen);
       cur = rfc822_new_address ();
       if (phraselen)
-	cur->personal = safe_strdup (phrase);
+	cur->personal = mutt_str_intern (phrase);
       if ((ps = parse_route_addr (s + 1, comment, &commentlen, sizeof (comment) - 1, cur)) == NULL)
       {
 	rfc822_free_address (&top);
@@ -659,7 +668,7 @@ ADDRESS *rfc822_parse_adrlist (ADDRESS *top, const char *s)
   else if (commentlen && last && !last->personal)
   {
     terminate_buffer (comment, commentlen);
-    last->personal = safe_strdup (comment);
+    last->personal = mutt_str_intern (comment);
   }
 #ifdef EXACT_ADDRESS
   if (last && !last->val)
@@ -682,7 +691,7 @@ void rfc822_qualify (ADDRESS *addr, const char *host)
     {
       p = safe_malloc (mutt_strlen (addr->mailbox) + mutt_strlen (host) + 2);
       sprintf (p, "%s@%s", addr->mailbox, host);	/* __SPRINTF_CHECKED__ */
-      FREE (&addr->mailbox);
+      mutt_str_release (&addr->mailbox);
       addr->mailbox = p;
     }
 }
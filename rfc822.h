@@ -57,6 +57,7 @@ ADDRESS *rfc822_cpy_adr_real (ADDRESS *addr);
 ADDRESS *rfc822_append (ADDRESS **a, ADDRESS *b, int);
 int rfc822_write_address (char *, size_t, ADDRESS *, int);
 void rfc822_write_address_single (char *, size_t, ADDRESS *, int);
+ADDRESS *rfc822_new_address (void);
 void rfc822_free_address (ADDRESS **addr);
 void rfc822_cat (char *, size_t, const char *, const char *);
 int rfc822_valid_msgid (const char *msgid);
@@ -69,6 +70,5 @@ extern int RFC822Error;
 extern const char * const RFC822Errors[];
 
 #define rfc822_error(x) RFC822Errors[x]
-#define rfc822_new_address() safe_calloc(1,sizeof(ADDRESS))
 
 #endif /* rfc822_h */
@@ -139,6 +139,7 @@ void mutt_score_message (CONTEXT *ctx, HEADER *hdr, int upd_ctx)
 {
   SCORE *tmp;
   pattern_cache_t cache;
+  int old_score = hdr->score;
 
   memset (&cache, 0, sizeof (cache));
   hdr->score = 0; /* in case of re-scoring */
@@ -156,6 +157,8 @@ void mutt_score_message (CONTEXT *ctx, HEADER *hdr, int upd_ctx)
   }
   if (hdr->score < 0)
     hdr->score = 0;
+  if (hdr->score != old_score)
+    hdr->search_known = 0;
 
   if (hdr->score <= ScoreThresholdDelete)
     _mutt_set_flag (ctx, hdr, MUTT_DELETE, 1,
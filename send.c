@@ -667,6 +667,8 @@ int mutt_fetch_recips (ENVELOPE *out, ENVELOPE *in, int flags)
   ADDRESS *tmp;
   int hmfupto = -1;
 
+  mutt_env_load_lazy (in);
+
   if ((flags & (SENDLISTREPLY|SENDGROUPREPLY|SENDGROUPCHATREPLY)) &&
       in->mail_followup_to)
   {
@@ -782,6 +784,8 @@ void mutt_add_to_reference_headers (ENVELOPE *env, ENVELOPE *curenv, LIST ***pp,
 {
   LIST **p = NULL, **q = NULL;
 
+  mutt_env_load_lazy (curenv);
+
   if (pp) p = *pp;
   if (qq) q = *qq;
 
@@ -1560,6 +1564,7 @@ int mutt_resend_message (FILE *fp, CONTEXT *ctx, HEADER *cur)
 
 static int is_reply (HEADER *reply, HEADER *orig)
 {
+  mutt_env_load_lazy (orig->env);
   return mutt_find_list (orig->env->references, reply->env->message_id) ||
     mutt_find_list (orig->env->in_reply_to, reply->env->message_id);
 }
@@ -2280,9 +2280,12 @@ int mutt_write_rfc822_header (FILE *fp, ENVELOPE *env, BODY *attach, char *date,
 {
   char buffer[LONG_STRING];
   char *p, *q;
-  LIST *tmp = env->userhdrs;
+  LIST *tmp;
   int has_agent = 0; /* user defined user-agent header field exists */
 
+  mutt_env_load_lazy (env);
+  tmp = env->userhdrs;
+
   if ((mode == MUTT_WRITE_HEADER_NORMAL || mode == MUTT_WRITE_HEADER_FCC ||
        mode == MUTT_WRITE_HEADER_POSTPONE) &&
       !privacy)
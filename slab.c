@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "slab.h"
+
+#include <string.h>
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_MMAP) && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Large enough that a mailbox needs few of them, and that malloc would
+ * have handed out most of this memory from the heap, where it stays
+ * fragmented after the mailbox is closed. */
+#define SLAB_SIZE (256 * 1024)
+
+/* Every object is preceded by a pointer to its slab.  The union keeps
+ * the objects aligned. */
+union slab_head
+{
+  struct slab *slab;
+  LOFF_T off;
+  double d;
+};
+
+#define SLAB_ROUND(n) \
+  (((n) + sizeof (union slab_head) - 1) / sizeof (union slab_head) * \
+   sizeof (union slab_head))
+#define SLAB_CHUNK(pool) (sizeof (union slab_head) + SLAB_ROUND ((pool)->size))
+
+struct slab
+{
+  struct slab *prev;		/* links on the pool's partial list */
+  struct slab *next;
+  SLAB_POOL *pool;
+  union slab_head *free;	/* objects given back */
+  char *fresh;			/* objects never handed out start here */
+  char *end;
+  size_t live;			/* objects handed out */
+  unsigned int mapped : 1;
+};
+
+/* The next free object is kept in the object itself. */
+#define SLAB_NEXT_FREE(head) (*(union slab_head **) ((head) + 1))
+
+/* Slabs with room left are on the pool's partial list, full ones are
+ * only reachable through their objects. */
+static int slab_full (struct slab *s)
+{
+  return !s->free && s->fresh == s->end;
+}
+
+static void slab_link (struct slab *s)
+{
+  SLAB_POOL *pool = s->pool;
+
+  s->prev = NULL;
+  s->next = pool->partial;
+  if (s->next)
+    s->next->prev = s;
+  pool->partial = s;
+}
+
+static void slab_unlink (struct slab *s)
+{
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    s->pool->partial = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+  s->prev = s->next = NULL;
+}
+
+static void slab_reset (struct slab *s)
+{
+  s->free = NULL;
+  s->fresh = (char *) s + SLAB_ROUND (sizeof (struct slab));
+  s->end = s->fresh + (SLAB_SIZE - SLAB_ROUND (sizeof (struct slab))) /
+    SLAB_CHUNK (s->pool) * SLAB_CHUNK (s->pool);
+  s->live = 0;
+}
+
+static struct slab *slab_new (SLAB_POOL *pool)
+{
+  struct slab *s = NULL;
+  int mapped = 0;
+
+#ifdef HAVE_MMAP
+  /* mapped separately, so that releasing the slab returns the memory to
+   * the system no matter what else malloc has handed out meanwhile */
+  s = mmap (NULL, SLAB_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (s == MAP_FAILED)
+    s = NULL;
+  else
+    mapped = 1;
+#endif
+  if (!s)
+    s = safe_malloc (SLAB_SIZE);
+
+  s->mapped = mapped;
+  s->pool = pool;
+  slab_reset (s);
+  slab_link (s);
+  return s;
+}
+
+static void slab_release (struct slab *s)
+{
+  slab_unlink (s);
+#ifdef HAVE_MMAP
+  if (s->mapped)
+  {
+    munmap ((void *) s, SLAB_SIZE);
+    return;
+  }
+#endif
+  FREE (&s);
+}
+
+/* Returns a zeroed object of pool->size bytes. */
+void *mutt_slab_alloc (SLAB_POOL *pool)
+{
+  struct slab *s;
+  union slab_head *head;
+
+  if (!(s = pool->partial))
+    s = slab_new (pool);
+
+  if (s->free)
+  {
+    head = s->free;
+    s->free = SLAB_NEXT_FREE (head);
+  }
+  else
+  {
+    head = (union slab_head *) s->fresh;
+    s->fresh += SLAB_CHUNK (pool);
+    head->slab = s;
+  }
+
+  s->live++;
+  if (slab_full (s))
+    slab_unlink (s);
+
+  memset (head + 1, 0, pool->size);
+  return head + 1;
+}
+
+/* Like FREE(), for objects from mutt_slab_alloc(). */
+void mutt_slab_free (void *ptr)
+{
+  void **p = (void **) ptr;
+  union slab_head *head;
+  struct slab *s;
+
+  if (!*p)
+    return;
+
+  head = (union slab_head *) *p - 1;
+  s = head->slab;
+  *p = NULL;
+
+  if (slab_full (s))
+    slab_link (s);
+  SLAB_NEXT_FREE (head) = s->free;
+  s->free = head;
+
+  if (--s->live)
+    return;
+
+  /* Keep one empty slab around, so that a single object allocated and
+   * freed over and over doesn't map and unmap a slab every time. */
+  if (s->pool->partial != s || s->next)
+    slab_release (s);
+  else
+    slab_reset (s);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _SLAB_H
+#define _SLAB_H 1
+
+/* A pool of fixed size objects, carved out of large slabs instead of
+ * being malloc'ed one by one.  Used for the objects every message of a
+ * mailbox is built from, so that opening a mailbox allocates them in
+ * bulk and closing it hands whole slabs back to the system.
+ *
+ * Objects may outlive any mailbox: a slab is only released once every
+ * object in it has been freed.  Pools are not thread safe, so objects
+ * must be allocated and freed by the main thread.
+ */
+struct slab;
+
+typedef struct
+{
+  size_t size;			/* object size */
+  struct slab *partial;		/* slabs with room left */
+}
+SLAB_POOL;
+
+#define SLAB_POOL_INITIALIZER(type) { sizeof (type), NULL }
+
+void *mutt_slab_alloc (SLAB_POOL *pool);
+void mutt_slab_free (void *ptr);
+
+#endif /* _SLAB_H */
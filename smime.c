@@ -1314,6 +1314,7 @@ int smime_verify_sender(HEADER *h)
   fflush(fpout);
   safe_fclose (&fpout);
 
+  mutt_env_load_lazy (h->env);
   if (h->env->from)
   {
     h->env->from = mutt_expand_aliases (h->env->from);
@@ -23,6 +23,9 @@
 #include "mutt.h"
 #include "sort.h"
 #include "mutt_idna.h"
+#ifdef USE_PTHREADS
+#include "mutt_workers.h"
+#endif
 
 #include <stdlib.h>
 #include <string.h>
@@ -87,6 +90,14 @@ const char *mutt_get_name (ADDRESS *a)
   return ("");
 }
 
+/* Parsed addresses share their strings (see mutt_str_intern()), so
+ * mutt_get_name() can often be answered by comparing pointers. */
+static int same_name (ADDRESS *a, ADDRESS *b)
+{
+  return a == b ||
+    (a && b && a->personal == b->personal && a->mailbox == b->mailbox);
+}
+
 static int compare_to (const void *a, const void *b)
 {
   HEADER **ppa = (HEADER **) a;
@@ -94,6 +105,8 @@ static int compare_to (const void *a, const void *b)
   char fa[SHORT_STRING];
   const char *fb;
 
+  if (same_name ((*ppa)->env->to, (*ppb)->env->to))
+    return 0;
   strfcpy (fa, mutt_get_name ((*ppa)->env->to), SHORT_STRING);
   fb = mutt_get_name ((*ppb)->env->to);
   return mutt_strncasecmp (fa, fb, SHORT_STRING);
@@ -106,6 +119,8 @@ static int compare_from (const void *a, const void *b)
   char fa[SHORT_STRING];
   const char *fb;
 
+  if (same_name ((*ppa)->env->from, (*ppb)->env->from))
+    return 0;
   strfcpy (fa, mutt_get_name ((*ppa)->env->from), SHORT_STRING);
   fb = mutt_get_name ((*ppb)->env->from);
   return mutt_strncasecmp (fa, fb, SHORT_STRING);
@@ -230,6 +245,229 @@ sort_t *mutt_get_sort_func (int method)
   /* not reached */
 }
 
+/* Runs this short are insertion sorted before merging. */
+#define MERGE_RUN 8
+
+static void merge_runs (const char *a, size_t na, const char *b, size_t nb,
+                        char *dst, size_t size, sort_t *cmp)
+{
+  /* already in order, as in a mailbox that is mostly sorted */
+  if (!na || !nb || cmp (a + (na - 1) * size, b) <= 0)
+  {
+    memcpy (dst, a, na * size);
+    memcpy (dst + na * size, b, nb * size);
+    return;
+  }
+
+  while (na && nb)
+  {
+    /* taking from the left run on ties is what keeps the sort stable */
+    if (cmp (a, b) <= 0)
+    {
+      memcpy (dst, a, size);
+      a += size;
+      na--;
+    }
+    else
+    {
+      memcpy (dst, b, size);
+      b += size;
+      nb--;
+    }
+    dst += size;
+  }
+  memcpy (dst, a, na * size);
+  memcpy (dst + na * size, b, nb * size);
+}
+
+static void insertion_sort (char *base, size_t nmemb, size_t size,
+                            sort_t *cmp, char *tmp)
+{
+  size_t i, j;
+
+  for (i = 1; i < nmemb; i++)
+  {
+    for (j = i; j && cmp (base + (j - 1) * size, base + i * size) > 0; j--)
+      ;
+    if (j == i)
+      continue;
+    memcpy (tmp, base + i * size, size);
+    memmove (base + (j + 1) * size, base + j * size, (i - j) * size);
+    memcpy (base + j * size, tmp, size);
+  }
+}
+
+/* Sorts bottom up, merging back and forth between base and tmp, which
+ * has room for nmemb elements. */
+static void merge_sort (char *base, size_t nmemb, size_t size, sort_t *cmp,
+                        char *tmp)
+{
+  char *src = base, *dst = tmp;
+  size_t width, lo, mid, hi;
+
+  for (lo = 0; lo < nmemb; lo += MERGE_RUN)
+    insertion_sort (src + lo * size, MIN (MERGE_RUN, nmemb - lo), size,
+                    cmp, tmp);
+
+  for (width = MERGE_RUN; width < nmemb; width *= 2)
+  {
+    for (lo = 0; lo < nmemb; lo = hi)
+    {
+      mid = MIN (lo + width, nmemb);
+      hi = MIN (lo + 2 * width, nmemb);
+      merge_runs (src + lo * size, mid - lo, src + mid * size, hi - mid,
+                  dst + lo * size, size, cmp);
+    }
+    dst = src;
+    src = (src == tmp) ? base : tmp;
+  }
+
+  if (src != base)
+    memcpy (base, src, nmemb * size);
+}
+
+/* A stable replacement for qsort(). */
+void mutt_merge_sort (void *base, size_t nmemb, size_t size, sort_t *cmp)
+{
+  char *tmp;
+
+  if (nmemb < 2)
+    return;
+
+  tmp = safe_malloc (nmemb * size);
+  merge_sort (base, nmemb, size, cmp, tmp);
+  FREE (&tmp);
+}
+
+#ifdef USE_PTHREADS
+/* Arrays shorter than this are not worth starting threads for. */
+#define SORT_PARALLEL_MIN 20000
+
+/* The array is cut into one chunk per thread.  The chunks are sorted,
+ * then pairs of neighbouring runs of chunks are merged, each pair by
+ * one thread, until a single run is left. */
+struct parallel_sort
+{
+  char *base;
+  char *tmp;
+  size_t size;
+  sort_t *cmp;
+  size_t *bounds;		/* chunk i is bounds[i] .. bounds[i + 1] - 1 */
+  int chunks;
+  int step;			/* chunks per run */
+  char *src;
+  char *dst;
+};
+
+static void parallel_sort_chunk (void *data, size_t item)
+{
+  struct parallel_sort *ps = (struct parallel_sort *) data;
+  size_t lo = ps->bounds[item];
+
+  merge_sort (ps->base + lo * ps->size, ps->bounds[item + 1] - lo, ps->size,
+              ps->cmp, ps->tmp + lo * ps->size);
+}
+
+static void parallel_sort_merge (void *data, size_t item)
+{
+  struct parallel_sort *ps = (struct parallel_sort *) data;
+  size_t lo, mid, hi;
+
+  lo = ps->bounds[item * 2 * ps->step];
+  mid = ps->bounds[MIN ((item * 2 + 1) * ps->step, ps->chunks)];
+  hi = ps->bounds[MIN ((item * 2 + 2) * ps->step, ps->chunks)];
+  merge_runs (ps->src + lo * ps->size, mid - lo, ps->src + mid * ps->size,
+              hi - mid, ps->dst + lo * ps->size, ps->size, ps->cmp);
+}
+
+/* Calls fn for items 0 .. count-1 from the workers, or from the main
+ * thread if none could be started. */
+static void parallel_sort_run (int nthreads, size_t count, workers_fn_t fn,
+                               struct parallel_sort *ps)
+{
+  WORKERS *workers;
+  size_t i;
+
+  workers = mutt_workers_start (nthreads, count, count, fn, ps);
+  for (i = 0; i < count; i++)
+  {
+    if (workers)
+      mutt_workers_wait (workers, i);
+    else
+      fn (ps, i);
+  }
+  mutt_workers_finish (&workers);
+}
+#endif /* USE_PTHREADS */
+
+/* Sorts like mutt_merge_sort() with $sort_workers threads.  cmp is called
+ * from those threads, so it must not touch anything that is not
+ * read-only while the sort runs.  Returns -1, without sorting, for
+ * arrays that are better left to the caller's usual sort function.
+ *
+ * The result is stable: on ties the element from the lower chunk is
+ * taken.  Callers still break ties on the message index, so that the
+ * result does not depend on which sort function was used.
+ */
+int mutt_parallel_sort (void *base, size_t nmemb, size_t size, sort_t *cmp)
+{
+#ifdef USE_PTHREADS
+  struct parallel_sort ps;
+  int i, nthreads;
+  char *swap;
+
+  if (SortWorkers < 2 || nmemb < SORT_PARALLEL_MIN)
+    return -1;
+
+  nthreads = MIN (SortWorkers, MUTT_WORKERS_MAX);
+  memset (&ps, 0, sizeof (ps));
+  ps.base = base;
+  ps.tmp = safe_malloc (nmemb * size);
+  ps.size = size;
+  ps.cmp = cmp;
+  ps.chunks = nthreads;
+  ps.bounds = safe_calloc (ps.chunks + 1, sizeof (size_t));
+  for (i = 0; i <= ps.chunks; i++)
+    ps.bounds[i] = nmemb * i / ps.chunks;
+
+  parallel_sort_run (nthreads, ps.chunks, parallel_sort_chunk, &ps);
+
+  ps.src = ps.base;
+  ps.dst = ps.tmp;
+  for (ps.step = 1; ps.step < ps.chunks; ps.step *= 2)
+  {
+    parallel_sort_run (nthreads, (ps.chunks + 2 * ps.step - 1) / (2 * ps.step),
+                       parallel_sort_merge, &ps);
+    swap = ps.src;
+    ps.src = ps.dst;
+    ps.dst = swap;
+  }
+
+  if (ps.src != ps.base)
+    memcpy (ps.base, ps.src, nmemb * size);
+  FREE (&ps.bounds);
+  FREE (&ps.tmp);
+  return 0;
+#else
+  return -1;
+#endif /* USE_PTHREADS */
+}
+
+/* Whether the comparison function for method may be called from other
+ * threads.  mutt_get_name() returns mutt_addr_for_display()'s static
+ * buffer. */
+int mutt_sort_func_reentrant (int method)
+{
+  switch (method & SORT_MASK)
+  {
+    case SORT_FROM:
+    case SORT_TO:
+      return 0;
+    default:
+      return 1;
+  }
+}
+
 static int compare_unthreaded (const void *a, const void *b)
 {
   static sort_t *sort_func = NULL;
@@ -258,6 +496,213 @@ static int compare_unthreaded (const void *a, const void *b)
   return rc;
 }
 
+/* Sorting the index by precomputed keys.  mutt_get_name() and case
+ * folding are costly, and qsort() with compare_unthreaded() repeats
+ * them for both messages of every comparison.  Instead each message's
+ * key for $sort and $sort_aux is extracted once, folded the way
+ * mutt_strcasecmp() folds, and the keys are sorted by plain numeric
+ * and byte comparisons.
+ */
+struct sort_field
+{
+  short rank;			/* compared first */
+  short folded;			/* the key is a folded string */
+  unsigned int tail;		/* offset of the rest of the string in KeyStrings */
+  union
+  {
+    long long num;
+    unsigned long long prefix;	/* the first bytes of the string, big endian */
+  } v;
+};
+
+struct sort_key
+{
+  HEADER *h;
+  struct sort_field field[2];	/* $sort, $sort_aux */
+};
+
+#define SORT_PREFIX_LEN sizeof (unsigned long long)
+
+static const char *KeyStrings = NULL;
+
+static int compare_fields (const struct sort_field *a,
+                           const struct sort_field *b)
+{
+  if (a->rank != b->rank)
+    return mutt_numeric_cmp (a->rank, b->rank);
+  if (!a->folded)
+    return mutt_numeric_cmp (a->v.num, b->v.num);
+  if (a->v.prefix != b->v.prefix)
+    return mutt_numeric_cmp (a->v.prefix, b->v.prefix);
+  /* both strings ended within the prefix */
+  if (!(a->v.prefix & 0xff))
+    return 0;
+  return strcmp (KeyStrings + a->tail, KeyStrings + b->tail);
+}
+
+static int compare_keys (const void *a, const void *b)
+{
+  const struct sort_key *ka = (const struct sort_key *) a;
+  const struct sort_key *kb = (const struct sort_key *) b;
+  int rc;
+
+  rc = compare_fields (&ka->field[0], &kb->field[0]);
+  if (rc)
+    return (Sort & SORT_REVERSE) ? -rc : rc;
+
+  rc = compare_fields (&ka->field[1], &kb->field[1]);
+  if (rc)
+    return (SortAux & SORT_REVERSE) ? -rc : rc;
+
+  rc = mutt_numeric_cmp (ka->h->index, kb->h->index);
+  return (Sort & SORT_REVERSE) ? -rc : rc;
+}
+
+/* Folds at most max bytes of s into f.  The first bytes are packed into
+ * f->v.prefix, so that most comparisons are decided without touching
+ * the strings at all. */
+static void fold_field (struct sort_field *f, const char *s, size_t max,
+                        BUFFER *strings)
+{
+  size_t i, len;
+  char *p;
+
+  f->folded = 1;
+  s = NONULL (s);
+  for (i = 0; i < SORT_PREFIX_LEN; i++)
+  {
+    f->v.prefix <<= 8;
+    if (i < max && *s)
+      f->v.prefix |= (unsigned char) tolower ((unsigned char) *s++);
+  }
+  if (!(f->v.prefix & 0xff) || !*s || max <= SORT_PREFIX_LEN)
+    return;
+
+  for (len = 0; len < max - SORT_PREFIX_LEN && s[len]; len++)
+    ;
+  if (strings->dsize - mutt_buffer_len (strings) < len + 2)
+    mutt_buffer_increase_size (strings, 2 * strings->dsize + len + 2);
+  f->tail = mutt_buffer_len (strings);
+  mutt_buffer_addstr_n (strings, s, len);
+  mutt_buffer_addch (strings, '\0');
+  for (p = strings->data + f->tail; *p; p++)
+    *p = tolower ((unsigned char) *p);
+}
+
+/* mutt_addr_for_display() converts the mailbox on every call, and a few
+ * senders tend to account for most of a mailbox, so addresses without a
+ * personal name are only folded once per mailbox. */
+static void fold_name (struct sort_field *f, ADDRESS *a, HASH *names,
+                       BUFFER *strings)
+{
+  struct sort_field *seen;
+
+  if (a && !a->personal && a->mailbox && !option (OPTREVALIAS))
+  {
+    if ((seen = hash_find (names, a->mailbox)))
+    {
+      *f = *seen;
+      return;
+    }
+    hash_insert (names, a->mailbox, f);
+  }
+  fold_field (f, mutt_get_name (a), SHORT_STRING - 1, strings);
+}
+
+/* Mirrors the comparison functions above.  Returns -1 for the methods
+ * that are left to them. */
+static int get_sort_field (struct sort_field *f, HEADER *h, int method,
+                           HASH *names, BUFFER *strings)
+{
+  switch (method & SORT_MASK)
+  {
+    case SORT_RECEIVED:
+      f->v.num = h->received;
+      break;
+    case SORT_ORDER:
+      f->v.num = h->index;
+      break;
+    case SORT_DATE:
+      f->v.num = h->date_sent;
+      break;
+    case SORT_SUBJECT:
+      if (h->env->real_subj)
+      {
+        f->rank = 1;
+        fold_field (f, h->env->real_subj, (size_t) -1, strings);
+      }
+      else
+        f->v.num = h->date_sent;
+      break;
+    case SORT_FROM:
+      fold_name (f, h->env->from, names, strings);
+      break;
+    case SORT_SIZE:
+      f->v.num = h->content->length;
+      break;
+    case SORT_TO:
+      fold_name (f, h->env->to, names, strings);
+      break;
+    case SORT_SCORE:
+      f->v.num = -h->score;
+      break;
+    case SORT_LABEL:
+      if (h->env && h->env->x_label && *h->env->x_label)
+        fold_field (f, h->env->x_label, (size_t) -1, strings);
+      else
+        f->rank = 1;
+      break;
+    default:
+      return -1;
+  }
+  return 0;
+}
+
+static int sort_by_keys (CONTEXT *ctx)
+{
+  struct sort_key *keys;
+  HASH *names;
+  BUFFER *strings;
+  HEADER *h;
+  int i, rc = 0;
+
+  keys = safe_calloc (ctx->msgcount, sizeof (struct sort_key));
+  names = hash_create (1024, 0);
+  strings = mutt_buffer_new ();
+  mutt_buffer_increase_size (strings, ctx->msgcount * 16 + 1);
+  /* offset 0 is the empty string */
+  mutt_buffer_addch (strings, '\0');
+
+  for (i = 0; i < ctx->msgcount; i++)
+  {
+    h = keys[i].h = ctx->hdrs[i];
+    if (get_sort_field (&keys[i].field[0], h, Sort, names, strings) < 0 ||
+        get_sort_field (&keys[i].field[1], h, SortAux, names, strings) < 0)
+    {
+      rc = -1;
+      goto cleanup;
+    }
+  }
+
+  /* compare_keys() only reads the keys, so any method can be sorted by
+   * several threads */
+  KeyStrings = strings->data;
+  if (mutt_parallel_sort (keys, ctx->msgcount, sizeof (struct sort_key),
+                          compare_keys) < 0)
+    mutt_merge_sort (keys, ctx->msgcount, sizeof (struct sort_key),
+                     compare_keys);
+  KeyStrings = NULL;
+
+  for (i = 0; i < ctx->msgcount; i++)
+    ctx->hdrs[i] = keys[i].h;
+
+cleanup:
+  hash_destroy (&names, NULL);
+  mutt_buffer_free (&strings);
+  FREE (&keys);
+  return rc;
+}
+
 static int sort_unthreaded (CONTEXT *ctx)
 {
   if (!compare_unthreaded (NULL, NULL))
@@ -267,7 +712,8 @@ static int sort_unthreaded (CONTEXT *ctx)
     return -1;
   }
 
-  qsort ((void *) ctx->hdrs, ctx->msgcount, sizeof (HEADER *), compare_unthreaded);
+  if (sort_by_keys (ctx) < 0)
+    qsort ((void *) ctx->hdrs, ctx->msgcount, sizeof (HEADER *), compare_unthreaded);
   return 0;
 }
 
@@ -317,13 +763,11 @@ void mutt_sort_headers (CONTEXT *ctx, int init)
   {
     /* if $sort_aux changed after the mailbox is sorted, then all the
        subthreads need to be resorted */
-    if (option (OPTSORTSUBTHREADS))
-    {
-      if (ctx->tree)
-	ctx->tree = mutt_sort_subthreads (ctx->tree, 1);
-      unset_option (OPTSORTSUBTHREADS);
-    }
+    if (option (OPTSORTSUBTHREADS) && ctx->tree)
+      ctx->tree = mutt_sort_subthreads (ctx->tree, 1);
+    /* keep the flag set until the tree has been redrawn in full */
     mutt_sort_threads (ctx, init);
+    unset_option (OPTSORTSUBTHREADS);
   }
   else if (sort_unthreaded (ctx))
     return;
@@ -56,6 +56,9 @@
 
 typedef int sort_t (const void *, const void *);
 sort_t *mutt_get_sort_func (int);
+void mutt_merge_sort (void *, size_t, size_t, sort_t *);
+int mutt_parallel_sort (void *, size_t, size_t, sort_t *);
+int mutt_sort_func_reentrant (int);
 
 void mutt_clear_threads (CONTEXT *);
 void mutt_sort_headers (CONTEXT *, int);
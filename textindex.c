@@ -0,0 +1,905 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Word search of message bodies for ~w, and an index of the words of
+ * each mailbox kept next to its header cache.
+ *
+ * The text is the decoded body, as mutt_body_handler() produces it for
+ * ~b with $thorough_search.  A word is a run of ASCII letters and
+ * digits and non-ASCII bytes.  ASCII letters are folded to lower case,
+ * and only the first TEXT_WORD_MAX bytes of a word count.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mx.h"
+#include "textindex.h"
+
+#if USE_HCACHE
+#include "hcache.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+static int text_word_char (int c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+    (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+/* Calls fn for every word of fp, from the current position to the end
+ * of the file. */
+void mutt_text_words_scan (FILE *fp, text_word_fn_t fn, void *data)
+{
+  char word[TEXT_WORD_MAX + 1];
+  size_t len = 0;
+  int c;
+
+  do
+  {
+    c = getc (fp);
+    if (c != EOF && text_word_char (c))
+    {
+      if (len < TEXT_WORD_MAX)
+	word[len++] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+      continue;
+    }
+    if (len)
+    {
+      word[len] = '\0';
+      if (fn (word, len, data))
+	return;
+      len = 0;
+    }
+  }
+  while (c != EOF);
+}
+
+/*
+ * Turns the argument of ~w into the words to look for, separated by
+ * spaces.  A word followed by `*' in s matches every word it is the
+ * start of, and keeps its `*' in dest.  Returns the number of words.
+ */
+int mutt_text_words_parse (BUFFER *dest, const char *s)
+{
+  const char *p;
+  size_t len;
+  int n = 0;
+
+  mutt_buffer_clear (dest);
+  while (*s)
+  {
+    if (!text_word_char ((unsigned char) *s))
+    {
+      s++;
+      continue;
+    }
+
+    for (p = s; *p && text_word_char ((unsigned char) *p); p++)
+      ;
+    len = MIN (p - s, TEXT_WORD_MAX);
+
+    if (n++)
+      mutt_buffer_addch (dest, ' ');
+    for (; len; len--, s++)
+      mutt_buffer_addch (dest, (*s >= 'A' && *s <= 'Z') ? *s - 'A' + 'a' : *s);
+    s = p;
+    if (*s == '*')
+      mutt_buffer_addch (dest, '*');
+  }
+
+  return n;
+}
+
+struct text_words
+{
+  char *buf;
+  char **word;
+  size_t *len;			/* without the `*' */
+  unsigned char *prefix;
+  unsigned char *seen;
+  int count;
+  int left;
+};
+
+static void text_words_split (struct text_words *tw, const char *words)
+{
+  char *p, *q;
+  int n = 1;
+
+  memset (tw, 0, sizeof (struct text_words));
+  tw->buf = safe_strdup (words);
+  for (p = tw->buf; *p; p++)
+    if (*p == ' ')
+      n++;
+
+  tw->word = safe_calloc (n, sizeof (char *));
+  tw->len = safe_calloc (n, sizeof (size_t));
+  tw->prefix = safe_calloc (n, sizeof (unsigned char));
+  tw->seen = safe_calloc (n, sizeof (unsigned char));
+
+  for (p = tw->buf; p; p = q)
+  {
+    if ((q = strchr (p, ' ')))
+      *q++ = '\0';
+    tw->len[tw->count] = strlen (p);
+    if (tw->len[tw->count] && p[tw->len[tw->count] - 1] == '*')
+    {
+      p[--tw->len[tw->count]] = '\0';
+      tw->prefix[tw->count] = 1;
+    }
+    tw->word[tw->count++] = p;
+  }
+  tw->left = tw->count;
+}
+
+static void text_words_free (struct text_words *tw)
+{
+  FREE (&tw->buf);
+  FREE (&tw->word);
+  FREE (&tw->len);
+  FREE (&tw->prefix);
+  FREE (&tw->seen);
+}
+
+static int text_words_check (const char *word, size_t len, void *data)
+{
+  struct text_words *tw = (struct text_words *) data;
+  int i;
+
+  for (i = 0; i < tw->count; i++)
+  {
+    if (tw->seen[i])
+      continue;
+    if (tw->prefix[i] ? !strncmp (word, tw->word[i], tw->len[i]) :
+        !strcmp (word, tw->word[i]))
+    {
+      tw->seen[i] = 1;
+      if (!--tw->left)
+	return 1;
+    }
+  }
+  return 0;
+}
+
+/* Whether the rest of fp contains all the words parsed by
+ * mutt_text_words_parse(). */
+int mutt_text_words_match (const char *words, FILE *fp)
+{
+  struct text_words tw;
+  int match;
+
+  text_words_split (&tw, words);
+  if (tw.left)
+    mutt_text_words_scan (fp, text_words_check, &tw);
+  match = !tw.left;
+  text_words_free (&tw);
+
+  return match;
+}
+
+#if USE_HCACHE
+/*
+ * The index of a mailbox is a header cache database of its own, named
+ * after the mailbox with TEXT_INDEX_SUFFIX appended.  Each message is
+ * a document, identified by its file name (Maildir without the flags,
+ * MH) or Message-ID (mbox, MMDF), and numbered in the order it was
+ * indexed.  Its keys are:
+ *
+ *   /FORMAT		TEXT_INDEX_FORMAT
+ *   /NEXT		the number of the next document
+ *   /D<message>	struct text_doc of the document
+ *   /W<word>		a struct text_record, followed by the ascending
+ *			numbers of the documents containing word as
+ *			varint deltas
+ *   /P<xx>		a struct text_record, followed by the indexed
+ *			words starting with the two bytes xx, each
+ *			followed by a NUL, for prefix searches
+ *
+ * Words shorter than two bytes aren't indexed.  Documents are only
+ * added, so the number of a message that left the mailbox stays in
+ * the word lists.  MH reuses file numbers and a Message-ID may be
+ * repeated, so a document also records a fingerprint of its message,
+ * see text_doc_fingerprint(); a message with the key of a document but
+ * another fingerprint gets a new number.  Answers from the index are
+ * therefore a superset, which the caller narrows down by searching the
+ * messages themselves.
+ */
+#define TEXT_INDEX_SUFFIX	"#words"
+#define TEXT_INDEX_FORMAT	2
+#define TEXT_INDEX_PENDING	200000	/* words queued before writing */
+
+struct text_doc
+{
+  unsigned int num;
+  unsigned int fingerprint;
+  LOFF_T length;		/* h->content->length */
+};
+
+struct text_pending
+{
+  char *key;
+  LOFF_T length;
+  unsigned int fingerprint;
+  char *words;			/* sorted and unique, each NUL terminated */
+  size_t size;
+};
+
+struct text_index
+{
+  struct text_pending *docs;
+  size_t count;
+  size_t max;
+  size_t words;			/* words in docs */
+  HASH *keys;			/* of docs */
+};
+
+/* A growing list of document numbers. */
+struct text_nums
+{
+  unsigned int *num;
+  size_t count;
+  size_t max;
+};
+
+static void text_nums_add (struct text_nums *tn, unsigned int num)
+{
+  if (tn->count == tn->max)
+  {
+    tn->max = tn->max ? tn->max * 2 : 16;
+    safe_realloc (&tn->num, tn->max * sizeof (unsigned int));
+  }
+  tn->num[tn->count++] = num;
+}
+
+static int text_nums_cmp (const void *a, const void *b)
+{
+  unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void text_nums_free (void *data)
+{
+  struct text_nums *tn = (struct text_nums *) data;
+
+  FREE (&tn->num);
+  FREE (&tn);
+}
+
+static int text_index_discard (const char *key, void *data)
+{
+  return 0;
+}
+
+static header_cache_t *text_index_open (CONTEXT *ctx)
+{
+  header_cache_t *hc;
+  BUFFER *folder;
+  void *data;
+  int format = TEXT_INDEX_FORMAT, removed = 0;
+  LOFF_T reclaimed = 0;
+
+  if (!option (OPTTEXTINDEX) || !HeaderCache)
+    return NULL;
+  if (ctx->magic != MUTT_MAILDIR && ctx->magic != MUTT_MH &&
+      ctx->magic != MUTT_MBOX && ctx->magic != MUTT_MMDF)
+    return NULL;
+#ifdef USE_COMPRESSED
+  /* compressed folders are read from a new temporary file every time */
+  if (ctx->compress_info)
+    return NULL;
+#endif
+
+  folder = mutt_buffer_pool_get ();
+  mutt_buffer_printf (folder, "%s%s", ctx->path, TEXT_INDEX_SUFFIX);
+  hc = mutt_hcache_open (HeaderCache, mutt_b2s (folder), NULL);
+  mutt_buffer_pool_release (&folder);
+  if (!hc)
+    return NULL;
+
+  if ((data = mutt_hcache_fetch_raw (hc, "/FORMAT", strlen)))
+  {
+    memcpy (&format, data, sizeof (int));
+    mutt_hcache_free (&data);
+  }
+  else
+    mutt_hcache_store_raw (hc, "/FORMAT", &format, sizeof (int), strlen);
+  if (format < TEXT_INDEX_FORMAT)
+  {
+    /* written by an older version: start over */
+    dprint (1, (debugfile, "text_index_open: discarding format %d\n", format));
+    if (mutt_hcache_gc (hc, text_index_discard, NULL, 0, &removed,
+                        &reclaimed) == 0)
+    {
+      format = TEXT_INDEX_FORMAT;
+      mutt_hcache_store_raw (hc, "/FORMAT", &format, sizeof (int), strlen);
+    }
+  }
+  if (format != TEXT_INDEX_FORMAT)
+  {
+    dprint (1, (debugfile, "text_index_open: unknown format %d\n", format));
+    mutt_hcache_close (hc);
+    return NULL;
+  }
+
+  return hc;
+}
+
+static int text_doc_key (CONTEXT *ctx, HEADER *h, BUFFER *key)
+{
+  const char *p;
+
+  switch (ctx->magic)
+  {
+    case MUTT_MAILDIR:
+      /* skip "cur/" or "new/", and the flags */
+      p = strrchr (h->path + 4, ':');
+      mutt_buffer_printf (key, "/D%.*s",
+                          p ? (int) (p - h->path - 4) : (int) strlen (h->path + 4),
+                          h->path + 4);
+      return 0;
+    case MUTT_MH:
+      mutt_buffer_printf (key, "/D%s", h->path);
+      return 0;
+    case MUTT_MBOX:
+    case MUTT_MMDF:
+      if (!h->env || !h->env->message_id)
+	return -1;
+      mutt_buffer_printf (key, "/D%s", h->env->message_id);
+      return 0;
+  }
+  return -1;
+}
+
+static void text_hash_add (unsigned int *hash, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) data;
+
+  /* FNV-1a */
+  while (len--)
+  {
+    *hash ^= *p++;
+    *hash *= 16777619U;
+  }
+}
+
+/*
+ * Computes what tells h from an earlier message with the same document
+ * key: its Message-ID, dates, and the size of its body, and for MH the
+ * inode and modification time of its file, which change when the file
+ * is replaced or rewritten.  Maildir file names aren't reused, and
+ * Maildir files aren't rewritten.  Returns -1 if the file can't be
+ * looked at.
+ */
+static int text_doc_fingerprint (CONTEXT *ctx, HEADER *h,
+                                 unsigned int *fingerprint)
+{
+  struct stat st;
+  BUFFER *path;
+  int rc = 0;
+
+  *fingerprint = 2166136261U;
+  if (h->env && h->env->message_id)
+    text_hash_add (fingerprint, h->env->message_id,
+                   strlen (h->env->message_id));
+  text_hash_add (fingerprint, &h->date_sent, sizeof (h->date_sent));
+  text_hash_add (fingerprint, &h->received, sizeof (h->received));
+  text_hash_add (fingerprint, &h->lines, sizeof (h->lines));
+  text_hash_add (fingerprint, &h->content->length, sizeof (h->content->length));
+
+  if (ctx->magic == MUTT_MH)
+  {
+    path = mutt_buffer_pool_get ();
+    mutt_buffer_printf (path, "%s/%s", ctx->path, h->path);
+    if (stat (mutt_b2s (path), &st) == 0)
+    {
+      text_hash_add (fingerprint, &st.st_ino, sizeof (st.st_ino));
+      text_hash_add (fingerprint, &st.st_mtime, sizeof (st.st_mtime));
+    }
+    else
+      rc = -1;
+    mutt_buffer_pool_release (&path);
+  }
+
+  return rc;
+}
+
+static int text_doc_fetch (header_cache_t *hc, const char *key,
+                           struct text_doc *doc)
+{
+  void *data;
+
+  if (!(data = mutt_hcache_fetch_raw (hc, key, strlen)))
+    return -1;
+  memcpy (doc, data, sizeof (struct text_doc));
+  mutt_hcache_free (&data);
+  return 0;
+}
+
+/* The words of a document, as they are scanned. */
+struct text_collect
+{
+  char *buf;			/* each NUL terminated */
+  size_t len;
+  size_t max;
+  struct text_nums offsets;	/* of the words in buf */
+};
+
+static int text_collect_word (const char *word, size_t len, void *data)
+{
+  struct text_collect *tc = (struct text_collect *) data;
+
+  if (len < 2)
+    return 0;
+  if (tc->len + len + 1 > tc->max)
+  {
+    tc->max = MAX (tc->max * 2, tc->len + len + 1 + STRING);
+    safe_realloc (&tc->buf, tc->max);
+  }
+  text_nums_add (&tc->offsets, tc->len);
+  memcpy (tc->buf + tc->len, word, len + 1);
+  tc->len += len + 1;
+  return 0;
+}
+
+static int text_strcmp (const void *a, const void *b)
+{
+  return strcmp (*(const char **) a, *(const char **) b);
+}
+
+static void text_index_clear (struct text_index *ti)
+{
+  size_t i;
+
+  for (i = 0; i < ti->count; i++)
+  {
+    FREE (&ti->docs[i].key);
+    FREE (&ti->docs[i].words);
+  }
+  FREE (&ti->docs);
+  hash_destroy (&ti->keys, NULL);
+  memset (ti, 0, sizeof (struct text_index));
+}
+
+/*
+ * Queues the words of h for the index of ctx.  The decoded body of h is
+ * the part of fp from offset to the end.  The words are written out by
+ * mutt_text_index_flush(), or once TEXT_INDEX_PENDING have piled up.
+ */
+void mutt_text_index_add (CONTEXT *ctx, HEADER *h, FILE *fp, LOFF_T offset)
+{
+  struct text_index *ti;
+  struct text_pending *doc;
+  struct text_collect tc;
+  BUFFER *key;
+  char **words;
+  size_t i, len;
+  unsigned int fingerprint;
+
+  if (!option (OPTTEXTINDEX) || !HeaderCache || !h->content)
+    return;
+
+  key = mutt_buffer_pool_get ();
+  if (text_doc_key (ctx, h, key) != 0 ||
+      text_doc_fingerprint (ctx, h, &fingerprint) != 0 ||
+      (ctx->text_index && ctx->text_index->keys &&
+       hash_find (ctx->text_index->keys, mutt_b2s (key))))
+  {
+    mutt_buffer_pool_release (&key);
+    return;
+  }
+
+  if (!(ti = ctx->text_index))
+    ti = ctx->text_index = safe_calloc (1, sizeof (struct text_index));
+  if (!ti->keys)
+    ti->keys = hash_create (1024, 0);
+
+  memset (&tc, 0, sizeof (tc));
+  fseeko (fp, offset, SEEK_SET);
+  mutt_text_words_scan (fp, text_collect_word, &tc);
+
+  if (ti->count == ti->max)
+  {
+    ti->max += 256;
+    safe_realloc (&ti->docs, ti->max * sizeof (struct text_pending));
+  }
+  doc = &ti->docs[ti->count++];
+  memset (doc, 0, sizeof (struct text_pending));
+  doc->key = safe_strdup (mutt_b2s (key));
+  doc->length = h->content->length;
+  doc->fingerprint = fingerprint;
+  hash_insert (ti->keys, doc->key, doc->key);
+  mutt_buffer_pool_release (&key);
+
+  /* keep each word once, in order */
+  words = safe_calloc (MAX (tc.offsets.count, 1), sizeof (char *));
+  for (i = 0; i < tc.offsets.count; i++)
+    words[i] = tc.buf + tc.offsets.num[i];
+  qsort (words, tc.offsets.count, sizeof (char *), text_strcmp);
+  doc->words = safe_malloc (MAX (tc.len, 1));
+  for (i = 0; i < tc.offsets.count; i++)
+  {
+    if (i && !strcmp (words[i], words[i - 1]))
+      continue;
+    len = strlen (words[i]) + 1;
+    memcpy (doc->words + doc->size, words[i], len);
+    doc->size += len;
+    ti->words++;
+  }
+  FREE (&words);
+  FREE (&tc.buf);
+  FREE (&tc.offsets.num);
+
+  if (ti->words >= TEXT_INDEX_PENDING)
+    mutt_text_index_flush (ctx);
+}
+
+/* Header of the /W and /P records */
+struct text_record
+{
+  unsigned int last;		/* last document number, in /W */
+  unsigned int size;		/* bytes following the header */
+};
+
+static void text_varint_add (BUFFER *buf, unsigned int n)
+{
+  while (n >= 0x80)
+  {
+    mutt_buffer_addch (buf, (char) ((n & 0x7f) | 0x80));
+    n >>= 7;
+  }
+  mutt_buffer_addch (buf, (char) n);
+}
+
+/*
+ * Appends the numbers in tn, ascending and above those already listed,
+ * to the record key.  Returns 1 if there was no such record yet.
+ */
+static int text_record_append (header_cache_t *hc, const char *key,
+                               struct text_nums *tn)
+{
+  struct text_record head = { 0, 0 };
+  BUFFER *rec;
+  void *data;
+  size_t i;
+  int rc = 1;
+
+  rec = mutt_buffer_new ();
+  if ((data = mutt_hcache_fetch_raw (hc, key, strlen)))
+  {
+    memcpy (&head, data, sizeof (head));
+    mutt_buffer_addstr_n (rec, data, sizeof (head) + head.size);
+    mutt_hcache_free (&data);
+    rc = 0;
+  }
+  else
+    mutt_buffer_addstr_n (rec, (char *) &head, sizeof (head));
+
+  for (i = 0; i < tn->count; i++)
+  {
+    text_varint_add (rec, tn->num[i] - head.last);
+    head.last = tn->num[i];
+  }
+  head.size = mutt_buffer_len (rec) - sizeof (head);
+  memcpy (rec->data, &head, sizeof (head));
+
+  mutt_hcache_store_raw (hc, key, rec->data, mutt_buffer_len (rec), strlen);
+  mutt_buffer_free (&rec);
+
+  return rc;
+}
+
+/* Appends the NUL terminated words in words to the /P record key. */
+static void text_prefix_append (header_cache_t *hc, const char *key,
+                                BUFFER *words)
+{
+  struct text_record head = { 0, 0 };
+  BUFFER *rec;
+  void *data;
+
+  rec = mutt_buffer_new ();
+  if ((data = mutt_hcache_fetch_raw (hc, key, strlen)))
+  {
+    memcpy (&head, data, sizeof (head));
+    mutt_buffer_addstr_n (rec, data, sizeof (head) + head.size);
+    mutt_hcache_free (&data);
+  }
+  else
+    mutt_buffer_addstr_n (rec, (char *) &head, sizeof (head));
+
+  mutt_buffer_addstr_n (rec, words->data, mutt_buffer_len (words));
+  head.size = mutt_buffer_len (rec) - sizeof (head);
+  memcpy (rec->data, &head, sizeof (head));
+
+  mutt_hcache_store_raw (hc, key, rec->data, mutt_buffer_len (rec), strlen);
+  mutt_buffer_free (&rec);
+}
+
+static void text_buffer_free (void *data)
+{
+  BUFFER *buf = (BUFFER *) data;
+
+  mutt_buffer_free (&buf);
+}
+
+/* Writes the queued documents of ctx to its index. */
+void mutt_text_index_flush (CONTEXT *ctx)
+{
+  struct text_index *ti = ctx->text_index;
+  struct text_pending *d;
+  struct text_nums *tn;
+  struct text_doc doc;
+  struct hash_walk_state state;
+  struct hash_elem *elem;
+  header_cache_t *hc;
+  HASH *lists, *prefixes;
+  BUFFER *key, *words;
+  unsigned int next = 1;
+  void *data;
+  size_t i;
+  char *w;
+
+  if (!ti || !ti->count)
+    return;
+
+  if (!(hc = text_index_open (ctx)))
+  {
+    text_index_clear (ti);
+    return;
+  }
+
+  dprint (2, (debugfile, "mutt_text_index_flush: %zu documents, %zu words\n",
+              ti->count, ti->words));
+
+  mutt_hcache_begin (hc);
+  if ((data = mutt_hcache_fetch_raw (hc, "/NEXT", strlen)))
+  {
+    memcpy (&next, data, sizeof (next));
+    mutt_hcache_free (&data);
+  }
+
+  /* the new documents of each word */
+  lists = hash_create (16384, MUTT_HASH_STRDUP_KEYS);
+  for (i = 0; i < ti->count; i++)
+  {
+    d = &ti->docs[i];
+    if (text_doc_fetch (hc, d->key, &doc) == 0 && doc.length == d->length &&
+        doc.fingerprint == d->fingerprint)
+      continue;
+
+    doc.num = next++;
+    doc.length = d->length;
+    doc.fingerprint = d->fingerprint;
+    mutt_hcache_store_raw (hc, d->key, &doc, sizeof (doc), strlen);
+
+    for (w = d->words; w < d->words + d->size; w += strlen (w) + 1)
+    {
+      if (!(tn = hash_find (lists, w)))
+      {
+	tn = safe_calloc (1, sizeof (struct text_nums));
+	hash_insert (lists, w, tn);
+      }
+      text_nums_add (tn, doc.num);
+    }
+  }
+  mutt_hcache_store_raw (hc, "/NEXT", &next, sizeof (next), strlen);
+
+  /* append them, and note the words not indexed before */
+  prefixes = hash_create (1024, MUTT_HASH_STRDUP_KEYS);
+  key = mutt_buffer_pool_get ();
+  memset (&state, 0, sizeof (state));
+  while ((elem = hash_walk (lists, &state)))
+  {
+    mutt_buffer_printf (key, "/W%s", elem->key.strkey);
+    if (text_record_append (hc, mutt_b2s (key), elem->data) != 1)
+      continue;
+
+    mutt_buffer_printf (key, "/P%.2s", elem->key.strkey);
+    if (!(words = hash_find (prefixes, mutt_b2s (key))))
+    {
+      words = mutt_buffer_new ();
+      hash_insert (prefixes, mutt_b2s (key), words);
+    }
+    mutt_buffer_addstr_n (words, elem->key.strkey,
+                          strlen (elem->key.strkey) + 1);
+  }
+  mutt_buffer_pool_release (&key);
+
+  memset (&state, 0, sizeof (state));
+  while ((elem = hash_walk (prefixes, &state)))
+    text_prefix_append (hc, elem->key.strkey, elem->data);
+
+  hash_destroy (&prefixes, text_buffer_free);
+  hash_destroy (&lists, text_nums_free);
+  mutt_hcache_commit (hc);
+  mutt_hcache_close (hc);
+
+  text_index_clear (ti);
+}
+
+/* Writes out and forgets the queued documents of ctx. */
+void mutt_text_index_free (CONTEXT *ctx)
+{
+  if (!ctx->text_index)
+    return;
+  mutt_text_index_flush (ctx);
+  text_index_clear (ctx->text_index);
+  FREE (&ctx->text_index);
+}
+
+/* Adds the numbers listed in the /W record key to tn. */
+static void text_record_read (header_cache_t *hc, const char *key,
+                              struct text_nums *tn)
+{
+  struct text_record head;
+  unsigned char *data, *p, *end;
+  unsigned int num = 0, delta;
+  int shift;
+
+  if (!(data = mutt_hcache_fetch_raw (hc, key, strlen)))
+    return;
+  memcpy (&head, data, sizeof (head));
+  p = data + sizeof (head);
+  end = p + head.size;
+  while (p < end)
+  {
+    delta = 0;
+    shift = 0;
+    do
+    {
+      delta |= (*p & 0x7f) << shift;
+      shift += 7;
+    }
+    while ((*p++ & 0x80) && p < end);
+    num += delta;
+    text_nums_add (tn, num);
+  }
+  mutt_hcache_free ((void **) &data);
+}
+
+/* Lists the documents containing the word, or a word starting with it. */
+static void text_index_lookup (header_cache_t *hc, const char *word, size_t len,
+                               int prefix, struct text_nums *tn)
+{
+  struct text_record head;
+  BUFFER *key;
+  char *data, *w, *end;
+  size_t i, j;
+
+  key = mutt_buffer_pool_get ();
+  if (!prefix)
+  {
+    mutt_buffer_printf (key, "/W%s", word);
+    text_record_read (hc, mutt_b2s (key), tn);
+    mutt_buffer_pool_release (&key);
+    return;
+  }
+
+  mutt_buffer_printf (key, "/P%.2s", word);
+  if ((data = mutt_hcache_fetch_raw (hc, mutt_b2s (key), strlen)))
+  {
+    memcpy (&head, data, sizeof (head));
+    end = data + sizeof (head) + head.size;
+    for (w = data + sizeof (head); w < end; w += strlen (w) + 1)
+    {
+      if (strncmp (w, word, len))
+	continue;
+      mutt_buffer_printf (key, "/W%s", w);
+      text_record_read (hc, mutt_b2s (key), tn);
+    }
+    mutt_hcache_free ((void **) &data);
+  }
+  mutt_buffer_pool_release (&key);
+
+  /* several words may share documents */
+  qsort (tn->num, tn->count, sizeof (unsigned int), text_nums_cmp);
+  for (i = j = 0; i < tn->count; i++)
+    if (!j || tn->num[i] != tn->num[j - 1])
+      tn->num[j++] = tn->num[i];
+  tn->count = j;
+}
+
+/* Keeps the numbers of a that are in b as well.  Both are ascending. */
+static void text_nums_intersect (struct text_nums *a, const struct text_nums *b)
+{
+  size_t i, j = 0, k = 0;
+
+  for (i = 0; i < a->count; i++)
+  {
+    while (j < b->count && b->num[j] < a->num[i])
+      j++;
+    if (j < b->count && b->num[j] == a->num[i])
+      a->num[k++] = a->num[i];
+  }
+  a->count = k;
+}
+
+/*
+ * Looks up words, as parsed by mutt_text_words_parse(), in the index of
+ * ctx.  Returns an array with an entry for each message, set if the
+ * message is indexed and lacks one of the words, or NULL if the index
+ * can't tell.
+ */
+unsigned char *mutt_text_index_query (CONTEXT *ctx, const char *words)
+{
+  struct text_words tw;
+  struct text_nums found, tn;
+  struct text_doc doc;
+  header_cache_t *hc;
+  unsigned char *excluded = NULL;
+  BUFFER *key;
+  HEADER *h;
+  unsigned int fingerprint;
+  int i, constrained = 0;
+
+  /* include what the last search saw */
+  mutt_text_index_flush (ctx);
+
+  if (!(hc = text_index_open (ctx)))
+    return NULL;
+
+  memset (&found, 0, sizeof (found));
+  text_words_split (&tw, words);
+  for (i = 0; i < tw.count; i++)
+  {
+    if (tw.len[i] < 2)
+      continue;
+
+    memset (&tn, 0, sizeof (tn));
+    text_index_lookup (hc, tw.word[i], tw.len[i], tw.prefix[i], &tn);
+    if (constrained++)
+    {
+      text_nums_intersect (&found, &tn);
+      FREE (&tn.num);
+    }
+    else
+      found = tn;
+  }
+  text_words_free (&tw);
+
+  if (constrained)
+  {
+    excluded = safe_calloc (MAX (ctx->msgcount, 1), sizeof (unsigned char));
+    key = mutt_buffer_pool_get ();
+    for (i = 0; i < ctx->msgcount; i++)
+    {
+      h = ctx->hdrs[i];
+      if (text_doc_key (ctx, h, key) == 0 &&
+          text_doc_fetch (hc, mutt_b2s (key), &doc) == 0 &&
+          doc.length == h->content->length &&
+          !bsearch (&doc.num, found.num, found.count, sizeof (unsigned int),
+                    text_nums_cmp) &&
+          text_doc_fingerprint (ctx, h, &fingerprint) == 0 &&
+          doc.fingerprint == fingerprint)
+	excluded[i] = 1;
+    }
+    mutt_buffer_pool_release (&key);
+    FREE (&found.num);
+  }
+
+  mutt_hcache_close (hc);
+  return excluded;
+}
+#endif /* USE_HCACHE */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TEXTINDEX_H
+#define _TEXTINDEX_H 1
+
+/* Only this many bytes of a word are compared or indexed. */
+#define TEXT_WORD_MAX 32
+
+/* Called for every word of a text.  Returning nonzero stops the scan. */
+typedef int (*text_word_fn_t) (const char *word, size_t len, void *data);
+
+void mutt_text_words_scan (FILE *fp, text_word_fn_t fn, void *data);
+int mutt_text_words_parse (BUFFER *dest, const char *s);
+int mutt_text_words_match (const char *words, FILE *fp);
+
+#ifdef USE_HCACHE
+void mutt_text_index_add (CONTEXT *ctx, HEADER *h, FILE *fp, LOFF_T offset);
+void mutt_text_index_flush (CONTEXT *ctx);
+void mutt_text_index_free (CONTEXT *ctx);
+unsigned char *mutt_text_index_query (CONTEXT *ctx, const char *words);
+#endif
+
+#endif /* _TEXTINDEX_H */
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Measures how fast the ~w text index is built and queried, on a
+ * synthetic mbox folder.  "make check" builds it but doesn't run it:
+ *
+ *   ./textindex_bench [messages [command ...]]
+ *
+ * The default is 1000000 messages.  The commands are run as with -e.
+ * The index is built under $TMPDIR; with gdbm a million messages take
+ * over 12 GB there.
+ *
+ * The bodies are generated, not read from a folder: each has 50 to 300
+ * words drawn from a vocabulary of TI_BENCH_WORDS, with the word of
+ * rank r about 1/r as likely as the most common one, as in real text.
+ * The same seed always gives the same corpus.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mx.h"
+#include "mutt_test.h"
+#include "textindex.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#ifdef USE_HCACHE
+#define TI_BENCH_WORDS	100000
+#define TI_BENCH_RUNS	5	/* times each query is timed */
+
+static unsigned int Seed = 2463534242U;
+
+/* xorshift32 */
+static unsigned int bench_random (void)
+{
+  Seed ^= Seed << 13;
+  Seed ^= Seed >> 17;
+  Seed ^= Seed << 5;
+  return Seed;
+}
+
+/* the word of rank r, 0 being the most common */
+static void bench_word (BUFFER *buf, unsigned int r)
+{
+  static const char *syllables[] =
+  {
+    "ba", "ce", "di", "fo", "gu", "ha", "je", "ki", "lo", "mu",
+    "na", "pe", "ri", "so", "tu", "va", "we", "xi", "yo", "zu"
+  };
+
+  do
+  {
+    mutt_buffer_addstr (buf, syllables[r % 20]);
+    r /= 20;
+  }
+  while (r);
+}
+
+/* a rank with a roughly Zipfian distribution: the power of two below
+ * r + 1 is uniform, and so is r between it and the next one */
+static unsigned int bench_rank (void)
+{
+  unsigned int k, r;
+
+  do
+  {
+    k = bench_random () % 17;
+    r = (1U << k) + bench_random () % (1U << k) - 1;
+  }
+  while (r >= TI_BENCH_WORDS);
+  return r;
+}
+
+/* the body of the next message */
+static void bench_body (BUFFER *body)
+{
+  int i, n;
+
+  mutt_buffer_clear (body);
+  n = 50 + bench_random () % 251;
+  for (i = 0; i < n; i++)
+  {
+    bench_word (body, bench_rank ());
+    mutt_buffer_addch (body, (i % 12 == 11) ? '\n' : ' ');
+  }
+  mutt_buffer_addch (body, '\n');
+}
+
+static HEADER *bench_header (int i, size_t length)
+{
+  HEADER *h;
+  char buf[SHORT_STRING];
+
+  h = mutt_new_header ();
+  h->env = mutt_new_envelope ();
+  h->content = mutt_new_body ();
+  snprintf (buf, sizeof (buf), "<%d.textindex@example.com>", i);
+  h->env->message_id = safe_strdup (buf);
+  h->content->length = length;
+  h->date_sent = 1767225600 + i * 60;
+  h->received = h->date_sent;
+  h->lines = length / 60 + 1;
+  h->index = h->msgno = i;
+  return h;
+}
+
+/* bytes in the files of dir */
+static LOFF_T bench_du (const char *dir)
+{
+  DIR *dp;
+  struct dirent *de;
+  struct stat st;
+  BUFFER *path;
+  LOFF_T size = 0;
+
+  if (!(dp = opendir (dir)))
+    return 0;
+  path = mutt_buffer_pool_get ();
+  while ((de = readdir (dp)))
+  {
+    mutt_buffer_printf (path, "%s/%s", dir, de->d_name);
+    if (stat (mutt_b2s (path), &st) == 0 && S_ISREG (st.st_mode))
+      size += st.st_size;
+  }
+  mutt_buffer_pool_release (&path);
+  closedir (dp);
+  return size;
+}
+
+/* times the query for words, returns the messages it didn't rule out */
+static int bench_query (CONTEXT *ctx, const char *words)
+{
+  unsigned char *excluded;
+  BUFFER *parsed;
+  double start, best = -1, t;
+  int i, run, left = ctx->msgcount;
+
+  parsed = mutt_buffer_pool_get ();
+  mutt_text_words_parse (parsed, words);
+  for (run = 0; run < TI_BENCH_RUNS; run++)
+  {
+    start = mutt_test_now ();
+    excluded = mutt_text_index_query (ctx, mutt_b2s (parsed));
+    t = mutt_test_now () - start;
+    if (best < 0 || t < best)
+      best = t;
+    if (excluded)
+    {
+      for (i = 0, left = 0; i < ctx->msgcount; i++)
+	if (!excluded[i])
+	  left++;
+      FREE (&excluded);
+    }
+  }
+  mutt_buffer_pool_release (&parsed);
+
+  printf ("query %-22s %9.1f ms, %d candidates\n", words, best * 1000, left);
+  return left;
+}
+#endif /* USE_HCACHE */
+
+int main (int argc, char **argv)
+{
+#ifdef USE_HCACHE
+  static const char *queries[] =
+  {
+    "ba",			/* the most common word */
+    "bace",			/* rank 20 */
+    "bacece",			/* rank 420 */
+    "lodixi",			/* rank 6848 */
+    "bace bacece",
+    "bacece lodixi",
+    "lo*",
+    NULL
+  };
+  CONTEXT *ctx;
+  LIST *commands = NULL;
+  BUFFER *dir, *body;
+  FILE *fp;
+  double start, built;
+  int i, n, bad = 0;
+
+  n = argc > 1 ? atoi (argv[1]) : 1000000;
+  if (n < 1)
+  {
+    fprintf (stderr, "usage: %s [messages [command ...]]\n", argv[0]);
+    return 1;
+  }
+
+  dir = mutt_buffer_new ();
+  mutt_buffer_printf (dir, "%s/mutt-textindex-bench-XXXXXX",
+                      (getenv ("TMPDIR") ? getenv ("TMPDIR") : "/tmp"));
+  if (!mkdtemp (dir->data))
+  {
+    perror (mutt_b2s (dir));
+    return 1;
+  }
+
+  body = mutt_buffer_new ();
+  mutt_buffer_printf (body, "set header_cache=%s/ text_index", mutt_b2s (dir));
+  commands = mutt_add_list (NULL, mutt_b2s (body));
+  for (i = 2; i < argc; i++)
+    commands = mutt_add_list (commands, argv[i]);
+  mutt_test_init (commands);
+  mutt_free_list (&commands);
+
+  ctx = safe_calloc (1, sizeof (CONTEXT));
+  ctx->path = safe_strdup ("/bench/textindex");
+  ctx->magic = MUTT_MBOX;
+  ctx->hdrmax = n;
+  ctx->hdrs = safe_calloc (n, sizeof (HEADER *));
+
+  printf ("%d messages\n", n);
+  start = mutt_test_now ();
+  for (i = 0; i < n; i++)
+  {
+    bench_body (body);
+    ctx->hdrs[ctx->msgcount++] = bench_header (i, mutt_buffer_len (body));
+    if (!(fp = fmemopen (body->data, mutt_buffer_len (body), "r")))
+    {
+      bad++;
+      continue;
+    }
+    mutt_text_index_add (ctx, ctx->hdrs[i], fp, 0);
+    safe_fclose (&fp);
+  }
+  mutt_text_index_flush (ctx);
+  built = mutt_test_now () - start;
+
+  printf ("build: %.1f s, %.0f messages/s, index %lld KB\n", built,
+          n / built, (long long) (bench_du (mutt_b2s (dir)) / 1024));
+
+  for (i = 0; queries[i]; i++)
+    bench_query (ctx, queries[i]);
+  /* no message has this one */
+  if (bench_query (ctx, "qqq") != 0)
+    bad++;
+
+  mutt_text_index_free (ctx);
+  for (i = 0; i < ctx->msgcount; i++)
+    mutt_free_header (&ctx->hdrs[i]);
+  FREE (&ctx->hdrs);
+  FREE (&ctx->path);
+  FREE (&ctx);
+  mutt_rmtree (mutt_b2s (dir));
+  mutt_buffer_free (&dir);
+  mutt_buffer_free (&body);
+
+  return bad ? 1 : 0;
+#else
+  printf ("%s: the header cache isn't compiled in\n", argv[0]);
+  return MUTT_TEST_SKIP;
+#endif
+}
@@ -121,12 +121,12 @@ static void linearize_tree (CONTEXT *ctx)
  * nodes, whether a node itself is visible, whether, if invisible, it has
  * depth anyway, and whether any of its later siblings are roots of visible
  * subtrees.  while it's at it, it frees the old thread display, so we can
- * skip parts of the tree in mutt_draw_tree() if we've decided here that we
+ * skip parts of the tree in draw_tree() if we've decided here that we
  * don't care about them any more.
  */
-static void calculate_visibility (CONTEXT *ctx, int *max_depth)
+static void calculate_visibility (CONTEXT *ctx, THREAD *top, int *max_depth)
 {
-  THREAD *tmp, *tree = ctx->tree;
+  THREAD *tmp, *tree = top;
   int hide_top_missing = option (OPTHIDETOPMISSING) && !option (OPTHIDEMISSING);
   int hide_top_limited = option (OPTHIDETOPLIMITED) && !option (OPTHIDELIMITED);
   int depth = 0;
@@ -201,7 +201,7 @@ static void calculate_visibility (CONTEXT *ctx, int *max_depth)
   /* now fix up for the OPTHIDETOP* options if necessary */
   if (hide_top_limited || hide_top_missing)
   {
-    tree = ctx->tree;
+    tree = top;
     FOREVER
     {
       if (!tree->visible && tree->deep && tree->subtree_visible < 2
@@ -232,18 +232,18 @@ static void calculate_visibility (CONTEXT *ctx, int *max_depth)
  * graphics chars on terminals which don't support them (see the man page
  * for curs_addch).
  */
-void mutt_draw_tree (CONTEXT *ctx)
+static void draw_tree (CONTEXT *ctx, THREAD *top)
 {
   char *pfx = NULL, *mypfx = NULL, *arrow = NULL, *myarrow = NULL, *new_tree;
   char corner = (Sort & SORT_REVERSE) ? MUTT_TREE_ULCORNER : MUTT_TREE_LLCORNER;
   char vtee = (Sort & SORT_REVERSE) ? MUTT_TREE_BTEE : MUTT_TREE_TTEE;
   int depth = 0, start_depth = 0, max_depth = 0, width = option (OPTNARROWTREE) ? 1 : 2;
-  THREAD *nextdisp = NULL, *pseudo = NULL, *parent = NULL, *tree = ctx->tree;
+  THREAD *nextdisp = NULL, *pseudo = NULL, *parent = NULL, *tree = top;
 
   /* Do the visibility calculations and free the old thread chars.
    * From now on we can simply ignore invisible subtrees
    */
-  calculate_visibility (ctx, &max_depth);
+  calculate_visibility (ctx, top, &max_depth);
   pfx = safe_malloc (width * max_depth + 2);
   arrow = safe_malloc (width * max_depth + 2);
   while (tree)
@@ -344,6 +344,11 @@ void mutt_draw_tree (CONTEXT *ctx)
   FREE (&arrow);
 }
 
+void mutt_draw_tree (CONTEXT *ctx)
+{
+  draw_tree (ctx, ctx->tree);
+}
+
 /* since we may be trying to attach as a pseudo-thread a THREAD that
  * has no message, we have to make a list of all the subjects of its
  * most immediate existing descendants.  we also note the earliest
@@ -498,63 +503,75 @@ static void insert_message (THREAD **new, THREAD *newparent, THREAD *cur)
   }
 }
 
-/* thread by subject things that didn't get threaded by message-id */
-static void pseudo_threads (CONTEXT *ctx)
+/* attach the thread root cur to the message it most likely replies to,
+ * judging by subject.  returns the new parent, or NULL if cur was left
+ * where it was. */
+static THREAD *pseudo_thread (CONTEXT *ctx, THREAD **top, THREAD *cur)
 {
-  THREAD *tree = ctx->tree, *top = tree;
-  THREAD *tmp, *cur, *parent, *curchild, *nextchild;
+  THREAD *tmp, *parent, *curchild, *nextchild;
 
-  if (!ctx->subj_hash)
-    ctx->subj_hash = mutt_make_subj_hash (ctx);
-
-  while (tree)
+  if ((parent = find_subject (ctx, cur)) != NULL)
   {
-    cur = tree;
-    tree = tree->next;
-    if ((parent = find_subject (ctx, cur)) != NULL)
+    cur->fake_thread = 1;
+    unlink_message (top, cur);
+    insert_message (&parent->child, parent, cur);
+    tmp = cur;
+    FOREVER
     {
-      cur->fake_thread = 1;
-      unlink_message (&top, cur);
-      insert_message (&parent->child, parent, cur);
-      tmp = cur;
-      FOREVER
+      while (!tmp->message)
+	tmp = tmp->child;
+
+      /* if the message we're attaching has pseudo-children, they
+       * need to be attached to its parent, so move them up a level.
+       * but only do this if they have the same real subject as the
+       * parent, since otherwise they rightly belong to the message
+       * we're attaching. */
+      if (tmp == cur
+	  || !mutt_strcmp (tmp->message->env->real_subj,
+			   parent->message->env->real_subj))
       {
-	while (!tmp->message)
-	  tmp = tmp->child;
-
-	/* if the message we're attaching has pseudo-children, they
-	 * need to be attached to its parent, so move them up a level.
-	 * but only do this if they have the same real subject as the
-	 * parent, since otherwise they rightly belong to the message
-	 * we're attaching. */
-	if (tmp == cur
-	    || !mutt_strcmp (tmp->message->env->real_subj,
-			     parent->message->env->real_subj))
-	{
-	  tmp->message->subject_changed = 0;
+	tmp->message->subject_changed = 0;
 
-	  for (curchild = tmp->child; curchild; )
+	for (curchild = tmp->child; curchild; )
+	{
+	  nextchild = curchild->next;
+	  if (curchild->fake_thread)
 	  {
-	    nextchild = curchild->next;
-	    if (curchild->fake_thread)
-	    {
-	      unlink_message (&tmp->child, curchild);
-	      insert_message (&parent->child, parent, curchild);
-	    }
-	    curchild = nextchild;
+	    unlink_message (&tmp->child, curchild);
+	    insert_message (&parent->child, parent, curchild);
 	  }
+	  curchild = nextchild;
 	}
+      }
 
-	while (!tmp->next && tmp != cur)
-	{
-	  tmp = tmp->parent;
-	}
-	if (tmp == cur)
-	  break;
-	tmp = tmp->next;
+      while (!tmp->next && tmp != cur)
+      {
+	tmp = tmp->parent;
       }
+      if (tmp == cur)
+	break;
+      tmp = tmp->next;
     }
   }
+
+  return (parent);
+}
+
+/* thread by subject things that didn't get threaded by message-id */
+static void pseudo_threads (CONTEXT *ctx)
+{
+  THREAD *tree = ctx->tree, *top = tree;
+  THREAD *cur;
+
+  if (!ctx->subj_hash)
+    ctx->subj_hash = mutt_make_subj_hash (ctx);
+
+  while (tree)
+  {
+    cur = tree;
+    tree = tree->next;
+    pseudo_thread (ctx, &top, cur);
+  }
   ctx->tree = top;
 }
 
@@ -626,6 +643,15 @@ static int compare_aux_sortkeys (const void *a, const void *b)
   return mutt_numeric_cmp ((*((HEADER **)a))->index, (*((HEADER **)b))->index);
 }
 
+/* The method compare_root_threads() sorts by: $sort_thread_groups
+ * delegates to $sort_aux by default. */
+static int root_sort_method (void)
+{
+  if ((SortThreadGroups & SORT_MASK) == SORT_AUX)
+    return SortAux;
+  return SortThreadGroups;
+}
+
 static int compare_root_threads (const void *a, const void *b)
 {
   static sort_t *sort_func = NULL;
@@ -634,17 +660,8 @@ static int compare_root_threads (const void *a, const void *b)
 
   if (!(a && b))
   {
-    /* Delegate to the $sort_aux function in this case. */
-    if ((SortThreadGroups & SORT_MASK) == SORT_AUX)
-    {
-      sort_func = mutt_get_sort_func (SortAux);
-      reverse = SortAux & SORT_REVERSE;
-    }
-    else
-    {
-      sort_func = mutt_get_sort_func (SortThreadGroups);
-      reverse = SortThreadGroups & SORT_REVERSE;
-    }
+    sort_func = mutt_get_sort_func (root_sort_method ());
+    reverse = root_sort_method () & SORT_REVERSE;
     return sort_func ? 1 : 0;
   }
 
@@ -690,6 +707,16 @@ static int compare_group_sortkeys (const void *a, const void *b)
   return mutt_numeric_cmp ((*((HEADER **)a))->index, (*((HEADER **)b))->index);
 }
 
+/* Every comparison function above breaks ties on the message index, so
+ * the parallel sort gives the same order as qsort(). */
+static void sort_thread_array (THREAD **array, int count, sort_t *cmp,
+                               int method)
+{
+  if (!mutt_sort_func_reentrant (method) ||
+      mutt_parallel_sort (array, count, sizeof (THREAD *), cmp) < 0)
+    qsort (array, count, sizeof (THREAD *), cmp);
+}
+
 THREAD *mutt_sort_subthreads (THREAD *thread, int init)
 {
   THREAD **array, *top, *last_child;
@@ -773,8 +800,9 @@ THREAD *mutt_sort_subthreads (THREAD *thread, int init)
 	  array[i] = thread;
 	}
 
-	qsort ((void *) array, i, sizeof (THREAD *),
-               has_parent ? compare_aux_threads : compare_root_threads);
+	sort_thread_array (array, i,
+                           has_parent ? compare_aux_threads : compare_root_threads,
+                           has_parent ? SortAux : root_sort_method ());
 
 	/* attach them back together.  make thread the last sibling. */
 	thread = array[0];
@@ -903,10 +931,30 @@ THREAD *mutt_sort_subthreads (THREAD *thread, int init)
   }
 }
 
+/* figure out whether a message has a subject different than its parent's */
+static void check_subject (HEADER *cur)
+{
+  THREAD *tmp;
+
+  tmp = cur->thread->parent;
+  while (tmp && !tmp->message)
+  {
+    tmp = tmp->parent;
+  }
+
+  if (!tmp)
+    cur->subject_changed = 1;
+  else if (cur->env->real_subj && tmp->message->env->real_subj)
+    cur->subject_changed = mutt_strcmp (cur->env->real_subj,
+					tmp->message->env->real_subj) ? 1 : 0;
+  else
+    cur->subject_changed = (cur->env->real_subj
+			    || tmp->message->env->real_subj) ? 1 : 0;
+}
+
 static void check_subjects (CONTEXT *ctx, int init)
 {
   HEADER *cur;
-  THREAD *tmp;
   int i;
 
   for (i = 0; i < ctx->msgcount; i++)
@@ -917,215 +965,415 @@ static void check_subjects (CONTEXT *ctx, int init)
     else if (!init)
       continue;
 
-    /* figure out which messages have subjects different than their parents' */
-    tmp = cur->thread->parent;
-    while (tmp && !tmp->message)
+    check_subject (cur);
+  }
+}
+
+/* like check_subjects(), but only for the messages in the subtree
+ * below start.  these are the only ones whose parents can have changed
+ * when start has just been threaded. */
+static void check_subtree_subjects (THREAD *start)
+{
+  THREAD *tmp = start;
+
+  FOREVER
+  {
+    if (tmp->message && tmp->check_subject)
     {
-      tmp = tmp->parent;
+      tmp->check_subject = 0;
+      check_subject (tmp->message);
     }
 
-    if (!tmp)
-      cur->subject_changed = 1;
-    else if (cur->env->real_subj && tmp->message->env->real_subj)
-      cur->subject_changed = mutt_strcmp (cur->env->real_subj,
-					  tmp->message->env->real_subj) ? 1 : 0;
+    if (tmp->child)
+      tmp = tmp->child;
     else
-      cur->subject_changed = (cur->env->real_subj
-			      || tmp->message->env->real_subj) ? 1 : 0;
+    {
+      while (tmp != start && !tmp->next)
+	tmp = tmp->parent;
+      if (tmp == start)
+	break;
+      tmp = tmp->next;
+    }
   }
 }
 
-void mutt_sort_threads (CONTEXT *ctx, int init)
+/* a growable list of THREAD pointers, used to remember which parts of
+ * the tree were changed by an incremental update */
+typedef struct
 {
-  HEADER *cur;
-  int i, using_refs = 0;
-  THREAD *thread, *new, *tmp, top;
-  LIST *ref = NULL;
+  THREAD **nodes;
+  int count;
+  int size;
+} THREAD_LIST;
 
-  if (!ctx->thread_hash)
-    init = 1;
+static void thread_list_add (THREAD_LIST *list, THREAD *thread)
+{
+  if (list->count >= list->size)
+    safe_realloc (&list->nodes,
+		  (list->size = list->size ? list->size * 2 : 32) * sizeof (THREAD *));
+  list->nodes[list->count++] = thread;
+}
 
-  if (init)
-    ctx->thread_hash = hash_create (ctx->msgcount * 2, MUTT_HASH_ALLOW_DUPS);
+/* put a new message together with the matching messageless THREAD if it
+ * exists.  otherwise, if there is a THREAD that already has a message, thread
+ * new message as an identical child.  if we didn't attach the message to a
+ * THREAD, make a new one for it.  if touched is given, the nodes that lost
+ * a child are added to it. */
+static void thread_new_message (CONTEXT *ctx, HEADER *cur, int init,
+				THREAD *top, THREAD_LIST *touched)
+{
+  THREAD *thread, *new, *tmp;
 
-  /* we want a quick way to see if things are actually attached to the top of the
-   * thread tree or if they're just dangling, so we attach everything to a top
-   * node temporarily */
-  top.parent = top.next = top.prev = NULL;
-  top.child = ctx->tree;
-  for (thread = ctx->tree; thread; thread = thread->next)
-    thread->parent = &top;
+  if ((!init || option (OPTDUPTHREADS)) && cur->env->message_id)
+    thread = hash_find (ctx->thread_hash, cur->env->message_id);
+  else
+    thread = NULL;
 
-  /* put each new message together with the matching messageless THREAD if it
-   * exists.  otherwise, if there is a THREAD that already has a message, thread
-   * new message as an identical child.  if we didn't attach the message to a
-   * THREAD, make a new one for it. */
-  for (i = 0; i < ctx->msgcount; i++)
+  if (thread && !thread->message)
   {
-    cur = ctx->hdrs[i];
+    /* this is a message which was missing before */
+    thread->message = cur;
+    cur->thread = thread;
+    thread->check_subject = 1;
 
-    if (!cur->thread)
+    /* mark descendants as needing subject_changed checked */
+    for (tmp = (thread->child ? thread->child : thread); tmp != thread; )
     {
-      if ((!init || option (OPTDUPTHREADS)) && cur->env->message_id)
-	thread = hash_find (ctx->thread_hash, cur->env->message_id);
-      else
-	thread = NULL;
+      while (!tmp->message)
+	tmp = tmp->child;
+      tmp->check_subject = 1;
+      while (!tmp->next && tmp != thread)
+	tmp = tmp->parent;
+      if (tmp != thread)
+	tmp = tmp->next;
+    }
 
-      if (thread && !thread->message)
+    if (thread->parent)
+    {
+      /* remove threading info above it based on its children, which we'll
+       * recalculate based on its headers.  make sure not to leave
+       * dangling missing messages.  note that we haven't kept track
+       * of what info came from its children and what from its siblings'
+       * children, so we just remove the stuff that's definitely from it */
+      do
       {
-	/* this is a message which was missing before */
-	thread->message = cur;
-	cur->thread = thread;
-	thread->check_subject = 1;
+	tmp = thread->parent;
+	unlink_message (&tmp->child, thread);
+	thread->parent = NULL;
+	thread->sort_aux_key = NULL;
+	thread->sort_group_key = NULL;
+	thread->fake_thread = 0;
+	thread = tmp;
+      } while (thread != top && !thread->child && !thread->message);
+
+      if (touched && thread != top)
+	thread_list_add (touched, thread);
+    }
+  }
+  else
+  {
+    new = (option (OPTDUPTHREADS) ? thread : NULL);
 
-	/* mark descendants as needing subject_changed checked */
-	for (tmp = (thread->child ? thread->child : thread); tmp != thread; )
-	{
-	  while (!tmp->message)
-	    tmp = tmp->child;
-	  tmp->check_subject = 1;
-	  while (!tmp->next && tmp != thread)
-	    tmp = tmp->parent;
-	  if (tmp != thread)
-	    tmp = tmp->next;
-	}
+    thread = safe_calloc (1, sizeof (THREAD));
+    thread->message = cur;
+    thread->check_subject = 1;
+    cur->thread = thread;
+    hash_insert (ctx->thread_hash,
+		 cur->env->message_id ? cur->env->message_id : "",
+		 thread);
 
-	if (thread->parent)
-	{
-	  /* remove threading info above it based on its children, which we'll
-	   * recalculate based on its headers.  make sure not to leave
-	   * dangling missing messages.  note that we haven't kept track
-	   * of what info came from its children and what from its siblings'
-	   * children, so we just remove the stuff that's definitely from it */
-	  do
-	  {
-	    tmp = thread->parent;
-	    unlink_message (&tmp->child, thread);
-	    thread->parent = NULL;
-	    thread->sort_aux_key = NULL;
-	    thread->sort_group_key = NULL;
-	    thread->fake_thread = 0;
-	    thread = tmp;
-	  } while (thread != &top && !thread->child && !thread->message);
-	}
-      }
-      else
-      {
-	new = (option (OPTDUPTHREADS) ? thread : NULL);
+    if (new)
+    {
+      if (new->duplicate_thread)
+	new = new->parent;
 
-	thread = safe_calloc (1, sizeof (THREAD));
-	thread->message = cur;
-	thread->check_subject = 1;
-	cur->thread = thread;
-	hash_insert (ctx->thread_hash,
-		     cur->env->message_id ? cur->env->message_id : "",
-		     thread);
+      thread = cur->thread;
 
-	if (new)
-	{
-	  if (new->duplicate_thread)
-	    new = new->parent;
+      insert_message (&new->child, new, thread);
+      thread->duplicate_thread = 1;
+      thread->message->threaded = 1;
+    }
+  }
+}
 
-	  thread = cur->thread;
+/* thread a message by its references */
+static void thread_by_refs (CONTEXT *ctx, HEADER *cur, THREAD *top)
+{
+  THREAD *thread, *new;
+  LIST *ref = NULL;
+  int using_refs = 0;
 
-	  insert_message (&new->child, new, thread);
-	  thread->duplicate_thread = 1;
-	  thread->message->threaded = 1;
-	}
+  cur->threaded = 1;
+  thread = cur->thread;
+
+  while (1)
+  {
+    if (using_refs == 0)
+    {
+      /* look at the beginning of in-reply-to: */
+      if ((ref = cur->env->in_reply_to) != NULL)
+	using_refs = 1;
+      else
+      {
+	ref = cur->env->references;
+	using_refs = 2;
       }
     }
-    else
+    else if (using_refs == 1)
     {
-      /* unlink pseudo-threads because they might be children of newly
-       * arrived messages */
-      thread = cur->thread;
-      for (new = thread->child; new; )
+      /* if there's no references header, use all the in-reply-to:
+       * data that we have.  otherwise, use the first reference
+       * if it's different than the first in-reply-to, otherwise use
+       * the second reference (since at least eudora puts the most
+       * recent reference in in-reply-to and the rest in references)
+       */
+      if (!cur->env->references)
+	ref = ref->next;
+      else
       {
-	tmp = new->next;
-	if (new->fake_thread)
-	{
-	  unlink_message (&thread->child, new);
-	  insert_message (&top.child, &top, new);
-	  new->fake_thread = 0;
-	}
-	new = tmp;
+	if (mutt_strcmp (ref->data, cur->env->references->data))
+	  ref = cur->env->references;
+	else
+	  ref = cur->env->references->next;
+
+	using_refs = 2;
       }
     }
+    else
+      ref = ref->next; /* go on with references */
+
+    if (!ref)
+      break;
+
+    if ((new = hash_find (ctx->thread_hash, ref->data)) == NULL)
+    {
+      new = safe_calloc (1, sizeof (THREAD));
+      hash_insert (ctx->thread_hash, ref->data, new);
+    }
+    else
+    {
+      if (new->duplicate_thread)
+	new = new->parent;
+      if (is_descendant (new, thread)) /* no loops! */
+	continue;
+    }
+
+    if (thread->parent)
+      unlink_message (&top->child, thread);
+    insert_message (&new->child, new, thread);
+    thread = new;
+    if (thread->message || (thread->parent && thread->parent != top))
+      break;
   }
 
-  /* thread by references */
-  for (i = 0; i < ctx->msgcount; i++)
+  if (!thread->parent)
+    insert_message (&top->child, top, thread);
+}
+
+/* a new message may be a better subject match for pseudo-threads that
+ * were already attached somewhere else.  take the pseudo-threads holding
+ * a message with the same subject as cur off their parents again and add
+ * them, along with the thread roots holding such a message, to the list
+ * of candidates for pseudo_thread(). */
+static void collect_pseudo_candidates (CONTEXT *ctx, HEADER *cur, THREAD *top,
+				       THREAD_LIST *touched,
+				       THREAD_LIST *candidates)
+{
+  struct hash_elem *ptr;
+  THREAD *thread, *parent;
+
+  if (!cur->env->real_subj)
+    return;
+
+  for (ptr = hash_find_bucket (ctx->subj_hash, cur->env->real_subj); ptr; ptr = ptr->next)
   {
-    cur = ctx->hdrs[i];
-    if (cur->threaded)
+    if (mutt_strcmp (cur->env->real_subj,
+		     ((HEADER *) ptr->data)->env->real_subj))
       continue;
-    cur->threaded = 1;
 
-    thread = cur->thread;
-    using_refs = 0;
+    for (thread = ((HEADER *) ptr->data)->thread;
+	 thread->parent && thread->parent != top && !thread->fake_thread;
+	 thread = thread->parent)
+      ;
 
-    while (1)
+    if (thread->fake_thread)
     {
-      if (using_refs == 0)
-      {
-	/* look at the beginning of in-reply-to: */
-	if ((ref = cur->env->in_reply_to) != NULL)
-	  using_refs = 1;
-	else
-	{
-	  ref = cur->env->references;
-	  using_refs = 2;
-	}
-      }
-      else if (using_refs == 1)
-      {
-	/* if there's no references header, use all the in-reply-to:
-	 * data that we have.  otherwise, use the first reference
-	 * if it's different than the first in-reply-to, otherwise use
-	 * the second reference (since at least eudora puts the most
-	 * recent reference in in-reply-to and the rest in references)
-	 */
-	if (!cur->env->references)
-	  ref = ref->next;
-	else
-	{
-	  if (mutt_strcmp (ref->data, cur->env->references->data))
-	    ref = cur->env->references;
-	  else
-	    ref = cur->env->references->next;
+      parent = thread->parent;
+      unlink_message (&parent->child, thread);
+      insert_message (&top->child, top, thread);
+      thread->fake_thread = 0;
+      thread_list_add (touched, parent);
+      thread_list_add (touched, thread);
+    }
+    else if (thread->dirty)
+      continue;
 
-	  using_refs = 2;
-	}
-      }
-      else
-	ref = ref->next; /* go on with references */
+    thread->dirty = 1;
+    thread_list_add (candidates, thread);
+  }
+}
 
-      if (!ref)
-	break;
+/* resort and redraw the thread roots which hold a new message or a node
+ * listed in touched, and merge them back into ctx->tree.  the other roots
+ * were left untouched, so they are still in order and still drawn. */
+static void update_dirty_roots (CONTEXT *ctx, HEADER **newhdrs, int nnew,
+				THREAD_LIST *touched)
+{
+  THREAD_LIST dirty;
+  THREAD *thread, *tree, *prev, **tail;
+  int i, j, sorted;
 
-      if ((new = hash_find (ctx->thread_hash, ref->data)) == NULL)
-      {
-	new = safe_calloc (1, sizeof (THREAD));
-	hash_insert (ctx->thread_hash, ref->data, new);
-      }
+  memset (&dirty, 0, sizeof (dirty));
+
+  for (i = 0; i < touched->count + nnew; i++)
+  {
+    thread = i < touched->count ? touched->nodes[i]
+				: newhdrs[i - touched->count]->thread;
+    while (thread->parent)
+      thread = thread->parent;
+    if (!thread->dirty)
+    {
+      thread->dirty = 1;
+      thread_list_add (&dirty, thread);
+    }
+  }
+
+  /* take them out of the list of roots and sort and draw each one on
+   * its own */
+  for (i = 0; i < dirty.count; i++)
+  {
+    thread = dirty.nodes[i];
+    thread->dirty = 0;
+
+    if (thread->prev)
+      thread->prev->next = thread->next;
+    else
+      ctx->tree = thread->next;
+    if (thread->next)
+      thread->next->prev = thread->prev;
+    thread->next = thread->prev = NULL;
+
+    dirty.nodes[i] = thread = mutt_sort_subthreads (thread, 0);
+    draw_tree (ctx, thread);
+  }
+
+  if ((sorted = compare_root_threads (NULL, NULL)))
+    sort_thread_array (dirty.nodes, dirty.count, compare_root_threads,
+                       root_sort_method ());
+
+  tree = ctx->tree;
+  tail = &ctx->tree;
+  prev = NULL;
+  j = 0;
+  while (tree || j < dirty.count)
+  {
+    if (j < dirty.count &&
+	(!tree || !sorted ||
+	 compare_root_threads (&dirty.nodes[j], &tree) < 0))
+      thread = dirty.nodes[j++];
+    else
+    {
+      thread = tree;
+      tree = tree->next;
+    }
+    thread->prev = prev;
+    thread->next = NULL;
+    *tail = thread;
+    tail = &thread->next;
+    prev = thread;
+  }
+
+  FREE (&dirty.nodes);
+}
+
+void mutt_sort_threads (CONTEXT *ctx, int init)
+{
+  HEADER *cur, **newhdrs = NULL;
+  int i, nnew = 0, incremental = 0;
+  THREAD *thread, *new, *tmp, top;
+  THREAD_LIST touched, candidates;
+
+  if (!ctx->thread_hash)
+    init = 1;
+
+  if (init)
+    ctx->thread_hash = hash_create (ctx->msgcount * 2, MUTT_HASH_ALLOW_DUPS);
+
+  /* if only a few messages arrived since the tree was last built, link
+   * just those into it and resort only the threads they end up in.
+   * the whole tree has to be resorted if nothing is new, because then
+   * it's the sort order which has changed. */
+  if (!init && ctx->tree && !option (OPTSORTSUBTHREADS))
+  {
+    for (i = 0; i < ctx->msgcount && nnew * 4 < ctx->msgcount; i++)
+    {
+      if (ctx->hdrs[i]->thread)
+	continue;
+      if (!newhdrs)
+	newhdrs = safe_malloc (sizeof (HEADER *) * (ctx->msgcount / 4 + 1));
+      newhdrs[nnew++] = ctx->hdrs[i];
+    }
+    incremental = nnew && nnew * 4 < ctx->msgcount;
+  }
+
+  /* we want a quick way to see if things are actually attached to the top of the
+   * thread tree or if they're just dangling, so we attach everything to a top
+   * node temporarily */
+  top.parent = top.next = top.prev = NULL;
+  top.child = ctx->tree;
+  for (thread = ctx->tree; thread; thread = thread->next)
+    thread->parent = &top;
+
+  if (incremental)
+  {
+    memset (&touched, 0, sizeof (touched));
+    memset (&candidates, 0, sizeof (candidates));
+
+    for (i = 0; i < nnew; i++)
+      thread_new_message (ctx, newhdrs[i], init, &top, &touched);
+
+    for (i = 0; i < nnew; i++)
+      if (!newhdrs[i]->threaded)
+	thread_by_refs (ctx, newhdrs[i], &top);
+
+    if (!option (OPTSTRICTTHREADS))
+    {
+      if (!ctx->subj_hash)
+	ctx->subj_hash = mutt_make_subj_hash (ctx);
+      for (i = 0; i < nnew; i++)
+	collect_pseudo_candidates (ctx, newhdrs[i], &top, &touched, &candidates);
+    }
+  }
+  else
+  {
+    for (i = 0; i < ctx->msgcount; i++)
+    {
+      cur = ctx->hdrs[i];
+
+      if (!cur->thread)
+	thread_new_message (ctx, cur, init, &top, NULL);
       else
       {
-	if (new->duplicate_thread)
-	  new = new->parent;
-	if (is_descendant (new, thread)) /* no loops! */
-	  continue;
+	/* unlink pseudo-threads because they might be children of newly
+	 * arrived messages */
+	thread = cur->thread;
+	for (new = thread->child; new; )
+	{
+	  tmp = new->next;
+	  if (new->fake_thread)
+	  {
+	    unlink_message (&thread->child, new);
+	    insert_message (&top.child, &top, new);
+	    new->fake_thread = 0;
+	  }
+	  new = tmp;
+	}
       }
-
-      if (thread->parent)
-	unlink_message (&top.child, thread);
-      insert_message (&new->child, new, thread);
-      thread = new;
-      if (thread->message || (thread->parent && thread->parent != &top))
-	break;
     }
 
-    if (!thread->parent)
-      insert_message (&top.child, &top, thread);
+    for (i = 0; i < ctx->msgcount; i++)
+      if (!ctx->hdrs[i]->threaded)
+	thread_by_refs (ctx, ctx->hdrs[i], &top);
   }
 
   /* detach everything from the temporary top node */
@@ -1135,21 +1383,45 @@ void mutt_sort_threads (CONTEXT *ctx, int init)
   }
   ctx->tree = top.child;
 
-  check_subjects (ctx, init);
+  if (incremental)
+  {
+    for (i = 0; i < nnew; i++)
+      check_subtree_subjects (newhdrs[i]->thread);
+
+    for (i = 0; i < candidates.count; i++)
+    {
+      thread = candidates.nodes[i];
+      thread->dirty = 0;
+      if (!thread->parent && pseudo_thread (ctx, &ctx->tree, thread))
+	thread_list_add (&touched, thread);
+    }
 
-  if (!option (OPTSTRICTTHREADS))
-    pseudo_threads (ctx);
+    update_dirty_roots (ctx, newhdrs, nnew, &touched);
+    linearize_tree (ctx);
 
-  if (ctx->tree)
+    FREE (&touched.nodes);
+    FREE (&candidates.nodes);
+  }
+  else
   {
-    ctx->tree = mutt_sort_subthreads (ctx->tree, init);
+    check_subjects (ctx, init);
 
-    /* Put the list into an array. */
-    linearize_tree (ctx);
+    if (!option (OPTSTRICTTHREADS))
+      pseudo_threads (ctx);
+
+    if (ctx->tree)
+    {
+      ctx->tree = mutt_sort_subthreads (ctx->tree, init);
 
-    /* Draw the thread tree. */
-    mutt_draw_tree (ctx);
+      /* Put the list into an array. */
+      linearize_tree (ctx);
+
+      /* Draw the thread tree. */
+      mutt_draw_tree (ctx);
+    }
   }
+
+  FREE (&newhdrs);
 }
 
 static HEADER *find_virtual (THREAD *cur, int reverse)
@@ -1606,16 +1878,19 @@ static void clean_references (THREAD *brk, THREAD *cur)
 
       h->changed = 1;
       h->env->changed |= MUTT_ENV_CHANGED_REFS;
+      h->search_known = 0;
     }
   }
 }
 
 void mutt_break_thread (HEADER *hdr)
 {
+  mutt_env_load_lazy (hdr->env);
   mutt_free_list (&hdr->env->in_reply_to);
   mutt_free_list (&hdr->env->references);
   hdr->changed = 1;
   hdr->env->changed |= (MUTT_ENV_CHANGED_IRT | MUTT_ENV_CHANGED_REFS);
+  hdr->search_known = 0;
 
   clean_references (hdr->thread, hdr->thread->child);
 }
@@ -1634,6 +1909,7 @@ static int link_threads (HEADER *parent, HEADER *child, CONTEXT *ctx)
 
   child->changed = 1;
   child->env->changed |= MUTT_ENV_CHANGED_IRT;
+  child->search_known = 0;
   return 1;
 }
 